@@ -56,6 +56,52 @@ _tpm2_activatecredential()
     } &&
     complete -F _tpm2_activatecredential tpm2_activatecredential
 # ex: filetype=sh
+# bash completion for tpm2_auditreplay                   -*- shell-script -*-
+_tpm2_auditreplay()
+    {
+        local auth_methods=(str: hex: file: file:- session: pcr:)
+
+        local hash_methods=(sha1 sha256 sha384 sha512)
+
+        local format_methods=(tss plain)
+
+        local signing_scheme=(rsassa rsapss ecdsa ecdaa sm2 ecshnorr hmac)
+
+        local key_object=(rsa ecc aes camellia hmac xor keyedhash)
+
+        local key_attributes=(\| fixedtpm stclear fixedparent \
+        sensitivedataorigin userwithauth adminwithpolicy noda \
+        encrypteddupplication restricted decrypt sign)
+
+        local nv_attributes=(\| ppwrite ownerwrite authwrite policywrite \
+        policydelete writelocked writeall writedefine write_stclear \
+        globallock ppread ownerread authread policyread no_da orderly \
+        clear_stclear readlocked written platformcreate read_stclear)
+
+        local cur prev words cword split
+        _init_completion -s || return
+        case $prev in
+            -h | --help)
+                COMPREPLY=( $(compgen -W "man no-man" -- "$cur") )
+                return;;
+            -T | --tcti)
+                COMPREPLY=( $(compgen -W "tabrmd mssim device none" -- "$cur") )
+                return;;
+            -g | --hash-algorithm | --signature-hash-algorithm)
+                COMPREPLY=($(compgen -W "${hash_methods[*]}" -- "$cur"))
+                return;;
+            -m | --message | -s | --signature | -u | --public | -q | --qualification | --checkpoint | --resume)
+                _filedir
+                return;;
+        esac
+
+        COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
+        -Z --enable-erata -T --tcti \
+        -g -m -s -u -q --hash-algorithm --message --signature --public --qualification --checkpoint --checkpoint-interval --resume --signature-hash-algorithm " \
+        -- "$cur"))
+    } &&
+    complete -F _tpm2_auditreplay tpm2_auditreplay
+# ex: filetype=sh
 # bash completion for tpm2_certify                   -*- shell-script -*-
 _tpm2_certify()
     {
@@ -163,11 +209,15 @@ _tpm2_certifyX509certutil()
             -s | --subject)
                 _filedir
                 return;;
+            --batch)
+                _filedir
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        -o -d -i -s --outcert --days --issuer --subject " \
+        -o -d -i -s --outcert --days --issuer --subject --key-usage \
+        --batch --jobs " \
         -- "$cur"))
     } &&
     complete -F _tpm2_certifyX509certutil tpm2_certifyX509certutil
@@ -435,11 +485,17 @@ _tpm2_checkquote()
             -F | --format)
                 COMPREPLY=($(compgen -W "${format_methods[*]}" -- "$cur"))
                 return;;
+            --batch | --proof)
+                _filedir
+                return;;
+            --eventlog-cache)
+                _filedir -d
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        -u -g -m -s -f -l -q -F --public --hash-algorithm --message --signature --pcr --pcr-list --qualification --format " \
+        -u -g -m -s -f -l -q -F --public --hash-algorithm --message --signature --pcr --pcr-list --qualification --format --batch --jobs --proof --eventlog-cache --eventlog-cache-size " \
         -- "$cur"))
     } &&
     complete -F _tpm2_checkquote tpm2_checkquote
@@ -707,11 +763,14 @@ _tpm2_create()
             -l | --pcr-list)
                 _filedir
                 return;;
+            --pool)
+                _filedir -d
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        -C -P -p -g -G -a -i -L -u -r -c -t -d -q -l --parent-context --parent-auth --key-auth --hash-algorithm --key-algorithm --attributes --sealing-input --policy --public --private --key-context --creation-ticket --creation-hash --outside-info --pcr-list --creation --template --cphash " \
+        -C -P -p -g -G -a -i -L -u -r -c -t -d -q -l --parent-context --parent-auth --key-auth --hash-algorithm --key-algorithm --attributes --sealing-input --policy --public --private --key-context --creation-ticket --creation-hash --outside-info --pcr-list --creation --template --cphash --pool --pool-fill --from-pool " \
         -- "$cur"))
     } &&
     complete -F _tpm2_create tpm2_create
@@ -838,11 +897,14 @@ _tpm2_createek()
             -t | --template)
                 _filedir
                 return;;
+            --cache-dir)
+                _filedir -d
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        -P -w -c -G -u -t --eh-auth --owner-auth --ek-context --key-algorithm --public --template " \
+        -P -w -c -G -u -t --eh-auth --owner-auth --ek-context --key-algorithm --public --template --cache-dir " \
         -- "$cur"))
     } &&
     complete -F _tpm2_createek tpm2_createek
@@ -969,11 +1031,14 @@ _tpm2_createprimary()
             -l | --pcr-list)
                 _filedir
                 return;;
+            --cache-dir)
+                _filedir -d
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        -C -P -p -g -G -c -L -a -u -t -d -q -l --hierarchy --hierarchy-auth --key-auth --hash-algorithm --key-algorithm --key-context --policy --attributes --unique-data --creation-ticket --creation-hash --outside-info --pcr-list --creation --template --cphash " \
+        -C -P -p -g -G -c -L -a -u -t -d -q -l --hierarchy --hierarchy-auth --key-auth --hash-algorithm --key-algorithm --key-context --policy --attributes --unique-data --creation-ticket --creation-hash --outside-info --pcr-list --creation --template --cphash --cache-dir " \
         -- "$cur"))
     } &&
     complete -F _tpm2_createprimary tpm2_createprimary
@@ -1091,11 +1156,14 @@ _tpm2_duplicate()
             -c | --key-context)
                 _filedir
                 return;;
+            --batch)
+                _filedir
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        -G -i -o -C -r -s -p -c --wrapper-algorithm --encryptionkey-in --encryptionkey-out --parent-context --private --encrypted-seed --auth --key-context --cphash " \
+        -G -i -o -C -r -s -p -c --wrapper-algorithm --encryptionkey-in --encryptionkey-out --parent-context --private --encrypted-seed --auth --key-context --cphash --batch --jobs " \
         -- "$cur"))
     } &&
     complete -F _tpm2_duplicate tpm2_duplicate
@@ -1343,7 +1411,7 @@ _tpm2_eventlog()
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        " \
+        --pcr --type --events --digest " \
         -- "$cur"))
     } &&
     complete -F _tpm2_eventlog tpm2_eventlog
@@ -1642,11 +1710,15 @@ _tpm2_getekcertificate()
             -x | --offline)
                 _filedir
                 return;;
+            --cache-dir)
+                _filedir -d
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        -o -X -u -x --ek-certificate --allow-unverified --ek-public --offline " \
+        -o -X -u -x --ek-certificate --allow-unverified --ek-public --offline \
+        --raw --cache-dir " \
         -- "$cur"))
     } &&
     complete -F _tpm2_getekcertificate tpm2_getekcertificate
@@ -2448,11 +2520,15 @@ _tpm2_nvdefine()
             -g | --hash-algorithm)
                 COMPREPLY=($(compgen -W "${hash_methods[*]}" -- "$cur"))
                 return;;
+            --batch)
+                _filedir
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        -C -s -a -P -p -L --hierarchy --size --attributes --hierarchy-auth --index-auth --policy --hash-algorithm --cphash " \
+        -C -s -a -P -p -L --hierarchy --size --attributes --hierarchy-auth --index-auth --policy --hash-algorithm --cphash \
+        --batch --prune --dry-run " \
         -- "$cur"))
     } &&
     complete -F _tpm2_nvdefine tpm2_nvdefine
@@ -3000,15 +3076,64 @@ _tpm2_pcrextend()
             -T | --tcti)
                 COMPREPLY=( $(compgen -W "tabrmd mssim device none" -- "$cur") )
                 return;;
+            --batch | --eventlog)
+                _filedir
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        " \
+        --batch --jobs --eventlog " \
         -- "$cur"))
     } &&
     complete -F _tpm2_pcrextend tpm2_pcrextend
 # ex: filetype=sh
+# bash completion for tpm2_pcrpredict                   -*- shell-script -*-
+_tpm2_pcrpredict()
+    {
+        local auth_methods=(str: hex: file: file:- session: pcr:)
+
+        local hash_methods=(sha1 sha256 sha384 sha512)
+
+        local format_methods=(tss plain)
+
+        local signing_scheme=(rsassa rsapss ecdsa ecdaa sm2 ecshnorr hmac)
+
+        local key_object=(rsa ecc aes camellia hmac xor keyedhash)
+
+        local key_attributes=(\| fixedtpm stclear fixedparent \
+        sensitivedataorigin userwithauth adminwithpolicy noda \
+        encrypteddupplication restricted decrypt sign)
+
+        local nv_attributes=(\| ppwrite ownerwrite authwrite policywrite \
+        policydelete writelocked writeall writedefine write_stclear \
+        globallock ppread ownerread authread policyread no_da orderly \
+        clear_stclear readlocked written platformcreate read_stclear)
+
+        local cur prev words cword split
+        _init_completion -s || return
+        case $prev in
+            -h | --help)
+                COMPREPLY=( $(compgen -W "man no-man" -- "$cur") )
+                return;;
+            -T | --tcti)
+                COMPREPLY=( $(compgen -W "tabrmd mssim device none" -- "$cur") )
+                return;;
+            -g | --hash-algorithm)
+                COMPREPLY=($(compgen -W "${hash_methods[*]}" -- "$cur"))
+                return;;
+            -o | --output | -L | --policy | --candidates)
+                _filedir
+                return;;
+        esac
+
+        COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
+        -Z --enable-erata -T --tcti \
+        -l -g -s -o -L --pcr-list --hash-algorithm --substitute --output --policy --candidates --jobs " \
+        -- "$cur"))
+    } &&
+    complete -F _tpm2_pcrpredict tpm2_pcrpredict
+# ex: filetype=sh
 # bash completion for tpm2_pcrread                   -*- shell-script -*-
 _tpm2_pcrread()
     {
@@ -4159,11 +4284,14 @@ _tpm2_quote()
             -g | --hash-algorithm)
                 COMPREPLY=($(compgen -W "${hash_methods[*]}" -- "$cur"))
                 return;;
+            --aggregate)
+                _filedir
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti -F --pcrs_format \
-        -c -p -l -m -s -f -o -q -g --key-context --auth --pcr-list --message --signature --format --pcr --qualification --hash-algorithm --cphash " \
+        -c -p -l -m -s -f -o -q -g --key-context --auth --pcr-list --message --signature --format --pcr --qualification --hash-algorithm --cphash --aggregate " \
         -- "$cur"))
     } &&
     complete -F _tpm2_quote tpm2_quote
@@ -4744,11 +4872,14 @@ _tpm2_sign()
             -f | --format)
                 COMPREPLY=($(compgen -W "${format_methods[*]}" -- "$cur"))
                 return;;
+            --batch)
+                _filedir
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        -c -p -g -s -d -t -o -f --key-context --auth --hash-algorithm --scheme --digest --ticket --signature --format --cphash " \
+        -c -p -g -s -d -t -o -f --key-context --auth --hash-algorithm --scheme --digest --ticket --signature --format --cphash --batch --jobs " \
         -- "$cur"))
     } &&
     complete -F _tpm2_sign tpm2_sign
@@ -5026,11 +5157,14 @@ _tpm2_verifysignature()
             -t | --ticket)
                 _filedir
                 return;;
+            --proof)
+                _filedir
+                return;;
         esac
 
         COMPREPLY=($(compgen -W "-h --help -v --version -V --verbose -Q --quiet \
         -Z --enable-erata -T --tcti \
-        -c -g -m -d -s -f -t --key-context --hash-algorithm --message --digest --signature --scheme --ticket --format " \
+        -c -g -m -d -s -f -t --key-context --hash-algorithm --message --digest --signature --scheme --ticket --format --proof " \
         -- "$cur"))
     } &&
     complete -F _tpm2_verifysignature tpm2_verifysignature
@@ -5092,7 +5226,7 @@ _tpm2() {
             _init_completion -s || return
 
             if ((cword == 1)); then
-                COMPREPLY=($(compgen -W "activatecredential certify certifyX509certutil certifycreation changeauth changeeps changepps checkquote clear clearcontrol clockrateadjust commit create createak createek createpolicy createprimary dictionarylockout duplicate ecdhkeygen ecdhzgen ecephemeral encryptdecrypt eventlog evictcontrol flushcontext getcap getcommandauditdigest geteccparameters getekcertificate getrandom getsessionauditdigest gettestresult gettime hash hierarchycontrol hmac import incrementalselftest load loadexternal makecredential nvcertify nvdefine nvextend nvincrement nvread nvreadlock nvreadpublic nvsetbits nvundefine nvwrite nvwritelock pcrallocate pcrevent pcrextend pcrread pcrreset policyauthorize policyauthorizenv policyauthvalue policycommandcode policycountertimer policycphash policyduplicationselect policylocality policynamehash policynv policynvwritten policyor policypassword policypcr policyrestart policysecret policysigned policytemplate policyticket print quote rc_decode readclock readpublic rsadecrypt rsaencrypt selftest send setclock setcommandauditstatus setprimarypolicy shutdown sign startauthsession startup stirrandom testparms unseal verifysignature zgen2phase " -- "$cur"))
+                COMPREPLY=($(compgen -W "activatecredential auditreplay certify certifyX509certutil certifycreation changeauth changeeps changepps checkquote clear clearcontrol clockrateadjust commit create createak createek createpolicy createprimary dictionarylockout duplicate ecdhkeygen ecdhzgen ecephemeral encryptdecrypt eventlog evictcontrol flushcontext getcap getcommandauditdigest geteccparameters getekcertificate getrandom getsessionauditdigest gettestresult gettime hash hierarchycontrol hmac import incrementalselftest load loadexternal makecredential nvcertify nvdefine nvextend nvincrement nvread nvreadlock nvreadpublic nvsetbits nvundefine nvwrite nvwritelock pcrallocate pcrevent pcrextend pcrpredict pcrread pcrreset policyauthorize policyauthorizenv policyauthvalue policycommandcode policycountertimer policycphash policyduplicationselect policylocality policynamehash policynv policynvwritten policyor policypassword policypcr policyrestart policysecret policysigned policytemplate policyticket print quote rc_decode readclock readpublic rsadecrypt rsaencrypt selftest send setclock setcommandauditstatus setprimarypolicy shutdown sign startauthsession startup stirrandom testparms unseal verifysignature zgen2phase " -- "$cur"))
             else
                 tpmcommand=_tpm2_$prev
                 type $tpmcommand &>/dev/null && $tpmcommand
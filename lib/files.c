@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <libgen.h>
 #include <limits.h>
@@ -9,6 +10,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <tss2/tss2_mu.h>
 
@@ -84,6 +87,99 @@ static size_t readx(FILE *f, UINT8 *data, size_t size) {
     return bread;
 }
 
+/**
+ * Writes size bytes to a file descriptor, continuing on EINTR and short
+ * writes.
+ * @param fd
+ *  The file descriptor to write to.
+ * @param data
+ *  The data to write.
+ * @param size
+ *  The size, in bytes, of that data.
+ * @return
+ *  True on success, False otherwise.
+ */
+static bool writefd(int fd, const UINT8 *data, size_t size) {
+
+    size_t index = 0;
+    while (index < size) {
+        ssize_t wrote = write(fd, &data[index], size - index);
+        if (wrote < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        index += wrote;
+    }
+
+    return true;
+}
+
+/**
+ * Reads a whole file from a file descriptor. For regular files the size is
+ * taken from fstat() so the common case is a single read() without seeking.
+ * @param fd
+ *  The file descriptor to read from.
+ * @param buf
+ *  The buffer to read into.
+ * @param size
+ *  On input the size of the buffer, on success the amount of bytes read.
+ * @param path
+ *  The path of the file for error reporting.
+ * @return
+ *  True on success, False otherwise.
+ */
+static bool readfd(int fd, UINT8 *buf, UINT16 *size, const char *path) {
+
+    struct stat sb;
+    int rc = fstat(fd, &sb);
+    if (rc < 0) {
+        LOG_ERR("Could not stat file \"%s\" error: %s", path, strerror(errno));
+        return false;
+    }
+
+    unsigned long file_size = S_ISREG(sb.st_mode) ? sb.st_size : 0;
+
+    /* max is bounded on *size */
+    if (file_size > *size) {
+        LOG_ERR("File \"%s\" size is larger than buffer, got %lu expected "
+                "less than or equal to %u", path, file_size, *size);
+        return false;
+    }
+
+    /*
+     * Files reporting a size of 0, like sysfs files generated on the fly or
+     * pipes, are read until EOF is reached or the buffer is full.
+     */
+    size_t want = file_size ? file_size : *size;
+    size_t bread = 0;
+    while (bread < want) {
+        ssize_t n = read(fd, &buf[bread], want - bread);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERR("Could not read data from file \"%s\" error: %s", path,
+                    strerror(errno));
+            return false;
+        }
+        if (n == 0) {
+            break;
+        }
+        bread += n;
+    }
+
+    if (bread < file_size) {
+        LOG_ERR("Could not read data from file \"%s\"", path);
+        return false;
+    }
+
+    *size = bread;
+
+    return true;
+}
+
 bool files_get_file_size(FILE *fp, unsigned long *file_size, const char *path) {
 
     long current = ftell(fp);
@@ -169,15 +265,15 @@ bool files_load_bytes_from_path(const char *path, UINT8 *buf, UINT16 *size) {
         return false;
     }
 
-    FILE *f = fopen(path, "rb");
-    if (!f) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
         LOG_ERR("Could not open file \"%s\" error %s", path, strerror(errno));
         return false;
     }
 
-    bool result = file_read_bytes_from_file(f, buf, size, path);
+    bool result = readfd(fd, buf, size, path);
 
-    fclose(f);
+    close(fd);
     return result;
 }
 
@@ -191,19 +287,29 @@ bool files_save_bytes_to_file(const char *path, UINT8 *buf, UINT16 size) {
         return true;
     }
 
-    FILE *fp = path ? fopen(path, "wb+") : stdout;
-    if (!fp) {
+    if (!path) {
+        bool result = files_write_bytes(stdout, buf, size);
+        if (!result) {
+            LOG_ERR("Could not write data to file \"<stdout>\"");
+        }
+        return result;
+    }
+
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
         LOG_ERR("Could not open file \"%s\", error: %s", path, strerror(errno));
         return false;
     }
 
-    bool result = files_write_bytes(fp, buf, size);
+    bool result = writefd(fd, buf, size);
     if (!result) {
-        LOG_ERR("Could not write data to file \"%s\"", path ? path : "<stdout>");
+        LOG_ERR("Could not write data to file \"%s\"", path);
     }
 
-    if (fp != stdout) {
-        fclose(fp);
+    if (close(fd) < 0 && result) {
+        LOG_ERR("Could not write data to file \"%s\", error: %s", path,
+                strerror(errno));
+        result = false;
     }
 
     return result;
@@ -214,6 +320,12 @@ bool files_save_bytes_to_file(const char *path, UINT8 *buf, UINT16 size) {
  */
 #define CONTEXT_VERSION 1
 
+/*
+ * Largest context file, the on disk TPMS_CONTEXT is never larger than the in
+ * memory one.
+ */
+#define CONTEXT_FILE_MAX (2 * sizeof(UINT32) + sizeof(TPMS_CONTEXT))
+
 bool files_save_context(TPMS_CONTEXT *context, FILE *stream) {
 
     /*
@@ -224,50 +336,46 @@ bool files_save_context(TPMS_CONTEXT *context, FILE *stream) {
      * U64 sequence
      * U16 contextBlobLength
      * BYTE[] contextBlob
+     *
+     * The file is marshalled in memory and written at once.
      */
-    bool result = files_write_header(stream, CONTEXT_VERSION);
-    if (!result) {
-        LOG_ERR("Could not write context file header");
-        goto out;
-    }
+    UINT8 buffer[CONTEXT_FILE_MAX];
+    size_t offset = 0;
 
-    // UINT32
-    result = files_write_32(stream, context->hierarchy);
-    if (!result) {
-        LOG_ERR("Could not write hierarchy");
-        goto out;
+    TSS2_RC rc = Tss2_MU_UINT32_Marshal(MAGIC, buffer, sizeof(buffer),
+            &offset);
+    if (rc == TSS2_RC_SUCCESS) {
+        rc = Tss2_MU_UINT32_Marshal(CONTEXT_VERSION, buffer, sizeof(buffer),
+                &offset);
     }
-
-    result = files_write_32(stream, context->savedHandle);
-    if (!result) {
-        LOG_ERR("Could not write savedHandle");
-        goto out;
+    if (rc == TSS2_RC_SUCCESS) {
+        rc = Tss2_MU_UINT32_Marshal(context->hierarchy, buffer,
+                sizeof(buffer), &offset);
     }
-    LOG_INFO("Save TPMS_CONTEXT->savedHandle: 0x%x", context->savedHandle);
-
-    // UINT64
-    result = files_write_64(stream, context->sequence);
-    if (!result) {
-        LOG_ERR("Could not write sequence");
-        goto out;
+    if (rc == TSS2_RC_SUCCESS) {
+        rc = Tss2_MU_UINT32_Marshal(context->savedHandle, buffer,
+                sizeof(buffer), &offset);
     }
-
-    // U16 LENGTH
-    result = files_write_16(stream, context->contextBlob.size);
-    if (!result) {
-        LOG_ERR("Could not write contextBob size");
-        goto out;
+    if (rc == TSS2_RC_SUCCESS) {
+        rc = Tss2_MU_UINT64_Marshal(context->sequence, buffer,
+                sizeof(buffer), &offset);
+    }
+    if (rc == TSS2_RC_SUCCESS) {
+        rc = Tss2_MU_TPM2B_CONTEXT_DATA_Marshal(&context->contextBlob, buffer,
+                sizeof(buffer), &offset);
     }
+    if (rc != TSS2_RC_SUCCESS) {
+        LOG_ERR("Error serializing TPMS_CONTEXT structure: 0x%x", rc);
+        return false;
+    }
+
+    LOG_INFO("Save TPMS_CONTEXT->savedHandle: 0x%x", context->savedHandle);
 
-    // BYTE[] contextBlob
-    result = files_write_bytes(stream, context->contextBlob.buffer,
-            context->contextBlob.size);
+    bool result = files_write_bytes(stream, buffer, offset);
     if (!result) {
-        LOG_ERR("Could not write contextBlob buffer");
+        LOG_ERR("Could not write context file");
     }
-    /* result is set by file_write_bytes() */
 
-out:
     return result;
 }
 
@@ -301,10 +409,11 @@ tool_rc files_save_tpm_context_to_path(ESYS_CONTEXT *context, ESYS_TR handle,
     return rc;
 }
 
-static bool load_tpm_context_file(FILE *fstream, TPMS_CONTEXT *context) {
+static bool load_tpm_context_buffer(const UINT8 *buffer, size_t size,
+        TPMS_CONTEXT *context) {
 
     /*
-     * Reading the TPMS_CONTEXT structure to disk, format:
+     * Reading the TPMS_CONTEXT structure from disk, format:
      * TPM2.0-TOOLS HEADER
      * U32 hierarchy
      * U32 savedHandle
@@ -312,71 +421,46 @@ static bool load_tpm_context_file(FILE *fstream, TPMS_CONTEXT *context) {
      * U16 contextBlobLength
      * BYTE[] contextBlob
      */
+    size_t offset = 0;
+    UINT32 magic;
     UINT32 version;
-    bool result = files_read_header(fstream, &version);
-    if (!result) {
-        LOG_WARN("The loaded tpm context does not appear to be in the proper "
-                "format, assuming old format, this will be converted on the "
-                "next save.");
-        rewind(fstream);
-        result = files_read_bytes(fstream, (UINT8 *) context, sizeof(*context));
-        if (!result) {
-            LOG_ERR("Could not load tpm context file");
-            goto out;
-        }
-        /* Success load the context into the TPM */
-        goto out;
+    TSS2_RC rc = Tss2_MU_UINT32_Unmarshal(buffer, size, &offset, &magic);
+    if (rc == TSS2_RC_SUCCESS) {
+        rc = Tss2_MU_UINT32_Unmarshal(buffer, size, &offset, &version);
+    }
+    if (rc != TSS2_RC_SUCCESS || magic != MAGIC) {
+        LOG_ERR("Could not read tpm context file header");
+        return false;
     }
 
     if (version != CONTEXT_VERSION) {
         LOG_ERR("Unsupported context file format version found, got: %"PRIu32,
                 version);
-        result = false;
-        goto out;
-    }
-
-    result = files_read_32(fstream, &context->hierarchy);
-    if (!result) {
-        LOG_ERR("Error reading hierarchy!");
-        goto out;
+        return false;
     }
 
-    result = files_read_32(fstream, &context->savedHandle);
-    if (!result) {
-        LOG_ERR("Error reading savedHandle!");
-        goto out;
+    rc = Tss2_MU_UINT32_Unmarshal(buffer, size, &offset, &context->hierarchy);
+    if (rc == TSS2_RC_SUCCESS) {
+        rc = Tss2_MU_UINT32_Unmarshal(buffer, size, &offset,
+                &context->savedHandle);
     }
-    LOG_INFO("load: TPMS_CONTEXT->savedHandle: 0x%x", context->savedHandle);
-
-    result = files_read_64(fstream, &context->sequence);
-    if (!result) {
-        LOG_ERR("Error reading sequence!");
-        goto out;
+    if (rc == TSS2_RC_SUCCESS) {
+        rc = Tss2_MU_UINT64_Unmarshal(buffer, size, &offset,
+                &context->sequence);
     }
-
-    result = files_read_16(fstream, &context->contextBlob.size);
-    if (!result) {
-        LOG_ERR("Error reading contextBlob.size!");
-        goto out;
+    if (rc == TSS2_RC_SUCCESS) {
+        /* also bounds contextBlob.size on the size of the buffer */
+        rc = Tss2_MU_TPM2B_CONTEXT_DATA_Unmarshal(buffer, size, &offset,
+                &context->contextBlob);
     }
-
-    if (context->contextBlob.size > sizeof(context->contextBlob.buffer)) {
-        LOG_ERR("Size mismatch found on contextBlob, got %"PRIu16" expected "
-                "less than or equal to %zu", context->contextBlob.size,
-                sizeof(context->contextBlob.buffer));
-        result = false;
-        goto out;
+    if (rc != TSS2_RC_SUCCESS) {
+        LOG_ERR("Error deserializing TPMS_CONTEXT structure: 0x%x", rc);
+        return false;
     }
 
-    result = files_read_bytes(fstream, context->contextBlob.buffer,
-            context->contextBlob.size);
-    if (!result) {
-        LOG_ERR("Error reading contextBlob.size!");
-        goto out;
-    }
+    LOG_INFO("load: TPMS_CONTEXT->savedHandle: 0x%x", context->savedHandle);
 
-out:
-    return result;
+    return true;
 }
 
 static bool check_magic(FILE *fstream, bool seek_reset) {
@@ -410,55 +494,52 @@ static bool check_magic(FILE *fstream, bool seek_reset) {
 tool_rc files_load_tpm_context_from_file(ESYS_CONTEXT *context,
         ESYS_TR *tr_handle, FILE *fstream) {
 
-    TPMS_CONTEXT tpms_context;
-    tool_rc rc = tool_rc_general_error;
+    /*
+     * The rest of the stream is read at once and parsed in memory. Context
+     * files are bounded by CONTEXT_FILE_MAX and serialized ESYS_TRs are
+     * smaller than that, the extra byte detects oversized files.
+     */
+    UINT8 buffer[CONTEXT_FILE_MAX + 1];
+    size_t size = readx(fstream, buffer, sizeof(buffer));
+    if (ferror(fstream)) {
+        LOG_ERR("Could not read tpm context from disk: %s", strerror(errno));
+        return tool_rc_general_error;
+    }
 
-    bool result = check_magic(fstream, true);
-    if (result) {
+    if (size == sizeof(buffer)) {
+        LOG_ERR("Invalid tpm context, size is larger than %zu",
+                sizeof(buffer) - 1);
+        return tool_rc_general_error;
+    }
+
+    size_t offset = 0;
+    UINT32 magic = 0;
+    TSS2_RC rval = Tss2_MU_UINT32_Unmarshal(buffer, size, &offset, &magic);
+    if (rval == TSS2_RC_SUCCESS && magic == MAGIC) {
         LOG_INFO("Assuming tpm context file");
-        result = load_tpm_context_file(fstream, &tpms_context);
+        TPMS_CONTEXT tpms_context;
+        bool result = load_tpm_context_buffer(buffer, size, &tpms_context);
         if (!result) {
-            LOG_ERR("Failed to load_tpm_context_file()");
-            goto out;
+            LOG_ERR("Failed to load tpm context file");
+            return tool_rc_general_error;
         }
 
         return tpm2_context_load(context, &tpms_context, tr_handle);
     }
 
-    ESYS_TR loaded_handle;
-    LOG_INFO("Assuming tpm context file");
-    /* try ESYS TR deserialize */
-    unsigned long size = 0;
-    result = files_get_file_size(fstream, &size, NULL);
-    if (!result) {
-        LOG_ERR("Failed to get file size: %s", strerror(ferror(fstream)));
-        goto out;
-    }
-
+    LOG_INFO("Assuming serialized ESYS_TR");
     if (size < 1) {
-        LOG_ERR("Invalid serialized ESYS_TR size, got: %lu", size);
-        goto out;
-    }
-
-    uint8_t *buffer = calloc(1, size);
-    if (!buffer) {
-        LOG_ERR("oom");
-        goto out;
-    }
-
-    result = files_read_bytes(fstream, buffer, size);
-    if (!result) {
-        LOG_ERR("Could not read serialized ESYS_TR from disk");
-        free(buffer);
-        goto out;
+        LOG_ERR("Invalid serialized ESYS_TR size, got: %zu", size);
+        return tool_rc_general_error;
     }
 
-    rc = tpm2_tr_deserialize(context, buffer, size, &loaded_handle);
-    free(buffer);
+    ESYS_TR loaded_handle;
+    tool_rc rc = tpm2_tr_deserialize(context, buffer, size, &loaded_handle);
     if (rc == tool_rc_success) {
         *tr_handle = loaded_handle;
     }
-    out: return rc;
+
+    return rc;
 }
 
 tool_rc files_load_tpm_context_from_path(ESYS_CONTEXT *context,
@@ -9,6 +9,7 @@
 #include "log.h"
 #include "pcr.h"
 #include "tpm2.h"
+#include "tpm2_codec.h"
 #include "tpm2_systemdeps.h"
 #include "tpm2_tool.h"
 #include "tpm2_alg_util.h"
@@ -212,16 +213,14 @@ bool pcr_print_pcr_struct_le(TPML_PCR_SELECTION *pcr_select, tpm2_pcrs *pcrs) {
                 return false;
             }
 
-            /* Print out PCR ID */
-            tpm2_tool_output("    %-2d: 0x", pcr_id);
-
-            /* Print out current PCR digest value */
+            /* Print out PCR ID and current PCR digest value */
             TPM2B_DIGEST *b = &pcrs->pcr_values[vi].digests[di];
-            int k;
-            for (k = 0; k < le16toh(b->size); k++) {
-                tpm2_tool_output("%02X", b->buffer[k]);
-            }
-            tpm2_tool_output("\n");
+            char hex[TPM2_CODEC_HEX_SIZE(sizeof(b->buffer)) + 1];
+            UINT16 size = le16toh(b->size);
+            tpm2_codec_hex_encode(b->buffer,
+                    size < sizeof(b->buffer) ? size : sizeof(b->buffer), hex,
+                    true);
+            tpm2_tool_output("    %-2d: 0x%s\n", pcr_id, hex);
 
             if (++di < le32toh(pcrs->pcr_values[vi].count)) {
                 continue;
@@ -354,15 +353,11 @@ bool pcr_print_values(const TPML_PCR_SELECTION *pcr_select,
                 return false;
             }
 
-            // Print out PCR ID
-            tpm2_tool_output("    %-2d: 0x", pcr_id);
-
-            // Print out current PCR digest value
+            // Print out PCR ID and current PCR digest value
             const TPM2B_DIGEST *digest = &pcr_value->digests[di];
-            for (int k = 0; k < digest->size; k++) {
-                tpm2_tool_output("%02X", digest->buffer[k]);
-            }
-            tpm2_tool_output("\n");
+            char hex[TPM2_CODEC_HEX_SIZE(sizeof(digest->buffer)) + 1];
+            tpm2_codec_hex_encode(digest->buffer, digest->size, hex, true);
+            tpm2_tool_output("    %-2d: 0x%s\n", pcr_id, hex);
 
             if (++di >= pcr_value->count) {
                 di = 0;
@@ -1,5 +1,8 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
 #include <string.h>
 #include <tss2/tss2_mu.h>
 #include <tss2/tss2_sys.h>
@@ -112,6 +115,111 @@ tool_rc tpm2_nv_readpublic(ESYS_CONTEXT *esys_context, ESYS_TR nv_index,
     return tool_rc_success;
 }
 
+tool_rc tpm2_async_wait(ESYS_CONTEXT *esys_context, tpm2_async_idle_fn idle,
+        void *userdata) {
+
+    bool is_idle_work = idle != NULL;
+
+    TSS2_TCTI_POLL_HANDLE *handles = NULL;
+    size_t count = 0;
+    TSS2_RC rval = Esys_GetPollHandles(esys_context, &handles, &count);
+    bool is_implemented = (rval & ~TSS2_RC_LAYER_MASK) !=
+            TSS2_BASE_RC_NOT_IMPLEMENTED;
+    if (rval != TSS2_RC_SUCCESS && is_implemented) {
+        LOG_PERR(Esys_GetPollHandles, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    if (rval != TSS2_RC_SUCCESS || !count) {
+        /*
+         * TCTIs without poll handles, such as the simulator ones, cannot
+         * tell when the response is ready, and polling no handles would
+         * never return: the host work runs to its end and the finish
+         * blocks.
+         */
+        free(handles);
+        while (is_idle_work) {
+            is_idle_work = idle(userdata);
+        }
+        return tool_rc_success;
+    }
+
+    tool_rc rc = tool_rc_success;
+    for (;;) {
+        /* only block once the host work is done */
+        int ready = poll(handles, count, is_idle_work ? 0 : -1);
+        if (ready > 0) {
+            break;
+        }
+
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            LOG_ERR("Could not poll the TCTI: %s", strerror(errno));
+            rc = tool_rc_general_error;
+            break;
+        }
+
+        is_idle_work = idle(userdata);
+    }
+
+    free(handles);
+
+    return rc;
+}
+
+tool_rc tpm2_nv_readpublic_async(ESYS_CONTEXT *esys_context,
+        TPMI_RH_NV_INDEX nv_index) {
+
+    TSS2_SYS_CONTEXT *sys_context = NULL;
+    tool_rc rc = tpm2_getsapicontext(esys_context, &sys_context);
+    if (rc != tool_rc_success) {
+        LOG_ERR("Failed to acquire SAPI context.");
+        return rc;
+    }
+
+    TSS2_RC rval = Tss2_Sys_NV_ReadPublic_Prepare(sys_context, nv_index);
+    if (rval != TPM2_RC_SUCCESS) {
+        LOG_PERR(Tss2_Sys_NV_ReadPublic_Prepare, rval);
+        return tool_rc_general_error;
+    }
+
+    rval = Tss2_Sys_ExecuteAsync(sys_context);
+    if (rval != TPM2_RC_SUCCESS) {
+        LOG_PERR(Tss2_Sys_ExecuteAsync, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
+tool_rc tpm2_nv_readpublic_finish(ESYS_CONTEXT *esys_context,
+        TPM2B_NV_PUBLIC *nv_public, TPM2B_NAME *nv_name) {
+
+    TSS2_SYS_CONTEXT *sys_context = NULL;
+    tool_rc rc = tpm2_getsapicontext(esys_context, &sys_context);
+    if (rc != tool_rc_success) {
+        LOG_ERR("Failed to acquire SAPI context.");
+        return rc;
+    }
+
+    TSS2_RC rval = Tss2_Sys_ExecuteFinish(sys_context,
+            TSS2_TCTI_TIMEOUT_BLOCK);
+    if (rval != TPM2_RC_SUCCESS) {
+        LOG_PERR(Tss2_Sys_ExecuteFinish, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    rval = Tss2_Sys_NV_ReadPublic_Complete(sys_context, nv_public, nv_name);
+    if (rval != TPM2_RC_SUCCESS) {
+        LOG_PERR(Tss2_Sys_NV_ReadPublic_Complete, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
 tool_rc tpm2_getcap(ESYS_CONTEXT *esys_context, TPM2_CAP capability,
         UINT32 property, UINT32 property_count, TPMI_YES_NO *more_data,
         TPMS_CAPABILITY_DATA **capability_data) {
@@ -202,6 +310,45 @@ tpm2_nvread_skip_esapi_call:
     return rc;
 }
 
+tool_rc tpm2_nv_read_async(ESYS_CONTEXT *esys_context,
+        tpm2_loaded_object *auth_hierarchy_obj, ESYS_TR nv_handle, UINT16 size,
+        UINT16 offset) {
+
+    ESYS_TR shandle1 = ESYS_TR_NONE;
+    tool_rc rc = tpm2_auth_util_get_shandle(esys_context,
+            auth_hierarchy_obj->tr_handle, auth_hierarchy_obj->session,
+            &shandle1);
+    if (rc != tool_rc_success) {
+        LOG_ERR("Failed to get shandle");
+        return rc;
+    }
+
+    TSS2_RC rval = Esys_NV_Read_Async(esys_context,
+            auth_hierarchy_obj->tr_handle, nv_handle, shandle1, ESYS_TR_NONE,
+            ESYS_TR_NONE, size, offset);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Esys_NV_Read_Async, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
+tool_rc tpm2_nv_read_finish(ESYS_CONTEXT *esys_context,
+        TPM2B_MAX_NV_BUFFER **data) {
+
+    TSS2_RC rval;
+    do {
+        rval = Esys_NV_Read_Finish(esys_context, data);
+    } while ((rval & ~TSS2_RC_LAYER_MASK) == TSS2_BASE_RC_TRY_AGAIN);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Esys_NV_Read_Finish, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
 tool_rc tpm2_context_save(ESYS_CONTEXT *esys_context, ESYS_TR save_handle,
         TPMS_CONTEXT **context) {
 
@@ -1151,6 +1298,34 @@ tool_rc tpm2_sequence_update(ESYS_CONTEXT *esys_context, ESYS_TR sequence_handle
     return tool_rc_success;
 }
 
+tool_rc tpm2_sequence_update_async(ESYS_CONTEXT *esys_context,
+        ESYS_TR sequence_handle, ESYS_TR shandle1,
+        const TPM2B_MAX_BUFFER *buffer) {
+
+    TSS2_RC rval = Esys_SequenceUpdate_Async(esys_context, sequence_handle,
+            shandle1, ESYS_TR_NONE, ESYS_TR_NONE, buffer);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Esys_SequenceUpdate_Async, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
+tool_rc tpm2_sequence_update_finish(ESYS_CONTEXT *esys_context) {
+
+    TSS2_RC rval;
+    do {
+        rval = Esys_SequenceUpdate_Finish(esys_context);
+    } while ((rval & ~TSS2_RC_LAYER_MASK) == TSS2_BASE_RC_TRY_AGAIN);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Esys_SequenceUpdate_Finish, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
 tool_rc tpm2_sequence_complete(ESYS_CONTEXT *esys_context,
         ESYS_TR sequence_handle, const TPM2B_MAX_BUFFER *buffer,
         TPMI_RH_HIERARCHY hierarchy, TPM2B_DIGEST **result,
@@ -2283,6 +2458,73 @@ tpm2_encryptdecrypt_skip_esapi_call:
     return rc;
 }
 
+tool_rc tpm2_encryptdecrypt_async(ESYS_CONTEXT *esys_context,
+        tpm2_loaded_object *encryption_key_obj, TPMI_YES_NO decrypt,
+        TPMI_ALG_SYM_MODE mode, const TPM2B_IV *iv_in,
+        const TPM2B_MAX_BUFFER *input_data) {
+
+    ESYS_TR shandle1 = ESYS_TR_NONE;
+    tool_rc rc = tpm2_auth_util_get_shandle(esys_context,
+            encryption_key_obj->tr_handle, encryption_key_obj->session,
+            &shandle1);
+    if (rc != tool_rc_success) {
+        LOG_ERR("Failed to get shandle");
+        return rc;
+    }
+
+    TSS2_RC rval = Esys_EncryptDecrypt2_Async(esys_context,
+            encryption_key_obj->tr_handle, shandle1, ESYS_TR_NONE,
+            ESYS_TR_NONE, input_data, decrypt, mode, iv_in);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Esys_EncryptDecrypt2_Async, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
+tool_rc tpm2_encryptdecrypt_finish(ESYS_CONTEXT *esys_context,
+        tpm2_loaded_object *encryption_key_obj, TPMI_YES_NO decrypt,
+        TPMI_ALG_SYM_MODE mode, const TPM2B_IV *iv_in,
+        const TPM2B_MAX_BUFFER *input_data, TPM2B_MAX_BUFFER **output_data,
+        TPM2B_IV **iv_out) {
+
+    TSS2_RC rval;
+    do {
+        rval = Esys_EncryptDecrypt2_Finish(esys_context, output_data, iv_out);
+    } while ((rval & ~TSS2_RC_LAYER_MASK) == TSS2_BASE_RC_TRY_AGAIN);
+    if (tpm2_error_get(rval) != TPM2_RC_COMMAND_CODE) {
+        if (rval != TSS2_RC_SUCCESS) {
+            LOG_PERR(Esys_EncryptDecrypt2_Finish, rval);
+            return tool_rc_from_tpm(rval);
+        }
+        return tool_rc_success;
+    }
+
+    /*
+     * The TPM does not implement EncryptDecrypt2, fall back to a
+     * synchronous EncryptDecrypt of the same input.
+     */
+    ESYS_TR shandle1 = ESYS_TR_NONE;
+    tool_rc rc = tpm2_auth_util_get_shandle(esys_context,
+            encryption_key_obj->tr_handle, encryption_key_obj->session,
+            &shandle1);
+    if (rc != tool_rc_success) {
+        LOG_ERR("Failed to get shandle");
+        return rc;
+    }
+
+    rval = Esys_EncryptDecrypt(esys_context, encryption_key_obj->tr_handle,
+            shandle1, ESYS_TR_NONE, ESYS_TR_NONE, decrypt, mode, iv_in,
+            input_data, output_data, iv_out);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Esys_EncryptDecrypt, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
 tool_rc tpm2_hierarchycontrol(ESYS_CONTEXT *esys_context,
         tpm2_loaded_object *auth_hierarchy, TPMI_RH_ENABLES enable,
         TPMI_YES_NO state, TPM2B_DIGEST *cp_hash) {
@@ -3468,6 +3710,44 @@ tpm2_sign_skip_esapi_call:
     return rc;
 }
 
+tool_rc tpm2_sign_async(ESYS_CONTEXT *esys_context,
+        tpm2_loaded_object *signingkey_obj, const TPM2B_DIGEST *digest,
+        const TPMT_SIG_SCHEME *in_scheme, const TPMT_TK_HASHCHECK *validation) {
+
+    ESYS_TR signingkey_obj_session_handle = ESYS_TR_NONE;
+    tool_rc rc = tpm2_auth_util_get_shandle(esys_context,
+            signingkey_obj->tr_handle, signingkey_obj->session,
+            &signingkey_obj_session_handle);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    TSS2_RC rval = Esys_Sign_Async(esys_context, signingkey_obj->tr_handle,
+            signingkey_obj_session_handle, ESYS_TR_NONE, ESYS_TR_NONE, digest,
+            in_scheme, validation);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Esys_Sign_Async, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
+tool_rc tpm2_sign_finish(ESYS_CONTEXT *esys_context,
+        TPMT_SIGNATURE **signature) {
+
+    TSS2_RC rval;
+    do {
+        rval = Esys_Sign_Finish(esys_context, signature);
+    } while ((rval & ~TSS2_RC_LAYER_MASK) == TSS2_BASE_RC_TRY_AGAIN);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Esys_Sign_Finish, rval);
+        return tool_rc_from_tpm(rval);
+    }
+
+    return tool_rc_success;
+}
+
 tool_rc tpm2_nvcertify(ESYS_CONTEXT *esys_context,
     tpm2_loaded_object *signingkey_obj, tpm2_loaded_object *nvindex_authobj,
     TPM2_HANDLE nv_index, UINT16 offset, UINT16 size,
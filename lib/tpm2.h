@@ -23,6 +23,67 @@ tool_rc tpm2_tr_serialize(ESYS_CONTEXT *esys_context, ESYS_TR object,
 tool_rc tpm2_nv_readpublic(ESYS_CONTEXT *esys_context, ESYS_TR nv_index,
         TPM2B_NV_PUBLIC **nv_public, TPM2B_NAME **nv_name);
 
+/**
+ * Called by tpm2_async_wait() while the TPM works, to run a unit of host
+ * work such as writing out the previous response.
+ * @param userdata
+ *  The userdata given to tpm2_async_wait().
+ * @return
+ *  true while host work remains, false once it is done.
+ */
+typedef bool (*tpm2_async_idle_fn)(void *userdata);
+
+/**
+ * Waits for the response of the command submitted by one of the *_async()
+ * wrappers, polling the TCTI and running the host work in between. Follow
+ * with the matching *_finish() wrapper to collect the response.
+ * With TCTIs which have no poll handles, all of the host work runs and the
+ * finish blocks instead.
+ * The *_async() and *_finish() wrappers compute neither a cpHash nor an
+ * rpHash. Tools given **--cphash** or **--rphash** use the synchronous
+ * wrappers instead, or reject the option in the modes without one.
+ * @param esys_context
+ *  The ESAPI context with a command in flight.
+ * @param idle
+ *  The host work, or NULL for none.
+ * @param userdata
+ *  Passed to idle.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_async_wait(ESYS_CONTEXT *esys_context, tpm2_async_idle_fn idle,
+        void *userdata);
+
+/**
+ * Submits a TPM2_CC_NV_ReadPublic of an NV index without waiting for the
+ * response, so the caller can process the previous index while the TPM works.
+ * The command goes through the SAPI context of the ESAPI context, sparing the
+ * ESYS_TR an ESAPI NV_ReadPublic needs, and must be followed by
+ * tpm2_nv_readpublic_finish() before any other ESAPI call.
+ * @param esys_context
+ *  The ESAPI context.
+ * @param nv_index
+ *  The TPM handle of the NV index.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_nv_readpublic_async(ESYS_CONTEXT *esys_context,
+        TPMI_RH_NV_INDEX nv_index);
+
+/**
+ * Waits for the response of tpm2_nv_readpublic_async().
+ * @param esys_context
+ *  The ESAPI context.
+ * @param nv_public
+ *  The public area of the NV index.
+ * @param nv_name
+ *  The name of the NV index, as computed by the TPM.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_nv_readpublic_finish(ESYS_CONTEXT *esys_context,
+        TPM2B_NV_PUBLIC *nv_public, TPM2B_NAME *nv_name);
+
 tool_rc tpm2_readpublic(ESYS_CONTEXT *esys_context, ESYS_TR object_handle,
         TPM2B_PUBLIC **out_public, TPM2B_NAME **name,
         TPM2B_NAME **qualified_name);
@@ -36,6 +97,42 @@ tool_rc tpm2_nv_read(ESYS_CONTEXT *esys_context,
     UINT16 offset, TPM2B_MAX_NV_BUFFER **data, TPM2B_DIGEST *cp_hash,
     TPMI_ALG_HASH parameter_hash_algorithm);
 
+/**
+ * Submits a TPM2_CC_NV_Read without waiting for the response, so the caller
+ * can use the previous chunk while the TPM reads the next one. Must be
+ * followed by tpm2_nv_read_finish() before any other ESAPI call.
+ * The cpHash is only computed by tpm2_nv_read(), which does not dispatch
+ * the command.
+ * @param esys_context
+ *  The ESAPI context.
+ * @param auth_hierarchy_obj
+ *  The object authorizing the read, the index itself or a hierarchy.
+ * @param nv_handle
+ *  The ESAPI handle of the index, resolved once by the caller for all of
+ *  the chunks.
+ * @param size
+ *  The number of bytes to read, at most the maximum NV buffer size.
+ * @param offset
+ *  The offset in the index to read from.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_nv_read_async(ESYS_CONTEXT *esys_context,
+        tpm2_loaded_object *auth_hierarchy_obj, ESYS_TR nv_handle, UINT16 size,
+        UINT16 offset);
+
+/**
+ * Waits for the response of tpm2_nv_read_async().
+ * @param esys_context
+ *  The ESAPI context.
+ * @param data
+ *  The bytes read, freed by the caller.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_nv_read_finish(ESYS_CONTEXT *esys_context,
+        TPM2B_MAX_NV_BUFFER **data);
+
 tool_rc tpm2_context_save(ESYS_CONTEXT *esys_context, ESYS_TR save_handle,
         TPMS_CONTEXT **context);
 
@@ -167,6 +264,34 @@ tool_rc tpm2_hash_sequence_start(ESYS_CONTEXT *esys_context, const TPM2B_AUTH *a
 tool_rc tpm2_sequence_update(ESYS_CONTEXT *esys_context, ESYS_TR sequence_handle,
         const TPM2B_MAX_BUFFER *buffer);
 
+/**
+ * Submits a TPM2_CC_SequenceUpdate without waiting for the response, so the
+ * caller can prepare the next buffer while the TPM works. Must be followed
+ * by tpm2_sequence_update_finish() before any other ESAPI call.
+ * @param esys_context
+ *  The ESAPI context.
+ * @param sequence_handle
+ *  The hash, HMAC or event sequence.
+ * @param shandle1
+ *  The session authorizing the sequence.
+ * @param buffer
+ *  The data to add to the sequence.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_sequence_update_async(ESYS_CONTEXT *esys_context,
+        ESYS_TR sequence_handle, ESYS_TR shandle1,
+        const TPM2B_MAX_BUFFER *buffer);
+
+/**
+ * Waits for the response of tpm2_sequence_update_async().
+ * @param esys_context
+ *  The ESAPI context.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_sequence_update_finish(ESYS_CONTEXT *esys_context);
+
 tool_rc tpm2_sequence_complete(ESYS_CONTEXT *esys_context,
         ESYS_TR sequence_handle, const TPM2B_MAX_BUFFER *buffer,
         TPMI_RH_HIERARCHY hierarchy, TPM2B_DIGEST **result,
@@ -272,6 +397,52 @@ tool_rc tpm2_encryptdecrypt(ESYS_CONTEXT *esys_context,
         const TPM2B_MAX_BUFFER *input_data, TPM2B_MAX_BUFFER **output_data,
         TPM2B_IV **iv_out, TPM2B_DIGEST *cp_hash);
 
+/**
+ * Submits a TPM2_CC_EncryptDecrypt2 without waiting for the response, so the
+ * caller can write out the previous block while the TPM works. Must be
+ * followed by tpm2_encryptdecrypt_finish() before any other ESAPI call.
+ * The cpHash is only computed by tpm2_encryptdecrypt(), which does not
+ * dispatch the command.
+ * @param esys_context
+ *  The ESAPI context.
+ * @param encryption_key_obj
+ *  The symmetric key.
+ * @param decrypt
+ *  TPM2_YES to decrypt, TPM2_NO to encrypt.
+ * @param mode
+ *  The symmetric mode.
+ * @param iv_in
+ *  The initial value, NULL for ECB.
+ * @param input_data
+ *  The data to encrypt or decrypt.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_encryptdecrypt_async(ESYS_CONTEXT *esys_context,
+        tpm2_loaded_object *encryption_key_obj, TPMI_YES_NO decrypt,
+        TPMI_ALG_SYM_MODE mode, const TPM2B_IV *iv_in,
+        const TPM2B_MAX_BUFFER *input_data);
+
+/**
+ * Waits for the response of tpm2_encryptdecrypt_async(). The inputs are the
+ * ones given to tpm2_encryptdecrypt_async(), for TPMs without
+ * TPM2_CC_EncryptDecrypt2 where the data is resubmitted with
+ * TPM2_CC_EncryptDecrypt.
+ * @param esys_context
+ *  The ESAPI context.
+ * @param output_data
+ *  The encrypted or decrypted data.
+ * @param iv_out
+ *  The chaining value for the next block.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_encryptdecrypt_finish(ESYS_CONTEXT *esys_context,
+        tpm2_loaded_object *encryption_key_obj, TPMI_YES_NO decrypt,
+        TPMI_ALG_SYM_MODE mode, const TPM2B_IV *iv_in,
+        const TPM2B_MAX_BUFFER *input_data, TPM2B_MAX_BUFFER **output_data,
+        TPM2B_IV **iv_out);
+
 tool_rc tpm2_hierarchycontrol(ESYS_CONTEXT *esys_context,
         tpm2_loaded_object *auth_hierarchy, TPMI_RH_ENABLES enable,
         TPMI_YES_NO state, TPM2B_DIGEST *cp_hash);
@@ -356,6 +527,41 @@ tool_rc tpm2_sign(ESYS_CONTEXT *esys_context, tpm2_loaded_object *signingkey_obj
         TPMT_TK_HASHCHECK *validation, TPMT_SIGNATURE **signature,
         TPM2B_DIGEST *cp_hash);
 
+/**
+ * Submits a TPM2_CC_Sign without waiting for the response, so the caller can
+ * save its other outputs while the TPM signs. Must be followed by
+ * tpm2_sign_finish() before any other ESAPI call.
+ * The cpHash is only computed by tpm2_sign(), which does not dispatch the
+ * command.
+ * @param esys_context
+ *  The ESAPI context.
+ * @param signingkey_obj
+ *  The signing key.
+ * @param digest
+ *  The digest to sign.
+ * @param in_scheme
+ *  The signing scheme.
+ * @param validation
+ *  The ticket of a digest computed by the TPM, or a NULL ticket.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_sign_async(ESYS_CONTEXT *esys_context,
+        tpm2_loaded_object *signingkey_obj, const TPM2B_DIGEST *digest,
+        const TPMT_SIG_SCHEME *in_scheme, const TPMT_TK_HASHCHECK *validation);
+
+/**
+ * Waits for the response of tpm2_sign_async().
+ * @param esys_context
+ *  The ESAPI context.
+ * @param signature
+ *  The signature, freed by the caller.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_sign_finish(ESYS_CONTEXT *esys_context,
+        TPMT_SIGNATURE **signature);
+
 tool_rc tpm2_quote(ESYS_CONTEXT *esys_context, tpm2_loaded_object *quote_obj,
         TPMT_SIG_SCHEME *in_scheme, TPM2B_DATA *qualifying_data,
         TPML_PCR_SELECTION *PCRselect, TPM2B_ATTEST **quoted,
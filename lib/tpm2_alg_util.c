@@ -726,6 +726,83 @@ static const char *hex_to_byte_err(int rc) {
     return "unknown";
 }
 
+bool pcr_parse_digest_values(char *str, TPML_DIGEST_VALUES *digests) {
+
+    /* count is 0 on error, whichever error returns early */
+    digests->count = 0;
+    UINT32 count = 0;
+
+    /* parse <hash_name>=<hash_value>,.. */
+    char *digest_hash_tok;
+    char *save_ptr = NULL;
+
+    while ((digest_hash_tok = strtok_r(str, ",", &save_ptr))) {
+        str = NULL;
+
+        if (count >= ARRAY_LEN(digests->digests)) {
+            LOG_ERR("Specified too many digests per spec, max is: %zu",
+                    ARRAY_LEN(digests->digests));
+            return false;
+        }
+
+        TPMT_HA *d = &digests->digests[count];
+
+        char *stralg = digest_hash_tok;
+        char *split = strchr(digest_hash_tok, '=');
+        if (!split) {
+            LOG_ERR("Expecting = in <hash alg>=<hash value> spec, got: "
+                    "\"%s\"", digest_hash_tok);
+            return false;
+        }
+        *split = '\0';
+        split++;
+
+        char *data = split;
+
+        /*
+         * Convert and validate the hash algorithm. It should be a hash algorithm
+         */
+        TPM2_ALG_ID alg = tpm2_alg_util_from_optarg(stralg,
+                tpm2_alg_util_flags_hash);
+        if (alg == TPM2_ALG_ERROR) {
+            LOG_ERR("Could not convert algorithm, got: \"%s\"", stralg);
+            return false;
+        }
+
+        d->hashAlg = alg;
+
+        /* fill up the TPMT_HA structure with algorithm and digest */
+        BYTE *digest_data = (BYTE *) &d->digest;
+
+        UINT16 expected_hash_size = tpm2_alg_util_get_hash_size(alg);
+        /* strip any preceding hex on the data as tpm2_util_hex_to_byte_structure doesn't support it */
+        bool is_hex = !strncmp("0x", data, 2);
+        if (is_hex) {
+            data += 2;
+        }
+
+        UINT16 size = expected_hash_size;
+        int rc = tpm2_util_hex_to_byte_structure(data, &size, digest_data);
+        if (rc) {
+            LOG_ERR("Error \"%s\" converting hex string as data, got:"
+                    " \"%s\"", hex_to_byte_err(rc), data);
+            return false;
+        }
+
+        if (expected_hash_size != size) {
+            LOG_ERR("Algorithm \"%s\" expects a size of %u bytes, got: %u",
+                    stralg, expected_hash_size, size);
+            return false;
+        }
+
+        count++;
+    }
+
+    digests->count = count;
+
+    return count > 0;
+}
+
 bool pcr_parse_digest_list(char **argv, int len,
         tpm2_pcr_digest_spec *digest_spec) {
 
@@ -737,8 +814,6 @@ bool pcr_parse_digest_list(char **argv, int len,
     for (i = 0; i < len; i++) {
         tpm2_pcr_digest_spec *dspec = &digest_spec[i];
 
-        UINT32 count = 0;
-
         /*
          * Split <pcr index>:<hash alg>=<hash value>,... on : and separate with null byte, ie:
          * <pce index> '\0' <hash alg>'\0'<data>
@@ -765,81 +840,12 @@ bool pcr_parse_digest_list(char **argv, int len,
         }
 
         /* now that the pcr_index is removed, parse the remaining <hash_name>=<hash_value>,.. */
-        char *digest_hash_tok;
-        char *save_ptr = NULL;
-
-        /* keep track of digests we have seen */
-
-        while ((digest_hash_tok = strtok_r(digest_spec_str, ",", &save_ptr))) {
-            digest_spec_str = NULL;
-
-            if (count >= ARRAY_LEN(dspec->digests.digests)) {
-                LOG_ERR("Specified too many digests per spec, max is: %zu",
-                        ARRAY_LEN(dspec->digests.digests));
-                return false;
-            }
-
-            TPMT_HA *d = &dspec->digests.digests[count];
-
-            char *stralg = digest_hash_tok;
-            char *split = strchr(digest_hash_tok, '=');
-            if (!split) {
-                LOG_ERR("Expecting = in <hash alg>=<hash value> spec, got: "
-                        "\"%s\"", digest_hash_tok);
-                return false;
-            }
-            *split = '\0';
-            split++;
-
-            char *data = split;
-
-            /*
-             * Convert and validate the hash algorithm. It should be a hash algorithm
-             */
-            TPM2_ALG_ID alg = tpm2_alg_util_from_optarg(stralg,
-                    tpm2_alg_util_flags_hash);
-            if (alg == TPM2_ALG_ERROR) {
-                LOG_ERR("Could not convert algorithm, got: \"%s\"", stralg);
-                return false;
-            }
-
-            d->hashAlg = alg;
-
-            /* fill up the TPMT_HA structure with algorithm and digest */
-            BYTE *digest_data = (BYTE *) &d->digest;
-
-            UINT16 expected_hash_size = tpm2_alg_util_get_hash_size(alg);
-            /* strip any preceding hex on the data as tpm2_util_hex_to_byte_structure doesn't support it */
-            bool is_hex = !strncmp("0x", data, 2);
-            if (is_hex) {
-                data += 2;
-            }
-
-            UINT16 size = expected_hash_size;
-            int rc = tpm2_util_hex_to_byte_structure(data, &size, digest_data);
-            if (rc) {
-                LOG_ERR("Error \"%s\" converting hex string as data, got:"
-                        " \"%s\"", hex_to_byte_err(rc), data);
-                return false;
-            }
-
-            if (expected_hash_size != size) {
-                LOG_ERR("Algorithm \"%s\" expects a size of %u bytes, got: %u",
-                        stralg, expected_hash_size, size);
-                return false;
-            }
-
-            count++;
-        }
-
-        if (!count) {
+        result = pcr_parse_digest_values(digest_spec_str, &dspec->digests);
+        if (!result) {
             LOG_ERR("Missing or invalid <hash alg>=<hash value> spec for pcr:"
                     " \"%s\"", pcr_index_str);
             return false;
         }
-
-        /* assign count at the end, so count is 0 on error */
-        dspec->digests.count = count;
     }
 
     return true;
@@ -115,6 +115,17 @@ struct tpm2_pcr_digest_spec {
 bool pcr_parse_digest_list(char **argv, int len,
         tpm2_pcr_digest_spec *digest_spec);
 
+/**
+ * Parses the <hash alg>=<hash value>,... part of a digest specification.
+ * @param str
+ *  The list of digests, tokenized in place.
+ * @param digests
+ *  The parsed digests, count is 0 on error.
+ * @return
+ *  True if at least one digest was parsed, False otherwise.
+ */
+bool pcr_parse_digest_values(char *str, TPML_DIGEST_VALUES *digests);
+
 /**
  * Retrieves the size of a hash in bytes for a given hash
  * algorithm or 0 if unknown/not found.
@@ -0,0 +1,130 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "tpm2_alg_util.h"
+#include "tpm2_audit.h"
+#include "tpm2_openssl.h"
+
+/*
+ * Number of extends buffered before they are hashed.
+ */
+#define AUDIT_BATCH 256
+
+struct tpm2_audit {
+    TPMI_ALG_HASH halg;
+    UINT16 size;
+    BYTE digest[sizeof(TPMU_HA)];
+    UINT64 count;
+    tpm2_openssl_hasher *hasher;
+    /* the extends not hashed yet, cpHash || rpHash in pairs */
+    tpm2_openssl_hash_msg msgs[AUDIT_BATCH];
+    BYTE pairs[AUDIT_BATCH][2 * sizeof(TPMU_HA)];
+    size_t pending;
+};
+
+tpm2_audit *tpm2_audit_new(TPMI_ALG_HASH halg, const TPM2B_DIGEST *initial) {
+
+    UINT16 size = tpm2_alg_util_get_hash_size(halg);
+    if (!size) {
+        LOG_ERR("Invalid audit digest algorithm 0x%x", halg);
+        return NULL;
+    }
+
+    if (initial && initial->size != size) {
+        LOG_ERR("Expected an initial audit digest of %u bytes, got %u", size,
+                initial->size);
+        return NULL;
+    }
+
+    tpm2_audit *audit = calloc(1, sizeof(*audit));
+    if (!audit) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+
+    audit->hasher = tpm2_openssl_hasher_new();
+    if (!audit->hasher) {
+        free(audit);
+        return NULL;
+    }
+
+    audit->halg = halg;
+    audit->size = size;
+    if (initial) {
+        memcpy(audit->digest, initial->buffer, size);
+    }
+
+    /* every extend hashes the previous digest into the same buffer */
+    size_t i;
+    for (i = 0; i < AUDIT_BATCH; i++) {
+        audit->msgs[i] = (tpm2_openssl_hash_msg) {
+            .halg = halg,
+            .prefix = audit->digest,
+            .prefix_len = size,
+            .data = audit->pairs[i],
+            .length = 2 * size,
+            .digest = audit->digest,
+        };
+    }
+
+    return audit;
+}
+
+void tpm2_audit_free(tpm2_audit *audit) {
+
+    if (!audit) {
+        return;
+    }
+
+    tpm2_openssl_hasher_free(audit->hasher);
+    free(audit);
+}
+
+static bool flush(tpm2_audit *audit) {
+
+    bool result = tpm2_openssl_hash_batch(audit->hasher, audit->msgs,
+            audit->pending);
+    audit->pending = 0;
+    if (!result) {
+        LOG_ERR("Could not hash the audit digest");
+    }
+
+    return result;
+}
+
+bool tpm2_audit_extend(tpm2_audit *audit, const TPM2B_DIGEST *cp_hash,
+        const TPM2B_DIGEST *rp_hash) {
+
+    if (cp_hash->size != audit->size || rp_hash->size != audit->size) {
+        LOG_ERR("Expected a cpHash and an rpHash of %u bytes, got %u and %u",
+                audit->size, cp_hash->size, rp_hash->size);
+        return false;
+    }
+
+    BYTE *pair = audit->pairs[audit->pending++];
+    memcpy(pair, cp_hash->buffer, audit->size);
+    memcpy(pair + audit->size, rp_hash->buffer, audit->size);
+    audit->count++;
+
+    return audit->pending < AUDIT_BATCH || flush(audit);
+}
+
+bool tpm2_audit_get_digest(tpm2_audit *audit, TPM2B_DIGEST *digest) {
+
+    if (audit->pending && !flush(audit)) {
+        return false;
+    }
+
+    digest->size = audit->size;
+    memcpy(digest->buffer, audit->digest, audit->size);
+
+    return true;
+}
+
+UINT64 tpm2_audit_get_count(const tpm2_audit *audit) {
+
+    return audit->count;
+}
@@ -0,0 +1,77 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef LIB_TPM2_AUDIT_H_
+#define LIB_TPM2_AUDIT_H_
+
+#include <stdbool.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+/*
+ * A software audit digest, replaying the extends the TPM applies to the
+ * command audit digest and to the digest of an audit session for every
+ * audited command:
+ *
+ *   digest = HASH(digest || cpHash || rpHash)
+ *
+ * The extends are buffered and hashed in batches over reused hash contexts,
+ * so the memory is constant however many commands are replayed. A
+ * tpm2_audit must not be shared between threads.
+ */
+typedef struct tpm2_audit tpm2_audit;
+
+/**
+ * Allocates an audit digest.
+ * @param halg
+ *  The hash algorithm of the digest, the one of the command audit or of the
+ *  audit session.
+ * @param initial
+ *  The digest to start from, as saved by a checkpoint, NULL to start from
+ *  the all zeros digest of a cleared audit.
+ * @return
+ *  The audit digest, to free with tpm2_audit_free(), NULL on error.
+ */
+tpm2_audit *tpm2_audit_new(TPMI_ALG_HASH halg, const TPM2B_DIGEST *initial);
+
+/**
+ * Frees an audit digest allocated with tpm2_audit_new().
+ * @param audit
+ *  The audit digest to free, may be NULL.
+ */
+void tpm2_audit_free(tpm2_audit *audit);
+
+/**
+ * Extends the audit digest with an audited command.
+ * @param audit
+ *  The audit digest.
+ * @param cp_hash
+ *  The cpHash of the command, of the size of the digest.
+ * @param rp_hash
+ *  The rpHash of the response, of the size of the digest.
+ * @return
+ *  true on success, false on a digest size mismatch or a hashing error.
+ */
+bool tpm2_audit_extend(tpm2_audit *audit, const TPM2B_DIGEST *cp_hash,
+        const TPM2B_DIGEST *rp_hash);
+
+/**
+ * Retrieves the audit digest, hashing the buffered extends.
+ * @param audit
+ *  The audit digest.
+ * @param digest
+ *  The audit digest over all the extends so far.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_audit_get_digest(tpm2_audit *audit, TPM2B_DIGEST *digest);
+
+/**
+ * Retrieves the number of extends since the digest was allocated.
+ * @param audit
+ *  The audit digest.
+ * @return
+ *  The number of extends.
+ */
+UINT64 tpm2_audit_get_count(const tpm2_audit *audit);
+
+#endif /* LIB_TPM2_AUDIT_H_ */
@@ -0,0 +1,150 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "tpm2_batch.h"
+#include "tpm2_manifest.h"
+#include "tpm2_tool_output.h"
+
+typedef struct batch_chunk batch_chunk;
+struct batch_chunk {
+    const tpm2_batch_ops *ops;
+    void *userdata;
+    size_t failed;
+    /* the items of the chunk whose manifest line could not be parsed */
+    bool is_invalid[TPM2_BATCH_CHUNK];
+};
+
+void tpm2_batch_stats_start(tpm2_batch_stats *stats) {
+
+    memset(stats, 0, sizeof(*stats));
+    clock_gettime(CLOCK_MONOTONIC, &stats->lap);
+}
+
+double tpm2_batch_stats_lap(tpm2_batch_stats *stats) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = (now.tv_sec - stats->lap.tv_sec) +
+            (now.tv_nsec - stats->lap.tv_nsec) / 1e9;
+    stats->lap = now;
+    stats->seconds += seconds;
+
+    return seconds;
+}
+
+/* Runs on the worker threads */
+static bool chunk_process_item(void *userdata, size_t index) {
+
+    batch_chunk *chunk = (batch_chunk *) userdata;
+
+    bool result = !chunk->is_invalid[index] &&
+            chunk->ops->process(chunk->userdata, index);
+    if (!result) {
+        __atomic_add_fetch(&chunk->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    return result;
+}
+
+tool_rc tpm2_batch_run(const char *path, const tpm2_batch_ops *ops,
+        unsigned jobs, void *userdata, tpm2_batch_stats *stats) {
+
+    tpm2_batch_stats_start(stats);
+
+    tpm2_manifest *manifest = tpm2_manifest_open(path);
+    if (!manifest) {
+        return tool_rc_general_error;
+    }
+
+    char **fields = calloc(ops->max_fields, sizeof(*fields));
+    if (!fields) {
+        LOG_ERR("oom");
+        tpm2_manifest_close(manifest);
+        return tool_rc_general_error;
+    }
+
+    batch_chunk *chunk = calloc(1, sizeof(*chunk));
+    if (!chunk) {
+        LOG_ERR("oom");
+        free(fields);
+        tpm2_manifest_close(manifest);
+        return tool_rc_general_error;
+    }
+    chunk->ops = ops;
+    chunk->userdata = userdata;
+
+    tool_rc rc = tool_rc_success;
+    size_t count = 0;
+    bool is_eof = false;
+    while (!is_eof) {
+        while (count < TPM2_BATCH_CHUNK) {
+            size_t field_count = ops->max_fields;
+            is_eof = !tpm2_manifest_next(manifest, fields, &field_count);
+            if (is_eof) {
+                break;
+            }
+
+            size_t line = tpm2_manifest_line(manifest);
+            chunk->is_invalid[count] = !ops->parse(userdata, count, fields,
+                    field_count, line);
+            if (chunk->is_invalid[count]) {
+                /* the item fails, the rest of the batch goes on */
+                LOG_ERR("Invalid item on line %zu of manifest \"%s\"", line,
+                        tpm2_manifest_path(manifest));
+            }
+            count++;
+        }
+
+        if (tpm2_manifest_is_error(manifest)) {
+            rc = tool_rc_general_error;
+            goto out;
+        }
+
+        bool result = tpm2_worker_run(count, jobs, chunk_process_item,
+                chunk);
+        if (!result) {
+            rc = tool_rc_general_error;
+        }
+
+        tool_rc tmp_rc = ops->complete ? ops->complete(userdata, count) :
+                tool_rc_success;
+        stats->processed += count;
+        ops->free(userdata, count);
+        count = 0;
+        if (tmp_rc != tool_rc_success) {
+            rc = tmp_rc;
+            goto out;
+        }
+    }
+
+    stats->is_complete = true;
+
+out:
+    ops->free(userdata, count);
+    free(fields);
+    tpm2_manifest_close(manifest);
+
+    stats->failed = chunk->failed;
+    free(chunk);
+    tpm2_batch_stats_lap(stats);
+
+    return rc;
+}
+
+void tpm2_batch_output(const tpm2_batch_stats *stats, const char *items,
+        unsigned jobs) {
+
+    tpm2_tool_output("batch:\n");
+    tpm2_tool_output("  %s: %zu\n", items, stats->processed);
+    tpm2_tool_output("  failed: %zu\n", stats->failed);
+    if (jobs) {
+        tpm2_tool_output("  jobs: %u\n", jobs);
+    }
+    tpm2_tool_output("  seconds: %.3f\n", stats->seconds);
+    tpm2_tool_output("  %s-per-second: %.1f\n", items,
+            stats->seconds > 0 ? stats->processed / stats->seconds : 0.0);
+}
@@ -0,0 +1,125 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef LIB_TPM2_BATCH_H_
+#define LIB_TPM2_BATCH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "tool_rc.h"
+#include "tpm2_worker.h"
+
+/*
+ * The batch modes of the tools: the items of a manifest, see tpm2_manifest.h,
+ * are parsed on the calling thread and processed in parallel by
+ * tpm2_worker_run(), TPM2_BATCH_CHUNK items at a time so that the memory use
+ * does not depend on the size of the manifest.
+ */
+
+/*
+ * Number of manifest items loaded and processed at once in batch mode, the
+ * size of the item arrays of the tools.
+ */
+#define TPM2_BATCH_CHUNK 1024
+
+/*
+ * The item logic of a tool. The items of a chunk are addressed by their
+ * index in it, [0, TPM2_BATCH_CHUNK), and the userdata is the one given to
+ * tpm2_batch_run().
+ */
+typedef struct tpm2_batch_ops tpm2_batch_ops;
+struct tpm2_batch_ops {
+    /*
+     * The maximum number of fields of a manifest line.
+     */
+    size_t max_fields;
+    /*
+     * Parses the fields of a manifest line into the item at index, logging
+     * why on failure. An item failing to parse is counted as failed and not
+     * processed, but still completed and freed with its chunk, so its state
+     * must tell it apart, eg a cleared result.
+     */
+    bool (*parse)(void *userdata, size_t index, char **fields, size_t count,
+            size_t line);
+    /*
+     * Processes the item at index on the worker threads, see
+     * tpm2_worker_item_fn. The items returning false are counted as failed,
+     * the other items are processed regardless.
+     */
+    tpm2_worker_item_fn process;
+    /*
+     * Runs on the calling thread after the count items of a chunk were
+     * processed, eg to output them in manifest order or to issue TPM
+     * commands. NULL for none. Failing stops the batch.
+     */
+    tool_rc (*complete)(void *userdata, size_t count);
+    /*
+     * Frees the count items of a chunk.
+     */
+    void (*free)(void *userdata, size_t count);
+};
+
+/*
+ * The counts and the duration of a batch.
+ */
+typedef struct tpm2_batch_stats tpm2_batch_stats;
+struct tpm2_batch_stats {
+    size_t processed;
+    size_t failed;
+    double seconds;
+    /* whether the whole manifest was run, failed items included */
+    bool is_complete;
+    struct timespec lap;
+};
+
+/**
+ * Clears the stats and starts timing the batch.
+ * @param stats
+ *  The stats to start.
+ */
+void tpm2_batch_stats_start(tpm2_batch_stats *stats);
+
+/**
+ * Adds the time since the start, or since the previous lap, to the duration
+ * of the batch.
+ * @param stats
+ *  The stats of the batch.
+ * @return
+ *  The seconds since the start or the previous lap.
+ */
+double tpm2_batch_stats_lap(tpm2_batch_stats *stats);
+
+/**
+ * Processes the items of a manifest.
+ * @param path
+ *  The manifest, NULL or "-" for stdin.
+ * @param ops
+ *  The item logic of the tool.
+ * @param jobs
+ *  The number of worker threads.
+ * @param userdata
+ *  Passed as is to the ops.
+ * @param stats
+ *  Set to the counts and the duration of the batch, even on failure.
+ * @return
+ *  tool_rc_success if every item was parsed and processed.
+ */
+tool_rc tpm2_batch_run(const char *path, const tpm2_batch_ops *ops,
+        unsigned jobs, void *userdata, tpm2_batch_stats *stats);
+
+/**
+ * Outputs the summary of a batch as the YAML map "batch", with the count of
+ * items, the failed ones, the jobs, the duration and the rate. The tools
+ * output their own keys of the map after it.
+ * @param stats
+ *  The stats of the batch.
+ * @param items
+ *  The key of the count of items, eg "quotes", also naming the rate.
+ * @param jobs
+ *  The number of worker threads, 0 to omit it for serial batches.
+ */
+void tpm2_batch_output(const tpm2_batch_stats *stats, const char *items,
+        unsigned jobs);
+
+#endif /* LIB_TPM2_BATCH_H_ */
@@ -0,0 +1,224 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <string.h>
+
+#include "tpm2_codec.h"
+
+#define CODEC_INVALID 0xff
+#define CODEC_SPACE   0xfe
+#define CODEC_PAD     0xfd
+
+static const char base64_alphabet[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/*
+ * The digit pairs of every byte, so that the encoding copies two characters
+ * per byte.
+ */
+#define DIGIT(n, a) ((n) < 10 ? '0' + (n) : (a) + (n) - 10)
+
+#define PAIR(b, a) { DIGIT((b) >> 4, a), DIGIT((b) & 0xf, a) }
+
+#define PAIR_ROW4(b, a) \
+    PAIR(b, a), PAIR((b) + 1, a), PAIR((b) + 2, a), PAIR((b) + 3, a)
+
+#define PAIR_ROW16(b, a) \
+    PAIR_ROW4(b, a), PAIR_ROW4((b) + 4, a), PAIR_ROW4((b) + 8, a), \
+    PAIR_ROW4((b) + 12, a)
+
+#define PAIR_TABLE(a) { \
+    PAIR_ROW16(0x00, a), PAIR_ROW16(0x10, a), PAIR_ROW16(0x20, a), \
+    PAIR_ROW16(0x30, a), PAIR_ROW16(0x40, a), PAIR_ROW16(0x50, a), \
+    PAIR_ROW16(0x60, a), PAIR_ROW16(0x70, a), PAIR_ROW16(0x80, a), \
+    PAIR_ROW16(0x90, a), PAIR_ROW16(0xa0, a), PAIR_ROW16(0xb0, a), \
+    PAIR_ROW16(0xc0, a), PAIR_ROW16(0xd0, a), PAIR_ROW16(0xe0, a), \
+    PAIR_ROW16(0xf0, a) }
+
+static const char hex_pairs[2][256][2] = {
+    PAIR_TABLE('a'),
+    PAIR_TABLE('A'),
+};
+
+/* the value of every hex digit, CODEC_INVALID for the other characters */
+#define NIBBLE_ROW(c) \
+    ((c) >= '0' && (c) <= '9' ? (c) - '0' : \
+     (c) >= 'a' && (c) <= 'f' ? (c) - 'a' + 10 : \
+     (c) >= 'A' && (c) <= 'F' ? (c) - 'A' + 10 : CODEC_INVALID)
+
+#define NIBBLE_ROW4(c) \
+    NIBBLE_ROW(c), NIBBLE_ROW((c) + 1), NIBBLE_ROW((c) + 2), \
+    NIBBLE_ROW((c) + 3)
+
+#define NIBBLE_ROW16(c) \
+    NIBBLE_ROW4(c), NIBBLE_ROW4((c) + 4), NIBBLE_ROW4((c) + 8), \
+    NIBBLE_ROW4((c) + 12)
+
+static const BYTE hex_values[256] = {
+    NIBBLE_ROW16(0x00), NIBBLE_ROW16(0x10), NIBBLE_ROW16(0x20),
+    NIBBLE_ROW16(0x30), NIBBLE_ROW16(0x40), NIBBLE_ROW16(0x50),
+    NIBBLE_ROW16(0x60), NIBBLE_ROW16(0x70), NIBBLE_ROW16(0x80),
+    NIBBLE_ROW16(0x90), NIBBLE_ROW16(0xa0), NIBBLE_ROW16(0xb0),
+    NIBBLE_ROW16(0xc0), NIBBLE_ROW16(0xd0), NIBBLE_ROW16(0xe0),
+    NIBBLE_ROW16(0xf0),
+};
+
+/*
+ * The value of every base64 character, CODEC_PAD for the padding and
+ * CODEC_SPACE for the white space which is skipped
+ */
+#define SEXTET_ROW(c) \
+    ((c) >= 'A' && (c) <= 'Z' ? (c) - 'A' : \
+     (c) >= 'a' && (c) <= 'z' ? (c) - 'a' + 26 : \
+     (c) >= '0' && (c) <= '9' ? (c) - '0' + 52 : \
+     (c) == '+' ? 62 : (c) == '/' ? 63 : (c) == '=' ? CODEC_PAD : \
+     (c) == ' ' || (c) == '\t' || (c) == '\r' || (c) == '\n' ? CODEC_SPACE : \
+     CODEC_INVALID)
+
+#define SEXTET_ROW4(c) \
+    SEXTET_ROW(c), SEXTET_ROW((c) + 1), SEXTET_ROW((c) + 2), \
+    SEXTET_ROW((c) + 3)
+
+#define SEXTET_ROW16(c) \
+    SEXTET_ROW4(c), SEXTET_ROW4((c) + 4), SEXTET_ROW4((c) + 8), \
+    SEXTET_ROW4((c) + 12)
+
+static const BYTE base64_values[256] = {
+    SEXTET_ROW16(0x00), SEXTET_ROW16(0x10), SEXTET_ROW16(0x20),
+    SEXTET_ROW16(0x30), SEXTET_ROW16(0x40), SEXTET_ROW16(0x50),
+    SEXTET_ROW16(0x60), SEXTET_ROW16(0x70), SEXTET_ROW16(0x80),
+    SEXTET_ROW16(0x90), SEXTET_ROW16(0xa0), SEXTET_ROW16(0xb0),
+    SEXTET_ROW16(0xc0), SEXTET_ROW16(0xd0), SEXTET_ROW16(0xe0),
+    SEXTET_ROW16(0xf0),
+};
+
+size_t tpm2_codec_hex_encode(const BYTE *data, size_t size, char *hex,
+        bool is_upper) {
+
+    const char (*pairs)[2] = hex_pairs[is_upper];
+    size_t i;
+    for (i = 0; i < size; i++) {
+        memcpy(&hex[i * 2], pairs[data[i]], 2);
+    }
+    hex[size * 2] = '\0';
+
+    return size * 2;
+}
+
+bool tpm2_codec_hex_decode(const char *hex, size_t length, BYTE *data) {
+
+    if (length % 2) {
+        return false;
+    }
+
+    const unsigned char *digits = (const unsigned char *) hex;
+    size_t i;
+    for (i = 0; i < length / 2; i++) {
+        BYTE high = hex_values[digits[i * 2]];
+        BYTE low = hex_values[digits[i * 2 + 1]];
+        /* an invalid digit has the high bits set */
+        if ((high | low) & 0xf0) {
+            return false;
+        }
+        data[i] = high << 4 | low;
+    }
+
+    return true;
+}
+
+size_t tpm2_codec_base64_encode(const BYTE *data, size_t size, char *base64) {
+
+    char *out = base64;
+    size_t i;
+    for (i = 0; i + 3 <= size; i += 3) {
+        UINT32 bits = data[i] << 16 | data[i + 1] << 8 | data[i + 2];
+        out[0] = base64_alphabet[bits >> 18];
+        out[1] = base64_alphabet[(bits >> 12) & 0x3f];
+        out[2] = base64_alphabet[(bits >> 6) & 0x3f];
+        out[3] = base64_alphabet[bits & 0x3f];
+        out += 4;
+    }
+
+    size_t left = size - i;
+    if (left) {
+        UINT32 bits = data[i] << 16 | (left == 2 ? data[i + 1] << 8 : 0);
+        out[0] = base64_alphabet[bits >> 18];
+        out[1] = base64_alphabet[(bits >> 12) & 0x3f];
+        out[2] = left == 2 ? base64_alphabet[(bits >> 6) & 0x3f] : '=';
+        out[3] = '=';
+        out += 4;
+    }
+    *out = '\0';
+
+    return out - base64;
+}
+
+bool tpm2_codec_base64_decode(const char *base64, size_t length, BYTE *data,
+        size_t *size) {
+
+    const unsigned char *in = (const unsigned char *) base64;
+    size_t capacity = *size;
+    size_t written = 0;
+    UINT32 bits = 0;
+    unsigned sextets = 0;
+    unsigned pads = 0;
+
+    size_t i;
+    for (i = 0; i < length; i++) {
+        BYTE value = base64_values[in[i]];
+        if (value == CODEC_SPACE) {
+            continue;
+        }
+
+        if (value == CODEC_INVALID) {
+            return false;
+        }
+
+        if (value == CODEC_PAD) {
+            /* at most two pads, completing the last quantum */
+            if (sextets < 2 || ++pads + sextets > 4) {
+                return false;
+            }
+            continue;
+        }
+
+        /* nothing but padding and white space after a pad */
+        if (pads) {
+            return false;
+        }
+
+        bits = bits << 6 | value;
+        if (++sextets < 4) {
+            continue;
+        }
+
+        if (capacity - written < 3) {
+            return false;
+        }
+        data[written++] = bits >> 16;
+        data[written++] = bits >> 8;
+        data[written++] = bits;
+        bits = 0;
+        sextets = 0;
+    }
+
+    /* a quantum of two or three sextets, padded or not */
+    if (sextets == 1 || (pads && sextets + pads != 4)) {
+        return false;
+    }
+
+    if (sextets) {
+        size_t count = sextets - 1;
+        if (capacity - written < count) {
+            return false;
+        }
+        bits <<= 6 * (4 - sextets);
+        data[written++] = bits >> 16;
+        if (count == 2) {
+            data[written++] = bits >> 8;
+        }
+    }
+
+    *size = written;
+
+    return true;
+}
@@ -0,0 +1,88 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef LIB_TPM2_CODEC_H_
+#define LIB_TPM2_CODEC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+/*
+ * Hex and base64 encoders and decoders working on whole buffers through
+ * lookup tables, for the printing and parsing paths handling large blobs
+ * such as event logs and NV indices.
+ */
+
+/*
+ * The size of the hex encoding of size bytes, without the terminating NUL.
+ */
+#define TPM2_CODEC_HEX_SIZE(size) ((size) * 2)
+
+/*
+ * The size of the unwrapped base64 encoding of size bytes, padding included,
+ * without the terminating NUL.
+ */
+#define TPM2_CODEC_BASE64_SIZE(size) ((((size) + 2) / 3) * 4)
+
+/**
+ * Encodes bytes as hex.
+ * @param data
+ *  The bytes to encode.
+ * @param size
+ *  The number of bytes to encode.
+ * @param hex
+ *  The encoding, NUL terminated, of TPM2_CODEC_HEX_SIZE(size) + 1 bytes.
+ * @param is_upper
+ *  true for upper case digits, false for lower case digits.
+ * @return
+ *  The length of the encoding.
+ */
+size_t tpm2_codec_hex_encode(const BYTE *data, size_t size, char *hex,
+        bool is_upper);
+
+/**
+ * Decodes hex digits of either case.
+ * @param hex
+ *  The hex digits, not necessarily NUL terminated.
+ * @param length
+ *  The number of hex digits, even.
+ * @param data
+ *  The bytes decoded, of length / 2 bytes, partially written on error.
+ * @return
+ *  true on success, false for an odd length or a character which is not a
+ *  hex digit.
+ */
+bool tpm2_codec_hex_decode(const char *hex, size_t length, BYTE *data);
+
+/**
+ * Encodes bytes as base64, padded and without line breaks.
+ * @param data
+ *  The bytes to encode.
+ * @param size
+ *  The number of bytes to encode.
+ * @param base64
+ *  The encoding, NUL terminated, of TPM2_CODEC_BASE64_SIZE(size) + 1 bytes.
+ * @return
+ *  The length of the encoding.
+ */
+size_t tpm2_codec_base64_encode(const BYTE *data, size_t size, char *base64);
+
+/**
+ * Decodes padded base64, skipping white space such as the line breaks of
+ * PEM.
+ * @param base64
+ *  The base64 characters, not necessarily NUL terminated.
+ * @param length
+ *  The number of base64 characters.
+ * @param data
+ *  The bytes decoded.
+ * @param size
+ *  On input, the size of data. On output, the number of bytes decoded.
+ * @return
+ *  true on success, false for malformed base64 or a too small buffer.
+ */
+bool tpm2_codec_base64_decode(const char *base64, size_t length, BYTE *data,
+        size_t *size);
+
+#endif /* LIB_TPM2_CODEC_H_ */
@@ -14,6 +14,7 @@
 #include "files.h"
 #include "log.h"
 #include "tpm2_alg_util.h"
+#include "tpm2_codec.h"
 #include "tpm2_convert.h"
 #include "tpm2_openssl.h"
 
@@ -662,66 +663,27 @@ out:
 
 bool tpm2_base64_encode(BYTE *buffer, size_t buffer_length, char *base64) {
 
-    unsigned char out[1024];
-    int outl;
-
-    EVP_ENCODE_CTX *ctx = EVP_ENCODE_CTX_new();
-    EVP_EncodeInit(ctx);
-
-#if defined(LIB_TPM2_OPENSSL_OPENSSL_PRE11)
-    EVP_EncodeUpdate(ctx, out, &outl, buffer, buffer_length);
-#else
-    int rc = EVP_EncodeUpdate(ctx, out, &outl, buffer, buffer_length);
-    if(rc < 0) {
-        LOG_ERR("EVP_DecodeUpdate failed with %d\n", rc);
-        EVP_ENCODE_CTX_free(ctx);
-        return false;
+    /* lines of 64 characters, each ending with a line feed, as PEM */
+    *base64 = '\0';
+    while (buffer_length) {
+        size_t chunk = buffer_length < 48 ? buffer_length : 48;
+        base64 += tpm2_codec_base64_encode(buffer, chunk, base64);
+        *base64++ = '\n';
+        *base64 = '\0';
+        buffer += chunk;
+        buffer_length -= chunk;
     }
-#endif
-
-    EVP_EncodeFinal(ctx, out, &outl); // no return value
-
-    EVP_ENCODE_CTX_free(ctx);
-
-    strcpy(base64, (char*) out);
 
     return true;
 }
 
 bool tpm2_base64_decode(char *base64, BYTE *buffer, size_t *buffer_length) {
 
-    bool is_base64_bufferlen_valid = strlen(base64) > 1024 ? false : true;
-    if (!is_base64_bufferlen_valid) {
-        return false;
+    bool result = tpm2_codec_base64_decode(base64, strlen(base64), buffer,
+            buffer_length);
+    if (!result) {
+        LOG_ERR("Invalid base64 or buffer too small");
     }
 
-    unsigned char base64u[1024];
-    memcpy(base64u, base64, strlen(base64));
-
-    EVP_ENCODE_CTX *ctx = EVP_ENCODE_CTX_new();
-    EVP_DecodeInit(ctx);
-    unsigned char out[1024];
-    int outl;
-    int rc = EVP_DecodeUpdate(ctx, out, &outl, base64u, strlen(base64));
-    if(rc < 0) {
-        LOG_ERR("EVP_DecodeUpdate failed with %d\n", rc);
-        EVP_ENCODE_CTX_free(ctx);
-        return false;
-    }
-
-    *buffer_length = outl;
-
-    rc = EVP_DecodeFinal(ctx, out, &outl);
-    if(rc < 0) {
-        LOG_ERR("EVP_DecodeFinal failed with %d\n", rc);
-        EVP_ENCODE_CTX_free(ctx);
-        return false;
-    }
-
-    EVP_ENCODE_CTX_free(ctx);
-
-    *buffer_length += outl;
-    memcpy(buffer, out, *buffer_length);
-
-    return true;
+    return result;
 }
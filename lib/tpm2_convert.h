@@ -143,7 +143,8 @@ bool tpm2_public_load_pkey(const char *path, EVP_PKEY **pkey);
  * @param buffer_length:
  *  The length of the binary buffer.
  * @param base64
- *  The resulting Base64-encoded String.
+ *  The resulting Base64-encoded String, in lines of 64 characters each ending
+ *  with a line feed.
  * @return
  *  true on success, false on error.
  */
@@ -156,7 +157,8 @@ bool tpm2_base64_encode(BYTE *buffer, size_t buffer_length, char *base64);
  * @param buffer
  *  The resulting binary buffer, valid on success.
  * @param buffer_length:
- *  The length of the resulting binary buffer, valid on success.
+ *  On input, the size of the binary buffer. On output, the length of the
+ *  resulting binary buffer, valid on success.
  * @return
  *  true on success, false on error.
  */
@@ -1,4 +1,6 @@
+#include <endian.h>
 #include <inttypes.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -9,6 +11,7 @@
 #include "tpm2_alg_util.h"
 #include "tpm2_eventlog.h"
 #include "tpm2_openssl.h"
+#include "tpm2_pcr_banks.h"
 
 bool digest2_accumulator_callback(TCG_DIGEST2 const *digest, size_t size,
                                   void *data){
@@ -24,13 +27,11 @@ bool digest2_accumulator_callback(TCG_DIGEST2 const *digest, size_t size,
     return true;
 }
 /*
- * Invoke callback function for each TCG_DIGEST2 structure in the provided
- * TCG_EVENT_HEADER2. The callback function is only invoked if this function
- * is first able to determine that the provided buffer is large enough to
- * hold the digest. The size of the digest is passed to the callback in the
- * 'size' parameter.
+ * Walks the TCG_DIGEST2 structures of an event, extending the PCR banks of
+ * the context when it has some, and invokes the digest callback.
  */
-bool foreach_digest2(tpm2_eventlog_context *ctx, unsigned pcr_index, TCG_DIGEST2 const *digest, size_t count, size_t size) {
+static bool walk_digest2(tpm2_eventlog_context *ctx, unsigned pcr_index,
+        TCG_DIGEST2 const *digest, size_t count, size_t size) {
 
     if (digest == NULL) {
         LOG_ERR("digest cannot be NULL");
@@ -60,29 +61,13 @@ bool foreach_digest2(tpm2_eventlog_context *ctx, unsigned pcr_index, TCG_DIGEST2
             return false;
         }
 
-        uint8_t *pcr = NULL;
-        if (alg == TPM2_ALG_SHA1) {
-            pcr = ctx->sha1_pcrs[pcr_index];
-            ctx->sha1_used |= (1 << pcr_index);
-        } else if (alg == TPM2_ALG_SHA256) {
-            pcr = ctx->sha256_pcrs[pcr_index];
-            ctx->sha256_used |= (1 << pcr_index);
-        } else if (alg == TPM2_ALG_SHA384) {
-            pcr = ctx->sha384_pcrs[pcr_index];
-            ctx->sha384_used |= (1 << pcr_index);
-        } else if (alg == TPM2_ALG_SHA512) {
-            pcr = ctx->sha512_pcrs[pcr_index];
-            ctx->sha512_used |= (1 << pcr_index);
-        } else if (alg == TPM2_ALG_SM3_256) {
-            pcr = ctx->sm3_256_pcrs[pcr_index];
-            ctx->sm3_256_used |= (1 << pcr_index);
-        } else {
+        if (!ctx->banks) {
+            /* only walking the digests */
+        } else if (!alg_size) {
             LOG_WARN("PCR%d algorithm %d unsupported", pcr_index, alg);
-        }
-
-        if (pcr && !tpm2_openssl_pcr_extend(alg, pcr, digest->Digest, alg_size)) {
-            LOG_ERR("PCR%d extend failed", pcr_index);
-            return false;
+        } else if (!tpm2_pcr_banks_extend(ctx->banks, alg, pcr_index,
+                digest->Digest)) {
+            LOG_WARN("PCR%d algorithm %d not replayed", pcr_index, alg);
         }
 
         if (ctx->digest2_cb != NULL) {
@@ -100,6 +85,94 @@ bool foreach_digest2(tpm2_eventlog_context *ctx, unsigned pcr_index, TCG_DIGEST2
     return ret;
 }
 
+/*
+ * Invoke callback function for each TCG_DIGEST2 structure in the provided
+ * TCG_EVENT_HEADER2. The callback function is only invoked if this function
+ * is first able to determine that the provided buffer is large enough to
+ * hold the digest. The size of the digest is passed to the callback in the
+ * 'size' parameter.
+ */
+bool foreach_digest2(tpm2_eventlog_context *ctx, unsigned pcr_index, TCG_DIGEST2 const *digest, size_t count, size_t size) {
+
+    return walk_digest2(ctx, pcr_index, digest, count, size);
+}
+
+void tpm2_eventlog_query_init(tpm2_eventlog_query *query) {
+
+    memset(query, 0, sizeof(*query));
+    query->last = SIZE_MAX;
+}
+
+/*
+ * Matches the fields of an event header common to both log formats.
+ */
+static bool query_match_header(const tpm2_eventlog_query *query,
+        size_t eventnum, UINT32 pcr_index, UINT32 type) {
+
+    if (eventnum < query->first || eventnum > query->last) {
+        return false;
+    }
+
+    if (query->pcrs && (pcr_index >= sizeof(query->pcrs) * 8 ||
+            !(query->pcrs & (1u << pcr_index)))) {
+        return false;
+    }
+
+    if (!query->type_count) {
+        return true;
+    }
+
+    size_t i;
+    for (i = 0; i < query->type_count; i++) {
+        if (query->types[i] == type) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Matches a crypto agile event from its header alone, its digests having
+ * been checked to fit the log by parse_event2().
+ */
+static bool query_match_event2(const tpm2_eventlog_query *query,
+        size_t eventnum, TCG_EVENT_HEADER2 const *eventhdr) {
+
+    if (!query_match_header(query, eventnum, eventhdr->PCRIndex,
+            eventhdr->EventType)) {
+        return false;
+    }
+
+    if (!query->digest.size) {
+        return true;
+    }
+
+    TCG_DIGEST2 const *digest = eventhdr->Digests;
+    UINT32 i;
+    for (i = 0; i < eventhdr->DigestCount; i++) {
+        size_t alg_size = tpm2_alg_util_get_hash_size(digest->AlgorithmId);
+        if (alg_size == query->digest.size &&
+            !memcmp(digest->Digest, query->digest.buffer, alg_size)) {
+            return true;
+        }
+        digest = (TCG_DIGEST2*)((uintptr_t)digest->Digest + alg_size);
+    }
+
+    return false;
+}
+
+static bool query_match_sha1_log_event(const tpm2_eventlog_query *query,
+        size_t eventnum, TCG_EVENT const *eventhdr) {
+
+    return query_match_header(query, eventnum, eventhdr->pcrIndex,
+            eventhdr->eventType) &&
+        (!query->digest.size ||
+            (query->digest.size == sizeof(eventhdr->digest) &&
+             !memcmp(eventhdr->digest, query->digest.buffer,
+                     sizeof(eventhdr->digest))));
+}
+
 /*
  * given the provided event type, parse event to ensure the structure / data
  * in the buffer doesn't exceed the buffer size
@@ -179,9 +252,9 @@ bool parse_event2(TCG_EVENT_HEADER2 const *eventhdr, size_t buf_size,
         .data = digests_size,
         .digest2_cb = digest2_accumulator_callback,
     };
-    ret = foreach_digest2(&ctx, eventhdr->PCRIndex,
-                          eventhdr->Digests, eventhdr->DigestCount,
-                          buf_size - sizeof(*eventhdr));
+    ret = walk_digest2(&ctx, eventhdr->PCRIndex,
+                       eventhdr->Digests, eventhdr->DigestCount,
+                       buf_size - sizeof(*eventhdr));
     if (ret != true) {
         return false;
     }
@@ -206,8 +279,6 @@ bool parse_event2(TCG_EVENT_HEADER2 const *eventhdr, size_t buf_size,
 bool parse_sha1_log_event(tpm2_eventlog_context *ctx, TCG_EVENT const *event, size_t size,
                       size_t *event_size) {
 
-    uint8_t *pcr = NULL;
-
     /* enough size for the 1.2 event structure */
     if (size < sizeof(*event)) {
         LOG_ERR("insufficient size for SpecID event header");
@@ -215,10 +286,10 @@ bool parse_sha1_log_event(tpm2_eventlog_context *ctx, TCG_EVENT const *event, si
     }
     *event_size = sizeof(*event);
 
-    pcr = ctx->sha1_pcrs[ event->pcrIndex];
-    if (pcr) {
-        tpm2_openssl_pcr_extend(TPM2_ALG_SHA1, pcr, &event->digest[0], 20);
-        ctx->sha1_used |= (1 << event->pcrIndex);
+    if (ctx->banks && !tpm2_pcr_banks_extend(ctx->banks, TPM2_ALG_SHA1,
+            event->pcrIndex, event->digest)) {
+        LOG_WARN("PCR%d algorithm %d not replayed", event->pcrIndex,
+                TPM2_ALG_SHA1);
     }
 
     /* buffer size must be sufficient to hold event and event data */
@@ -244,18 +315,24 @@ bool foreach_sha1_log_event(tpm2_eventlog_context *ctx, TCG_EVENT const *eventhd
 
     TCG_EVENT const *eventhdr;
     size_t event_size;
+    size_t eventnum;
     bool ret;
 
-    for (eventhdr = eventhdr_start, event_size = 0;
+    for (eventhdr = eventhdr_start, event_size = 0, eventnum = 0;
          size > 0;
          eventhdr = (TCG_EVENT*)((uintptr_t)eventhdr + event_size),
-         size -= event_size) {
+         size -= event_size, eventnum++) {
 
         ret = parse_sha1_log_event(ctx, eventhdr, size, &event_size);
         if (!ret) {
             return ret;
         }
 
+        if (ctx->query && !query_match_sha1_log_event(ctx->query, eventnum,
+                eventhdr)) {
+            continue;
+        }
+
         TCG_EVENT2 *event = (TCG_EVENT2*)((uintptr_t)&eventhdr->eventDataSize);
 
         /* event header callback */
@@ -284,41 +361,80 @@ bool foreach_sha1_log_event(tpm2_eventlog_context *ctx, TCG_EVENT const *eventhd
     return true;
 }
 
+/*
+ * Hashes data with the algorithm of every digest of an event in one batch,
+ * and flags the digests matching the data.
+ */
+static bool digests_match(tpm2_openssl_hasher *hasher,
+        TCG_EVENT_HEADER2 const *eventhdr, const BYTE *data, size_t length,
+        bool *matches) {
+
+    BYTE calc_digests[TPM2_NUM_PCR_BANKS][sizeof(TPMU_HA)];
+    tpm2_openssl_hash_msg msgs[TPM2_NUM_PCR_BANKS];
+
+    TCG_DIGEST2 const *digest = eventhdr->Digests;
+    UINT32 i;
+    for (i = 0; i < eventhdr->DigestCount; i++) {
+        TPMI_ALG_HASH alg = digest->AlgorithmId;
+        msgs[i] = (tpm2_openssl_hash_msg) {
+            .halg = alg,
+            .data = data,
+            .length = length,
+            .digest = calc_digests[i]
+        };
+        digest = (TCG_DIGEST2*)((uintptr_t)digest->Digest +
+                tpm2_alg_util_get_hash_size(alg));
+    }
+
+    if (!tpm2_openssl_hash_batch(hasher, msgs, eventhdr->DigestCount)) {
+        return false;
+    }
+
+    digest = eventhdr->Digests;
+    for (i = 0; i < eventhdr->DigestCount; i++) {
+        size_t alg_size = tpm2_alg_util_get_hash_size(digest->AlgorithmId);
+        matches[i] = !memcmp(calc_digests[i], digest->Digest, alg_size);
+        digest = (TCG_DIGEST2*)((uintptr_t)digest->Digest + alg_size);
+    }
+
+    return true;
+}
+
 /*
  * For event types where digest can be verified from their event payload,
  * perform verification to ensure event payload was not tempered
  */
-bool verify_digests(size_t eventnum, TCG_EVENT_HEADER2 const *eventhdr, TCG_EVENT2 *event) {
+bool verify_digests(tpm2_openssl_hasher *hasher, size_t eventnum,
+        TCG_EVENT_HEADER2 const *eventhdr, TCG_EVENT2 *event) {
 
 size_t i;
 
-    TCG_DIGEST2 const *digest = eventhdr->Digests;
     UINT32 digest_count = eventhdr->DigestCount;
     UINT32 event_type = eventhdr->EventType;
+    bool matches[TPM2_NUM_PCR_BANKS];
+    bool matches_nul[TPM2_NUM_PCR_BANKS];
+    if (digest_count > TPM2_NUM_PCR_BANKS) {
+        LOG_WARN("Event %zu has too many digests to verify", eventnum - 1);
+        return false;
+    }
+
     switch (event_type) {
     /* Digests of these event types are calculated directly from event->Event, thus can be verified  */
     case EV_S_CRTM_VERSION:
     case EV_SEPARATOR:
     case EV_EFI_VARIABLE_DRIVER_CONFIG:
     case EV_EFI_GPT_EVENT:
-        for (i = 0; i < digest_count; i++) {
-            TPMI_ALG_HASH alg = digest->AlgorithmId;
-            TPM2B_DIGEST calc_digest;
-
-            bool result = tpm2_openssl_hash_compute_data(alg, event->Event,
-            event->EventSize, &calc_digest);
-            if (!result) {
-                LOG_WARN("Event %zu: Cannot calculate hash value from data", eventnum - 1);
-                return false;
-            }
+        if (!digests_match(hasher, eventhdr, event->Event, event->EventSize,
+                matches)) {
+            LOG_WARN("Event %zu: Cannot calculate hash value from data", eventnum - 1);
+            return false;
+        }
 
-            size_t alg_size = tpm2_alg_util_get_hash_size(alg);
-            if (memcmp(calc_digest.buffer, digest->Digest, alg_size) != 0) {
+        for (i = 0; i < digest_count; i++) {
+            if (!matches[i]) {
                 LOG_WARN("Event %zu's digest does not match its payload", eventnum - 1);
                 return false;
             }
-
-            digest = (TCG_DIGEST2*)((uintptr_t)digest->Digest + alg_size);
         }
         break;
 
@@ -342,47 +458,49 @@ size_t i;
             return false;
         }
 
+        if (!digest_count) {
+            break;
+        }
+
         /* Digest is applied on the string between "^[a-zA-Z_]+:? " and EOL,
          * including or excluding the trailing NULL character */
-        for (i = 0; i < digest_count; i++) {
-            size_t j;
+        size_t j;
+        for (j = 0; j < event->EventSize; j++) {
+            if (event->Event[j] == ' ')
+                break;
+        }
 
-            for (j = 0; j < event->EventSize; j++) {
-                if (event->Event[j] == ' ')
-                    break;
-            }
+        if (j + 1 >= event->EventSize || event->Event[event->EventSize - 1] != '\0') {
+            LOG_WARN("Event %zu's event data is in unexpected format", eventnum - 1);
+            return false;
+        }
 
-            if (j + 1 >= event->EventSize || event->Event[event->EventSize - 1] != '\0') {
-                LOG_WARN("Event %zu's event data is in unexpected format", eventnum - 1);
-                return false;
+        /* First try to calculate the hash excluding the trailing \0 */
+        if (!digests_match(hasher, eventhdr, event->Event + (j + 1),
+                event->EventSize - (j + 2), matches)) {
+            LOG_WARN("Event %zu: Cannot calculate hash value from data", eventnum - 1);
+            return false;
+        }
+
+        bool is_nul_tried = false;
+        for (i = 0; i < digest_count; i++) {
+            if (matches[i]) {
+                continue;
             }
 
-            TPM2B_DIGEST calc_digest;
-            TPMI_ALG_HASH alg = digest->AlgorithmId;
-            /* First try to calculate the hash excluding the trailing \0 */
-            bool result = tpm2_openssl_hash_compute_data(alg,
-            event->Event + (j + 1), event->EventSize - (j + 2), &calc_digest);
-            if (!result) {
+            /* Next try to calculate the hash including the trailing \0 */
+            if (!is_nul_tried && !digests_match(hasher, eventhdr,
+                    event->Event + (j + 1), event->EventSize - (j + 1),
+                    matches_nul)) {
                 LOG_WARN("Event %zu: Cannot calculate hash value from data", eventnum - 1);
                 return false;
             }
+            is_nul_tried = true;
 
-            size_t alg_size = tpm2_alg_util_get_hash_size(alg);
-            if (memcmp(calc_digest.buffer, digest->Digest, alg_size) != 0) {
-                /* Next try to calculate the hash including the trailing \0 */
-                bool result = tpm2_openssl_hash_compute_data(alg,
-                event->Event + (j + 1), event->EventSize - (j + 1), &calc_digest);
-                if (!result) {
-                    LOG_WARN("Event %zu: Cannot calculate hash value from data", eventnum - 1);
-                    return false;
-                }
-
-                if (memcmp(calc_digest.buffer, digest->Digest, alg_size) != 0) {
-                    LOG_WARN("Event %zu's digest does not match its payload", eventnum - 1);
-                    return false;
-                }
+            if (!matches_nul[i]) {
+                LOG_WARN("Event %zu's digest does not match its payload", eventnum - 1);
+                return false;
             }
-            digest = (TCG_DIGEST2*)((uintptr_t)digest->Digest + alg_size);
         }
         break;
     }
@@ -402,12 +520,14 @@ bool foreach_event2(tpm2_eventlog_context *ctx, TCG_EVENT_HEADER2 const *eventhd
 
     TCG_EVENT_HEADER2 const *eventhdr;
     size_t event_size;
+    size_t eventnum;
     bool ret;
 
-    for (eventhdr = eventhdr_start, event_size = 0;
+    /* the Spec ID event preceding the crypto agile events is event 0 */
+    for (eventhdr = eventhdr_start, event_size = 0, eventnum = 1;
          size > 0;
          eventhdr = (TCG_EVENT_HEADER2*)((uintptr_t)eventhdr + event_size),
-         size -= event_size) {
+         size -= event_size, eventnum++) {
 
         size_t digests_size = 0;
 
@@ -416,6 +536,22 @@ bool foreach_event2(tpm2_eventlog_context *ctx, TCG_EVENT_HEADER2 const *eventhd
             return ret;
         }
 
+        if (ctx->query && !query_match_event2(ctx->query, eventnum,
+                eventhdr)) {
+            /* the PCRs are replayed all the same */
+            tpm2_eventlog_context replay = { .banks = ctx->banks };
+            if (ctx->banks && !walk_digest2(&replay, eventhdr->PCRIndex,
+                    eventhdr->Digests, eventhdr->DigestCount, digests_size)) {
+                return false;
+            }
+
+            if (ctx->event2skip_cb != NULL &&
+                !ctx->event2skip_cb(eventhdr, event_size, ctx->data)) {
+                return false;
+            }
+            continue;
+        }
+
         TCG_EVENT2 *event = (TCG_EVENT2*)((uintptr_t)eventhdr->Digests + digests_size);
 
         /* event header callback */
@@ -439,7 +575,8 @@ bool foreach_event2(tpm2_eventlog_context *ctx, TCG_EVENT_HEADER2 const *eventhd
 
         /* digest verification */
         if (ctx->data != 0) {
-            verify_digests(*(size_t*)ctx->data, eventhdr, event);
+            verify_digests(ctx->hasher, *(size_t*)ctx->data, eventhdr,
+                    event);
         }
 
         /* event data callback */
@@ -533,7 +670,8 @@ bool specid_event(TCG_EVENT const *event, size_t size,
     return true;
 }
 
-bool parse_eventlog(tpm2_eventlog_context *ctx, BYTE const *eventlog, size_t size) {
+static bool parse_events(tpm2_eventlog_context *ctx, BYTE const *eventlog,
+        size_t size) {
 
     if(!eventlog) {
         return false;
@@ -553,8 +691,14 @@ bool parse_eventlog(tpm2_eventlog_context *ctx, BYTE const *eventlog, size_t siz
 
         size -= (uintptr_t)next - (uintptr_t)eventlog;
 
-        if (ctx->specid_cb) {
-            ret = ctx->specid_cb(event, ctx->data);
+        /* the Spec ID event is event 0 of the query */
+        SPECID_CALLBACK cb = ctx->specid_cb;
+        if (ctx->query && !query_match_sha1_log_event(ctx->query, 0, event)) {
+            cb = ctx->specidskip_cb;
+        }
+
+        if (cb) {
+            ret = cb(event, ctx->data);
             if (!ret) {
                 return false;
             }
@@ -566,3 +710,111 @@ bool parse_eventlog(tpm2_eventlog_context *ctx, BYTE const *eventlog, size_t siz
     /* No specid event found. sha1 log format will be parsed. */
     return foreach_sha1_log_event(ctx, event, size);
 }
+
+bool parse_eventlog(tpm2_eventlog_context *ctx, BYTE const *eventlog, size_t size) {
+
+    /* without a hasher, every digest gets its own hash context */
+    bool is_own_hasher = !ctx->hasher;
+    if (is_own_hasher) {
+        ctx->hasher = tpm2_openssl_hasher_new();
+    }
+
+    bool result = parse_events(ctx, eventlog, size);
+
+    if (is_own_hasher) {
+        tpm2_openssl_hasher_free(ctx->hasher);
+        ctx->hasher = NULL;
+    }
+
+    return result;
+}
+
+bool tpm2_eventlog_write_specid(FILE *f, const TPMI_ALG_HASH *algs,
+        UINT32 count) {
+
+    static const BYTE signature[16] = "Spec ID Event03";
+
+    if (!count || count > TPM2_NUM_PCR_BANKS) {
+        LOG_ERR("Invalid number of event log algorithms, got: %"PRIu32, count);
+        return false;
+    }
+
+    BYTE buffer[sizeof(TCG_EVENT) + sizeof(TCG_SPECID_EVENT) +
+                sizeof(TCG_SPECID_ALG) * TPM2_NUM_PCR_BANKS +
+                sizeof(TCG_VENDOR_INFO)] = { 0 };
+
+    TCG_EVENT *event = (TCG_EVENT *)buffer;
+    TCG_SPECID_EVENT *specid = (TCG_SPECID_EVENT *)event->event;
+
+    UINT32 event_size = sizeof(*specid) + sizeof(TCG_SPECID_ALG) * count +
+            sizeof(TCG_VENDOR_INFO);
+    event->pcrIndex = 0;
+    event->eventType = htole32(EV_NO_ACTION);
+    event->eventDataSize = htole32(event_size);
+
+    memcpy(specid->Signature, signature, sizeof(signature));
+    specid->specVersionMajor = 2;
+    /* UINTN is 64 bits */
+    specid->uintnSize = 2;
+    specid->numberOfAlgorithms = htole32(count);
+
+    UINT32 i;
+    for (i = 0; i < count; i++) {
+        UINT16 size = tpm2_alg_util_get_hash_size(algs[i]);
+        if (!size) {
+            LOG_ERR("Unknown event log algorithm, got: 0x%x", algs[i]);
+            return false;
+        }
+        specid->digestSizes[i].algorithmId = htole16(algs[i]);
+        specid->digestSizes[i].digestSize = htole16(size);
+    }
+    /* the TCG_VENDOR_INFO that follows is left empty */
+
+    size_t size = sizeof(*event) + event_size;
+    if (fwrite(buffer, 1, size, f) != size) {
+        LOG_ERR("Could not write event log header");
+        return false;
+    }
+
+    return true;
+}
+
+bool tpm2_eventlog_write_event2(FILE *f, UINT32 pcr, UINT32 type,
+        const TPML_DIGEST_VALUES *digests, const BYTE *data, UINT32 data_size) {
+
+    BYTE buffer[sizeof(TCG_EVENT_HEADER2) + sizeof(TPML_DIGEST_VALUES) +
+                sizeof(TCG_EVENT2)];
+
+    TCG_EVENT_HEADER2 *header = (TCG_EVENT_HEADER2 *)buffer;
+    header->PCRIndex = htole32(pcr);
+    header->EventType = htole32(type);
+    header->DigestCount = htole32(digests->count);
+
+    size_t offset = sizeof(*header);
+    UINT32 i;
+    for (i = 0; i < digests->count; i++) {
+        const TPMT_HA *digest = &digests->digests[i];
+        UINT16 size = tpm2_alg_util_get_hash_size(digest->hashAlg);
+        if (!size) {
+            LOG_ERR("Unknown event log algorithm, got: 0x%x", digest->hashAlg);
+            return false;
+        }
+
+        TCG_DIGEST2 *digest2 = (TCG_DIGEST2 *)&buffer[offset];
+        digest2->AlgorithmId = htole16(digest->hashAlg);
+        memcpy(digest2->Digest, &digest->digest, size);
+        offset += sizeof(*digest2) + size;
+    }
+
+    TCG_EVENT2 *event = (TCG_EVENT2 *)&buffer[offset];
+    event->EventSize = htole32(data_size);
+    offset += sizeof(*event);
+
+    if (fwrite(buffer, 1, offset, f) != offset ||
+        fwrite(data, 1, data_size, f) != data_size) {
+        LOG_ERR("Could not write event log entry");
+        return false;
+    }
+
+    return true;
+}
@@ -3,6 +3,7 @@
 #define TPM2_EVENTLOG_H
 
 #include <stdbool.h>
+#include <stdio.h>
 #include <stdlib.h>
 
 #include <tss2/tss2_tpm2_types.h>
@@ -19,6 +20,26 @@ typedef bool (*SPECID_CALLBACK)(TCG_EVENT const *event, void *data);
 typedef bool (*LOG_EVENT_CALLBACK)(TCG_EVENT const *event_hdr, size_t size,
                                    void *data);
 
+#define TPM2_EVENTLOG_QUERY_MAX_TYPES 16
+
+/*
+ * Selects events from their header, the events selected matching every
+ * criterion. The bodies of the other events are skipped without being
+ * parsed, verified or handed to the callbacks.
+ */
+typedef struct tpm2_eventlog_query tpm2_eventlog_query;
+struct tpm2_eventlog_query {
+    /* bitmap of the PCR indices, any PCR when 0 */
+    UINT32 pcrs;
+    /* the event types, any type when type_count is 0 */
+    UINT32 types[TPM2_EVENTLOG_QUERY_MAX_TYPES];
+    size_t type_count;
+    /* the inclusive range of event numbers, the Spec ID event being 0 */
+    size_t first;
+    size_t last;
+    /* a digest of the event in any bank, any digest when empty */
+    TPM2B_DIGEST digest;
+};
 
 typedef struct {
     void *data;
@@ -27,17 +48,19 @@ typedef struct {
     EVENT2_CALLBACK event2hdr_cb;
     DIGEST2_CALLBACK digest2_cb;
     EVENT2DATA_CALLBACK event2_cb;
-    uint32_t sha1_used;
-    uint32_t sha256_used;
-    uint32_t sha384_used;
-    uint32_t sha512_used;
-    uint32_t sm3_256_used;
-    uint8_t sha1_pcrs[TPM2_MAX_PCRS][TPM2_SHA1_DIGEST_SIZE];
-    uint8_t sha256_pcrs[TPM2_MAX_PCRS][TPM2_SHA256_DIGEST_SIZE];
-    uint8_t sha384_pcrs[TPM2_MAX_PCRS][TPM2_SHA384_DIGEST_SIZE];
-    uint8_t sha512_pcrs[TPM2_MAX_PCRS][TPM2_SHA512_DIGEST_SIZE];
-    uint8_t sm3_256_pcrs[TPM2_MAX_PCRS][TPM2_SM3_256_DIGEST_SIZE];
+    /* the PCR banks the events are replayed into, set up by the caller, no
+     * replay when NULL */
+    struct tpm2_pcr_banks *banks;
     uint32_t eventlog_version;
+    /* the hash contexts of the payload verification, set up by
+     * parse_eventlog() when NULL */
+    struct tpm2_openssl_hasher *hasher;
+    /* the events to parse, every event when NULL */
+    const tpm2_eventlog_query *query;
+    /* invoked for the crypto agile events the query skips */
+    EVENT2_CALLBACK event2skip_cb;
+    /* invoked for the Spec ID event when the query skips it */
+    SPECID_CALLBACK specidskip_cb;
 } tpm2_eventlog_context;
 
 bool digest2_accumulator_callback(TCG_DIGEST2 const *digest, size_t size,
@@ -51,5 +74,48 @@ bool parse_event2(TCG_EVENT_HEADER2 const *eventhdr, size_t buf_size,
 bool foreach_event2(tpm2_eventlog_context *ctx, TCG_EVENT_HEADER2 const *eventhdr_start, size_t size);
 bool specid_event(TCG_EVENT const *event, size_t size, TCG_EVENT_HEADER2 **next);
 bool parse_eventlog(tpm2_eventlog_context *ctx, BYTE const *eventlog, size_t size);
+bool verify_digests(struct tpm2_openssl_hasher *hasher, size_t eventnum,
+        TCG_EVENT_HEADER2 const *eventhdr, TCG_EVENT2 *event);
+
+/**
+ * Initializes a query selecting every event, to narrow down.
+ * @param query
+ *  The query to initialize.
+ */
+void tpm2_eventlog_query_init(tpm2_eventlog_query *query);
+
+/**
+ * Writes the Spec ID event starting a crypto agile TCG event log.
+ * @param f
+ *  The file to write to.
+ * @param algs
+ *  The hash algorithms of the events in the log.
+ * @param count
+ *  The number of algorithms.
+ * @return
+ *  true on success, false otherwise.
+ */
+bool tpm2_eventlog_write_specid(FILE *f, const TPMI_ALG_HASH *algs,
+        UINT32 count);
+
+/**
+ * Writes a crypto agile TCG_PCR_EVENT2 entry to an event log.
+ * @param f
+ *  The file to write to.
+ * @param pcr
+ *  The PCR index the event was extended to.
+ * @param type
+ *  The event type.
+ * @param digests
+ *  The digests extended to the PCR.
+ * @param data
+ *  The event data.
+ * @param data_size
+ *  The size of the event data.
+ * @return
+ *  true on success, false otherwise.
+ */
+bool tpm2_eventlog_write_event2(FILE *f, UINT32 pcr, UINT32 type,
+        const TPML_DIGEST_VALUES *digests, const BYTE *data, UINT32 data_size);
 
 #endif
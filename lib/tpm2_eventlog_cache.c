@@ -0,0 +1,381 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "files.h"
+#include "log.h"
+#include "tpm2_codec.h"
+#include "tpm2_eventlog.h"
+#include "tpm2_eventlog_cache.h"
+#include "tpm2_openssl.h"
+
+#define EVENTLOG_CACHE_VERSION 1
+#define EVENTLOG_CACHE_SUFFIX ".banks"
+/* temporary entries older than this were left by a crashed writer */
+#define EVENTLOG_CACHE_STALE_SECONDS 3600
+
+struct tpm2_eventlog_cache {
+    char *dir;
+    UINT64 max_size;
+    /* updated by the threads sharing the cache */
+    size_t hits;
+    size_t misses;
+    /*
+     * The size of the entries as of the last scan of the directory plus the
+     * size of the entries saved since, those of other processes excluded.
+     */
+    UINT64 size;
+    bool is_evicting;
+};
+
+typedef struct eventlog_cache_file eventlog_cache_file;
+struct eventlog_cache_file {
+    char *name;
+    off_t size;
+    struct timespec mtime;
+};
+
+static void evict(tpm2_eventlog_cache *cache);
+
+tpm2_eventlog_cache *tpm2_eventlog_cache_open(const char *dir,
+        UINT64 max_size) {
+
+    if (mkdir(dir, 0700) && errno != EEXIST) {
+        LOG_ERR("Could not create event log cache \"%s\": %s", dir,
+                strerror(errno));
+        return NULL;
+    }
+
+    struct stat st;
+    if (stat(dir, &st) || !S_ISDIR(st.st_mode)) {
+        LOG_ERR("Event log cache \"%s\" is not a directory", dir);
+        return NULL;
+    }
+
+    tpm2_eventlog_cache *cache = calloc(1, sizeof(*cache));
+    if (!cache) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+
+    cache->dir = strdup(dir);
+    if (!cache->dir) {
+        LOG_ERR("oom");
+        free(cache);
+        return NULL;
+    }
+
+    cache->max_size = max_size;
+
+    evict(cache);
+
+    return cache;
+}
+
+void tpm2_eventlog_cache_close(tpm2_eventlog_cache *cache) {
+
+    if (!cache) {
+        return;
+    }
+
+    free(cache->dir);
+    free(cache);
+}
+
+void tpm2_eventlog_cache_stats(const tpm2_eventlog_cache *cache,
+        size_t *hits, size_t *misses) {
+
+    *hits = __atomic_load_n(&cache->hits, __ATOMIC_RELAXED);
+    *misses = __atomic_load_n(&cache->misses, __ATOMIC_RELAXED);
+}
+
+static tpm2_pcr_banks *replay(const BYTE *eventlog, size_t size) {
+
+    tpm2_eventlog_context ctx = {
+        .banks = tpm2_pcr_banks_new(TPM2_MAX_PCRS),
+    };
+    if (!ctx.banks) {
+        return NULL;
+    }
+
+    if (!parse_eventlog(&ctx, eventlog, size)) {
+        tpm2_pcr_banks_free(ctx.banks);
+        return NULL;
+    }
+
+    return ctx.banks;
+}
+
+/*
+ * Entries are named after the SHA256 of the log, the replay depending on
+ * nothing else.
+ */
+static bool entry_path(const tpm2_eventlog_cache *cache, const BYTE *eventlog,
+        size_t size, char path[PATH_MAX]) {
+
+    BYTE digest[TPM2_SHA256_DIGEST_SIZE];
+    tpm2_openssl_hash_msg msg = {
+        .halg = TPM2_ALG_SHA256,
+        .data = eventlog,
+        .length = size,
+        .digest = digest
+    };
+    if (!tpm2_openssl_hash_batch(NULL, &msg, 1)) {
+        return false;
+    }
+
+    char hex[TPM2_CODEC_HEX_SIZE(sizeof(digest)) + 1];
+    tpm2_codec_hex_encode(digest, sizeof(digest), hex, false);
+
+    int written = snprintf(path, PATH_MAX, "%s/%s" EVENTLOG_CACHE_SUFFIX,
+            cache->dir, hex);
+    if (written < 0 || written >= PATH_MAX) {
+        LOG_ERR("Event log cache path too long");
+        return false;
+    }
+
+    return true;
+}
+
+static tpm2_pcr_banks *entry_load(const char *path) {
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        /* a miss is not an error, the log is replayed instead */
+        return NULL;
+    }
+
+    tpm2_pcr_banks *banks = NULL;
+    UINT32 version;
+    if (files_read_header(f, &version) && version == EVENTLOG_CACHE_VERSION) {
+        banks = tpm2_pcr_banks_load(f);
+    }
+    fclose(f);
+
+    if (!banks) {
+        LOG_WARN("Ignoring invalid event log cache entry \"%s\"", path);
+        return NULL;
+    }
+
+    /* the modification time orders the entries for the eviction */
+    if (utimensat(AT_FDCWD, path, NULL, 0)) {
+        LOG_WARN("Could not touch event log cache entry \"%s\": %s", path,
+                strerror(errno));
+    }
+
+    return banks;
+}
+
+/*
+ * Returns the size of the entry saved, 0 if it could not be saved.
+ */
+static UINT64 entry_save(const char *path, const tpm2_pcr_banks *banks) {
+
+    /*
+     * Write to a temporary file and rename it in place so that the threads
+     * and processes sharing a cache never observe partial entries.
+     */
+    char tmp_path[PATH_MAX];
+    int written = snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX", path);
+    if (written < 0 || (size_t)written >= sizeof(tmp_path)) {
+        return 0;
+    }
+
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        LOG_WARN("Could not create event log cache entry \"%s\": %s", path,
+                strerror(errno));
+        return 0;
+    }
+
+    FILE *f = fdopen(fd, "wb");
+    if (!f) {
+        close(fd);
+        unlink(tmp_path);
+        return 0;
+    }
+
+    bool result = files_write_header(f, EVENTLOG_CACHE_VERSION)
+            && tpm2_pcr_banks_save(banks, f);
+    long size = result ? ftell(f) : -1;
+    result = !fclose(f) && result && size > 0;
+    if (!result || rename(tmp_path, path) != 0) {
+        LOG_WARN("Could not save event log cache entry \"%s\"", path);
+        unlink(tmp_path);
+        return 0;
+    }
+
+    return (UINT64) size;
+}
+
+static int file_compare(const void *a, const void *b) {
+
+    const eventlog_cache_file *fa = (const eventlog_cache_file *) a;
+    const eventlog_cache_file *fb = (const eventlog_cache_file *) b;
+
+    if (fa->mtime.tv_sec != fb->mtime.tv_sec) {
+        return fa->mtime.tv_sec < fb->mtime.tv_sec ? -1 : 1;
+    }
+
+    if (fa->mtime.tv_nsec != fb->mtime.tv_nsec) {
+        return fa->mtime.tv_nsec < fb->mtime.tv_nsec ? -1 : 1;
+    }
+
+    return 0;
+}
+
+/*
+ * Whether a file is the temporary entry of a writer gone for long.
+ */
+static bool is_stale_tmp(const char *name, const struct stat *st, time_t now) {
+
+    /* named after the entry by entry_save() */
+    static const char tmp_suffix[] = EVENTLOG_CACHE_SUFFIX ".XXXXXX";
+
+    const char *suffix = strstr(name, EVENTLOG_CACHE_SUFFIX ".");
+
+    return suffix && strlen(suffix) == sizeof(tmp_suffix) - 1 &&
+            st->st_mtim.tv_sec + EVENTLOG_CACHE_STALE_SECONDS < now;
+}
+
+/*
+ * Scans the directory, removing the stale temporary entries and the least
+ * recently used entries until the cache fits its maximum size, and sets the
+ * size of the cache. Entries another thread or process removed first are
+ * skipped.
+ */
+static void evict(tpm2_eventlog_cache *cache) {
+
+    DIR *dir = opendir(cache->dir);
+    if (!dir) {
+        LOG_WARN("Could not open event log cache \"%s\": %s", cache->dir,
+                strerror(errno));
+        return;
+    }
+
+    eventlog_cache_file *files = NULL;
+    size_t count = 0;
+    size_t capacity = 0;
+    UINT64 total = 0;
+    time_t now = time(NULL);
+
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        struct stat st;
+        if (fstatat(dirfd(dir), entry->d_name, &st, 0) ||
+            !S_ISREG(st.st_mode)) {
+            continue;
+        }
+
+        if (is_stale_tmp(entry->d_name, &st, now)) {
+            if (unlinkat(dirfd(dir), entry->d_name, 0) && errno != ENOENT) {
+                LOG_WARN("Could not remove event log cache temporary entry "
+                        "\"%s\": %s", entry->d_name, strerror(errno));
+            }
+            continue;
+        }
+
+        size_t length = strlen(entry->d_name);
+        size_t suffix_length = sizeof(EVENTLOG_CACHE_SUFFIX) - 1;
+        if (length <= suffix_length || strcmp(entry->d_name + length -
+                suffix_length, EVENTLOG_CACHE_SUFFIX)) {
+            continue;
+        }
+
+        if (count == capacity) {
+            capacity = capacity ? 2 * capacity : 64;
+            eventlog_cache_file *tmp = realloc(files,
+                    capacity * sizeof(*files));
+            if (!tmp) {
+                LOG_ERR("oom");
+                goto out;
+            }
+            files = tmp;
+        }
+
+        files[count].name = strdup(entry->d_name);
+        if (!files[count].name) {
+            LOG_ERR("oom");
+            goto out;
+        }
+        files[count].size = st.st_size;
+        files[count].mtime = st.st_mtim;
+        total += st.st_size;
+        count++;
+    }
+
+    if (total <= cache->max_size) {
+        goto out;
+    }
+
+    qsort(files, count, sizeof(*files), file_compare);
+
+    size_t i;
+    for (i = 0; i < count && total > cache->max_size; i++) {
+        if (unlinkat(dirfd(dir), files[i].name, 0) && errno != ENOENT) {
+            LOG_WARN("Could not evict event log cache entry \"%s\": %s",
+                    files[i].name, strerror(errno));
+            continue;
+        }
+        total -= files[i].size;
+    }
+
+out:
+    __atomic_store_n(&cache->size, total, __ATOMIC_RELAXED);
+    for (i = 0; i < count; i++) {
+        free(files[i].name);
+    }
+    free(files);
+    closedir(dir);
+}
+
+tpm2_pcr_banks *tpm2_eventlog_cache_replay(tpm2_eventlog_cache *cache,
+        const BYTE *eventlog, size_t size) {
+
+    if (!cache) {
+        return replay(eventlog, size);
+    }
+
+    char path[PATH_MAX];
+    if (!entry_path(cache, eventlog, size, path)) {
+        return NULL;
+    }
+
+    tpm2_pcr_banks *banks = entry_load(path);
+    if (banks) {
+        __atomic_add_fetch(&cache->hits, 1, __ATOMIC_RELAXED);
+        return banks;
+    }
+
+    __atomic_add_fetch(&cache->misses, 1, __ATOMIC_RELAXED);
+
+    /* logs which fail to replay are not cached, their errors are reported
+     * every time */
+    banks = replay(eventlog, size);
+    if (!banks) {
+        return NULL;
+    }
+
+    /*
+     * The directory is only scanned once the entries may exceed the maximum
+     * size, by one thread at a time.
+     */
+    UINT64 total = __atomic_add_fetch(&cache->size, entry_save(path, banks),
+            __ATOMIC_RELAXED);
+    if (total > cache->max_size &&
+        !__atomic_test_and_set(&cache->is_evicting, __ATOMIC_ACQUIRE)) {
+        evict(cache);
+        __atomic_clear(&cache->is_evicting, __ATOMIC_RELEASE);
+    }
+
+    return banks;
+}
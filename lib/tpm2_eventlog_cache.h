@@ -0,0 +1,74 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef LIB_TPM2_EVENTLOG_CACHE_H_
+#define LIB_TPM2_EVENTLOG_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+#include "tpm2_pcr_banks.h"
+
+/*
+ * A directory caching the PCR banks replayed from event logs, by the SHA-256
+ * digest of the log, so a log seen before is verified without being parsed.
+ * The least recently used entries are evicted to keep the directory under a
+ * maximum size, the directory being scanned when the cache is opened and
+ * when the entries saved since may exceed it. The entries are written
+ * atomically, so a cache is safe to share between threads and processes.
+ */
+typedef struct tpm2_eventlog_cache tpm2_eventlog_cache;
+
+/*
+ * The default maximum size of a cache.
+ */
+#define TPM2_EVENTLOG_CACHE_DEFAULT_SIZE (64 * 1024 * 1024)
+
+/**
+ * Opens a cache, creating its directory if needed.
+ * @param dir
+ *  The directory of the cache.
+ * @param max_size
+ *  The size the entries of the cache are kept under, in bytes.
+ * @return
+ *  The cache, to close with tpm2_eventlog_cache_close(), NULL on error.
+ */
+tpm2_eventlog_cache *tpm2_eventlog_cache_open(const char *dir,
+        UINT64 max_size);
+
+/**
+ * Closes a cache opened with tpm2_eventlog_cache_open().
+ * @param cache
+ *  The cache to close, may be NULL.
+ */
+void tpm2_eventlog_cache_close(tpm2_eventlog_cache *cache);
+
+/**
+ * Replays an event log into PCR banks, from the cache when it holds the log
+ * and into the cache otherwise.
+ * @param cache
+ *  The cache, NULL to always replay the log.
+ * @param eventlog
+ *  The event log.
+ * @param size
+ *  The size of the event log.
+ * @return
+ *  The PCR banks, to free with tpm2_pcr_banks_free(), NULL on error.
+ */
+tpm2_pcr_banks *tpm2_eventlog_cache_replay(tpm2_eventlog_cache *cache,
+        const BYTE *eventlog, size_t size);
+
+/**
+ * Retrieves the number of logs replayed from the cache and parsed.
+ * @param cache
+ *  The cache.
+ * @param hits
+ *  The number of logs replayed from the cache.
+ * @param misses
+ *  The number of logs parsed.
+ */
+void tpm2_eventlog_cache_stats(const tpm2_eventlog_cache *cache,
+        size_t *hits, size_t *misses);
+
+#endif /* LIB_TPM2_EVENTLOG_CACHE_H_ */
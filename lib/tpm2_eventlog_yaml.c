@@ -4,6 +4,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <uchar.h>
 
 #include <tss2/tss2_tpm2_types.h>
@@ -11,8 +12,10 @@
 #include "log.h"
 #include "efi_event.h"
 #include "tpm2_alg_util.h"
+#include "tpm2_codec.h"
 #include "tpm2_eventlog.h"
 #include "tpm2_eventlog_yaml.h"
+#include "tpm2_pcr_banks.h"
 #include "tpm2_tool.h"
 #include "tpm2_tool_output.h"
 
@@ -96,14 +99,35 @@ char const *eventtype_to_string (UINT32 event_type) {
         return "Unknown event type";
     }
 }
-void bytes_to_str(uint8_t const *buf, size_t size, char *dest, size_t dest_size) {
 
-    size_t i, j;
+bool eventtype_from_string(char const *str, UINT32 *event_type) {
+
+    /* the names are the ones eventtype_to_string() knows of */
+    static const UINT32 ranges[][2] = {
+        { EV_PREBOOT_CERT, EV_OMIT_BOOT_DEVICE_EVENTS },
+        { EV_EFI_VARIABLE_DRIVER_CONFIG, EV_EFI_HANDOFF_TABLES },
+        { EV_EFI_VARIABLE_AUTHORITY, EV_EFI_VARIABLE_AUTHORITY },
+    };
 
-    for(i = 0, j = 0; i < size && j < dest_size - 2; ++i, j+=2) {
-        sprintf(&dest[j], "%02x", buf[i]);
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(ranges); i++) {
+        UINT32 type;
+        for (type = ranges[i][0]; type <= ranges[i][1]; type++) {
+            if (!strcasecmp(str, eventtype_to_string(type))) {
+                *event_type = type;
+                return true;
+            }
+        }
     }
-    dest[j] = '\0';
+
+    return tpm2_util_string_to_uint32(str, event_type);
+}
+void bytes_to_str(uint8_t const *buf, size_t size, char *dest, size_t dest_size) {
+
+    /* as many bytes as fit, the rest is truncated */
+    size_t fit = (dest_size - 1) / 2;
+
+    tpm2_codec_hex_encode(buf, size < fit ? size : fit, dest, false);
 }
 void yaml_event2hdr(TCG_EVENT_HEADER2 const *eventhdr, size_t size) {
 
@@ -773,6 +797,27 @@ bool yaml_event2hdr_callback(TCG_EVENT_HEADER2 const *eventhdr, size_t size,
 
     return true;
 }
+static bool yaml_event2skip_callback(TCG_EVENT_HEADER2 const *eventhdr,
+        size_t size, void *data_in) {
+
+    (void)eventhdr;
+    (void)size;
+
+    /* keep the numbers of the events printed those of the log */
+    size_t *count = (size_t*)data_in;
+    (*count)++;
+
+    return true;
+}
+static bool yaml_specidskip_callback(TCG_EVENT const *event, void *data) {
+
+    (void)event;
+
+    size_t *count = (size_t*)data;
+    (*count)++;
+
+    return true;
+}
 bool yaml_sha1_log_eventhdr_callback(TCG_EVENT const *eventhdr, size_t size,
                                      void *data_in) {
 
@@ -878,69 +923,47 @@ bool yaml_specid_callback(TCG_EVENT const *event, void *data) {
     return yaml_specid_event(event, count);
 }
 
-static void yaml_eventlog_pcrs(tpm2_eventlog_context *ctx) {
+static void yaml_eventlog_pcrs(const tpm2_pcr_banks *banks) {
+
+    static const struct {
+        TPMI_ALG_HASH alg;
+        const char *name;
+    } bank_names[] = {
+        { TPM2_ALG_SHA1, "sha1" },
+        { TPM2_ALG_SHA256, "sha256" },
+        { TPM2_ALG_SHA384, "sha384" },
+        { TPM2_ALG_SHA512, "sha512" },
+        { TPM2_ALG_SM3_256, "sm3_256" },
+    };
 
     char hexstr[DIGEST_HEX_STRING_MAX] = { 0, };
 
     tpm2_tool_output("pcrs:\n");
 
-    if (ctx->sha1_used != 0) {
-        tpm2_tool_output("  sha1:\n");
+    for (size_t b = 0; b < ARRAY_LEN(bank_names); b++) {
+        TPMI_ALG_HASH alg = bank_names[b].alg;
+        bool is_bank_used = false;
         for(unsigned i = 0 ; i < TPM2_MAX_PCRS ; i++) {
-            if ((ctx->sha1_used & (1 << i)) == 0)
+            if (!tpm2_pcr_banks_is_extended(banks, alg, i))
                 continue;
-            bytes_to_str(ctx->sha1_pcrs[i], sizeof(ctx->sha1_pcrs[i]),
-                hexstr, sizeof(hexstr));
-            tpm2_tool_output("    %-2d : 0x%s\n", i, hexstr);
-        }
-    }
-
-    if (ctx->sha256_used != 0) {
-        tpm2_tool_output("  sha256:\n");
-        for(unsigned i = 0 ; i < TPM2_MAX_PCRS ; i++) {
-            if ((ctx->sha256_used & (1 << i)) == 0)
-                continue;
-            bytes_to_str(ctx->sha256_pcrs[i], sizeof(ctx->sha256_pcrs[i]),
-                hexstr, sizeof(hexstr));
-            tpm2_tool_output("    %-2d : 0x%s\n", i, hexstr);
-        }
-    }
-
-    if (ctx->sha384_used != 0) {
-        tpm2_tool_output("  sha384:\n");
-        for(unsigned i = 0 ; i < TPM2_MAX_PCRS ; i++) {
-            if ((ctx->sha384_used & (1 << i)) == 0)
-                continue;
-            bytes_to_str(ctx->sha384_pcrs[i], sizeof(ctx->sha384_pcrs[i]),
-                hexstr, sizeof(hexstr));
+            if (!is_bank_used) {
+                tpm2_tool_output("  %s:\n", bank_names[b].name);
+                is_bank_used = true;
+            }
+            bytes_to_str(tpm2_pcr_banks_value(banks, alg, i),
+                tpm2_alg_util_get_hash_size(alg), hexstr, sizeof(hexstr));
             tpm2_tool_output("    %-2d : 0x%s\n", i, hexstr);
         }
     }
+}
 
-    if (ctx->sha512_used != 0) {
-        tpm2_tool_output("  sha512:\n");
-        for(unsigned i = 0 ; i < TPM2_MAX_PCRS ; i++) {
-            if ((ctx->sha512_used & (1 << i)) == 0)
-                continue;
-            bytes_to_str(ctx->sha512_pcrs[i], sizeof(ctx->sha512_pcrs[i]),
-                hexstr, sizeof(hexstr));
-            tpm2_tool_output("    %-2d : 0x%s\n", i, hexstr);
-        }
-    }
+bool yaml_eventlog(UINT8 const *eventlog, size_t size, uint32_t eventlog_version) {
 
-    if (ctx->sm3_256_used != 0) {
-        tpm2_tool_output("  sm3_256:\n");
-        for(unsigned i = 0 ; i < TPM2_MAX_PCRS ; i++) {
-            if ((ctx->sm3_256_used & (1 << i)) == 0)
-                continue;
-            bytes_to_str(ctx->sm3_256_pcrs[i], sizeof(ctx->sm3_256_pcrs[i]),
-                hexstr, sizeof(hexstr));
-            tpm2_tool_output("    %-2d : 0x%s\n", i, hexstr);
-        }
-    }
+    return yaml_eventlog_query(eventlog, size, eventlog_version, NULL);
 }
 
-bool yaml_eventlog(UINT8 const *eventlog, size_t size, uint32_t eventlog_version) {
+bool yaml_eventlog_query(UINT8 const *eventlog, size_t size,
+        uint32_t eventlog_version, const tpm2_eventlog_query *query) {
 
     if (eventlog_version < MIN_EVLOG_YAML_VERSION || 
         eventlog_version > MAX_EVLOG_YAML_VERSION) {
@@ -957,16 +980,27 @@ bool yaml_eventlog(UINT8 const *eventlog, size_t size, uint32_t eventlog_version
         .digest2_cb = yaml_digest2_callback,
         .event2_cb = yaml_event2data_callback,
         .eventlog_version = eventlog_version,
+        .query = query,
+        .event2skip_cb = yaml_event2skip_callback,
+        .specidskip_cb = yaml_specidskip_callback,
     };
 
+    /* the PCR values replayed are those of the whole log, not of a query */
+    if (!query) {
+        ctx.banks = tpm2_pcr_banks_new(TPM2_MAX_PCRS);
+        if (!ctx.banks) {
+            return false;
+        }
+    }
+
     tpm2_tool_output("---\n");
     tpm2_tool_output("version: %u\n", eventlog_version);
     tpm2_tool_output("events:\n");
     bool rc = parse_eventlog(&ctx, eventlog, size);
-    if (!rc) {
-        return rc;
+    if (rc && ctx.banks) {
+        yaml_eventlog_pcrs(ctx.banks);
     }
 
-    yaml_eventlog_pcrs(&ctx);
-    return true;
+    tpm2_pcr_banks_free(ctx.banks);
+    return rc;
 }
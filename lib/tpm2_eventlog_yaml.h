@@ -12,6 +12,7 @@
 #define MAX_EVLOG_YAML_VERSION 2
 
 char const *eventtype_to_string (UINT32 event_type);
+bool eventtype_from_string(char const *str, UINT32 *event_type);
 void yaml_event2hdr(TCG_EVENT_HEADER2 const *event_hdr, size_t size);
 bool yaml_digest2(TCG_DIGEST2 const *digest, size_t size);
 bool yaml_event2data(TCG_EVENT2 const *event, UINT32 type, uint32_t eventlog_version);
@@ -23,4 +24,21 @@ bool yaml_event2data_callback(TCG_EVENT2 const *event, UINT32 type, void *data,
 
 bool yaml_eventlog(UINT8 const *eventlog, size_t size, uint32_t eventlog_version);
 
+/**
+ * Prints the events of a log a query selects, the bodies of the other events
+ * are not decoded.
+ * @param eventlog
+ *  The event log.
+ * @param size
+ *  The size of the event log.
+ * @param eventlog_version
+ *  The version of the YAML output.
+ * @param query
+ *  The query, NULL for every event and the PCR values replayed from the log.
+ * @return
+ *  true on success, false otherwise.
+ */
+bool yaml_eventlog_query(UINT8 const *eventlog, size_t size,
+        uint32_t eventlog_version, const tpm2_eventlog_query *query);
+
 #endif
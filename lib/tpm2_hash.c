@@ -9,106 +9,178 @@
 #include "tpm2.h"
 #include "tpm2_hash.h"
 
-static tool_rc tpm2_hash_common(ESYS_CONTEXT *ectx, TPMI_ALG_HASH halg,
-        TPMI_RH_HIERARCHY hierarchy, FILE *infilep, BYTE *inbuffer,
-        UINT16 inbuffer_len, TPM2B_DIGEST **result,
-        TPMT_TK_HASHCHECK **validation) {
-    bool use_left = true, done;
-    unsigned long left = inbuffer_len;
-    size_t bytes_read;
-    TPM2B_AUTH null_auth = TPM2B_EMPTY_INIT;
-    TPMI_DH_OBJECT sequence_handle;
-    TPM2B_MAX_BUFFER buffer;
+typedef struct hash_stream hash_stream;
+struct hash_stream {
+    FILE *input;
+    const BYTE *buffer;
+    size_t left;
+    bool is_eof;
+};
+
+static tool_rc hash_stream_read(hash_stream *stream, TPM2B_MAX_BUFFER *block) {
 
-    /*  if we're using infilep, get file size */
-    if (!!infilep) {
-        /* Suppress error reporting with NULL path */
-        use_left = files_get_file_size(infilep, &left, NULL);
+    size_t size = BUFFER_SIZE(typeof(*block), buffer);
+
+    if (!stream->input) {
+        if (size > stream->left) {
+            size = stream->left;
+        }
+        memcpy(block->buffer, stream->buffer, size);
+        stream->buffer += size;
+        stream->left -= size;
+        stream->is_eof = !stream->left;
+        block->size = size;
+        return tool_rc_success;
     }
 
-    /* if data length is non-zero (valid) and less than 1024, just do it in one
-     hash invocation */
-    if (use_left && left <= TPM2_MAX_DIGEST_BUFFER) {
-        buffer.size = left;
-        if (!!infilep) {
-            bool res = files_read_bytes(infilep, buffer.buffer, buffer.size);
-            if (!res) {
+    size_t bytes_read = fread(block->buffer, 1, size, stream->input);
+    if (ferror(stream->input)) {
+        LOG_ERR("Error reading from input file");
+        return tool_rc_general_error;
+    }
+
+    stream->is_eof = bytes_read < size || feof(stream->input);
+    if (!stream->is_eof) {
+        /*
+         * A full block may be the last one, as with input of exactly the
+         * block size, which must still take the one shot path.
+         */
+        int c = getc(stream->input);
+        if (c == EOF) {
+            if (ferror(stream->input)) {
+                LOG_ERR("Error reading from input file");
                 return tool_rc_general_error;
             }
+            stream->is_eof = true;
         } else {
-            memcpy(buffer.buffer, inbuffer, buffer.size);
+            ungetc(c, stream->input);
         }
-
-        return tpm2_hash(ectx, ESYS_TR_NONE, ESYS_TR_NONE, ESYS_TR_NONE,
-                &buffer, halg, hierarchy, result, validation);
     }
+    block->size = bytes_read;
+
+    return tool_rc_success;
+}
+
+tool_rc tpm2_hash_sequence_stream(ESYS_CONTEXT *ectx,
+        const tpm2_hash_sequence_ops *ops, void *userdata, FILE *input,
+        const BYTE *buffer, size_t length) {
+
+    hash_stream stream = {
+        .input = input,
+        .buffer = buffer,
+        .left = length,
+    };
+
     /*
-     * length is either unknown because the FILE * is a fifo, or it's too
-     * big to do in a single hash call. Based on the size figure out the
-     * chunks to loop over, if possible. This way we can call Complete with
-     * data.
+     * Reads are done one block ahead, so the end of the data is known
+     * without querying the input size, which also works for pipes. Input
+     * fitting a single block takes the one shot command when the backend
+     * has one.
      */
-    tool_rc rc = tpm2_hash_sequence_start(ectx, &null_auth, halg, &sequence_handle);
+    TPM2B_MAX_BUFFER blocks[2];
+    unsigned current = 0;
+    tool_rc rc = hash_stream_read(&stream, &blocks[current]);
     if (rc != tool_rc_success) {
         return rc;
     }
 
-    /* If we know the file size, we decrement the amount read and terminate
-     * the loop when 1 block is left, else we go till feof.
+    if (stream.is_eof && ops->oneshot) {
+        return ops->oneshot(ectx, userdata, &blocks[current]);
+    }
+
+    ESYS_TR sequence_handle;
+    ESYS_TR shandle1;
+    rc = ops->start(ectx, userdata, &sequence_handle, &shandle1);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    /*
+     * The update of a block is submitted before reading the next one into
+     * the other buffer, overlapping the file I/O with the TPM work.
      */
-    done = false;
-    while (!done) {
-        /*  if we're using infilep, read the file. Otherwise, directly
-         copy into our local buffer. */
-        buffer.size = BUFFER_SIZE(typeof(buffer), buffer);
-        if (!!infilep) {
-            bytes_read = fread(buffer.buffer, 1, buffer.size, infilep);
-            if (ferror(infilep)) {
-                LOG_ERR("Error reading from input file");
-                return tool_rc_general_error;
-            } else {
-                buffer.size = bytes_read;
-            }
-        } else {
-            memcpy(buffer.buffer, inbuffer, buffer.size);
-            inbuffer = inbuffer + buffer.size;
+    while (!stream.is_eof) {
+        rc = tpm2_sequence_update_async(ectx, sequence_handle, shandle1,
+                &blocks[current]);
+        if (rc != tool_rc_success) {
+            return rc;
         }
 
-        rc = tpm2_sequence_update(ectx, sequence_handle, &buffer);
+        tool_rc read_rc = hash_stream_read(&stream, &blocks[!current]);
+
+        rc = tpm2_sequence_update_finish(ectx);
         if (rc != tool_rc_success) {
             return rc;
         }
 
-        if (use_left) {
-            left -= buffer.size;
-            if (left <= TPM2_MAX_DIGEST_BUFFER) {
-                done = true;
-                continue;
-            }
-        } else if (!!infilep && feof(infilep)) {
-            done = true;
-        }
-    } /* end file read/hash update loop */
-
-    /*  if there is data left, get the last bit of data from the file or
-     buffer or set the size to zero */
-    if (use_left) {
-        buffer.size = left;
-        if (!!infilep) {
-            bool res = files_read_bytes(infilep, buffer.buffer, buffer.size);
-            if (!res) {
-                LOG_ERR("Error reading from input file.");
-                return tool_rc_general_error;
-            }
-        } else {
-            memcpy(buffer.buffer, inbuffer, buffer.size);
+        if (read_rc != tool_rc_success) {
+            return read_rc;
         }
-    } else {
-        buffer.size = 0;
+
+        current = !current;
     }
 
-    return tpm2_sequence_complete(ectx, sequence_handle,
-            &buffer, hierarchy, result, validation);
+    return ops->complete(ectx, userdata, sequence_handle, &blocks[current]);
+}
+
+typedef struct hash_sequence hash_sequence;
+struct hash_sequence {
+    TPMI_ALG_HASH halg;
+    TPMI_RH_HIERARCHY hierarchy;
+    TPM2B_DIGEST **result;
+    TPMT_TK_HASHCHECK **validation;
+};
+
+static tool_rc hash_oneshot(ESYS_CONTEXT *ectx, void *userdata,
+        const TPM2B_MAX_BUFFER *data) {
+
+    hash_sequence *seq = userdata;
+
+    return tpm2_hash(ectx, ESYS_TR_NONE, ESYS_TR_NONE, ESYS_TR_NONE, data,
+            seq->halg, seq->hierarchy, seq->result, seq->validation);
+}
+
+static tool_rc hash_start(ESYS_CONTEXT *ectx, void *userdata,
+        ESYS_TR *sequence_handle, ESYS_TR *shandle1) {
+
+    hash_sequence *seq = userdata;
+
+    TPM2B_AUTH null_auth = TPM2B_EMPTY_INIT;
+    *shandle1 = ESYS_TR_PASSWORD;
+
+    return tpm2_hash_sequence_start(ectx, &null_auth, seq->halg,
+            sequence_handle);
+}
+
+static tool_rc hash_complete(ESYS_CONTEXT *ectx, void *userdata,
+        ESYS_TR sequence_handle, const TPM2B_MAX_BUFFER *data) {
+
+    hash_sequence *seq = userdata;
+
+    return tpm2_sequence_complete(ectx, sequence_handle, data,
+            seq->hierarchy, seq->result, seq->validation);
+}
+
+static tool_rc tpm2_hash_common(ESYS_CONTEXT *ectx, TPMI_ALG_HASH halg,
+        TPMI_RH_HIERARCHY hierarchy, FILE *infilep, BYTE *inbuffer,
+        UINT16 inbuffer_len, TPM2B_DIGEST **result,
+        TPMT_TK_HASHCHECK **validation) {
+
+    static const tpm2_hash_sequence_ops ops = {
+        .oneshot = hash_oneshot,
+        .start = hash_start,
+        .complete = hash_complete,
+    };
+
+    hash_sequence seq = {
+        .halg = halg,
+        .hierarchy = hierarchy,
+        .result = result,
+        .validation = validation,
+    };
+
+    return tpm2_hash_sequence_stream(ectx, &ops, &seq, infilep, inbuffer,
+            inbuffer_len);
 }
 
 tool_rc tpm2_hash_compute_data(ESYS_CONTEXT *ectx, TPMI_ALG_HASH halg,
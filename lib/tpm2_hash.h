@@ -5,8 +5,37 @@
 
 #include <stdbool.h>
 
+#include <stdio.h>
+
 #include <tss2/tss2_esys.h>
 
+#include "tool_rc.h"
+
+/*
+ * A TPM sequence backend for tpm2_hash_sequence_stream(), ie a hash, HMAC or
+ * event sequence. The userdata is the one given to
+ * tpm2_hash_sequence_stream() and is where the backend keeps its results.
+ */
+typedef struct tpm2_hash_sequence_ops tpm2_hash_sequence_ops;
+struct tpm2_hash_sequence_ops {
+    /*
+     * Processes input fitting a single buffer with one command, NULL to
+     * always use a sequence.
+     */
+    tool_rc (*oneshot)(ESYS_CONTEXT *ectx, void *userdata,
+            const TPM2B_MAX_BUFFER *data);
+    /*
+     * Starts the sequence and returns the session authorizing its updates.
+     */
+    tool_rc (*start)(ESYS_CONTEXT *ectx, void *userdata,
+            ESYS_TR *sequence_handle, ESYS_TR *shandle1);
+    /*
+     * Completes the sequence with the last, possibly empty, buffer.
+     */
+    tool_rc (*complete)(ESYS_CONTEXT *ectx, void *userdata,
+            ESYS_TR sequence_handle, const TPM2B_MAX_BUFFER *data);
+};
+
 /**
  * Hashes a BYTE array via the tpm.
  * @param context
@@ -53,4 +82,28 @@ tool_rc tpm2_hash_file(ESYS_CONTEXT *ectx, TPMI_ALG_HASH halg,
         TPMI_RH_HIERARCHY hierarchy, FILE *input, TPM2B_DIGEST **result,
         TPMT_TK_HASHCHECK **validation);
 
+/**
+ * Streams a FILE * object or a BYTE array through a TPM sequence. Input is
+ * read one buffer ahead with the sequence updates submitted asynchronously,
+ * so reading the input overlaps with the TPM processing the previous
+ * buffer.
+ * @param ectx
+ *  The esapi context.
+ * @param ops
+ *  The sequence backend.
+ * @param userdata
+ *  The backend data.
+ * @param input
+ *  The FILE object to process, NULL to process buffer instead.
+ * @param buffer
+ *  The data to process when input is NULL.
+ * @param length
+ *  The length of the data.
+ * @return
+ *  A tool_rc indicating status.
+ */
+tool_rc tpm2_hash_sequence_stream(ESYS_CONTEXT *ectx,
+        const tpm2_hash_sequence_ops *ops, void *userdata, FILE *input,
+        const BYTE *buffer, size_t length);
+
 #endif /* SRC_TPM_HASH_H_ */
@@ -98,23 +98,61 @@ static TPM2_KEY_BITS get_pub_asym_key_bits(TPM2B_PUBLIC *public) {
     return 0;
 }
 
+struct tpm2_identity_util_seed_ctx {
+    TPM2B_PUBLIC parent_pub;
+    RSA *rsa; /* the parent's public key, RSA parents only */
+};
+
+/*
+ * Only the public operation is needed to encrypt the seed, so the key is
+ * built straight from the modulus and exponent of the TPM public.
+ */
+static RSA *rsa_from_tpm2_public(TPM2B_PUBLIC *public) {
+
+    TPMS_RSA_PARMS *parms = &public->publicArea.parameters.rsaDetail;
+    TPM2B_PUBLIC_KEY_RSA *modulus = &public->publicArea.unique.rsa;
+    UINT16 mod_size = parms->keyBits / 8;
+    if (!mod_size || modulus->size < mod_size) {
+        LOG_ERR("Invalid RSA public modulus, got %u bytes, expected %u",
+                modulus->size, mod_size);
+        return NULL;
+    }
+
+    RSA *rsa = RSA_new();
+    BIGNUM *n = BN_bin2bn(modulus->buffer, mod_size, NULL);
+    BIGNUM *e = BN_new();
+    if (!rsa || !n || !e) {
+        LOG_ERR("oom");
+        goto error;
+    }
+
+    /* an exponent of 0 means the default exponent */
+    int rc = BN_set_word(e, parms->exponent ? parms->exponent : RSA_F4);
+    if (rc != 1) {
+        LOG_ERR("BN_set_word failed\n");
+        goto error;
+    }
+
+    if (!RSA_set0_key(rsa, n, e, NULL)) {
+        LOG_ERR("RSA_set0_key failed\n");
+        goto error;
+    }
+
+    return rsa;
+
+error:
+    BN_free(n);
+    BN_free(e);
+    RSA_free(rsa);
+    return NULL;
+}
+
 static bool share_secret_with_tpm2_rsa_public_key(TPM2B_DIGEST *protection_seed,
-        TPM2B_PUBLIC *parent_pub, const unsigned char *label, int label_len,
-        TPM2B_ENCRYPTED_SECRET *encrypted_protection_seed) {
-    bool rval = false;
-    RSA *rsa = NULL;
+        TPM2B_PUBLIC *parent_pub, RSA *rsa, const unsigned char *label,
+        int label_len, TPM2B_ENCRYPTED_SECRET *encrypted_protection_seed) {
 
     // Public modulus (RSA-only!)
-    TPMI_RSA_KEY_BITS mod_size_bits =
-            parent_pub->publicArea.parameters.rsaDetail.keyBits;
-    UINT16 mod_size = mod_size_bits / 8;
-    TPM2B *pub_key_val = (TPM2B *) &parent_pub->publicArea.unique.rsa;
-    unsigned char *pub_modulus = malloc(mod_size);
-    if (pub_modulus == NULL) {
-        LOG_ERR("Failed to allocate memory to store public key's modulus.");
-        return false;
-    }
-    memcpy(pub_modulus, pub_key_val->buffer, mod_size);
+    UINT16 mod_size = parent_pub->publicArea.parameters.rsaDetail.keyBits / 8;
 
     TPMI_ALG_HASH parent_name_alg = parent_pub->publicArea.nameAlg;
 
@@ -125,7 +163,7 @@ static bool share_secret_with_tpm2_rsa_public_key(TPM2B_DIGEST *protection_seed,
     int return_code = RAND_bytes(protection_seed->buffer, protection_seed->size);
     if (return_code != 1) {
         LOG_ERR("Failed to get random bytes");
-        goto error;
+        return false;
     }
 
     /*
@@ -137,56 +175,19 @@ static bool share_secret_with_tpm2_rsa_public_key(TPM2B_DIGEST *protection_seed,
             tpm2_openssl_halg_from_tpmhalg(parent_name_alg), NULL);
     if (return_code != 1) {
         LOG_ERR("Failed RSA_padding_add_PKCS1_OAEP_mgf1\n");
-        goto error;
-    }
-    BIGNUM* bne = BN_new();
-    if (!bne) {
-        LOG_ERR("BN_new for bne failed\n");
-        goto error;
-    }
-    return_code = BN_set_word(bne, RSA_F4);
-    if (return_code != 1) {
-        LOG_ERR("BN_set_word failed\n");
-        BN_free(bne);
-        goto error;
-    }
-    rsa = RSA_new();
-    if (!rsa) {
-        LOG_ERR("RSA_new failed\n");
-        BN_free(bne);
-        goto error;
-    }
-    return_code = RSA_generate_key_ex(rsa, mod_size_bits, bne, NULL);
-    BN_free(bne);
-    if (return_code != 1) {
-        LOG_ERR("RSA_generate_key_ex failed\n");
-        goto error;
-    }
-    BIGNUM *n = BN_bin2bn(pub_modulus, mod_size, NULL);
-    if (n == NULL) {
-        LOG_ERR("BN_bin2bn failed\n");
-        goto error;
-    }
-    if (!RSA_set0_key(rsa, n, NULL, NULL)) {
-        LOG_ERR("RSA_set0_key failed\n");
-        BN_free(n);
-        goto error;
+        return false;
     }
+
     // Encrypting
     encrypted_protection_seed->size = mod_size;
     return_code = RSA_public_encrypt(mod_size, encoded,
             encrypted_protection_seed->secret, rsa, RSA_NO_PADDING);
     if (return_code < 0) {
         LOG_ERR("Failed RSA_public_encrypt\n");
-        goto error;
+        return false;
     }
 
-    rval = true;
-
-error:
-    free(pub_modulus);
-    RSA_free(rsa);
-    return rval;
+    return true;
 }
 
 bool tpm2_identity_util_calc_outer_integrity_hmac_key_and_dupsensitive_enc_key(
@@ -216,29 +217,77 @@ bool tpm2_identity_util_calc_outer_integrity_hmac_key_and_dupsensitive_enc_key(
     return true;
 }
 
+tpm2_identity_util_seed_ctx *tpm2_identity_util_seed_ctx_new(
+        TPM2B_PUBLIC *parent_pub) {
+
+    TPMI_ALG_PUBLIC alg = parent_pub->publicArea.type;
+    if (alg != TPM2_ALG_RSA && alg != TPM2_ALG_ECC) {
+        LOG_ERR("Cannot handle algorithm, got: %s",
+                tpm2_alg_util_algtostr(alg, tpm2_alg_util_flags_any));
+        return NULL;
+    }
+
+    tpm2_identity_util_seed_ctx *seed_ctx = calloc(1, sizeof(*seed_ctx));
+    if (!seed_ctx) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+
+    seed_ctx->parent_pub = *parent_pub;
+
+    if (alg == TPM2_ALG_RSA) {
+        seed_ctx->rsa = rsa_from_tpm2_public(parent_pub);
+        if (!seed_ctx->rsa) {
+            free(seed_ctx);
+            return NULL;
+        }
+    }
+
+    return seed_ctx;
+}
+
+bool tpm2_identity_util_seed_ctx_share_secret(
+        tpm2_identity_util_seed_ctx *seed_ctx, const unsigned char *label,
+        int label_len, TPM2B_DIGEST *protection_seed,
+        TPM2B_ENCRYPTED_SECRET *encrypted_protection_seed) {
+
+    if (seed_ctx->rsa) {
+        return share_secret_with_tpm2_rsa_public_key(protection_seed,
+                &seed_ctx->parent_pub, seed_ctx->rsa, label, label_len,
+                encrypted_protection_seed);
+    }
+
+    /* ECC secret sharing needs a new ephemeral key every time */
+    return ecdh_derive_seed_and_encrypted_seed(&seed_ctx->parent_pub,
+            label, label_len, protection_seed, encrypted_protection_seed);
+}
+
+void tpm2_identity_util_seed_ctx_free(tpm2_identity_util_seed_ctx *seed_ctx) {
+
+    if (!seed_ctx) {
+        return;
+    }
+
+    RSA_free(seed_ctx->rsa);
+    free(seed_ctx);
+}
+
 bool tpm2_identity_util_share_secret_with_public_key(
         TPM2B_DIGEST *protection_seed, TPM2B_PUBLIC *parent_pub,
         const unsigned char *label, int label_len,
         TPM2B_ENCRYPTED_SECRET *encrypted_protection_seed) {
-    bool result = false;
-    TPMI_ALG_PUBLIC alg = parent_pub->publicArea.type;
 
-    switch (alg) {
-    case TPM2_ALG_RSA:
-        result = share_secret_with_tpm2_rsa_public_key(protection_seed,
-                parent_pub, label, label_len, encrypted_protection_seed);
-        break;
-    case TPM2_ALG_ECC:
-        result = ecdh_derive_seed_and_encrypted_seed(parent_pub,
-                label, label_len,
-                protection_seed, encrypted_protection_seed);
-        break;
-    default:
-        LOG_ERR("Cannot handle algorithm, got: %s",
-                tpm2_alg_util_algtostr(alg, tpm2_alg_util_flags_any));
+    tpm2_identity_util_seed_ctx *seed_ctx =
+            tpm2_identity_util_seed_ctx_new(parent_pub);
+    if (!seed_ctx) {
         return false;
     }
 
+    bool result = tpm2_identity_util_seed_ctx_share_secret(seed_ctx, label,
+            label_len, protection_seed, encrypted_protection_seed);
+
+    tpm2_identity_util_seed_ctx_free(seed_ctx);
+
     return result;
 }
 
@@ -52,6 +52,55 @@ bool tpm2_identity_util_share_secret_with_public_key(
         const unsigned char *label, int label_len,
         TPM2B_ENCRYPTED_SECRET *encrypted_protection_seed);
 
+/*
+ * A parent public key prepared for sharing many protection seeds with it, so
+ * that the parent key is only converted once when wrapping a batch of
+ * objects. A context may be used from multiple threads at once.
+ */
+typedef struct tpm2_identity_util_seed_ctx tpm2_identity_util_seed_ctx;
+
+/**
+ * Prepares a parent public key for tpm2_identity_util_seed_ctx_share_secret().
+ *
+ * @param parent_pub
+ *  The public key used for encryption, RSA or ECC.
+ * @return
+ *  The seed context or NULL on error. Free with
+ *  tpm2_identity_util_seed_ctx_free().
+ */
+tpm2_identity_util_seed_ctx *tpm2_identity_util_seed_ctx_new(
+        TPM2B_PUBLIC *parent_pub);
+
+/**
+ * Same as tpm2_identity_util_share_secret_with_public_key() with a prepared
+ * parent public key.
+ *
+ * @param seed_ctx
+ *  The prepared parent public key.
+ * @param label
+ *  Indicates label for the seed, such as "IDENTITY" or "DUPLICATE".
+ * @param label_len
+ *  Length of label.
+ * @param protection_seed
+ *  The identity structure protection seed to generate and populate.
+ * @param encrypted_protection_seed
+ *  The encrypted protection seed to populate.
+ * @return
+ *  True on success, false on failure.
+ */
+bool tpm2_identity_util_seed_ctx_share_secret(
+        tpm2_identity_util_seed_ctx *seed_ctx, const unsigned char *label,
+        int label_len, TPM2B_DIGEST *protection_seed,
+        TPM2B_ENCRYPTED_SECRET *encrypted_protection_seed);
+
+/**
+ * Frees a seed context.
+ *
+ * @param seed_ctx
+ *  The seed context to free, may be NULL.
+ */
+void tpm2_identity_util_seed_ctx_free(tpm2_identity_util_seed_ctx *seed_ctx);
+
 /**
  * Marshalls Credential Value and encrypts it with the symmetric encryption key.
  *
@@ -0,0 +1,253 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <tss2/tss2_mu.h>
+
+#include "files.h"
+#include "log.h"
+#include "tpm2_codec.h"
+#include "tpm2_key_pool.h"
+#include "tpm2_openssl.h"
+#include "tpm2_util.h"
+
+#define KEY_PREFIX "key-"
+
+bool tpm2_key_pool_open(tpm2_key_pool *pool, const char *pool_dir,
+        const TPM2B_NAME *parent_name, const TPM2B_PUBLIC *template) {
+
+    UINT8 buffer[sizeof(TPM2B_NAME) + sizeof(TPM2B_PUBLIC)];
+    size_t offset = 0;
+
+    TSS2_RC rval = Tss2_MU_TPM2B_NAME_Marshal(parent_name, buffer,
+            sizeof(buffer), &offset);
+    if (rval == TSS2_RC_SUCCESS) {
+        rval = Tss2_MU_TPM2B_PUBLIC_Marshal(template, buffer, sizeof(buffer),
+                &offset);
+    }
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Tss2_MU_TPM2B_PUBLIC_Marshal, rval);
+        return false;
+    }
+
+    TPM2B_DIGEST digest = { .size = 0 };
+    bool result = tpm2_openssl_hash_compute_data(TPM2_ALG_SHA256, buffer,
+            offset, &digest);
+    if (!result) {
+        return false;
+    }
+
+    char hex[TPM2_CODEC_HEX_SIZE(sizeof(digest.buffer)) + 1];
+    tpm2_codec_hex_encode(digest.buffer, digest.size, hex, false);
+
+    int written = snprintf(pool->path, sizeof(pool->path), "%s/%s", pool_dir,
+            hex);
+    if (written < 0 || (size_t)written >= sizeof(pool->path)) {
+        LOG_ERR("Key pool path too long");
+        return false;
+    }
+
+    pool->template = template->publicArea;
+
+    if (mkdir(pool->path, 0700) != 0 && errno != EEXIST) {
+        LOG_ERR("Could not create key pool \"%s\": %s", pool->path,
+                strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+static bool is_key_entry(const struct dirent *entry) {
+
+    return !strncmp(entry->d_name, KEY_PREFIX, sizeof(KEY_PREFIX) - 1);
+}
+
+bool tpm2_key_pool_depth(tpm2_key_pool *pool, size_t *depth) {
+
+    DIR *dir = opendir(pool->path);
+    if (!dir) {
+        LOG_ERR("Could not open key pool \"%s\": %s", pool->path,
+                strerror(errno));
+        return false;
+    }
+
+    *depth = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (is_key_entry(entry)) {
+            *depth += 1;
+        }
+    }
+
+    closedir(dir);
+
+    return true;
+}
+
+bool tpm2_key_pool_put(tpm2_key_pool *pool, const TPM2B_PUBLIC *public,
+        const TPM2B_PRIVATE *private) {
+
+    UINT8 buffer[sizeof(TPM2B_PUBLIC) + sizeof(TPM2B_PRIVATE)];
+    size_t offset = 0;
+
+    TSS2_RC rval = Tss2_MU_TPM2B_PUBLIC_Marshal(public, buffer,
+            sizeof(buffer), &offset);
+    if (rval == TSS2_RC_SUCCESS) {
+        rval = Tss2_MU_TPM2B_PRIVATE_Marshal(private, buffer, sizeof(buffer),
+                &offset);
+    }
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Tss2_MU_TPM2B_PRIVATE_Marshal, rval);
+        return false;
+    }
+
+    /*
+     * Keys are written under a name claimers ignore and then linked in
+     * place, link(2) unlike rename(2) never replaces an existing key.
+     */
+    char tmp_path[PATH_MAX];
+    int written = snprintf(tmp_path, sizeof(tmp_path), "%s/.tmp-XXXXXX",
+            pool->path);
+    if (written < 0 || (size_t)written >= sizeof(tmp_path)) {
+        LOG_ERR("Key pool path too long");
+        return false;
+    }
+
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        LOG_ERR("Could not create key in pool \"%s\": %s", pool->path,
+                strerror(errno));
+        return false;
+    }
+    close(fd);
+
+    bool result = files_save_bytes_to_file(tmp_path, buffer, offset);
+    if (!result) {
+        goto out;
+    }
+
+    result = false;
+    char key_path[PATH_MAX];
+    unsigned i;
+    for (i = 0; i < UINT16_MAX; i++) {
+        written = snprintf(key_path, sizeof(key_path), "%s/" KEY_PREFIX "%s-%u",
+                pool->path, &tmp_path[strlen(pool->path) + sizeof("/.tmp-") - 1],
+                i);
+        if (written < 0 || (size_t)written >= sizeof(key_path)) {
+            LOG_ERR("Key pool path too long");
+            break;
+        }
+
+        if (link(tmp_path, key_path) == 0) {
+            result = true;
+            break;
+        }
+
+        if (errno != EEXIST) {
+            LOG_ERR("Could not add key to pool \"%s\": %s", pool->path,
+                    strerror(errno));
+            break;
+        }
+    }
+
+out:
+    unlink(tmp_path);
+    return result;
+}
+
+bool tpm2_key_pool_claim(tpm2_key_pool *pool, TPM2B_PUBLIC *public,
+        TPM2B_PRIVATE *private, bool *is_claimed) {
+
+    *is_claimed = false;
+
+    DIR *dir = opendir(pool->path);
+    if (!dir) {
+        LOG_ERR("Could not open key pool \"%s\": %s", pool->path,
+                strerror(errno));
+        return false;
+    }
+
+    char claim_path[PATH_MAX];
+    int written = snprintf(claim_path, sizeof(claim_path), "%s/.claim-%ld",
+            pool->path, (long)getpid());
+    if (written < 0 || (size_t)written >= sizeof(claim_path)) {
+        LOG_ERR("Key pool path too long");
+        closedir(dir);
+        return false;
+    }
+
+    /*
+     * Renaming a key to a name private to this process claims it, a
+     * concurrent claimer of the same key gets ENOENT and moves on.
+     */
+    struct dirent *entry;
+    while ((entry = readdir(dir))) {
+        if (!is_key_entry(entry)) {
+            continue;
+        }
+
+        char key_path[PATH_MAX];
+        written = snprintf(key_path, sizeof(key_path), "%s/%s", pool->path,
+                entry->d_name);
+        if (written < 0 || (size_t)written >= sizeof(key_path)) {
+            continue;
+        }
+
+        if (rename(key_path, claim_path) == 0) {
+            *is_claimed = true;
+            break;
+        }
+
+        if (errno != ENOENT) {
+            LOG_ERR("Could not claim key \"%s\": %s", key_path,
+                    strerror(errno));
+            closedir(dir);
+            return false;
+        }
+    }
+
+    closedir(dir);
+
+    if (!*is_claimed) {
+        return true;
+    }
+
+    UINT8 buffer[sizeof(TPM2B_PUBLIC) + sizeof(TPM2B_PRIVATE)];
+    UINT16 size = sizeof(buffer);
+    bool result = files_load_bytes_from_path(claim_path, buffer, &size);
+    unlink(claim_path);
+    if (!result) {
+        return false;
+    }
+
+    size_t offset = 0;
+    TSS2_RC rval = Tss2_MU_TPM2B_PUBLIC_Unmarshal(buffer, size, &offset,
+            public);
+    if (rval == TSS2_RC_SUCCESS) {
+        rval = Tss2_MU_TPM2B_PRIVATE_Unmarshal(buffer, size, &offset, private);
+    }
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_ERR("Invalid key in pool \"%s\"", pool->path);
+        return false;
+    }
+
+    /*
+     * The pool directory is only named after the template, a key dropped in
+     * the wrong directory must not be handed out for this template.
+     */
+    if (!tpm2_util_public_matches_template(&public->publicArea,
+            &pool->template)) {
+        LOG_ERR("Key in pool \"%s\" does not match the template", pool->path);
+        return false;
+    }
+
+    return true;
+}
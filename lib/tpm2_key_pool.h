@@ -0,0 +1,87 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef LIB_TPM2_KEY_POOL_H_
+#define LIB_TPM2_KEY_POOL_H_
+
+#include <limits.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+/*
+ * A key pool is a spool directory of keys created ahead of time so that
+ * issuing a key doesn't wait on the TPM key generation. Keys are grouped in
+ * a sub-directory per parent name and template, each key being a single
+ * file holding its TPM2B_PUBLIC and TPM2B_PRIVATE. Files are published and
+ * claimed with atomic link(2) and rename(2) calls, so any number of
+ * producers and consumers can share a pool.
+ */
+typedef struct tpm2_key_pool tpm2_key_pool;
+struct tpm2_key_pool {
+    char path[PATH_MAX];
+    TPMT_PUBLIC template;
+};
+
+/**
+ * Opens the pool of keys for a parent and template, creating its
+ * sub-directory if needed.
+ * @param pool
+ *  The pool to initialize.
+ * @param pool_dir
+ *  The spool directory, which must exist.
+ * @param parent_name
+ *  The name of the parent the keys are created under.
+ * @param template
+ *  The public template of the keys.
+ * @return
+ *  true on success, false otherwise.
+ */
+bool tpm2_key_pool_open(tpm2_key_pool *pool, const char *pool_dir,
+        const TPM2B_NAME *parent_name, const TPM2B_PUBLIC *template);
+
+/**
+ * Counts the keys available in a pool.
+ * @param pool
+ *  The pool.
+ * @param depth
+ *  The number of keys available.
+ * @return
+ *  true on success, false otherwise.
+ */
+bool tpm2_key_pool_depth(tpm2_key_pool *pool, size_t *depth);
+
+/**
+ * Adds a key to a pool.
+ * @param pool
+ *  The pool.
+ * @param public
+ *  The public portion of the key.
+ * @param private
+ *  The private portion of the key.
+ * @return
+ *  true on success, false otherwise.
+ */
+bool tpm2_key_pool_put(tpm2_key_pool *pool, const TPM2B_PUBLIC *public,
+        const TPM2B_PRIVATE *private);
+
+/**
+ * Takes a key out of a pool. A claimed key whose public area doesn't match
+ * the template of the pool, ignoring the unique field, is discarded and
+ * refused.
+ * @param pool
+ *  The pool.
+ * @param public
+ *  The public portion of the claimed key.
+ * @param private
+ *  The private portion of the claimed key.
+ * @param is_claimed
+ *  Set to false when the pool is empty.
+ * @return
+ *  true on success, including an empty pool, false otherwise, including a
+ *  claimed key not matching the template.
+ */
+bool tpm2_key_pool_claim(tpm2_key_pool *pool, TPM2B_PUBLIC *public,
+        TPM2B_PRIVATE *private, bool *is_claimed);
+
+#endif /* LIB_TPM2_KEY_POOL_H_ */
@@ -0,0 +1,122 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "tpm2_manifest.h"
+
+struct tpm2_manifest {
+    FILE *f;
+    const char *path;
+    char *line;
+    size_t line_size;
+    size_t lineno;
+    bool is_error;
+};
+
+tpm2_manifest *tpm2_manifest_open(const char *path) {
+
+    bool is_stdin = !path || !strcmp(path, "-");
+
+    tpm2_manifest *manifest = calloc(1, sizeof(*manifest));
+    if (!manifest) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+
+    manifest->path = is_stdin ? "<stdin>" : path;
+    manifest->f = is_stdin ? stdin : fopen(path, "r");
+    if (!manifest->f) {
+        LOG_ERR("Could not open manifest \"%s\", error: %s", path,
+                strerror(errno));
+        free(manifest);
+        return NULL;
+    }
+
+    return manifest;
+}
+
+bool tpm2_manifest_next(tpm2_manifest *manifest, char **fields, size_t *count) {
+
+    size_t max = *count;
+
+    while (true) {
+        errno = 0;
+        ssize_t len = getline(&manifest->line, &manifest->line_size,
+                manifest->f);
+        if (len < 0) {
+            if (ferror(manifest->f) || errno) {
+                LOG_ERR("Could not read manifest \"%s\", error: %s",
+                        manifest->path, strerror(errno));
+                manifest->is_error = true;
+            }
+            return false;
+        }
+
+        manifest->lineno++;
+
+        size_t found = 0;
+        char *s = manifest->line;
+        while (*s) {
+            while (isspace((unsigned char) *s)) {
+                *s++ = '\0';
+            }
+
+            /* empty line, trailing whitespace or comment */
+            if (!*s || (!found && *s == '#')) {
+                break;
+            }
+
+            if (found == max) {
+                LOG_ERR("Too many fields on line %zu of manifest \"%s\", "
+                        "expected at most %zu", manifest->lineno,
+                        manifest->path, max);
+                manifest->is_error = true;
+                return false;
+            }
+
+            fields[found++] = s;
+            while (*s && !isspace((unsigned char) *s)) {
+                s++;
+            }
+        }
+
+        if (found) {
+            *count = found;
+            return true;
+        }
+    }
+}
+
+bool tpm2_manifest_is_error(tpm2_manifest *manifest) {
+
+    return manifest->is_error;
+}
+
+size_t tpm2_manifest_line(tpm2_manifest *manifest) {
+
+    return manifest->lineno;
+}
+
+const char *tpm2_manifest_path(tpm2_manifest *manifest) {
+
+    return manifest->path;
+}
+
+void tpm2_manifest_close(tpm2_manifest *manifest) {
+
+    if (!manifest) {
+        return;
+    }
+
+    if (manifest->f && manifest->f != stdin) {
+        fclose(manifest->f);
+    }
+
+    free(manifest->line);
+    free(manifest);
+}
@@ -0,0 +1,75 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef LIB_TPM2_MANIFEST_H_
+#define LIB_TPM2_MANIFEST_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * A manifest is a line oriented text file describing a batch of work items
+ * for the tools' batch modes. Every line holds the whitespace separated
+ * fields of one item. Empty lines and lines starting with '#' are skipped.
+ */
+typedef struct tpm2_manifest tpm2_manifest;
+
+/**
+ * Opens a manifest for reading.
+ * @param path
+ *  The path to the manifest, NULL or "-" for stdin.
+ * @return
+ *  The manifest or NULL on error.
+ */
+tpm2_manifest *tpm2_manifest_open(const char *path);
+
+/**
+ * Reads the next item from the manifest.
+ * @param manifest
+ *  The manifest to read from.
+ * @param fields
+ *  The fields of the item, valid until the next call or until the manifest
+ *  is closed. Fields may be modified in place by the caller.
+ * @param count
+ *  On input the maximum number of fields, on success the number of fields
+ *  found on the line.
+ * @return
+ *  True if an item was read, false on end of file or error. Use
+ *  tpm2_manifest_is_error() to tell them apart.
+ */
+bool tpm2_manifest_next(tpm2_manifest *manifest, char **fields, size_t *count);
+
+/**
+ * Checks if reading the manifest failed.
+ * @param manifest
+ *  The manifest to check.
+ * @return
+ *  True if an error occurred, false otherwise.
+ */
+bool tpm2_manifest_is_error(tpm2_manifest *manifest);
+
+/**
+ * Retrieves the line number of the last item read, for error reporting.
+ * @param manifest
+ *  The manifest to query.
+ * @return
+ *  The line number, starting at 1.
+ */
+size_t tpm2_manifest_line(tpm2_manifest *manifest);
+
+/**
+ * Retrieves the path the manifest was opened with, for error reporting.
+ * @param manifest
+ *  The manifest to query.
+ * @return
+ *  The path of the manifest, "<stdin>" for stdin.
+ */
+const char *tpm2_manifest_path(tpm2_manifest *manifest);
+
+/**
+ * Closes a manifest opened with tpm2_manifest_open().
+ * @param manifest
+ *  The manifest to close, may be NULL.
+ */
+void tpm2_manifest_close(tpm2_manifest *manifest);
+
+#endif /* LIB_TPM2_MANIFEST_H_ */
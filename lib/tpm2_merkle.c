@@ -0,0 +1,360 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "files.h"
+#include "log.h"
+#include "tpm2_alg_util.h"
+#include "tpm2_merkle.h"
+#include "tpm2_openssl.h"
+
+#define MERKLE_PROOF_VERSION 1
+
+static const BYTE leaf_tag = 0x00;
+static const BYTE node_tag = 0x01;
+
+struct tpm2_merkle_tree {
+    TPMI_ALG_HASH halg;
+    UINT16 size;
+    /* the nodes of the levels one after the other, the leaves first */
+    BYTE *nodes;
+    size_t offsets[TPM2_MERKLE_MAX_DEPTH + 1];
+    size_t counts[TPM2_MERKLE_MAX_DEPTH + 1];
+    unsigned levels;
+};
+
+static BYTE *tree_node(const tpm2_merkle_tree *tree, unsigned level,
+        size_t index) {
+
+    return tree->nodes + (tree->offsets[level] + index) * tree->size;
+}
+
+/*
+ * Hashes the pairs of nodes of a level into the next level, the nodes of a
+ * pair being adjacent in the level they are hashed together.
+ */
+static bool hash_level(tpm2_merkle_tree *tree, tpm2_openssl_hasher *hasher,
+        tpm2_openssl_hash_msg *msgs, unsigned level) {
+
+    size_t count = tree->counts[level];
+    size_t pairs = count / 2;
+
+    size_t i;
+    for (i = 0; i < pairs; i++) {
+        msgs[i] = (tpm2_openssl_hash_msg) {
+            .halg = tree->halg,
+            .prefix = &node_tag,
+            .prefix_len = sizeof(node_tag),
+            .data = tree_node(tree, level, 2 * i),
+            .length = 2 * tree->size,
+            .digest = tree_node(tree, level + 1, i)
+        };
+    }
+
+    if (!tpm2_openssl_hash_batch(hasher, msgs, pairs)) {
+        return false;
+    }
+
+    /* the odd node out is promoted */
+    if (count % 2) {
+        memcpy(tree_node(tree, level + 1, pairs),
+                tree_node(tree, level, count - 1), tree->size);
+    }
+
+    return true;
+}
+
+tpm2_merkle_tree *tpm2_merkle_tree_new(TPMI_ALG_HASH halg,
+        const TPM2B_DATA *leaves, size_t count) {
+
+    UINT16 size = tpm2_alg_util_get_hash_size(halg);
+    if (!size) {
+        LOG_ERR("Unknown Merkle tree hash algorithm 0x%x", halg);
+        return NULL;
+    }
+
+    if (!count || (UINT64) count > UINT32_MAX) {
+        LOG_ERR("Expected between 1 and %u leaves, got %zu", UINT32_MAX,
+                count);
+        return NULL;
+    }
+
+    tpm2_merkle_tree *tree = calloc(1, sizeof(*tree));
+    if (!tree) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+
+    tree->halg = halg;
+    tree->size = size;
+
+    /* a level has half the nodes of the level below, rounded up */
+    size_t total = 0;
+    size_t n = count;
+    for (;;) {
+        tree->offsets[tree->levels] = total;
+        tree->counts[tree->levels] = n;
+        total += n;
+        if (n == 1) {
+            break;
+        }
+        tree->levels++;
+        n = (n + 1) / 2;
+    }
+
+    tpm2_openssl_hash_msg *msgs = calloc(count, sizeof(*msgs));
+    tpm2_openssl_hasher *hasher = tpm2_openssl_hasher_new();
+    tree->nodes = malloc(total * size);
+    if (!msgs || !hasher || !tree->nodes) {
+        LOG_ERR("oom");
+        goto err;
+    }
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        msgs[i] = (tpm2_openssl_hash_msg) {
+            .halg = halg,
+            .prefix = &leaf_tag,
+            .prefix_len = sizeof(leaf_tag),
+            .data = leaves[i].buffer,
+            .length = leaves[i].size,
+            .digest = tree_node(tree, 0, i)
+        };
+    }
+
+    bool result = tpm2_openssl_hash_batch(hasher, msgs, count);
+
+    unsigned level;
+    for (level = 0; result && level < tree->levels; level++) {
+        result = hash_level(tree, hasher, msgs, level);
+    }
+
+    if (!result) {
+        LOG_ERR("Could not hash the Merkle tree");
+        goto err;
+    }
+
+    tpm2_openssl_hasher_free(hasher);
+    free(msgs);
+
+    return tree;
+
+err:
+    tpm2_openssl_hasher_free(hasher);
+    free(msgs);
+    tpm2_merkle_tree_free(tree);
+
+    return NULL;
+}
+
+void tpm2_merkle_tree_free(tpm2_merkle_tree *tree) {
+
+    if (!tree) {
+        return;
+    }
+
+    free(tree->nodes);
+    free(tree);
+}
+
+void tpm2_merkle_tree_root(const tpm2_merkle_tree *tree, TPM2B_DATA *root) {
+
+    root->size = tree->size;
+    memcpy(root->buffer, tree_node(tree, tree->levels, 0), tree->size);
+}
+
+bool tpm2_merkle_tree_proof(const tpm2_merkle_tree *tree, size_t index,
+        tpm2_merkle_proof *proof) {
+
+    if (index >= tree->counts[0]) {
+        LOG_ERR("Leaf %zu is out of bounds for %zu leaves", index,
+                tree->counts[0]);
+        return false;
+    }
+
+    proof->halg = tree->halg;
+    proof->index = index;
+    proof->count = tree->counts[0];
+    proof->length = 0;
+
+    unsigned level;
+    for (level = 0; level < tree->levels; level++) {
+        size_t sibling = index ^ 1;
+        if (sibling < tree->counts[level]) {
+            memcpy(proof->path[proof->length++],
+                    tree_node(tree, level, sibling), tree->size);
+        }
+        index /= 2;
+    }
+
+    return true;
+}
+
+bool tpm2_merkle_proof_root(const tpm2_merkle_proof *proof,
+        const TPM2B_DATA *leaf, TPM2B_DATA *root) {
+
+    UINT16 size = tpm2_alg_util_get_hash_size(proof->halg);
+    if (!size || proof->index >= proof->count) {
+        LOG_ERR("Invalid Merkle proof");
+        return false;
+    }
+
+    BYTE node[1 + 2 * sizeof(TPMU_HA)];
+    node[0] = node_tag;
+    BYTE *digest = &node[1];
+
+    tpm2_openssl_hash_msg msg = {
+        .halg = proof->halg,
+        .prefix = &leaf_tag,
+        .prefix_len = sizeof(leaf_tag),
+        .data = leaf->buffer,
+        .length = leaf->size,
+        .digest = digest
+    };
+    if (!tpm2_openssl_hash_batch(NULL, &msg, 1)) {
+        return false;
+    }
+
+    /* walk up the levels as the tree was built, consuming the siblings */
+    UINT32 index = proof->index;
+    UINT32 count = proof->count;
+    UINT16 used = 0;
+    while (count > 1) {
+        bool is_right = index % 2;
+        if (is_right || index + 1 < count) {
+            if (used == proof->length) {
+                LOG_ERR("Merkle proof is too short");
+                return false;
+            }
+
+            const BYTE *sibling = proof->path[used++];
+            if (is_right) {
+                memmove(&node[1 + size], digest, size);
+                memcpy(&node[1], sibling, size);
+            } else {
+                memcpy(&node[1 + size], sibling, size);
+            }
+
+            msg = (tpm2_openssl_hash_msg) {
+                .halg = proof->halg,
+                .data = node,
+                .length = 1 + 2 * size,
+                .digest = digest
+            };
+            if (!tpm2_openssl_hash_batch(NULL, &msg, 1)) {
+                return false;
+            }
+        }
+
+        index /= 2;
+        count = count / 2 + count % 2;
+    }
+
+    if (used != proof->length) {
+        LOG_ERR("Merkle proof is too long");
+        return false;
+    }
+
+    root->size = size;
+    memcpy(root->buffer, digest, size);
+
+    return true;
+}
+
+bool tpm2_merkle_proof_verify(const tpm2_merkle_proof *proof,
+        const TPM2B_DATA *leaf, const TPM2B_DATA *root) {
+
+    TPM2B_DATA computed;
+    if (!tpm2_merkle_proof_root(proof, leaf, &computed)) {
+        return false;
+    }
+
+    if (root->size != computed.size ||
+        memcmp(root->buffer, computed.buffer, computed.size)) {
+        LOG_ERR("Merkle proof does not lead to the expected root");
+        return false;
+    }
+
+    return true;
+}
+
+bool tpm2_merkle_proof_save(const tpm2_merkle_proof *proof, const char *path) {
+
+    FILE *fp = fopen(path, "wb+");
+    if (!fp) {
+        LOG_ERR("Could not open file \"%s\" error: \"%s\"", path,
+                strerror(errno));
+        return false;
+    }
+
+    UINT16 size = tpm2_alg_util_get_hash_size(proof->halg);
+    bool result = files_write_header(fp, MERKLE_PROOF_VERSION)
+            && files_write_16(fp, proof->halg)
+            && files_write_32(fp, proof->index)
+            && files_write_32(fp, proof->count)
+            && files_write_16(fp, proof->length);
+
+    UINT16 i;
+    for (i = 0; result && i < proof->length; i++) {
+        result = files_write_bytes(fp, (UINT8 *) proof->path[i], size);
+    }
+
+    if (!result) {
+        LOG_ERR("Could not write Merkle proof \"%s\"", path);
+    }
+
+    fclose(fp);
+
+    return result;
+}
+
+bool tpm2_merkle_proof_load(const char *path, tpm2_merkle_proof *proof) {
+
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        LOG_ERR("Could not open file \"%s\" error: \"%s\"", path,
+                strerror(errno));
+        return false;
+    }
+
+    UINT32 version;
+    bool result = files_read_header(fp, &version);
+    if (!result || version != MERKLE_PROOF_VERSION) {
+        LOG_ERR("Unsupported Merkle proof \"%s\"", path);
+        result = false;
+        goto out;
+    }
+
+    result = files_read_16(fp, &proof->halg)
+            && files_read_32(fp, &proof->index)
+            && files_read_32(fp, &proof->count)
+            && files_read_16(fp, &proof->length);
+    if (!result) {
+        LOG_ERR("Could not read Merkle proof \"%s\"", path);
+        goto out;
+    }
+
+    UINT16 size = tpm2_alg_util_get_hash_size(proof->halg);
+    if (!size || proof->length > TPM2_MERKLE_MAX_DEPTH) {
+        LOG_ERR("Invalid Merkle proof \"%s\"", path);
+        result = false;
+        goto out;
+    }
+
+    UINT16 i;
+    for (i = 0; result && i < proof->length; i++) {
+        result = files_read_bytes(fp, proof->path[i], size);
+    }
+
+    if (!result) {
+        LOG_ERR("Could not read Merkle proof \"%s\"", path);
+    }
+
+out:
+    fclose(fp);
+
+    return result;
+}
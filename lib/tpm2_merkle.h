@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef LIB_TPM2_MERKLE_H_
+#define LIB_TPM2_MERKLE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+/*
+ * Merkle trees aggregating the nonces of many verifiers into the qualifying
+ * data of a single quote. Leaves are hashed as HASH(0x00 || nonce) and nodes
+ * as HASH(0x01 || left || right), a node without a sibling is promoted to
+ * the next level as is.
+ */
+typedef struct tpm2_merkle_tree tpm2_merkle_tree;
+
+/*
+ * Deep enough for the 2^32 leaves a proof can index.
+ */
+#define TPM2_MERKLE_MAX_DEPTH 32
+
+/*
+ * The inclusion proof of a leaf: the siblings of the nodes on the path from
+ * the leaf to the root, from the bottom up.
+ */
+typedef struct tpm2_merkle_proof tpm2_merkle_proof;
+struct tpm2_merkle_proof {
+    TPMI_ALG_HASH halg;
+    UINT32 index;
+    UINT32 count;
+    UINT16 length;
+    BYTE path[TPM2_MERKLE_MAX_DEPTH][sizeof(TPMU_HA)];
+};
+
+/**
+ * Builds the Merkle tree of leaves.
+ * @param halg
+ *  The hash algorithm of the tree.
+ * @param leaves
+ *  The leaves, at least one.
+ * @param count
+ *  The number of leaves.
+ * @return
+ *  The tree, to free with tpm2_merkle_tree_free(), NULL on error.
+ */
+tpm2_merkle_tree *tpm2_merkle_tree_new(TPMI_ALG_HASH halg,
+        const TPM2B_DATA *leaves, size_t count);
+
+/**
+ * Frees a tree built with tpm2_merkle_tree_new().
+ * @param tree
+ *  The tree to free, may be NULL.
+ */
+void tpm2_merkle_tree_free(tpm2_merkle_tree *tree);
+
+/**
+ * Retrieves the root of a tree, to quote as qualifying data.
+ * @param tree
+ *  The tree.
+ * @param root
+ *  The root of the tree.
+ */
+void tpm2_merkle_tree_root(const tpm2_merkle_tree *tree, TPM2B_DATA *root);
+
+/**
+ * Computes the inclusion proof of a leaf.
+ * @param tree
+ *  The tree.
+ * @param index
+ *  The index of the leaf.
+ * @param proof
+ *  The inclusion proof of the leaf.
+ * @return
+ *  true on success, false if the index is out of bounds.
+ */
+bool tpm2_merkle_tree_proof(const tpm2_merkle_tree *tree, size_t index,
+        tpm2_merkle_proof *proof);
+
+/**
+ * Computes the root of the tree a leaf is included in.
+ * @param proof
+ *  The inclusion proof of the leaf.
+ * @param leaf
+ *  The leaf.
+ * @param root
+ *  The root the proof leads to from the leaf.
+ * @return
+ *  true on success, false if the proof is malformed.
+ */
+bool tpm2_merkle_proof_root(const tpm2_merkle_proof *proof,
+        const TPM2B_DATA *leaf, TPM2B_DATA *root);
+
+/**
+ * Checks that a leaf is included in the tree of a root.
+ * @param proof
+ *  The inclusion proof of the leaf.
+ * @param leaf
+ *  The leaf.
+ * @param root
+ *  The root of the tree, as quoted or signed.
+ * @return
+ *  true if the proof leads from the leaf to the root, false otherwise.
+ */
+bool tpm2_merkle_proof_verify(const tpm2_merkle_proof *proof,
+        const TPM2B_DATA *leaf, const TPM2B_DATA *root);
+
+/**
+ * Saves an inclusion proof to a file.
+ * @param proof
+ *  The proof to save.
+ * @param path
+ *  The path of the file.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_merkle_proof_save(const tpm2_merkle_proof *proof, const char *path);
+
+/**
+ * Loads an inclusion proof saved with tpm2_merkle_proof_save().
+ * @param path
+ *  The path of the file.
+ * @param proof
+ *  The proof loaded.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_merkle_proof_load(const char *path, tpm2_merkle_proof *proof);
+
+#endif /* LIB_TPM2_MERKLE_H_ */
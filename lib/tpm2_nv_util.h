@@ -126,6 +126,30 @@ out:
     return max_nv_size;
 }
 
+/*
+ * A chunk read from an index, copied to the output buffer by
+ * tpm2_util_nv_read_copy_chunk() while the TPM reads the next one.
+ */
+typedef struct tpm2_util_nv_read_chunk tpm2_util_nv_read_chunk;
+struct tpm2_util_nv_read_chunk {
+    UINT8 *dest;
+    TPM2B_MAX_NV_BUFFER *data;
+};
+
+/* Called by tpm2_async_wait(), see tpm2_async_idle_fn */
+static inline bool tpm2_util_nv_read_copy_chunk(void *userdata) {
+
+    tpm2_util_nv_read_chunk *chunk = (tpm2_util_nv_read_chunk *) userdata;
+
+    if (chunk->data) {
+        memcpy(chunk->dest, chunk->data->buffer, chunk->data->size);
+        free(chunk->data);
+        chunk->data = NULL;
+    }
+
+    return false;
+}
+
 /**
  * Reads data at Non-Volatile (nv) index.
  * @param ectx
@@ -210,28 +234,63 @@ tpm2_util_nv_read_collect_cp_hash:
         goto out;
     }
 
+    /* resolved once rather than for every chunk */
+    ESYS_TR nv_handle = ESYS_TR_NONE;
+    rc = tpm2_from_tpm_public(ectx, nv_index, ESYS_TR_NONE, ESYS_TR_NONE,
+            ESYS_TR_NONE, &nv_handle);
+    if (rc != tool_rc_success) {
+        goto out;
+    }
+
     UINT16 data_offset = 0;
+    tpm2_util_nv_read_chunk pending = { 0 };
 
     while (size > 0) {
 
         UINT16 bytes_to_read = size > max_data_size ? max_data_size : size;
 
-        TPM2B_MAX_NV_BUFFER *nv_data;
+        rc = tpm2_nv_read_async(ectx, auth_hierarchy_obj, nv_handle,
+                bytes_to_read, offset);
+        if (rc != tool_rc_success) {
+            LOG_ERR("Failed to read NVRAM area at index 0x%X", nv_index);
+            break;
+        }
+
+        /* the previous chunk is copied while the TPM reads this one */
+        tool_rc wait_rc = tpm2_async_wait(ectx, tpm2_util_nv_read_copy_chunk,
+                &pending);
 
-        rc = tpm2_nv_read(ectx, auth_hierarchy_obj, nv_index, bytes_to_read,
-            offset, &nv_data, cp_hash, parameter_hash_algorithm);
+        TPM2B_MAX_NV_BUFFER *nv_data;
+        rc = tpm2_nv_read_finish(ectx, &nv_data);
         if (rc != tool_rc_success) {
             LOG_ERR("Failed to read NVRAM area at index 0x%X", nv_index);
-            goto out;
+            break;
         }
 
+        if (wait_rc != tool_rc_success) {
+            free(nv_data);
+            rc = wait_rc;
+            break;
+        }
+
+        /* the poll may have returned before the previous chunk was copied */
+        tpm2_util_nv_read_copy_chunk(&pending);
+        pending.dest = *data_buffer + data_offset;
+        pending.data = nv_data;
+
         size -= nv_data->size;
         offset += nv_data->size;
-
-        memcpy(*data_buffer + data_offset, nv_data->buffer, nv_data->size);
         data_offset += nv_data->size;
+    }
 
-        free(nv_data);
+    tpm2_util_nv_read_copy_chunk(&pending);
+
+    tool_rc tmp_rc = tpm2_close(ectx, &nv_handle);
+    if (rc == tool_rc_success) {
+        rc = tmp_rc;
+    }
+    if (rc != tool_rc_success) {
+        goto out;
     }
 
     if (bytes_written) {
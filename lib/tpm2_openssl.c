@@ -184,6 +184,59 @@ out:
     return result;
 }
 
+bool tpm2_openssl_hash_file(TPMI_ALG_HASH halg, FILE *input,
+        TPM2B_DIGEST *digest) {
+
+    bool result = false;
+
+    const EVP_MD *md = tpm2_openssl_halg_from_tpmhalg(halg);
+    if (!md) {
+        return false;
+    }
+
+    EVP_MD_CTX *mdctx = EVP_MD_CTX_create();
+    if (!mdctx) {
+        LOG_ERR("%s", tpm2_openssl_get_err());
+        return false;
+    }
+
+    int rc = EVP_DigestInit_ex(mdctx, md, NULL);
+    if (!rc) {
+        LOG_ERR("%s", tpm2_openssl_get_err());
+        goto out;
+    }
+
+    BYTE buffer[16384];
+    size_t length;
+    while ((length = fread(buffer, 1, sizeof(buffer), input))) {
+        rc = EVP_DigestUpdate(mdctx, buffer, length);
+        if (!rc) {
+            LOG_ERR("%s", tpm2_openssl_get_err());
+            goto out;
+        }
+    }
+
+    if (ferror(input)) {
+        LOG_ERR("Error reading the input to hash");
+        goto out;
+    }
+
+    unsigned size = EVP_MD_size(md);
+    rc = EVP_DigestFinal_ex(mdctx, digest->buffer, &size);
+    if (!rc) {
+        LOG_ERR("%s", tpm2_openssl_get_err());
+        goto out;
+    }
+
+    digest->size = size;
+
+    result = true;
+
+out:
+    EVP_MD_CTX_destroy(mdctx);
+    return result;
+}
+
 bool tpm2_openssl_pcr_extend(TPMI_ALG_HASH halg, BYTE *pcr,
         const BYTE *data, UINT16 length) {
 
@@ -233,6 +286,157 @@ out:
     return result;
 }
 
+struct tpm2_openssl_hasher {
+    struct {
+        TPMI_ALG_HASH halg;
+        EVP_MD *md;
+        EVP_MD_CTX *mdctx;
+    } algs[TPM2_NUM_PCR_BANKS];
+    size_t count;
+};
+
+tpm2_openssl_hasher *tpm2_openssl_hasher_new(void) {
+
+    tpm2_openssl_hasher *hasher = calloc(1, sizeof(*hasher));
+    if (!hasher) {
+        LOG_ERR("oom");
+    }
+
+    return hasher;
+}
+
+void tpm2_openssl_hasher_free(tpm2_openssl_hasher *hasher) {
+
+    if (!hasher) {
+        return;
+    }
+
+    size_t i;
+    for (i = 0; i < hasher->count; i++) {
+        EVP_MD_CTX_destroy(hasher->algs[i].mdctx);
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        EVP_MD_free(hasher->algs[i].md);
+#endif
+    }
+
+    free(hasher);
+}
+
+/*
+ * Finds the context of an algorithm, setting it up on first use. Under
+ * OpenSSL 3 the digest is fetched once here, initializing a context with
+ * a legacy digest like EVP_sha256() fetches it again every time.
+ */
+static EVP_MD_CTX *hasher_get(tpm2_openssl_hasher *hasher,
+        TPMI_ALG_HASH halg, const EVP_MD **md) {
+
+    size_t i;
+    for (i = 0; i < hasher->count; i++) {
+        if (hasher->algs[i].halg == halg) {
+            *md = hasher->algs[i].md;
+            return hasher->algs[i].mdctx;
+        }
+    }
+
+    const EVP_MD *legacy_md = tpm2_openssl_halg_from_tpmhalg(halg);
+    if (!legacy_md || hasher->count == ARRAY_LEN(hasher->algs)) {
+        return NULL;
+    }
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+    EVP_MD *fetched_md = EVP_MD_fetch(NULL, EVP_MD_get0_name(legacy_md),
+            NULL);
+#else
+    EVP_MD *fetched_md = (EVP_MD *) legacy_md;
+#endif
+    EVP_MD_CTX *mdctx = fetched_md ? EVP_MD_CTX_create() : NULL;
+    if (!mdctx) {
+        LOG_ERR("%s", tpm2_openssl_get_err());
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+        EVP_MD_free(fetched_md);
+#endif
+        return NULL;
+    }
+
+    hasher->algs[hasher->count].halg = halg;
+    hasher->algs[hasher->count].md = fetched_md;
+    hasher->algs[hasher->count].mdctx = mdctx;
+    hasher->count++;
+
+    *md = fetched_md;
+    return mdctx;
+}
+
+static bool hash_msg(EVP_MD_CTX *mdctx, const EVP_MD *md,
+        const tpm2_openssl_hash_msg *msg) {
+
+    int rc = EVP_DigestInit_ex(mdctx, md, NULL);
+    if (!rc) {
+        LOG_ERR("%s", tpm2_openssl_get_err());
+        return false;
+    }
+
+    if (msg->prefix_len) {
+        rc = EVP_DigestUpdate(mdctx, msg->prefix, msg->prefix_len);
+        if (!rc) {
+            LOG_ERR("%s", tpm2_openssl_get_err());
+            return false;
+        }
+    }
+
+    rc = EVP_DigestUpdate(mdctx, msg->data, msg->length);
+    if (!rc) {
+        LOG_ERR("%s", tpm2_openssl_get_err());
+        return false;
+    }
+
+    unsigned size = EVP_MD_size(md);
+    rc = EVP_DigestFinal_ex(mdctx, msg->digest, &size);
+    if (!rc) {
+        LOG_ERR("%s", tpm2_openssl_get_err());
+        return false;
+    }
+
+    return true;
+}
+
+bool tpm2_openssl_hash_batch(tpm2_openssl_hasher *hasher,
+        const tpm2_openssl_hash_msg *msgs, size_t count) {
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        const EVP_MD *md = NULL;
+        EVP_MD_CTX *mdctx = NULL;
+        if (hasher) {
+            mdctx = hasher_get(hasher, msgs[i].halg, &md);
+            if (!mdctx) {
+                return false;
+            }
+        } else {
+            md = tpm2_openssl_halg_from_tpmhalg(msgs[i].halg);
+            if (!md) {
+                return false;
+            }
+
+            mdctx = EVP_MD_CTX_create();
+            if (!mdctx) {
+                LOG_ERR("%s", tpm2_openssl_get_err());
+                return false;
+            }
+        }
+
+        bool result = hash_msg(mdctx, md, &msgs[i]);
+        if (!hasher) {
+            EVP_MD_CTX_destroy(mdctx);
+        }
+        if (!result) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 bool tpm2_openssl_hash_pcr_values(TPMI_ALG_HASH halg, TPML_DIGEST *digests,
         TPM2B_DIGEST *digest) {
 
@@ -1406,3 +1610,53 @@ bool tpm2_openssl_import_keys(
 
     return true;
 }
+
+bool tpm2_openssl_verify_signature(EVP_PKEY *pkey, TPMI_ALG_HASH halg,
+        TPM2B_MAX_BUFFER *signature, TPM2B_DIGEST *msg_hash) {
+
+    bool result = false;
+
+    const EVP_MD *md = tpm2_openssl_halg_from_tpmhalg(halg);
+    if (!md) {
+        LOG_ERR("Unsupported signature hash algorithm, got: 0x%x", halg);
+        return false;
+    }
+
+    EVP_PKEY_CTX *pkey_ctx = EVP_PKEY_CTX_new(pkey, NULL);
+    if (!pkey_ctx) {
+        LOG_ERR("EVP_PKEY_CTX_new failed: %s", ERR_error_string(ERR_get_error(), NULL));
+        return false;
+    }
+
+    int rc = EVP_PKEY_verify_init(pkey_ctx);
+    if (!rc) {
+        LOG_ERR("EVP_PKEY_verify_init failed: %s", ERR_error_string(ERR_get_error(), NULL));
+        goto err;
+    }
+
+    rc = EVP_PKEY_CTX_set_signature_md(pkey_ctx, md);
+    if (!rc) {
+        LOG_ERR("EVP_PKEY_CTX_set_signature_md failed: %s", ERR_error_string(ERR_get_error(), NULL));
+        goto err;
+    }
+
+    // Verify the signature matches message digest
+
+    rc = EVP_PKEY_verify(pkey_ctx, signature->buffer, signature->size,
+            msg_hash->buffer, msg_hash->size);
+    if (rc != 1) {
+        if (rc == 0) {
+            LOG_ERR("Error validating signed message with public key provided");
+        } else {
+            LOG_ERR("Error %s", ERR_error_string(ERR_get_error(), NULL));
+        }
+        goto err;
+    }
+
+    result = true;
+
+err:
+    EVP_PKEY_CTX_free(pkey_ctx);
+
+    return result;
+}
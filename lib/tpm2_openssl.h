@@ -109,6 +109,69 @@ void tpm2_openssl_hmac_free(HMAC_CTX *ctx);
 bool tpm2_openssl_hash_compute_data(TPMI_ALG_HASH halg, BYTE *buffer,
         UINT16 length, TPM2B_DIGEST *digest);
 
+/**
+ * Hash the contents of a file, read until its end.
+ * @param halg
+ *  The hashing algorithm to use.
+ * @param input
+ *  The file to hash.
+ * @param digest
+ *  The digest of the contents of the file.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_openssl_hash_file(TPMI_ALG_HASH halg, FILE *input,
+        TPM2B_DIGEST *digest);
+
+/*
+ * Hash contexts kept across the many small messages of an event log, so that
+ * they are not created, and under OpenSSL 3 the digest fetched, per message.
+ */
+typedef struct tpm2_openssl_hasher tpm2_openssl_hasher;
+
+/*
+ * A message of a batch, hashed as HASH(prefix || data) into digest. The
+ * digest may overlap the prefix, like the PCR of an extend.
+ */
+typedef struct tpm2_openssl_hash_msg tpm2_openssl_hash_msg;
+struct tpm2_openssl_hash_msg {
+    TPMI_ALG_HASH halg;
+    const BYTE *prefix;
+    size_t prefix_len;
+    const BYTE *data;
+    size_t length;
+    BYTE *digest;
+};
+
+/**
+ * Allocates the hash contexts of a batch.
+ * @return
+ *  The hasher, to free with tpm2_openssl_hasher_free(), NULL on error.
+ */
+tpm2_openssl_hasher *tpm2_openssl_hasher_new(void);
+
+/**
+ * Frees a hasher allocated with tpm2_openssl_hasher_new().
+ * @param hasher
+ *  The hasher to free, may be NULL.
+ */
+void tpm2_openssl_hasher_free(tpm2_openssl_hasher *hasher);
+
+/**
+ * Hashes a batch of messages. The messages are hashed in order, so a message
+ * may hash the digest of a previous one, as successive extends of a PCR do.
+ * @param hasher
+ *  The hash contexts to reuse, NULL to use a context per message.
+ * @param msgs
+ *  The messages to hash.
+ * @param count
+ *  The number of messages.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_openssl_hash_batch(tpm2_openssl_hasher *hasher,
+        const tpm2_openssl_hash_msg *msgs, size_t count);
+
 /**
  * Hash a list of PCR digests.
  * @param halg
@@ -201,6 +264,22 @@ void tpm2_openssl_cipher_free(EVP_CIPHER_CTX *ctx);
  */
 digester tpm2_openssl_halg_to_digester(TPMI_ALG_HASH halg);
 
+/**
+ * Verifies a plain signature of a message digest.
+ * @param pkey
+ *  The public key of the signer.
+ * @param halg
+ *  The hash algorithm of the signature scheme.
+ * @param signature
+ *  The plain signature, as loaded by tpm2_convert_sig_load_plain().
+ * @param msg_hash
+ *  The digest of the signed message.
+ * @return
+ *  true if the signature is valid, false otherwise.
+ */
+bool tpm2_openssl_verify_signature(EVP_PKEY *pkey, TPMI_ALG_HASH halg,
+        TPM2B_MAX_BUFFER *signature, TPM2B_DIGEST *msg_hash);
+
 typedef enum tpm2_openssl_load_rc tpm2_openssl_load_rc;
 enum tpm2_openssl_load_rc {
     lprc_error = 0, /* an error has occurred */
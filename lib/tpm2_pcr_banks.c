@@ -0,0 +1,345 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "files.h"
+#include "log.h"
+#include "tpm2_alg_util.h"
+#include "tpm2_openssl.h"
+#include "tpm2_pcr_banks.h"
+#include "tpm2_util.h"
+
+typedef struct tpm2_pcr_bank tpm2_pcr_bank;
+struct tpm2_pcr_bank {
+    TPMI_ALG_HASH halg;
+    UINT16 size;
+    /* of the PCR values of the bank in data, followed by the bitmap of the
+     * extended PCRs */
+    size_t offset;
+};
+
+struct tpm2_pcr_banks {
+    unsigned pcr_count;
+    tpm2_pcr_bank banks[TPM2_NUM_PCR_BANKS];
+    size_t count;
+    BYTE *data;
+    size_t data_size;
+    tpm2_openssl_hasher *hasher;
+};
+
+/* the value of the PCRs of the banks never extended */
+static const BYTE zero_pcr[sizeof(TPMU_HA)];
+
+tpm2_pcr_banks *tpm2_pcr_banks_new(unsigned pcr_count) {
+
+    tpm2_pcr_banks *banks = calloc(1, sizeof(*banks));
+    if (!banks) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+
+    banks->pcr_count = pcr_count;
+    banks->hasher = tpm2_openssl_hasher_new();
+    if (!banks->hasher) {
+        free(banks);
+        return NULL;
+    }
+
+    return banks;
+}
+
+void tpm2_pcr_banks_free(tpm2_pcr_banks *banks) {
+
+    if (!banks) {
+        return;
+    }
+
+    tpm2_openssl_hasher_free(banks->hasher);
+    free(banks->data);
+    free(banks);
+}
+
+static const tpm2_pcr_bank *find_bank(const tpm2_pcr_banks *banks,
+        TPMI_ALG_HASH halg) {
+
+    size_t i;
+    for (i = 0; i < banks->count; i++) {
+        if (banks->banks[i].halg == halg) {
+            return &banks->banks[i];
+        }
+    }
+
+    return NULL;
+}
+
+static const tpm2_pcr_bank *add_bank(tpm2_pcr_banks *banks,
+        TPMI_ALG_HASH halg, UINT16 size) {
+
+    if (banks->count == ARRAY_LEN(banks->banks)) {
+        LOG_ERR("Too many PCR banks");
+        return NULL;
+    }
+
+    size_t bank_size = (size_t) banks->pcr_count * size +
+            (banks->pcr_count + 7) / 8;
+    BYTE *data = realloc(banks->data, banks->data_size + bank_size);
+    if (!data) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+    memset(data + banks->data_size, 0, bank_size);
+
+    tpm2_pcr_bank *bank = &banks->banks[banks->count++];
+    bank->halg = halg;
+    bank->size = size;
+    bank->offset = banks->data_size;
+
+    banks->data = data;
+    banks->data_size += bank_size;
+
+    return bank;
+}
+
+static BYTE *bank_pcr(const tpm2_pcr_banks *banks, const tpm2_pcr_bank *bank,
+        unsigned pcr) {
+
+    return banks->data + bank->offset + (size_t) pcr * bank->size;
+}
+
+static BYTE *bank_bitmap(const tpm2_pcr_banks *banks,
+        const tpm2_pcr_bank *bank) {
+
+    return bank_pcr(banks, bank, banks->pcr_count);
+}
+
+bool tpm2_pcr_banks_extend(tpm2_pcr_banks *banks, TPMI_ALG_HASH halg,
+        unsigned pcr, const BYTE *digest) {
+
+    if (pcr >= banks->pcr_count) {
+        LOG_ERR("PCR%u is out of bounds for %u PCRs", pcr, banks->pcr_count);
+        return false;
+    }
+
+    const tpm2_pcr_bank *bank = find_bank(banks, halg);
+    if (!bank) {
+        UINT16 size = tpm2_alg_util_get_hash_size(halg);
+        if (!size) {
+            LOG_ERR("Unknown PCR bank algorithm 0x%x", halg);
+            return false;
+        }
+
+        bank = add_bank(banks, halg, size);
+        if (!bank) {
+            return false;
+        }
+    }
+
+    BYTE *value = bank_pcr(banks, bank, pcr);
+    const tpm2_openssl_hash_msg extend = {
+        .halg = halg,
+        .prefix = value,
+        .prefix_len = bank->size,
+        .data = digest,
+        .length = bank->size,
+        .digest = value
+    };
+    if (!tpm2_openssl_hash_batch(banks->hasher, &extend, 1)) {
+        LOG_ERR("PCR%u extend failed", pcr);
+        return false;
+    }
+
+    bank_bitmap(banks, bank)[pcr / 8] |= 1 << (pcr % 8);
+
+    return true;
+}
+
+bool tpm2_pcr_banks_is_extended(const tpm2_pcr_banks *banks,
+        TPMI_ALG_HASH halg, unsigned pcr) {
+
+    const tpm2_pcr_bank *bank = find_bank(banks, halg);
+
+    return bank && pcr < banks->pcr_count &&
+            (bank_bitmap(banks, bank)[pcr / 8] & (1 << (pcr % 8)));
+}
+
+const BYTE *tpm2_pcr_banks_value(const tpm2_pcr_banks *banks,
+        TPMI_ALG_HASH halg, unsigned pcr) {
+
+    if (pcr >= banks->pcr_count) {
+        return NULL;
+    }
+
+    const tpm2_pcr_bank *bank = find_bank(banks, halg);
+    if (bank) {
+        return bank_pcr(banks, bank, pcr);
+    }
+
+    return tpm2_alg_util_get_hash_size(halg) ? zero_pcr : NULL;
+}
+
+bool tpm2_pcr_banks_read(const tpm2_pcr_banks *banks,
+        const TPML_PCR_SELECTION *pcr_select, tpm2_pcrs *pcrs) {
+
+    memset(pcrs, 0, sizeof(*pcrs));
+
+    size_t vi = 0;
+    UINT32 i;
+    for (i = 0; i < pcr_select->count; i++) {
+        const TPMS_PCR_SELECTION *sel = &pcr_select->pcrSelections[i];
+        UINT16 size = tpm2_alg_util_get_hash_size(sel->hash);
+
+        unsigned pcr_id;
+        for (pcr_id = 0; pcr_id < sel->sizeofSelect * 8u; pcr_id++) {
+            if (!tpm2_util_is_pcr_select_bit_set(sel, pcr_id)) {
+                continue;
+            }
+
+            const BYTE *value = tpm2_pcr_banks_value(banks, sel->hash, pcr_id);
+            if (!value) {
+                LOG_ERR("Cannot predict PCR %u of bank 0x%x", pcr_id,
+                        sel->hash);
+                return false;
+            }
+
+            TPML_DIGEST *values = &pcrs->pcr_values[vi];
+            if (values->count == ARRAY_LEN(values->digests)) {
+                if (++vi == ARRAY_LEN(pcrs->pcr_values)) {
+                    LOG_ERR("Too many PCRs selected");
+                    return false;
+                }
+                values = &pcrs->pcr_values[vi];
+            }
+
+            TPM2B_DIGEST *digest = &values->digests[values->count++];
+            digest->size = size;
+            memcpy(digest->buffer, value, size);
+            pcrs->count = vi + 1;
+        }
+    }
+
+    return true;
+}
+
+bool tpm2_pcr_banks_compare(const tpm2_pcr_banks *banks,
+        const TPML_PCR_SELECTION *pcr_select, const tpm2_pcrs *pcrs) {
+
+    bool is_mismatch = false;
+    unsigned vi = 0;
+    unsigned di = 0;
+    UINT32 i;
+    for (i = 0; i < pcr_select->count; i++) {
+        const TPMS_PCR_SELECTION *sel = &pcr_select->pcrSelections[i];
+
+        // Loop through all PCRs in this bank
+        unsigned pcr_id;
+        for (pcr_id = 0; pcr_id < sel->sizeofSelect * 8u; pcr_id++) {
+            // skip non-selected banks
+            if (!tpm2_util_is_pcr_select_bit_set(sel, pcr_id)) {
+                continue;
+            }
+            if (vi >= pcrs->count || di >= pcrs->pcr_values[vi].count) {
+                LOG_ERR("Something wrong, trying to print but nothing more");
+                return false;
+            }
+
+            const TPM2B_DIGEST *pcr = &pcrs->pcr_values[vi].digests[di];
+            const BYTE *value = tpm2_pcr_banks_value(banks, sel->hash, pcr_id);
+            if (!value || pcr->size != tpm2_alg_util_get_hash_size(sel->hash)) {
+                LOG_WARN("PCR%u unsupported algorithm/size %u/%u", pcr_id,
+                        sel->hash, pcr->size);
+                is_mismatch = true;
+            } else if (memcmp(value, pcr->buffer, pcr->size) != 0) {
+                LOG_WARN("PCR%u mismatch", pcr_id);
+                is_mismatch = true;
+            }
+
+            if (++di < pcrs->pcr_values[vi].count) {
+                continue;
+            }
+
+            di = 0;
+            vi++;
+        }
+    }
+
+    return !is_mismatch;
+}
+
+/* the size of the values and of the bitmap of a bank */
+static size_t bank_data_size(const tpm2_pcr_banks *banks,
+        const tpm2_pcr_bank *bank) {
+
+    return (size_t) banks->pcr_count * bank->size +
+            (banks->pcr_count + 7) / 8;
+}
+
+bool tpm2_pcr_banks_save(const tpm2_pcr_banks *banks, FILE *f) {
+
+    bool result = files_write_32(f, banks->pcr_count)
+            && files_write_32(f, banks->count);
+
+    size_t i;
+    for (i = 0; result && i < banks->count; i++) {
+        const tpm2_pcr_bank *bank = &banks->banks[i];
+        result = files_write_16(f, bank->halg)
+                && files_write_bytes(f, banks->data + bank->offset,
+                        bank_data_size(banks, bank));
+    }
+
+    if (!result) {
+        LOG_ERR("Could not write PCR banks");
+    }
+
+    return result;
+}
+
+tpm2_pcr_banks *tpm2_pcr_banks_load(FILE *f) {
+
+    UINT32 pcr_count;
+    UINT32 count;
+    if (!files_read_32(f, &pcr_count) || !files_read_32(f, &count)) {
+        LOG_ERR("Could not read PCR banks");
+        return NULL;
+    }
+
+    if (pcr_count > TPM2_MAX_PCRS || count > TPM2_NUM_PCR_BANKS) {
+        LOG_ERR("Invalid PCR banks, got %"PRIu32" banks of %"PRIu32" PCRs",
+                count, pcr_count);
+        return NULL;
+    }
+
+    tpm2_pcr_banks *banks = tpm2_pcr_banks_new(pcr_count);
+    if (!banks) {
+        return NULL;
+    }
+
+    UINT32 i;
+    for (i = 0; i < count; i++) {
+        TPMI_ALG_HASH halg;
+        if (!files_read_16(f, &halg)) {
+            goto err;
+        }
+
+        UINT16 size = tpm2_alg_util_get_hash_size(halg);
+        if (!size || find_bank(banks, halg)) {
+            LOG_ERR("Invalid PCR bank algorithm 0x%x", halg);
+            goto err;
+        }
+
+        const tpm2_pcr_bank *bank = add_bank(banks, halg, size);
+        if (!bank || !files_read_bytes(f, banks->data + bank->offset,
+                bank_data_size(banks, bank))) {
+            goto err;
+        }
+    }
+
+    return banks;
+
+err:
+    LOG_ERR("Could not read PCR banks");
+    tpm2_pcr_banks_free(banks);
+
+    return NULL;
+}
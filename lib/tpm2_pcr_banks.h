@@ -0,0 +1,131 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef LIB_TPM2_PCR_BANKS_H_
+#define LIB_TPM2_PCR_BANKS_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+#include "pcr.h"
+
+/*
+ * Software PCR banks, as replayed from an event log. The banks are added as
+ * they are first extended and hold their PCRs in one contiguous buffer. The
+ * extends reuse the hash contexts of the banks, so a tpm2_pcr_banks must not
+ * be shared between threads.
+ */
+typedef struct tpm2_pcr_banks tpm2_pcr_banks;
+
+/**
+ * Allocates empty PCR banks.
+ * @param pcr_count
+ *  The number of PCRs of every bank.
+ * @return
+ *  The banks, to free with tpm2_pcr_banks_free(), NULL on error.
+ */
+tpm2_pcr_banks *tpm2_pcr_banks_new(unsigned pcr_count);
+
+/**
+ * Frees PCR banks allocated with tpm2_pcr_banks_new().
+ * @param banks
+ *  The banks to free, may be NULL.
+ */
+void tpm2_pcr_banks_free(tpm2_pcr_banks *banks);
+
+/**
+ * Extends a PCR: pcr = HASH(pcr || digest).
+ * @param banks
+ *  The PCR banks.
+ * @param halg
+ *  The bank of the PCR, added if it is the first extend of the bank.
+ * @param pcr
+ *  The index of the PCR.
+ * @param digest
+ *  The digest to extend, of the size of the bank.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_pcr_banks_extend(tpm2_pcr_banks *banks, TPMI_ALG_HASH halg,
+        unsigned pcr, const BYTE *digest);
+
+/**
+ * Checks whether a PCR was extended.
+ * @param banks
+ *  The PCR banks.
+ * @param halg
+ *  The bank of the PCR.
+ * @param pcr
+ *  The index of the PCR.
+ * @return
+ *  true if the PCR was extended at least once, false otherwise.
+ */
+bool tpm2_pcr_banks_is_extended(const tpm2_pcr_banks *banks,
+        TPMI_ALG_HASH halg, unsigned pcr);
+
+/**
+ * Retrieves the value of a PCR.
+ * @param banks
+ *  The PCR banks.
+ * @param halg
+ *  The bank of the PCR.
+ * @param pcr
+ *  The index of the PCR.
+ * @return
+ *  The value of the PCR, all zeros if its bank was never extended, valid
+ *  until the next extend. NULL for an unknown algorithm or index.
+ */
+const BYTE *tpm2_pcr_banks_value(const tpm2_pcr_banks *banks,
+        TPMI_ALG_HASH halg, unsigned pcr);
+
+/**
+ * Lays out the values of the selected PCRs like TPM2_PCR_Read returns them.
+ * @param banks
+ *  The PCR banks.
+ * @param pcr_select
+ *  The selected PCRs.
+ * @param pcrs
+ *  The values of the selected PCRs.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_pcr_banks_read(const tpm2_pcr_banks *banks,
+        const TPML_PCR_SELECTION *pcr_select, tpm2_pcrs *pcrs);
+
+/**
+ * Compares the values of the selected PCRs, laid out like TPM2_PCR_Read
+ * returns them, against the banks, and logs the PCRs which differ.
+ * @param banks
+ *  The PCR banks.
+ * @param pcr_select
+ *  The selected PCRs.
+ * @param pcrs
+ *  The values of the selected PCRs.
+ * @return
+ *  true if every selected PCR matches, false otherwise.
+ */
+bool tpm2_pcr_banks_compare(const tpm2_pcr_banks *banks,
+        const TPML_PCR_SELECTION *pcr_select, const tpm2_pcrs *pcrs);
+
+/**
+ * Writes the values of the PCR banks, and which PCRs were extended.
+ * @param banks
+ *  The PCR banks.
+ * @param f
+ *  The file to write to.
+ * @return
+ *  true on success, false on error.
+ */
+bool tpm2_pcr_banks_save(const tpm2_pcr_banks *banks, FILE *f);
+
+/**
+ * Reads PCR banks written with tpm2_pcr_banks_save().
+ * @param f
+ *  The file to read from.
+ * @return
+ *  The banks, to free with tpm2_pcr_banks_free(), NULL on error.
+ */
+tpm2_pcr_banks *tpm2_pcr_banks_load(FILE *f);
+
+#endif /* LIB_TPM2_PCR_BANKS_H_ */
@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <tss2/tss2_mu.h>
+
+#include "files.h"
+#include "log.h"
+#include "tpm2.h"
+#include "tpm2_codec.h"
+#include "tpm2_openssl.h"
+#include "tpm2_primary_cache.h"
+#include "tpm2_util.h"
+
+typedef struct primary_cache_entry primary_cache_entry;
+struct primary_cache_entry {
+    char ctx_path[PATH_MAX];
+};
+
+static bool entry_init(primary_cache_entry *entry, const char *cache_dir,
+        tpm2_hierarchy_pdata *objdata) {
+
+    UINT8 buffer[sizeof(UINT32) + sizeof(TPM2B_PUBLIC)];
+    size_t offset = 0;
+
+    TSS2_RC rval = Tss2_MU_UINT32_Marshal(objdata->in.hierarchy, buffer,
+            sizeof(buffer), &offset);
+    if (rval == TSS2_RC_SUCCESS) {
+        rval = Tss2_MU_TPM2B_PUBLIC_Marshal(&objdata->in.public, buffer,
+                sizeof(buffer), &offset);
+    }
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Tss2_MU_TPM2B_PUBLIC_Marshal, rval);
+        return false;
+    }
+
+    TPM2B_DIGEST digest = { .size = 0 };
+    bool result = tpm2_openssl_hash_compute_data(TPM2_ALG_SHA256, buffer,
+            offset, &digest);
+    if (!result) {
+        return false;
+    }
+
+    char hex[TPM2_CODEC_HEX_SIZE(sizeof(digest.buffer)) + 1];
+    tpm2_codec_hex_encode(digest.buffer, digest.size, hex, false);
+
+    int written = snprintf(entry->ctx_path, sizeof(entry->ctx_path),
+            "%s/%s.ctx", cache_dir, hex);
+    if (written < 0 || (size_t)written >= sizeof(entry->ctx_path)) {
+        LOG_ERR("Primary cache path too long");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * The qualified name of a primary binds its hierarchy: the hash of the
+ * handle of the hierarchy and of the name of the object.
+ */
+static bool is_in_hierarchy(TPMI_RH_PROVISION hierarchy, TPMI_ALG_HASH halg,
+        const TPM2B_NAME *name, const TPM2B_NAME *qualified_name) {
+
+    UINT8 buffer[sizeof(UINT32) + sizeof(name->name)];
+    size_t offset = 0;
+    TSS2_RC rval = Tss2_MU_UINT32_Marshal(hierarchy, buffer, sizeof(buffer),
+            &offset);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Tss2_MU_UINT32_Marshal, rval);
+        return false;
+    }
+    memcpy(buffer + offset, name->name, name->size);
+
+    TPM2B_DIGEST digest = { .size = 0 };
+    bool result = tpm2_openssl_hash_compute_data(halg, buffer,
+            offset + name->size, &digest);
+    if (!result) {
+        return false;
+    }
+
+    UINT8 expected[sizeof(qualified_name->name)];
+    offset = 0;
+    rval = Tss2_MU_UINT16_Marshal(halg, expected, sizeof(expected), &offset);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Tss2_MU_UINT16_Marshal, rval);
+        return false;
+    }
+    memcpy(expected + offset, digest.buffer, digest.size);
+
+    return qualified_name->size == offset + digest.size
+            && !memcmp(qualified_name->name, expected, qualified_name->size);
+}
+
+static bool entry_load(ESYS_CONTEXT *ectx, primary_cache_entry *entry,
+        tpm2_hierarchy_pdata *objdata) {
+
+    if (access(entry->ctx_path, R_OK) != 0) {
+        /* a miss is not an error, the primary is created instead */
+        return false;
+    }
+
+    ESYS_TR handle = ESYS_TR_NONE;
+    tool_rc rc = files_load_tpm_context_from_path(ectx, &handle,
+            entry->ctx_path);
+    if (rc != tool_rc_success) {
+        LOG_WARN("Could not load primary cache entry \"%s\", the hierarchy "
+                "seed probably changed", entry->ctx_path);
+        return false;
+    }
+
+    /*
+     * Anything in the cache directory could have been put there, only what
+     * the TPM reports of the loaded object is trusted: it must be in the
+     * requested hierarchy and have been created from the requested
+     * template, eg with its policy and attributes.
+     */
+    TPM2B_PUBLIC *public = NULL;
+    TPM2B_NAME *name = NULL;
+    TPM2B_NAME *qualified_name = NULL;
+    rc = tpm2_readpublic(ectx, handle, &public, &name, &qualified_name);
+    if (rc != tool_rc_success) {
+        goto flush;
+    }
+
+    bool result = tpm2_util_public_matches_template(&public->publicArea,
+            &objdata->in.public.publicArea)
+            && is_in_hierarchy(objdata->in.hierarchy,
+                    public->publicArea.nameAlg, name, qualified_name);
+    free(name);
+    free(qualified_name);
+    if (!result) {
+        LOG_WARN("Primary cache entry \"%s\" is not the requested primary",
+                entry->ctx_path);
+        free(public);
+        goto flush;
+    }
+
+    objdata->out.handle = handle;
+    objdata->out.public = public;
+
+    LOG_INFO("Primary loaded from cache \"%s\"", entry->ctx_path);
+
+    return true;
+
+flush:
+    tpm2_flush_context(ectx, handle);
+    return false;
+}
+
+static void entry_save(ESYS_CONTEXT *ectx, primary_cache_entry *entry,
+        tpm2_hierarchy_pdata *objdata) {
+
+    /*
+     * Write to a temporary file and rename it in place so that concurrent
+     * provisioning steps sharing a cache directory never observe partial
+     * entries. Failing to populate the cache is not fatal.
+     */
+    char tmp_path[PATH_MAX];
+    int written = snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX",
+            entry->ctx_path);
+    if (written < 0 || (size_t)written >= sizeof(tmp_path)) {
+        return;
+    }
+
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        LOG_WARN("Could not create primary cache entry \"%s\": %s",
+                entry->ctx_path, strerror(errno));
+        return;
+    }
+    close(fd);
+
+    tool_rc rc = files_save_tpm_context_to_path(ectx, objdata->out.handle,
+            tmp_path);
+    if (rc != tool_rc_success || rename(tmp_path, entry->ctx_path) != 0) {
+        unlink(tmp_path);
+        LOG_WARN("Could not save primary cache entry \"%s\"",
+                entry->ctx_path);
+    }
+}
+
+tool_rc tpm2_primary_cache_create(ESYS_CONTEXT *ectx, tpm2_session *sess,
+        tpm2_hierarchy_pdata *objdata, const char *cache_dir, bool *is_cached) {
+
+    if (is_cached) {
+        *is_cached = false;
+    }
+
+    TPMS_SENSITIVE_CREATE *sensitive = &objdata->in.sensitive.sensitive;
+    bool is_cacheable = cache_dir && !sensitive->userAuth.size
+            && !sensitive->data.size;
+    if (cache_dir && !is_cacheable) {
+        LOG_INFO("Not caching a primary with an auth value or sensitive data");
+    }
+
+    primary_cache_entry entry;
+    if (is_cacheable) {
+        is_cacheable = entry_init(&entry, cache_dir, objdata);
+    }
+
+    if (is_cacheable && entry_load(ectx, &entry, objdata)) {
+        if (is_cached) {
+            *is_cached = true;
+        }
+        return tool_rc_success;
+    }
+
+    tool_rc rc = tpm2_hierarchy_create_primary(ectx, sess, objdata, NULL);
+    if (rc != tool_rc_success || !is_cacheable) {
+        return rc;
+    }
+
+    entry_save(ectx, &entry, objdata);
+
+    return tool_rc_success;
+}
@@ -0,0 +1,46 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef LIB_TPM2_PRIMARY_CACHE_H_
+#define LIB_TPM2_PRIMARY_CACHE_H_
+
+#include <tss2/tss2_esys.h>
+
+#include "tool_rc.h"
+#include "tpm2_hierarchy.h"
+#include "tpm2_session.h"
+
+/**
+ * Creates a primary object like tpm2_hierarchy_create_primary(), but first
+ * looks for a context of the same primary in a cache directory.
+ *
+ * Primaries are deterministic for a hierarchy seed and template, so entries
+ * are keyed on the SHA256 of the hierarchy and the TPM2B_PUBLIC template,
+ * unique data included. A context no longer loads once the seed changed,
+ * and a hit is only used if the TPM reports the loaded object in the
+ * hierarchy and with the public area of the template, the unique field
+ * aside. Any miss falls back to TPM2_CC_CreatePrimary and refreshes the
+ * entry.
+ *
+ * Objects with a sensitive part, ie an auth value or data, are never
+ * cached so that no secret is derivable from the cache contents.
+ *
+ * On a hit, only objdata->out.handle and objdata->out.public are set, the
+ * creation data, hash and ticket are left NULL.
+ *
+ * @param ectx
+ *  The Enhanced System API (ESAPI) context.
+ * @param sess
+ *  The authorised session for the hierarchy.
+ * @param objdata
+ *  The objects data configuration.
+ * @param cache_dir
+ *  The cache directory, NULL to not use a cache.
+ * @param is_cached
+ *  Set to true if the primary came from the cache, may be NULL.
+ * @return
+ *  tool_rc indicating status.
+ */
+tool_rc tpm2_primary_cache_create(ESYS_CONTEXT *ectx, tpm2_session *sess,
+        tpm2_hierarchy_pdata *objdata, const char *cache_dir, bool *is_cached);
+
+#endif /* LIB_TPM2_PRIMARY_CACHE_H_ */
@@ -1,16 +1,18 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
-#include <ctype.h>
 #include <dlfcn.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#include <tss2/tss2_mu.h>
+
 #include "files.h"
 #include "log.h"
 #include "tool_rc.h"
 #include "tpm2.h"
+#include "tpm2_codec.h"
 #include "tpm2_alg_util.h"
 #include "tpm2_attr_util.h"
 #include "tpm2_convert.h"
@@ -182,29 +184,21 @@ bool tpm2_util_string_to_int32(const char *str, int32_t *value) {
 
 int tpm2_util_hex_to_byte_structure(const char *input_string, UINT16 *byte_length,
         BYTE *byte_buffer) {
-    int str_length; //if the input_string likes "1a2b...", no prefix "0x"
-    int i = 0;
+    size_t str_length; //if the input_string likes "1a2b...", no prefix "0x"
     if (input_string == NULL || byte_length == NULL || byte_buffer == NULL)
         return -1;
     str_length = strlen(input_string);
     if (str_length % 2)
         return -2;
-    for (i = 0; i < str_length; i++) {
-        if (!isxdigit(input_string[i]))
-            return -3;
-    }
+    if (strspn(input_string, "0123456789abcdefABCDEF") != str_length)
+        return -3;
 
     if (*byte_length < str_length / 2)
         return -4;
 
     *byte_length = str_length / 2;
 
-    for (i = 0; i < *byte_length; i++) {
-        char tmp_str[4] = { 0 };
-        tmp_str[0] = input_string[i * 2];
-        tmp_str[1] = input_string[i * 2 + 1];
-        byte_buffer[i] = strtol(tmp_str, NULL, 16);
-    }
+    tpm2_codec_hex_decode(input_string, str_length, byte_buffer);
     return 0;
 }
 
@@ -231,9 +225,14 @@ out:
 
 void tpm2_util_hexdump2(FILE *f, const BYTE *data, size_t len) {
 
-    size_t i;
-    for (i = 0; i < len; i++) {
-        fprintf(f, "%02x", data[i]);
+    /* encode in chunks, writing each with a single call */
+    char hex[TPM2_CODEC_HEX_SIZE(512) + 1];
+    while (len) {
+        size_t chunk = len < 512 ? len : 512;
+        size_t length = tpm2_codec_hex_encode(data, chunk, hex, false);
+        fwrite(hex, 1, length, f);
+        data += chunk;
+        len -= chunk;
     }
 }
 
@@ -452,6 +451,33 @@ static void print_kdf_scheme(TPMT_KDF_SCHEME *kdf, const char *indent) {
     print_alg_raw("kdfa-halg", kdf->details.mgf1.hashAlg, indent);
 }
 
+bool tpm2_util_public_matches_template(const TPMT_PUBLIC *public,
+        const TPMT_PUBLIC *template) {
+
+    /*
+     * Compared in their marshalled form, which skips the unused bytes of
+     * the unions and the sized buffers.
+     */
+    UINT8 buffers[2][sizeof(TPMT_PUBLIC)];
+    size_t sizes[2] = { 0, 0 };
+    const TPMT_PUBLIC *areas[2] = { public, template };
+
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(areas); i++) {
+        TPMT_PUBLIC area = *areas[i];
+        memset(&area.unique, 0, sizeof(area.unique));
+
+        TSS2_RC rval = Tss2_MU_TPMT_PUBLIC_Marshal(&area, buffers[i],
+                sizeof(buffers[i]), &sizes[i]);
+        if (rval != TSS2_RC_SUCCESS) {
+            LOG_PERR(Tss2_MU_TPMT_PUBLIC_Marshal, rval);
+            return false;
+        }
+    }
+
+    return sizes[0] == sizes[1] && !memcmp(buffers[0], buffers[1], sizes[0]);
+}
+
 void tpm2_util_tpmt_public_to_yaml(TPMT_PUBLIC *public, char *indent) {
 
     if (!indent) {
@@ -1045,7 +1071,7 @@ bool tpm2_pem_encoded_key_to_fingerprint(const char *pem_encoded_key,
     }
 
     BYTE buffer[1024];
-    size_t buffer_length = 0;
+    size_t buffer_length = sizeof(buffer);
     int rc = tpm2_base64_decode(base64, buffer, &buffer_length);
     if(!rc){
         LOG_ERR("%s", "tpm2_base64_decode");
@@ -334,6 +334,20 @@ void tpm2_util_public_to_yaml(TPM2B_PUBLIC *public, char *indent);
 
 void tpm2_util_tpmt_public_to_yaml(TPMT_PUBLIC *public, char *indent);
 
+/**
+ * Checks that a public area, eg of an object found on disk, is the one the
+ * TPM would create from a template. The unique field is ignored: the TPM
+ * replaces the one of the template with the public key.
+ * @param public
+ *  The public area of the object.
+ * @param template
+ *  The template of the object.
+ * @return
+ *  true if the public area matches the template.
+ */
+bool tpm2_util_public_matches_template(const TPMT_PUBLIC *public,
+        const TPMT_PUBLIC *template);
+
 /**
  * Convert a TPMA_OBJECT to a yaml format and output if not quiet.
  * @param obj
@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "tpm2_openssl.h"
+#include "tpm2_util.h"
+#include "tpm2_worker.h"
+
+/*
+ * Upper bound on the worker threads, guards against typos in the jobs option
+ * spawning thousands of threads.
+ */
+#define MAX_JOBS 256
+
+typedef struct worker_batch worker_batch;
+struct worker_batch {
+    size_t count;
+    size_t next;
+    bool is_failed;
+    tpm2_worker_item_fn fn;
+    void *userdata;
+};
+
+unsigned tpm2_worker_default_jobs(void) {
+
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    if (online < 1) {
+        return 1;
+    }
+
+    return online > MAX_JOBS ? MAX_JOBS : (unsigned) online;
+}
+
+bool tpm2_worker_jobs_from_optarg(const char *value, unsigned *jobs) {
+
+    uint32_t count;
+    bool result = tpm2_util_string_to_uint32(value, &count);
+    if (!result || count > MAX_JOBS) {
+        LOG_ERR("Invalid number of jobs, got: \"%s\", expected 0 to %u",
+                value, MAX_JOBS);
+        return false;
+    }
+
+    *jobs = count ? count : tpm2_worker_default_jobs();
+    return true;
+}
+
+static void *worker_main(void *arg) {
+
+    worker_batch *batch = (worker_batch *) arg;
+
+    while (true) {
+        size_t index = __atomic_fetch_add(&batch->next, 1, __ATOMIC_RELAXED);
+        if (index >= batch->count) {
+            break;
+        }
+
+        bool result = batch->fn(batch->userdata, index);
+        if (!result) {
+            __atomic_store_n(&batch->is_failed, true, __ATOMIC_RELAXED);
+        }
+    }
+
+    return NULL;
+}
+
+bool tpm2_worker_run(size_t count, unsigned jobs, tpm2_worker_item_fn fn,
+        void *userdata) {
+
+    worker_batch batch = {
+        .count = count,
+        .fn = fn,
+        .userdata = userdata,
+    };
+
+#if defined(LIB_TPM2_OPENSSL_OPENSSL_PRE11)
+    /*
+     * OpenSSL before 1.1.0 requires locking callbacks to be used from
+     * multiple threads, which the tools do not install.
+     */
+    jobs = 1;
+#endif
+
+    if (jobs > MAX_JOBS) {
+        jobs = MAX_JOBS;
+    }
+
+    size_t thread_cnt = jobs > 1 && count > 1 ?
+            (count < jobs ? count : jobs) - 1 : 0;
+    pthread_t *threads = NULL;
+    size_t started = 0;
+    if (thread_cnt) {
+        threads = calloc(thread_cnt, sizeof(*threads));
+        if (!threads) {
+            LOG_WARN("oom, processing serially");
+            thread_cnt = 0;
+        }
+    }
+
+    for (started = 0; started < thread_cnt; started++) {
+        int rc = pthread_create(&threads[started], NULL, worker_main, &batch);
+        if (rc) {
+            LOG_WARN("Could not create worker thread: %s, continuing with %zu",
+                    strerror(rc), started + 1);
+            break;
+        }
+    }
+
+    /* the calling thread is a worker as well */
+    worker_main(&batch);
+
+    size_t i;
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    free(threads);
+
+    return !batch.is_failed;
+}
@@ -0,0 +1,64 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef LIB_TPM2_WORKER_H_
+#define LIB_TPM2_WORKER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Callback invoked for every item of a batch handed to tpm2_worker_run().
+ * The callback is invoked concurrently from multiple threads and must only
+ * touch state that belongs to the item at index.
+ * @param userdata
+ *  The userdata pointer passed to tpm2_worker_run().
+ * @param index
+ *  The index of the item to process.
+ * @return
+ *  True on success, false otherwise.
+ */
+typedef bool (*tpm2_worker_item_fn)(void *userdata, size_t index);
+
+/**
+ * Retrieves the number of worker threads to use when none is specified, which
+ * is the number of online processors.
+ * @return
+ *  The default number of worker threads, always at least 1.
+ */
+unsigned tpm2_worker_default_jobs(void);
+
+/**
+ * Converts a jobs option argument into a worker thread count. A value of 0
+ * selects tpm2_worker_default_jobs().
+ * @param value
+ *  The option argument to convert.
+ * @param jobs
+ *  The converted worker thread count, valid on success.
+ * @return
+ *  True on success, false otherwise.
+ */
+bool tpm2_worker_jobs_from_optarg(const char *value, unsigned *jobs);
+
+/**
+ * Processes the items [0, count) by invoking fn on a pool of worker threads.
+ * The calling thread takes part in the processing and the call returns once
+ * every item has been processed. Items are handed out dynamically so slow
+ * items do not stall the other workers.
+ *
+ * When threads cannot be created, or the crypto library is not thread safe,
+ * the items are processed serially on the calling thread.
+ * @param count
+ *  The number of items to process.
+ * @param jobs
+ *  The maximum number of threads to use, including the calling thread.
+ * @param fn
+ *  The callback to invoke for every item.
+ * @param userdata
+ *  Passed as is to fn.
+ * @return
+ *  True if fn succeeded for every item, false otherwise.
+ */
+bool tpm2_worker_run(size_t count, unsigned jobs, tpm2_worker_item_fn fn,
+        void *userdata);
+
+#endif /* LIB_TPM2_WORKER_H_ */
@@ -0,0 +1,950 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+/*
+ * Generates a synthetic crypto agile TCG event log and times the event log
+ * stack on it: the parsing, the verification of the digests, the replay of
+ * tpm2_checkquote with and without its cache and the YAML output of
+ * tpm2_eventlog. The results are printed as a YAML document, to track the
+ * performance of the parser from one commit to the next.
+ *
+ * Run without options, as done by "make check", it benchmarks a small log
+ * and fails if the log does not parse, verify and replay to the PCR values
+ * the generator extended. "make bench" runs it on logs of growing sizes.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "efi_event.h"
+#include "files.h"
+#include "log.h"
+#include "tpm2_alg_util.h"
+#include "tpm2_eventlog.h"
+#include "tpm2_eventlog_cache.h"
+#include "tpm2_eventlog_yaml.h"
+#include "tpm2_openssl.h"
+#include "tpm2_pcr_banks.h"
+#include "tpm2_util.h"
+
+#define BENCH_DEFAULT_SIZE (256 * 1024)
+#define BENCH_DEFAULT_ITERATIONS 3
+#define BENCH_DEFAULT_SEED 1
+/* the largest payload of the templates, a certificate of the db */
+#define BENCH_EVENT_MAX 2048
+#define BENCH_PCRS 24
+#define BENCH_YAML_VERSION 2
+
+typedef struct bench_event bench_event;
+struct bench_event {
+    UINT32 pcr;
+    UINT32 type;
+    BYTE data[BENCH_EVENT_MAX];
+    UINT32 size;
+    /* the part of the data the digests are of, random digests when NULL */
+    const BYTE *measured;
+    size_t measured_size;
+};
+
+typedef void (*bench_event_fn)(UINT64 *rng, bench_event *event);
+
+typedef struct bench_template bench_template;
+struct bench_template {
+    UINT32 type;
+    unsigned weight;
+    bench_event_fn fn;
+};
+
+typedef struct bench_log bench_log;
+struct bench_log {
+    BYTE *data;
+    size_t size;
+    size_t events;
+    /* the PCR values the generator extended, NULL for a log read from file */
+    tpm2_pcr_banks *banks;
+};
+
+typedef struct bench_result bench_result;
+struct bench_result {
+    double seconds;
+    size_t failed;
+};
+
+typedef bool (*bench_phase_fn)(const bench_log *log, bench_result *result);
+
+/* the state of the event log callbacks, which get no data from the phases
+ * since a context with data verifies the digests of its events */
+static struct {
+    size_t events;
+    size_t failed;
+    TCG_EVENT_HEADER2 const *eventhdr;
+    tpm2_openssl_hasher *hasher;
+    tpm2_eventlog_cache *cache;
+} state;
+
+static struct {
+    UINT64 size;
+    UINT32 iterations;
+    UINT64 seed;
+    TPMI_ALG_HASH banks[TPM2_NUM_PCR_BANKS];
+    UINT32 bank_count;
+    const char *input_path;
+    const char *output_path;
+    const char *label;
+} ctx = {
+    .size = BENCH_DEFAULT_SIZE,
+    .iterations = BENCH_DEFAULT_ITERATIONS,
+    .seed = BENCH_DEFAULT_SEED,
+    .banks = { TPM2_ALG_SHA1, TPM2_ALG_SHA256 },
+    .bank_count = 2,
+};
+
+/* xorshift64*, the logs are reproducible from their seed */
+static UINT64 rng_next(UINT64 *rng) {
+
+    *rng ^= *rng >> 12;
+    *rng ^= *rng << 25;
+    *rng ^= *rng >> 27;
+    return *rng * 0x2545f4914f6cdd1dULL;
+}
+
+static size_t rng_range(UINT64 *rng, size_t min, size_t max) {
+
+    return min + rng_next(rng) % (max - min + 1);
+}
+
+static void rng_fill(UINT64 *rng, BYTE *data, size_t size) {
+
+    size_t i;
+    for (i = 0; i < size; i++) {
+        data[i] = rng_next(rng);
+    }
+}
+
+static UINT32 uefi_variable(UINT64 *rng, bench_event *event, const char *name,
+        size_t data_size) {
+
+    UEFI_VARIABLE_DATA *var = (UEFI_VARIABLE_DATA *)event->data;
+    rng_fill(rng, (BYTE *)&var->VariableName, sizeof(var->VariableName));
+    var->UnicodeNameLength = strlen(name);
+    var->VariableDataLength = data_size;
+
+    size_t i;
+    for (i = 0; name[i]; i++) {
+        var->UnicodeName[i].c = name[i];
+    }
+
+    return sizeof(*var) + var->UnicodeNameLength * sizeof(UTF16_CHAR) +
+            data_size;
+}
+
+static void event_post_code(UINT64 *rng, bench_event *event) {
+
+    UEFI_PLATFORM_FIRMWARE_BLOB *blob =
+            (UEFI_PLATFORM_FIRMWARE_BLOB *)event->data;
+    blob->BlobBase = rng_next(rng) & ~0xfffULL;
+    blob->BlobLength = rng_range(rng, 1, 256) * 4096;
+    event->pcr = 0;
+    event->size = sizeof(*blob);
+}
+
+static void event_crtm_version(UINT64 *rng, bench_event *event) {
+
+    UNUSED(rng);
+
+    static const char version[] = "1.0.0";
+    UTF16_CHAR *data = (UTF16_CHAR *)event->data;
+    size_t i;
+    for (i = 0; i < sizeof(version); i++) {
+        data[i].c = version[i];
+    }
+    event->pcr = 0;
+    event->size = sizeof(version) * sizeof(UTF16_CHAR);
+    event->measured = event->data;
+    event->measured_size = event->size;
+}
+
+static void event_driver_config(UINT64 *rng, bench_event *event) {
+
+    event->pcr = 7;
+    event->size = uefi_variable(rng, event, "SecureBoot", 1);
+    event->data[event->size - 1] = 1;
+    event->measured = event->data;
+    event->measured_size = event->size;
+}
+
+static void event_variable_boot(UINT64 *rng, bench_event *event) {
+
+    size_t count = rng_range(rng, 1, 8);
+    event->pcr = 1;
+    event->size = uefi_variable(rng, event, "BootOrder", count * 2);
+    rng_fill(rng, &event->data[event->size - count * 2], count * 2);
+    event->measured = event->data;
+    event->measured_size = event->size;
+}
+
+static void event_variable_authority(UINT64 *rng, bench_event *event) {
+
+    /* an EFI_SIGNATURE_DATA, its owner and a certificate */
+    size_t data_size = sizeof(EFI_GUID) + rng_range(rng, 512, 1536);
+    event->pcr = 7;
+    event->size = uefi_variable(rng, event, "db", data_size);
+    rng_fill(rng, &event->data[event->size - data_size], data_size);
+    event->measured = event->data;
+    event->measured_size = event->size;
+}
+
+static void event_image_load(UINT64 *rng, bench_event *event) {
+
+    /* the end of the device path only, the image digests are random */
+    static const BYTE end[] = { 0x7f, 0xff, 0x04, 0x00 };
+    UEFI_IMAGE_LOAD_EVENT *image = (UEFI_IMAGE_LOAD_EVENT *)event->data;
+    image->ImageLocationInMemory = rng_next(rng) & ~0xfffULL;
+    image->ImageLengthInMemory = rng_range(rng, 16, 4096) * 1024;
+    image->ImageLinkTimeAddress = 0;
+    image->LengthOfDevicePath = sizeof(end);
+    memcpy(image->DevicePath, end, sizeof(end));
+    event->pcr = event->type == EV_EFI_BOOT_SERVICES_APPLICATION ? 4 : 2;
+    event->size = sizeof(*image) + sizeof(end);
+}
+
+static void event_action(UINT64 *rng, bench_event *event) {
+
+    static const char *actions[] = {
+        "Calling EFI Application from Boot Option",
+        "Returning from EFI Application from Boot Option",
+        "Exit Boot Services Invocation",
+        "Exit Boot Services Returned with Success",
+    };
+    const char *action = actions[rng_next(rng) % ARRAY_LEN(actions)];
+    event->pcr = rng_next(rng) % 2 ? 4 : 5;
+    event->size = strlen(action);
+    memcpy(event->data, action, event->size);
+    event->measured = event->data;
+    event->measured_size = event->size;
+}
+
+static void event_separator(UINT64 *rng, bench_event *event) {
+
+    memset(event->data, 0, 4);
+    event->pcr = rng_next(rng) % 8;
+    event->size = 4;
+    event->measured = event->data;
+    event->measured_size = event->size;
+}
+
+static void event_ipl(UINT64 *rng, bench_event *event) {
+
+    /* the kernel and initrd images loaded by grub, digests of the images */
+    if (rng_next(rng) % 4 == 0) {
+        static const char image[] = "/boot/vmlinuz-linux";
+        event->pcr = 9;
+        event->size = sizeof(image);
+        memcpy(event->data, image, sizeof(image));
+        return;
+    }
+
+    /* the grub commands, the digests being of the command line */
+    static const char prefix[] = "grub_cmd: ";
+    static const char alphabet[] = "abcdefghijklmnopqrstuvwxyz0123456789_=/";
+    size_t length = rng_range(rng, 16, 200);
+    memcpy(event->data, prefix, sizeof(prefix) - 1);
+    size_t i;
+    for (i = 0; i < length; i++) {
+        event->data[sizeof(prefix) - 1 + i] =
+                alphabet[rng_next(rng) % (sizeof(alphabet) - 1)];
+    }
+    event->data[sizeof(prefix) - 1 + length] = '\0';
+    event->pcr = 8;
+    event->size = sizeof(prefix) + length;
+    event->measured = &event->data[sizeof(prefix) - 1];
+    event->measured_size = length;
+}
+
+/* the default weights follow the boot log of a Linux host */
+static bench_template templates[] = {
+    { EV_POST_CODE,                     4,  event_post_code },
+    { EV_EFI_PLATFORM_FIRMWARE_BLOB,    4,  event_post_code },
+    { EV_S_CRTM_VERSION,                1,  event_crtm_version },
+    { EV_EFI_VARIABLE_DRIVER_CONFIG,    5,  event_driver_config },
+    { EV_EFI_VARIABLE_BOOT,             2,  event_variable_boot },
+    { EV_EFI_VARIABLE_AUTHORITY,        4,  event_variable_authority },
+    { EV_EFI_BOOT_SERVICES_APPLICATION, 4,  event_image_load },
+    { EV_EFI_BOOT_SERVICES_DRIVER,      6,  event_image_load },
+    { EV_EFI_ACTION,                    2,  event_action },
+    { EV_SEPARATOR,                     8,  event_separator },
+    { EV_IPL,                           60, event_ipl },
+};
+
+static const bench_template *template_pick(UINT64 *rng) {
+
+    unsigned total = 0;
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(templates); i++) {
+        total += templates[i].weight;
+    }
+
+    unsigned pick = rng_next(rng) % total;
+    for (i = 0; pick >= templates[i].weight; i++) {
+        pick -= templates[i].weight;
+    }
+
+    return &templates[i];
+}
+
+static bool event_write(FILE *f, tpm2_openssl_hasher *hasher, UINT64 *rng,
+        const bench_event *event, tpm2_pcr_banks *banks) {
+
+    TPML_DIGEST_VALUES digests = { .count = ctx.bank_count };
+    tpm2_openssl_hash_msg msgs[TPM2_NUM_PCR_BANKS];
+
+    UINT32 i;
+    for (i = 0; i < ctx.bank_count; i++) {
+        digests.digests[i].hashAlg = ctx.banks[i];
+        msgs[i] = (tpm2_openssl_hash_msg) {
+            .halg = ctx.banks[i],
+            .data = event->measured,
+            .length = event->measured_size,
+            .digest = (BYTE *)&digests.digests[i].digest
+        };
+        if (!event->measured) {
+            rng_fill(rng, msgs[i].digest,
+                    tpm2_alg_util_get_hash_size(ctx.banks[i]));
+        }
+    }
+
+    if (event->measured && !tpm2_openssl_hash_batch(hasher, msgs,
+            ctx.bank_count)) {
+        return false;
+    }
+
+    for (i = 0; i < ctx.bank_count; i++) {
+        if (!tpm2_pcr_banks_extend(banks, ctx.banks[i], event->pcr,
+                msgs[i].digest)) {
+            return false;
+        }
+    }
+
+    return tpm2_eventlog_write_event2(f, event->pcr, event->type, &digests,
+            event->data, event->size);
+}
+
+/*
+ * Generates events until the log reaches the requested size, closing it with
+ * the separators of PCRs 0 to 7 like firmware does.
+ */
+static bool log_generate(bench_log *log) {
+
+    FILE *f = open_memstream((char **)&log->data, &log->size);
+    if (!f) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    bool result = false;
+    tpm2_openssl_hasher *hasher = tpm2_openssl_hasher_new();
+    log->banks = tpm2_pcr_banks_new(TPM2_MAX_PCRS);
+    if (!hasher || !log->banks) {
+        goto out;
+    }
+
+    if (!tpm2_eventlog_write_specid(f, ctx.banks, ctx.bank_count)) {
+        goto out;
+    }
+
+    UINT64 rng = ctx.seed ? ctx.seed : BENCH_DEFAULT_SEED;
+    bench_event event;
+    while ((UINT64)ftell(f) < ctx.size) {
+        memset(&event, 0, sizeof(event));
+        const bench_template *template = template_pick(&rng);
+        event.type = template->type;
+        template->fn(&rng, &event);
+        if (!event_write(f, hasher, &rng, &event, log->banks)) {
+            goto out;
+        }
+        log->events++;
+    }
+
+    UINT32 pcr;
+    for (pcr = 0; pcr < 8; pcr++) {
+        memset(&event, 0, sizeof(event));
+        event.type = EV_SEPARATOR;
+        event_separator(&rng, &event);
+        event.pcr = pcr;
+        if (!event_write(f, hasher, &rng, &event, log->banks)) {
+            goto out;
+        }
+        log->events++;
+    }
+
+    result = true;
+
+out:
+    tpm2_openssl_hasher_free(hasher);
+    if (fclose(f)) {
+        result = false;
+    }
+
+    return result;
+}
+
+static bool log_read(const char *path, bench_log *log) {
+
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+        LOG_ERR("Could not open \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+
+    unsigned long size;
+    bool result = files_get_file_size(f, &size, path);
+    if (result) {
+        log->size = size;
+        log->data = malloc(size ? size : 1);
+        result = log->data && files_read_bytes(f, log->data, size);
+    }
+    fclose(f);
+
+    return result;
+}
+
+static bool log_write(const char *path, const bench_log *log) {
+
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        LOG_ERR("Could not open \"%s\": %s", path, strerror(errno));
+        return false;
+    }
+
+    bool result = files_write_bytes(f, log->data, log->size);
+    result = !fclose(f) && result;
+    if (!result) {
+        LOG_ERR("Could not write \"%s\"", path);
+    }
+
+    return result;
+}
+
+static double seconds_since(const struct timespec *start) {
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) +
+            (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static bool count_event2(TCG_EVENT_HEADER2 const *eventhdr, size_t size,
+        void *data) {
+
+    UNUSED(eventhdr);
+    UNUSED(size);
+    UNUSED(data);
+
+    state.events++;
+    return true;
+}
+
+static bool verify_event2hdr(TCG_EVENT_HEADER2 const *eventhdr, size_t size,
+        void *data) {
+
+    state.eventhdr = eventhdr;
+    return count_event2(eventhdr, size, data);
+}
+
+static bool verify_event2(TCG_EVENT2 const *event, UINT32 type, void *data,
+        uint32_t eventlog_version) {
+
+    UNUSED(type);
+    UNUSED(data);
+    UNUSED(eventlog_version);
+
+    if (!verify_digests(state.hasher, state.events, state.eventhdr,
+            (TCG_EVENT2 *)event)) {
+        state.failed++;
+    }
+
+    return true;
+}
+
+static bool phase_parse(const bench_log *log, bench_result *result) {
+
+    UNUSED(result);
+
+    tpm2_eventlog_context eventlog_ctx = { 0 };
+    return parse_eventlog(&eventlog_ctx, log->data, log->size);
+}
+
+static bool phase_verify(const bench_log *log, bench_result *result) {
+
+    tpm2_eventlog_context eventlog_ctx = {
+        .event2hdr_cb = verify_event2hdr,
+        .event2_cb = verify_event2,
+        .hasher = state.hasher,
+    };
+
+    state.events = 0;
+    state.failed = 0;
+    bool ret = parse_eventlog(&eventlog_ctx, log->data, log->size);
+    result->failed = state.failed;
+
+    return ret;
+}
+
+/* the replay of tpm2_checkquote, parsing the log every time */
+static bool phase_replay(const bench_log *log, bench_result *result) {
+
+    UNUSED(result);
+
+    tpm2_pcr_banks *banks = tpm2_eventlog_cache_replay(NULL, log->data,
+            log->size);
+    tpm2_pcr_banks_free(banks);
+
+    return banks != NULL;
+}
+
+/* the replay of tpm2_checkquote with --eventlog-cache, the log being known */
+static bool phase_replay_cached(const bench_log *log, bench_result *result) {
+
+    UNUSED(result);
+
+    tpm2_pcr_banks *banks = tpm2_eventlog_cache_replay(state.cache, log->data,
+            log->size);
+    tpm2_pcr_banks_free(banks);
+
+    return banks != NULL;
+}
+
+/* the output of tpm2_eventlog, written to /dev/null */
+static bool phase_yaml(const bench_log *log, bench_result *result) {
+
+    UNUSED(result);
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd < 0) {
+        LOG_ERR("Could not open /dev/null: %s", strerror(errno));
+        return false;
+    }
+
+    fflush(stdout);
+    int stdout_fd = dup(STDOUT_FILENO);
+    if (stdout_fd < 0 || dup2(null_fd, STDOUT_FILENO) < 0) {
+        LOG_ERR("Could not redirect stdout: %s", strerror(errno));
+        close(null_fd);
+        if (stdout_fd >= 0) {
+            close(stdout_fd);
+        }
+        return false;
+    }
+    close(null_fd);
+
+    bool ret = yaml_eventlog(log->data, log->size, BENCH_YAML_VERSION);
+
+    fflush(stdout);
+    dup2(stdout_fd, STDOUT_FILENO);
+    close(stdout_fd);
+
+    return ret;
+}
+
+/*
+ * Times a phase over the iterations and prints its fastest run, the least
+ * disturbed by the rest of the system.
+ */
+static bool phase_run(const char *name, bench_phase_fn fn,
+        const bench_log *log) {
+
+    bench_result best = { 0 };
+    unsigned i;
+    for (i = 0; i < ctx.iterations; i++) {
+        bench_result result = { 0 };
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        bool ret = fn(log, &result);
+        result.seconds = seconds_since(&start);
+        if (!ret) {
+            LOG_ERR("The %s phase failed", name);
+            return false;
+        }
+
+        if (!i || result.seconds < best.seconds) {
+            best = result;
+        }
+    }
+
+    printf("  %s:\n", name);
+    printf("    seconds: %.6f\n", best.seconds);
+    printf("    mib-per-second: %.1f\n", best.seconds > 0 ?
+            log->size / (1024.0 * 1024.0) / best.seconds : 0.0);
+    printf("    events-per-second: %.0f\n", best.seconds > 0 ?
+            log->events / best.seconds : 0.0);
+    if (fn == phase_verify) {
+        printf("    failed: %zu\n", best.failed);
+    }
+
+    return true;
+}
+
+/*
+ * Checks the log against the generator: every event is parsed, every digest
+ * the parser can verify matches its payload and the replay leads to the PCR
+ * values the generator extended.
+ */
+static bool log_check(const bench_log *log) {
+
+    bench_result result = { 0 };
+    if (!phase_verify(log, &result)) {
+        LOG_ERR("The generated log does not parse");
+        return false;
+    }
+
+    if (state.events != log->events || result.failed) {
+        LOG_ERR("Parsed %zu events of %zu, %zu failed to verify",
+                state.events, log->events, result.failed);
+        return false;
+    }
+
+    tpm2_pcr_banks *banks = tpm2_eventlog_cache_replay(NULL, log->data,
+            log->size);
+    if (!banks) {
+        LOG_ERR("The generated log does not replay");
+        return false;
+    }
+
+    bool ret = true;
+    UINT32 i;
+    for (i = 0; i < ctx.bank_count && ret; i++) {
+        unsigned pcr;
+        for (pcr = 0; pcr < BENCH_PCRS && ret; pcr++) {
+            ret = !memcmp(tpm2_pcr_banks_value(banks, ctx.banks[i], pcr),
+                    tpm2_pcr_banks_value(log->banks, ctx.banks[i], pcr),
+                    tpm2_alg_util_get_hash_size(ctx.banks[i]));
+            if (!ret) {
+                LOG_ERR("PCR%u of bank 0x%x differs from the generator",
+                        pcr, ctx.banks[i]);
+            }
+        }
+    }
+    tpm2_pcr_banks_free(banks);
+
+    return ret;
+}
+
+static void cache_remove(const char *dir) {
+
+    DIR *d = opendir(dir);
+    if (d) {
+        struct dirent *entry;
+        while ((entry = readdir(d))) {
+            if (strcmp(entry->d_name, ".") && strcmp(entry->d_name, "..")) {
+                unlinkat(dirfd(d), entry->d_name, 0);
+            }
+        }
+        closedir(d);
+    }
+    rmdir(dir);
+}
+
+static bool bench_run(const bench_log *log) {
+
+    printf("---\n");
+    printf("label: %s\n", ctx.label ? ctx.label : "");
+    printf("log:\n");
+    if (ctx.input_path) {
+        printf("  path: %s\n", ctx.input_path);
+    } else {
+        printf("  seed: %" PRIu64 "\n", ctx.seed);
+        printf("  banks:\n");
+        UINT32 i;
+        for (i = 0; i < ctx.bank_count; i++) {
+            printf("    - %s\n", tpm2_alg_util_algtostr(ctx.banks[i],
+                    tpm2_alg_util_flags_hash));
+        }
+    }
+    printf("  size: %zu\n", log->size);
+    printf("  events: %zu\n", log->events);
+    printf("iterations: %u\n", ctx.iterations);
+
+    if (!ctx.iterations) {
+        return true;
+    }
+
+    char cache_dir[] = "/tmp/tpm2_eventlog_bench.XXXXXX";
+    if (!mkdtemp(cache_dir)) {
+        LOG_ERR("Could not create a cache directory: %s", strerror(errno));
+        return false;
+    }
+
+    bool result = false;
+    state.cache = tpm2_eventlog_cache_open(cache_dir,
+            TPM2_EVENTLOG_CACHE_DEFAULT_SIZE);
+    state.hasher = tpm2_openssl_hasher_new();
+    if (!state.cache || !state.hasher) {
+        goto out;
+    }
+
+    /* fill the cache, the cached replay is then timed on hits */
+    tpm2_pcr_banks *banks = tpm2_eventlog_cache_replay(state.cache,
+            log->data, log->size);
+    if (!banks) {
+        goto out;
+    }
+    tpm2_pcr_banks_free(banks);
+
+    printf("phases:\n");
+    result = phase_run("parse", phase_parse, log) &&
+             phase_run("verify", phase_verify, log) &&
+             phase_run("replay", phase_replay, log) &&
+             phase_run("replay-cached", phase_replay_cached, log) &&
+             phase_run("yaml", phase_yaml, log);
+
+out:
+    tpm2_openssl_hasher_free(state.hasher);
+    tpm2_eventlog_cache_close(state.cache);
+    cache_remove(cache_dir);
+
+    return result;
+}
+
+static bool size_from_optarg(const char *value, UINT64 *size) {
+
+    char *end;
+    errno = 0;
+    unsigned long long number = strtoull(value, &end, 0);
+    if (errno || end == value) {
+        return false;
+    }
+
+    unsigned shift = 0;
+    switch (*end) {
+    case 'G':
+        shift += 10;
+        /* fallthrough */
+    case 'M':
+        shift += 10;
+        /* fallthrough */
+    case 'K':
+        shift += 10;
+        end++;
+        break;
+    }
+
+    if (*end || number > (UINT64_MAX >> shift)) {
+        return false;
+    }
+
+    *size = (UINT64)number << shift;
+    return true;
+}
+
+static bool banks_from_optarg(char *value) {
+
+    ctx.bank_count = 0;
+
+    char *saveptr;
+    char *token;
+    for (token = strtok_r(value, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        TPMI_ALG_HASH halg = tpm2_alg_util_from_optarg(token,
+                tpm2_alg_util_flags_hash);
+        if (halg == TPM2_ALG_ERROR) {
+            LOG_ERR("Unknown hash algorithm, got: \"%s\"", token);
+            return false;
+        }
+
+        UINT32 i;
+        for (i = 0; i < ctx.bank_count; i++) {
+            if (ctx.banks[i] == halg) {
+                LOG_ERR("Duplicate bank, got: \"%s\"", token);
+                return false;
+            }
+        }
+
+        if (ctx.bank_count == ARRAY_LEN(ctx.banks)) {
+            LOG_ERR("Too many banks, at most %zu", ARRAY_LEN(ctx.banks));
+            return false;
+        }
+        ctx.banks[ctx.bank_count++] = halg;
+    }
+
+    if (!ctx.bank_count) {
+        LOG_ERR("Expected at least a bank");
+        return false;
+    }
+
+    return true;
+}
+
+/* TYPE=WEIGHT[,TYPE=WEIGHT...], the other types keeping their weights */
+static bool mix_from_optarg(char *value) {
+
+    char *saveptr;
+    char *token;
+    for (token = strtok_r(value, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        char *weight = strchr(token, '=');
+        if (!weight) {
+            LOG_ERR("Expected TYPE=WEIGHT, got: \"%s\"", token);
+            return false;
+        }
+        *weight++ = '\0';
+
+        UINT32 type;
+        UINT32 number;
+        if (!eventtype_from_string(token, &type) ||
+            !tpm2_util_string_to_uint32(weight, &number)) {
+            LOG_ERR("Expected TYPE=WEIGHT, got: \"%s=%s\"", token, weight);
+            return false;
+        }
+
+        size_t i;
+        for (i = 0; i < ARRAY_LEN(templates); i++) {
+            if (templates[i].type == type) {
+                templates[i].weight = number;
+                break;
+            }
+        }
+
+        if (i == ARRAY_LEN(templates)) {
+            LOG_ERR("No synthetic events of type \"%s\"", token);
+            return false;
+        }
+    }
+
+    unsigned total = 0;
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(templates); i++) {
+        total += templates[i].weight;
+    }
+
+    if (!total) {
+        LOG_ERR("Expected a type of a non zero weight");
+        return false;
+    }
+
+    return true;
+}
+
+static void usage(const char *name) {
+
+    printf("Usage: %s [OPTIONS]\n"
+           "  -s, --size=BYTES        size of the generated log, with an "
+           "optional K, M or G suffix\n"
+           "  -b, --banks=ALGS        comma separated hash algorithms of the "
+           "log\n"
+           "  -m, --mix=TYPE=WEIGHT   comma separated weights of the event "
+           "types\n"
+           "  -S, --seed=NUMBER       seed of the generator\n"
+           "  -n, --iterations=COUNT  runs of each phase, 0 to only generate\n"
+           "  -o, --output=FILE       write the generated log to FILE\n"
+           "  -i, --input=FILE        benchmark the log FILE instead\n"
+           "  -l, --label=STRING      label of the results, e.g. a commit\n",
+           name);
+}
+
+int main(int argc, char *argv[]) {
+
+    static const struct option options[] = {
+        { "size",       required_argument, NULL, 's' },
+        { "banks",      required_argument, NULL, 'b' },
+        { "mix",        required_argument, NULL, 'm' },
+        { "seed",       required_argument, NULL, 'S' },
+        { "iterations", required_argument, NULL, 'n' },
+        { "output",     required_argument, NULL, 'o' },
+        { "input",      required_argument, NULL, 'i' },
+        { "label",      required_argument, NULL, 'l' },
+        { "help",       no_argument,       NULL, 'h' },
+        { NULL,         0,                 NULL,  0  },
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, "s:b:m:S:n:o:i:l:h", options,
+            NULL)) != -1) {
+        switch (c) {
+        case 's':
+            if (!size_from_optarg(optarg, &ctx.size)) {
+                LOG_ERR("Invalid size, got: \"%s\"", optarg);
+                return 1;
+            }
+            break;
+        case 'b':
+            if (!banks_from_optarg(optarg)) {
+                return 1;
+            }
+            break;
+        case 'm':
+            if (!mix_from_optarg(optarg)) {
+                return 1;
+            }
+            break;
+        case 'S':
+            if (!tpm2_util_string_to_uint64(optarg, &ctx.seed)) {
+                LOG_ERR("Invalid seed, got: \"%s\"", optarg);
+                return 1;
+            }
+            break;
+        case 'n':
+            if (!tpm2_util_string_to_uint32(optarg, &ctx.iterations)) {
+                LOG_ERR("Invalid number of iterations, got: \"%s\"", optarg);
+                return 1;
+            }
+            break;
+        case 'o':
+            ctx.output_path = optarg;
+            break;
+        case 'i':
+            ctx.input_path = optarg;
+            break;
+        case 'l':
+            ctx.label = optarg;
+            break;
+        case 'h':
+            usage(argv[0]);
+            return 0;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (optind != argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    bench_log log = { 0 };
+    bool result;
+    if (ctx.input_path) {
+        tpm2_eventlog_context eventlog_ctx = {
+            .event2hdr_cb = count_event2,
+        };
+        result = log_read(ctx.input_path, &log) &&
+                 parse_eventlog(&eventlog_ctx, log.data, log.size);
+        log.events = state.events;
+    } else {
+        result = log_generate(&log);
+        if (result && ctx.output_path) {
+            result = log_write(ctx.output_path, &log);
+        }
+        if (result) {
+            state.hasher = tpm2_openssl_hasher_new();
+            result = state.hasher && log_check(&log);
+            tpm2_openssl_hasher_free(state.hasher);
+            state.hasher = NULL;
+        }
+    }
+
+    result = result && bench_run(&log);
+
+    tpm2_pcr_banks_free(log.banks);
+    free(log.data);
+
+    return result ? 0 : 1;
+}
@@ -0,0 +1,88 @@
+
+set -e
+source helpers.sh
+
+start_up
+
+CRYPTO_PROFILE="RSA"
+setup_fapi $CRYPTO_PROFILE
+
+function cleanup {
+    tss2 delete --path=/
+    shut_down
+}
+
+trap cleanup EXIT
+
+KEY_PATH=HS/SRK/myBatchSign
+DIGEST_FILE=$TEMP_DIR/digest.file
+SIGNATURE_FILE=$TEMP_DIR/signature.file
+PUBLIC_KEY_FILE=$TEMP_DIR/public_key.file
+RANDOM_FILE=$TEMP_DIR/random.file
+BATCH_FILE=$TEMP_DIR/commands.batch
+LIST_FILE=$TEMP_DIR/list.file
+
+tss2 provision
+echo -n "01234567890123456789" > $DIGEST_FILE
+
+# Commands of a batch share the FAPI context and see each others objects
+cat > $BATCH_FILE <<EOF
+# create, use and delete a key in one FAPI context
+createkey --path=$KEY_PATH --type="noDa, sign" --authValue=""
+tss2 sign --digest=$DIGEST_FILE --keyPath=$KEY_PATH --padding="RSA_PSS" --signature=$SIGNATURE_FILE --publicKey=$PUBLIC_KEY_FILE
+
+verifysignature --keyPath="$KEY_PATH" --digest=$DIGEST_FILE --signature=$SIGNATURE_FILE
+getrandom --numBytes=4 --hex --data=$RANDOM_FILE --force
+list --searchPath=HS/SRK --pathList=$LIST_FILE --force
+delete --path=$KEY_PATH
+EOF
+
+tss2 batch $BATCH_FILE
+
+test -s $SIGNATURE_FILE
+test "$(cat $RANDOM_FILE | wc -c)" -eq 8
+grep -q myBatchSign $LIST_FILE
+
+# The key deleted by the batch is gone
+expect <<EOF
+spawn tss2 verifysignature --keyPath=$KEY_PATH --digest=$DIGEST_FILE \
+    --signature=$SIGNATURE_FILE
+set ret [wait]
+if {[lindex \$ret 2] || [lindex \$ret 3] != 1} {
+    Command has not failed as expected\n"
+    exit 1
+}
+EOF
+
+# The batch may be read from stdin
+echo "getrandom --numBytes=2 --hex --data=$RANDOM_FILE --force" | tss2 batch
+test "$(cat $RANDOM_FILE | wc -c)" -eq 4
+
+# The batch stops at the first failing command
+cat > $BATCH_FILE <<EOF
+getrandom --numBytes=a --data=$RANDOM_FILE --force
+getrandom --numBytes=8 --hex --data=$RANDOM_FILE --force
+EOF
+
+expect <<EOF
+spawn tss2 batch $BATCH_FILE
+set ret [wait]
+if {[lindex \$ret 2] || [lindex \$ret 3] != 1} {
+    Command has not failed as expected\n"
+    exit 1
+}
+EOF
+test "$(cat $RANDOM_FILE | wc -c)" -eq 4
+
+# Unknown commands fail the batch
+echo "frobnicate --path=/" > $BATCH_FILE
+expect <<EOF
+spawn tss2 batch $BATCH_FILE
+set ret [wait]
+if {[lindex \$ret 2] || [lindex \$ret 3] != 1} {
+    Command has not failed as expected\n"
+    exit 1
+}
+EOF
+
+exit 0
@@ -30,4 +30,54 @@ if [ `tss2 list --searchPath=$KEY_PATH --pathList=-` != $SIGN_OBJECT ]; then
   exit 1
 fi
 
+# The keystore index answers like Fapi_List
+tss2 list --searchPath= --pathList=$TEMP_DIR/fapi.list --force
+export TSS2_FAPI_INDEX=$TEMP_DIR/keystore.index
+tss2 list --rebuild --pathList=$TEMP_DIR/indexed.list
+test -f $TSS2_FAPI_INDEX
+if [ "`tr ':' '\n' < $TEMP_DIR/indexed.list | sort`" != \
+     "`tr ':' '\n' < $TEMP_DIR/fapi.list | sort`" ]; then
+  echo "tss2_list index does not match the keystore"
+  exit 1
+fi
+
+if [ `tss2 list --searchPath=$KEY_PATH --pathList=-` != $SIGN_OBJECT ]; then
+  echo "tss2_list index single object failed"
+  exit 1
+fi
+
+# Filters select on the indexed type, attributes and description
+tss2 createseal --path=HS/SRK/mySeal --type="noDa" --authValue="" \
+    --data=$TEMP_DIR/fapi.list
+tss2 setdescription --path=HS/SRK/mySeal --description="indexed seal"
+
+if [ `tss2 list --type=key --attributes=sign,noDa --pathList=-` != \
+     $SIGN_OBJECT ]; then
+  echo "tss2_list attribute filter failed"
+  exit 1
+fi
+
+if [ `tss2 list --searchPath=HS/SRK --type=seal --description=indexed \
+      --pathList=-` != /$PROFILE_NAME/HS/SRK/mySeal ]; then
+  echo "tss2_list type and description filter failed"
+  exit 1
+fi
+
+# Deleted objects leave the index
+tss2 delete --path=HS/SRK/mySeal
+if [ -n "`tss2 list --type=seal --pathList=-`" ]; then
+  echo "tss2_list index kept a deleted object"
+  exit 1
+fi
+
+expect <<EOF
+# Searching a path that does not exist fails
+spawn tss2 list --searchPath=HS/SRK/mySeal
+set ret [wait]
+if {[lindex \$ret 2] || [lindex \$ret 3] != 1} {
+    Command has not failed as expected\n"
+    exit 1
+}
+EOF
+
 exit 0
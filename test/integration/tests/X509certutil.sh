@@ -45,6 +45,29 @@ if [ $? -ne 0 ]; then
 fi
 rm $outfile
 
+# Generate the certificates of a manifest in parallel
+cat > certs.manifest << EOF
+# output    subject          validity
+batch1.cert C=US;CN=dev0001
+batch2.cert C=US;CN=dev0002  -                                 -  digitalSignature
+batch3.cert C=US;CN=dev0003  20260101000000Z,20360101000000Z
+EOF
+tpm2 certifyX509certutil -i "C=US;O=My Org;CN=ca" --batch=certs.manifest \
+    --jobs=2 > batch.yaml
+test "$(yaml_get_kv batch.yaml batch certificates)" -eq 3
+test "$(yaml_get_kv batch.yaml batch failed)" -eq 0
+for i in 1 2 3; do
+    openssl asn1parse -in batch$i.cert -inform DER | grep -q "dev000$i"
+    openssl asn1parse -in batch$i.cert -inform DER | grep -q "My Org"
+done
+openssl asn1parse -in batch3.cert -inform DER | grep -q "20360101000000Z"
+
+# The single certificate of a manifest line matches the one of the options
+tpm2 certifyX509certutil -o $outfile -i "C=US;O=My Org;CN=ca" \
+    -s "C=US;CN=dev0003" -d 20260101000000Z,20360101000000Z
+cmp $outfile batch3.cert
+rm -f $outfile certs.manifest batch.yaml batch1.cert batch2.cert batch3.cert
+
 # Negative tests
 # generate cert in non-existing path
 if tpm2 certifyX509certutil -o /non/existing/path/$outfile &>/dev/null; then
@@ -54,6 +77,15 @@ else
     true
 fi
 
+# A manifest line with an invalid validity fails the batch
+echo "batch1.cert C=US;CN=dev0001 20260101000000Z,invalid" > certs.manifest
+if tpm2 certifyX509certutil --batch=certs.manifest &> /dev/null; then
+    echo "Expected an invalid validity to fail."
+    rm -f certs.manifest batch1.cert
+    exit 1
+fi
+rm -f certs.manifest batch1.cert
+
 # Use only invalid fields for issuer - should fail
 if tpm2 certifyX509certutil -i "B=USA;Y=12345678901234567890;X=12345678901234567890;YXZ=12345678901234567890" &> /dev/null; then
     echo "Expected \"$cmd\" to fail."
@@ -0,0 +1,105 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+source helpers.sh
+
+cleanup() {
+
+    rm -f \
+    prim.ctx signing_key.ctx signing_key.pub signing_key.priv session.ctx \
+    att.data att.sig att.plain.sig cp.*.hash rp.*.hash records.txt first.txt \
+    checkpoints.txt replay.yaml records.resume.txt
+
+    if [ "${1}" != "no-shutdown" ]; then
+        shut_down
+    fi
+}
+trap cleanup EXIT
+
+start_up
+
+cleanup "no-shutdown"
+
+tpm2 clear -Q
+
+tpm2 createprimary -Q -C e -c prim.ctx
+
+tpm2 create -Q -C prim.ctx -c signing_key.ctx -u signing_key.pub \
+-r signing_key.priv
+
+#
+# Record the cpHash and rpHash of the commands of an audit session
+#
+tpm2 startauthsession -S session.ctx --audit-session
+
+for i in $(seq 1 10); do
+    tpm2 getrandom 8 -S session.ctx --cphash cp.$i.hash --rphash rp.$i.hash \
+    > /dev/null
+    # the records take digest files and hex alike
+    if [ $i -le 5 ]; then
+        echo "cp.$i.hash rp.$i.hash" >> records.txt
+    else
+        echo "$(tail -c 32 cp.$i.hash | xxd -p -c 32)" \
+             "$(tail -c 32 rp.$i.hash | xxd -p -c 32)" >> records.txt
+    fi
+done
+
+tpm2 getsessionauditdigest -c signing_key.ctx -m att.data -s att.sig \
+-S session.ctx
+
+tpm2 getsessionauditdigest -c signing_key.ctx -m att.data -s att.plain.sig \
+-f plain -S session.ctx
+
+tpm2 flushcontext session.ctx
+
+#
+# Replay the session and verify the signed digest
+#
+tpm2 auditreplay -m att.data -s att.sig -u signing_key.pub records.txt \
+> replay.yaml
+
+test "$(yaml_get_kv replay.yaml commands)" == "10"
+test "$(yaml_get_kv replay.yaml verified)" == "true"
+test "$(yaml_get_kv replay.yaml digest)" == "$(tail -c 32 att.data | xxd -p -c 32)"
+
+# a plain signature does not name its hash algorithm
+tpm2 auditreplay -m att.data -s att.plain.sig -u signing_key.pub \
+--signature-hash-algorithm sha256 records.txt > replay.yaml
+test "$(yaml_get_kv replay.yaml verified)" == "true"
+
+trap - ERR
+tpm2 auditreplay -m att.data -s att.plain.sig -u signing_key.pub records.txt
+if [ $? -eq 0 ]; then
+    echo "expected the plain signature to require its hash algorithm"
+    exit 1
+fi
+trap onerror ERR
+
+#
+# Resume from a checkpoint of the first commands
+#
+head -n 4 records.txt > first.txt
+tpm2 auditreplay --checkpoint checkpoints.txt --checkpoint-interval 3 \
+first.txt > /dev/null
+test "$(wc -l < checkpoints.txt)" == "2"
+
+cp first.txt records.resume.txt
+tail -n 6 records.txt >> records.resume.txt
+tpm2 auditreplay --resume checkpoints.txt -m att.data -s att.sig \
+-u signing_key.pub records.resume.txt > replay.yaml
+
+test "$(yaml_get_kv replay.yaml commands)" == "10"
+test "$(yaml_get_kv replay.yaml verified)" == "true"
+
+#
+# A missing command fails the verification
+#
+trap - ERR
+
+sed '3d' records.txt > first.txt
+tpm2 auditreplay -m att.data -s att.sig -u signing_key.pub first.txt
+if [ $? -eq 0 ]; then
+    echo "auditreplay verified a replay missing a command"
+    exit 1
+fi
+
+exit 0
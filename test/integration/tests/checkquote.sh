@@ -21,7 +21,12 @@ output_quotepcr=quotepcr.out
 cleanup() {
   rm -f $output_ek_pub_pem $output_ak_pub_pem $output_ak_pub_name \
   $output_quote $output_quotesig $output_quotepcr rand.out $ak_ctx \
-  pcr.bin
+  pcr.bin batch.manifest batch.out batch_*.quote batch_*.sig batch_*.pcr \
+  batch_*.nonce aggregate.manifest aggregate.out aggregate.quote \
+  aggregate.sig aggregate.pcr aggregate_*.nonce aggregate_*.proof \
+  measured.bin measured.manifest measured.log measured.quote measured.sig \
+  measured.pcr
+  rm -rf eventlog.cache
 
   tpm2 pcrreset 16
   tpm2 evictcontrol -C o -c $handle_ek 2>/dev/null || true
@@ -90,4 +95,99 @@ tpm2 pcrread sha256:15,16,22 -o pcr.bin
 tpm2 checkquote -u ecc.ak.tpmt -m quote.bin -s quote.sig -g sha256 -q nonce.bin \
 -f pcr.bin -l sha256:15,16,22
 
+# Verify a batch of quotes from both attestation keys
+echo "# public message signature pcr eventlog qualification" > batch.manifest
+for i in `seq 1 4`; do
+  tpm2 getrandom -o batch_$i.nonce 20
+  tpm2 quote -c $handle_ak -l sha256:15,16,22 -q batch_$i.nonce \
+  -m batch_$i.quote -s batch_$i.sig -o batch_$i.pcr -g sha256 -p "$akpw"
+  echo "$output_ak_pub_pem batch_$i.quote batch_$i.sig batch_$i.pcr - \
+  batch_$i.nonce" >> batch.manifest
+done
+echo "ecc.ak.pem quote.bin quote.sig quote.pcr - nonce.bin" >> batch.manifest
+echo "ecc.ak.tss quote.bin quote.sig - - nonce.bin" >> batch.manifest
+
+tpm2 checkquote -g sha256 --batch=batch.manifest --jobs=3 > batch.out
+yaml_get_kv batch.out "batch" "quotes" | grep -q "^6$"
+yaml_get_kv batch.out "batch" "failed" | grep -q "^0$"
+
+# A quote with the wrong nonce fails without failing the others
+echo "ecc.ak.pem quote.bin quote.sig quote.pcr - batch_1.nonce" \
+>> batch.manifest
+trap - ERR
+tpm2 checkquote -g sha256 --batch=batch.manifest --jobs=3 > batch.out
+if [ $? -eq 0 ]; then
+  echo "Expected the batch with a wrong nonce to fail"
+  exit 1
+fi
+trap onerror ERR
+yaml_get_kv batch.out "batch" "failed" | grep -q "^1$"
+
+# Quote the nonces of several verifiers at once
+echo "# nonce proof" > aggregate.manifest
+for i in `seq 1 5`; do
+  tpm2 getrandom -o aggregate_$i.nonce 20
+  echo "aggregate_$i.nonce aggregate_$i.proof" >> aggregate.manifest
+done
+tpm2 quote -c $handle_ak -l sha256:15,16,22 --aggregate=aggregate.manifest \
+-m aggregate.quote -s aggregate.sig -o aggregate.pcr -g sha256 -p "$akpw" \
+> aggregate.out
+yaml_get_kv aggregate.out "aggregate" "nonces" | grep -q "^5$"
+
+for i in `seq 1 5`; do
+  tpm2 checkquote -u $output_ak_pub_pem -m aggregate.quote -s aggregate.sig \
+  -f aggregate.pcr -g sha256 -q aggregate_$i.nonce --proof=aggregate_$i.proof
+done
+
+# A nonce is not verified with the proof of another nonce
+trap - ERR
+tpm2 checkquote -u $output_ak_pub_pem -m aggregate.quote -s aggregate.sig \
+-f aggregate.pcr -g sha256 -q aggregate_1.nonce --proof=aggregate_2.proof
+if [ $? -eq 0 ]; then
+  echo "Expected the nonce to fail with the proof of another nonce"
+  exit 1
+fi
+trap onerror ERR
+
+# The aggregated nonces verify in batch mode as well
+echo "# public message signature pcr eventlog qualification proof" \
+> batch.manifest
+for i in `seq 1 5`; do
+  echo "$output_ak_pub_pem aggregate.quote aggregate.sig aggregate.pcr - \
+  aggregate_$i.nonce aggregate_$i.proof" >> batch.manifest
+done
+tpm2 checkquote -g sha256 --batch=batch.manifest --jobs=2 > batch.out
+yaml_get_kv batch.out "batch" "failed" | grep -q "^0$"
+
+# Replay the event log of the quoted PCRs once and the cached banks after
+tpm2 pcrreset 16
+echo "measured in software" > measured.bin
+echo "16 measured.bin" > measured.manifest
+tpm2 pcrextend --batch=measured.manifest --eventlog=measured.log
+tpm2 quote -c $handle_ak -l sha256:16 -q nonce.bin -m measured.quote \
+  -s measured.sig -o measured.pcr -g sha256 -p "$akpw"
+
+echo "# public message signature pcr eventlog qualification" > batch.manifest
+for i in `seq 1 3`; do
+  echo "$output_ak_pub_pem measured.quote measured.sig measured.pcr \
+  measured.log nonce.bin" >> batch.manifest
+done
+tpm2 checkquote -g sha256 --batch=batch.manifest \
+  --eventlog-cache=eventlog.cache > batch.out
+yaml_get_kv batch.out "batch" "failed" | grep -q "^0$"
+yaml_get_kv batch.out "batch" "eventlog-cache-hits" | grep -q "^2$"
+yaml_get_kv batch.out "batch" "eventlog-cache-misses" | grep -q "^1$"
+test "$(ls eventlog.cache/*.banks | wc -l)" -eq 1
+
+tpm2 checkquote -u $output_ak_pub_pem -m measured.quote -s measured.sig \
+  -f measured.pcr -e measured.log -g sha256 -q nonce.bin \
+  --eventlog-cache=eventlog.cache
+
+# An entry larger than the cache is evicted right away
+rm -rf eventlog.cache
+tpm2 checkquote -u $output_ak_pub_pem -m measured.quote -s measured.sig \
+  -f measured.pcr -e measured.log -g sha256 -q nonce.bin \
+  --eventlog-cache=eventlog.cache --eventlog-cache-size=1
+test "$(ls eventlog.cache | wc -l)" -eq 0
+
 exit 0
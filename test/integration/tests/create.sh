@@ -9,7 +9,8 @@ cleanup() {
     rm -f context.out
   fi
 
-  rm -f key*.ctx out.yaml
+  rm -f key*.ctx out.yaml pool.yaml pool.pub pool.priv
+  rm -rf keypool
 
   if [ $(ina "$@" "no-shut-down") -ne 0 ]; then
     shut_down
@@ -119,4 +120,57 @@ tpm2 flushcontext enc_session.ctx
 tpm2_create -C primary.ctx -u obj.pub -r obj.priv -f pem -o obj.pem
 openssl rsa -noout -text -inform PEM -in obj.pem -pubin
 
+# Test key pools
+mkdir keypool
+tpm2 create -C prim.ctx -G ecc --pool=keypool --pool-fill=3 > pool.yaml
+test "$(yaml_get_kv pool.yaml pool depth)" -eq 3
+test "$(yaml_get_kv pool.yaml pool created)" -eq 3
+ecc_pool=$(ls keypool)
+
+# Filling a full pool creates nothing
+tpm2 create -C prim.ctx -G ecc --pool=keypool --pool-fill=3 > pool.yaml
+test "$(yaml_get_kv pool.yaml pool created)" -eq 0
+
+tpm2 create -C prim.ctx -G ecc --pool=keypool --from-pool -u pool.pub \
+-r pool.priv > pool.yaml
+test "$(yaml_get_kv pool.yaml pool hit)" == "true"
+test "$(yaml_get_kv pool.yaml pool depth)" -eq 2
+tpm2 load -C prim.ctx -u pool.pub -r pool.priv -c key.ctx
+tpm2 flushcontext -t
+
+tpm2 create -C prim.ctx -G ecc --pool=keypool --from-pool -c key.ctx \
+> pool.yaml
+test "$(yaml_get_kv pool.yaml pool depth)" -eq 1
+tpm2 readpublic -c key.ctx > /dev/null
+tpm2 flushcontext -t
+
+# Keys of another template are not claimed
+tpm2 create -C prim.ctx -G rsa --pool=keypool --from-pool -u pool.pub \
+-r pool.priv > pool.yaml
+test "$(yaml_get_kv pool.yaml pool hit)" == "false"
+
+# A key of another template moved into a pool is refused
+tpm2 create -C prim.ctx -G ecc --pool=keypool --from-pool -u pool.pub \
+-r pool.priv > pool.yaml
+test "$(yaml_get_kv pool.yaml pool depth)" -eq 0
+tpm2 create -C prim.ctx -G rsa --pool=keypool --pool-fill=1 > pool.yaml
+rsa_pool=$(ls keypool | grep -v "$ecc_pool")
+mv keypool/"$rsa_pool"/key-* keypool/"$ecc_pool"/
+
+trap - ERR
+tpm2 create -C prim.ctx -G ecc --pool=keypool --from-pool -u pool.pub \
+-r pool.priv
+if [ $? -eq 0 ]; then
+    echo "Expected key pools to refuse a key of another template"
+    exit 1
+fi
+
+tpm2 create -C prim.ctx -G ecc -p secret --pool=keypool --from-pool \
+-u pool.pub -r pool.priv
+if [ $? -eq 0 ]; then
+    echo "Expected key pools to reject -p"
+    exit 1
+fi
+trap onerror ERR
+
 exit 0
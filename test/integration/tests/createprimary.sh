@@ -6,7 +6,9 @@ start_up
 
 cleanup() {
 
-  rm -f policy.bin obj.pub pub.out primary.ctx
+  rm -f policy.bin obj.pub pub.out primary.ctx cached.ctx cache.ctx.orig \
+        cached.pub.1 cached.pub.2 cached.pub.3 cached.pub.4 other.ctx
+  rm -rf primary-cache
 
   if [ $(ina "$@" "keep-context") -ne 0 ]; then
     rm -f context.out
@@ -114,4 +116,54 @@ test "${BEFORE}" = "${AFTER}"
 tpm2 createprimary -f pem -o public.pem
 openssl rsa -noout -text -inform PEM -in public.pem -pubin
 
+# Test the primary cache
+mkdir primary-cache
+tpm2 createprimary -C o -c cached.ctx --cache-dir=primary-cache
+tpm2 readpublic -c cached.ctx -n cached.pub.1
+test "$(ls primary-cache/*.ctx | wc -l)" -eq 1
+cp primary-cache/*.ctx cache.ctx.orig
+
+# A second run reuses the cached entry as is
+tpm2 flushcontext -t
+tpm2 createprimary -C o -c cached.ctx --cache-dir=primary-cache
+tpm2 readpublic -c cached.ctx -n cached.pub.2
+cmp cached.pub.1 cached.pub.2
+cmp cache.ctx.orig primary-cache/*.ctx
+
+# Changing the owner seed invalidates the entry
+tpm2 flushcontext -t
+tpm2 clear
+tpm2 createprimary -C o -c cached.ctx --cache-dir=primary-cache
+tpm2 readpublic -c cached.ctx -n cached.pub.3
+if cmp -s cached.pub.1 cached.pub.3; then
+    echo "Expected a new primary after changing the seed"
+    exit 1
+fi
+test "$(ls primary-cache/*.ctx | wc -l)" -eq 1
+
+# An object of another template put in place of the entry is not used
+tpm2 flushcontext -t
+tpm2 createprimary -C o -G ecc -c other.ctx
+cp other.ctx primary-cache/*.ctx
+tpm2 flushcontext -t
+tpm2 createprimary -C o -c cached.ctx --cache-dir=primary-cache
+tpm2 readpublic -c cached.ctx -n cached.pub.4
+cmp cached.pub.3 cached.pub.4
+
+# Primaries with an auth value are not cached
+rm -f primary-cache/*
+tpm2 flushcontext -t
+tpm2 createprimary -C o -p secret -c cached.ctx --cache-dir=primary-cache
+test -z "$(ls primary-cache)"
+
+# The cache cannot be combined with creation outputs
+trap - ERR
+tpm2 createprimary -C o -c cached.ctx --cache-dir=primary-cache \
+    --creation-data creation.data
+if [ $? -eq 0 ]; then
+    echo "Expected --cache-dir and --creation-data to conflict"
+    exit 1
+fi
+trap onerror ERR
+
 exit 0
@@ -6,7 +6,9 @@ cleanup() {
     rm -f primary.ctx new_parent.prv new_parent.pub new_parent.ctx policy.dat \
     session.dat key.prv key.pub key.ctx duppriv.bin dupseed.dat key2.prv \
     key2.pub key2.ctx sym_key_in.bin cleartext.txt secret.bin decrypted.txt \
-    primary.pub rsa-priv.pem rsa.pub rsa.priv rsa.dpriv rsa.seed rsa-pub.pem rsa.sig
+    primary.pub rsa-priv.pem rsa.pub rsa.priv rsa.dpriv rsa.seed rsa-pub.pem rsa.sig \
+    batch.manifest batch.out batch_*.pem batch_*.pub batch_*.priv batch_*.dpriv \
+    batch_*.seed
 
     if [ "$1" != "no-shut-down" ]; then
           shut_down
@@ -184,8 +186,37 @@ cat secret.bin | tpm2 rsadecrypt \
 	> decrypted.txt
 cmp cleartext.txt decrypted.txt
 
+## Batch of external RSA keys, wrapped for the primary key
+echo "# key public private seed" > batch.manifest
+for i in `seq 1 4`; do
+    openssl genrsa -out batch_$i.pem 2048 2>/dev/null
+    echo "batch_$i.pem batch_$i.pub batch_$i.dpriv batch_$i.seed" \
+    >> batch.manifest
+done
+
+tpm2 duplicate --tcti none -U primary.pub -G rsa --batch=batch.manifest \
+    --jobs=2 > batch.out
+yaml_get_kv batch.out "batch" "keys" | grep -q "^4$"
+
+for i in `seq 1 4`; do
+    tpm2 import -C primary.ctx -G rsa -i batch_$i.dpriv -s batch_$i.seed \
+        -u batch_$i.pub -r batch_$i.priv
+    tpm2 load -C primary.ctx -c rsa.ctx -u batch_$i.pub -r batch_$i.priv
+    echo foo | tpm2 sign -c rsa.ctx -o rsa.sig -f plain
+    openssl rsa -in batch_$i.pem -pubout > rsa-pub.pem 2>/dev/null
+    echo foo | openssl dgst -sha256 -verify rsa-pub.pem -signature rsa.sig
+done
+
 trap - ERR
 
+## Batch keys come from the manifest only
+tpm2 duplicate --tcti none -U primary.pub -G rsa --batch=batch.manifest \
+    -k rsa-priv.pem
+if [ $? -eq 0 ]; then
+  echo "Expected \"tpm2 duplicate --batch -k\" to fail."
+  exit 1
+fi
+
 ## Attempt to decrypt without the password or policy
 
 cat secret.bin | tpm2 rsadecrypt \
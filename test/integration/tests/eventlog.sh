@@ -42,4 +42,24 @@ expect_pass tpm2 eventlog ${srcdir}/test/integration/fixtures/event-postcode.bin
 expect_pass tpm2 eventlog --eventlog-version=2 ${srcdir}/test/integration/fixtures/event-arch-linux.bin
 expect_pass tpm2 eventlog --eventlog-version=2 ${srcdir}/test/integration/fixtures/event-gce-ubuntu-2104-log.bin
 
+# Query the events of a log, decoding the matching ones only
+fixture=${srcdir}/test/integration/fixtures/event-arch-linux.bin
+expect_pass tpm2 eventlog --pcr=7 --type=EV_EFI_VARIABLE_DRIVER_CONFIG $fixture
+expect_pass tpm2 eventlog --events=2:5 $fixture
+expect_pass tpm2 eventlog --pcr=0,7 ${srcdir}/test/integration/fixtures/event.bin $fixture
+expect_fail tpm2 eventlog --type=EV_FOO $fixture
+expect_fail tpm2 eventlog --events=5:2 $fixture
+expect_fail tpm2 eventlog --digest=xyz $fixture
+
+if tpm2 eventlog --pcr=7 $fixture | grep "PCRIndex" | grep -vq "PCRIndex: 7"; then
+    echo "query returned events of another PCR"
+    exit 1
+fi
+
+if [ "$(tpm2 eventlog --events=3 $fixture | grep -c "EventNum: [0-9]")" != "1" ] ||
+   ! tpm2 eventlog --events=3 $fixture | grep -q "EventNum: 3"; then
+    echo "query did not return the event numbered 3"
+    exit 1
+fi
+
 exit $?
@@ -0,0 +1,132 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+source helpers.sh
+
+server_pid=""
+
+cleanup() {
+    if [ -n "$server_pid" ]; then
+        kill $server_pid 2>/dev/null || true
+    fi
+
+    rm -rf test_rsa_ek.pub test_ecc_ek.pub rsa_ek_cert.bin ecc_ek_cert.bin \
+           cached_rsa_ek_cert.bin cached_ecc_ek_cert.bin ek_server.py \
+           ek_server.port ek_server.log ek_cert_body ekcache
+
+    if [ "$1" != "no-shut-down" ]; then
+        shut_down
+    fi
+}
+trap cleanup EXIT
+
+start_up
+
+cleanup "no-shut-down"
+
+# Sample RSA ek public from a real platform
+echo "013a0001000b000300b20020837197674484b3f81a90cc8d46a5d724fd52
+d76e06520b64f2a1da1b331469aa00060080004300100800000000000100
+c320e2f244a8601aacf3e01d26c665249935562de1da197e9e7f076c4696
+13cfb653e98ec2c386fc1d133f2c8c6cc338b732f0b208bd838a877a3e5b
+bc3e1d4084e835c7c8906a1c05b4d2d30fdbebc1dbad950fa6b165bd4b6a
+864603146164c0c4f59d489011ef1f928deea6e90061f3d375e564627315
+1ef622252098be1a4ab01dc0a12227c609fdaceb115af408d4693a6f4991
+9774695b0c12bc18a1ff7120a7337b2fb5f1951d8bb7f094d5b554c11c95
+23b30729fe64787d0a13b9e630488dab4dfd86634a5270ec72fcc5a44dc6
+79a8f32938dd8197e29dae839f5b4ca0f5de27c9522c23c54e1c2ce57859
+525118bd4470b18180eef78ae4267bcd" | xxd -r -p > test_rsa_ek.pub
+
+# Sample ECC ek public from a real platform
+echo "007a0023000b000300b20020837197674484b3f81a90cc8d46a5d724fd52
+d76e06520b64f2a1da1b331469aa00060080004300100003001000206d8e
+7630ee5d11e566e80299bfb9e43cec8c44f70bc8ad81b50f690a3deb7498
+002021a536c8fef7482313d7f4517f11c9f2b4cd424cbc8fe9094b895668
+51fe0853" | xxd -r -p > test_ecc_ek.pub
+
+#
+# Local stand-in for the EK certificate server. It answers every lookup with
+# a body derived from the requested path and logs the requests so the test
+# can tell cached from fetched certificates.
+#
+cat > ek_server.py << EOF
+import http.server
+import sys
+
+class Handler(http.server.BaseHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_GET(self):
+        with open("ek_server.log", "a") as log:
+            log.write(self.path + "\n")
+        body = ("certificate-for:" + self.path).encode()
+        self.send_response(200)
+        self.send_header("Content-Length", str(len(body)))
+        self.end_headers()
+        self.wfile.write(body)
+
+    def log_message(self, *args):
+        pass
+
+server = http.server.HTTPServer(("127.0.0.1", 0), Handler)
+with open("ek_server.port", "w") as f:
+    f.write(str(server.server_address[1]))
+server.serve_forever()
+EOF
+
+python ek_server.py &
+server_pid=$!
+
+for i in `seq 1 50`; do
+    if [ -s ek_server.port ]; then
+        break
+    fi
+    sleep 0.1
+done
+server="http://127.0.0.1:$(cat ek_server.port)"
+
+mkdir ekcache
+
+# Both EK certificates are fetched from the server and cached
+tpm2 getekcertificate -x -u test_rsa_ek.pub -u test_ecc_ek.pub \
+    -o rsa_ek_cert.bin -o ecc_ek_cert.bin --cache-dir=ekcache $server
+
+test "$(wc -l < ek_server.log)" -eq 2
+test "$(ls ekcache | wc -l)" -eq 2
+grep -q "certificate-for:" rsa_ek_cert.bin
+grep -q "certificate-for:" ecc_ek_cert.bin
+if cmp -s rsa_ek_cert.bin ecc_ek_cert.bin; then
+    echo "RSA and ECC EK certificates should differ"
+    exit 1
+fi
+
+# With the server gone, the certificates must come from the cache
+kill $server_pid
+wait $server_pid 2>/dev/null || true
+server_pid=""
+
+tpm2 getekcertificate -x -u test_rsa_ek.pub -u test_ecc_ek.pub \
+    -o cached_rsa_ek_cert.bin -o cached_ecc_ek_cert.bin --cache-dir=ekcache \
+    $server
+
+cmp rsa_ek_cert.bin cached_rsa_ek_cert.bin
+cmp ecc_ek_cert.bin cached_ecc_ek_cert.bin
+
+# The EK publics may be given in any order
+tpm2 getekcertificate -x -u test_ecc_ek.pub -u test_rsa_ek.pub \
+    -o cached_rsa_ek_cert.bin -o cached_ecc_ek_cert.bin --cache-dir=ekcache \
+    $server
+
+cmp rsa_ek_cert.bin cached_rsa_ek_cert.bin
+cmp ecc_ek_cert.bin cached_ecc_ek_cert.bin
+
+# A cache miss without a reachable server is an error
+rm ekcache/*
+trap - ERR
+tpm2 getekcertificate -x -u test_rsa_ek.pub -o cached_rsa_ek_cert.bin \
+    --cache-dir=ekcache $server
+if [ $? -eq 0 ]; then
+    echo "Expected failure on a cache miss with no server"
+    exit 1
+fi
+
+exit 0
@@ -64,6 +64,12 @@ cleanup "keep-context" "no-shut-down"
 dd if=/dev/urandom of=$file_input_data bs=2093 count=1 2>/dev/null
 tpm2 hmac -Q -c $file_hmac_key_ctx -o $file_hmac_output $file_input_data
 
+# Input of exactly one buffer is still a single HMAC, so its cpHash works.
+dd if=/dev/urandom of=$file_input_data bs=1024 count=1 2>/dev/null
+tpm2 hmac -Q -c $file_hmac_key_ctx --cphash cp.hash $file_input_data
+test -f cp.hash
+rm -f cp.hash
+
 ####handle test
 rm -f $file_hmac_output
 
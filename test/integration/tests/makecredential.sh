@@ -17,7 +17,8 @@ output_mkcredential=mkcredential.out
 
 cleanup() {
     rm -f $output_ek_pub $output_ak_pub $output_ak_pub_name \
-    $output_mkcredential $file_input_data output_ak grep.txt $ak_ctx
+    $output_mkcredential $file_input_data output_ak grep.txt $ak_ctx \
+    batch.manifest batch_secret_*.data batch_*.cred batch_*.out session.ctx
 
     tpm2 evictcontrol -Q -Co -c $handle_ek 2>/dev/null || true
 
@@ -55,4 +56,43 @@ tpm2 readpublic -c $handle_ek -o ek.pem -f pem -Q
 tpm2 makecredential -T none -Q -u ek.pem -G rsa -s $file_input_data \
 -n $Loadkeyname -o $output_mkcredential
 
+# batch mode without a TPM
+echo "# public name secret output" > batch.manifest
+for i in `seq 1 8`; do
+    echo "secret-$i" > batch_secret_$i.data
+    echo "$output_ek_pub $Loadkeyname batch_secret_$i.data batch_$i.cred" \
+    >> batch.manifest
+done
+
+tpm2 makecredential -T none --batch=batch.manifest --jobs=4 > batch.out
+yaml_get_kv batch.out "batch" "credentials" | grep -q "^8$"
+
+for i in `seq 1 8`; do
+    tpm2 startauthsession --policy-session -S session.ctx
+    tpm2 policysecret -S session.ctx -c e
+    tpm2 activatecredential -Q -c $ak_ctx -C $handle_ek -i batch_$i.cred \
+    -o batch_$i.out -P"session:session.ctx"
+    tpm2 flushcontext session.ctx
+    diff batch_$i.out batch_secret_$i.data
+done
+
+# a bad manifest line fails the batch but not the other items
+echo "$output_ek_pub zz batch_secret_1.data batch_bad.cred" >> batch.manifest
+# as do an unparsable line and stdin as a secret
+echo "$output_ek_pub $Loadkeyname batch_secret_1.data" >> batch.manifest
+echo "$output_ek_pub $Loadkeyname - batch_stdin.cred" >> batch.manifest
+echo "$output_ek_pub $Loadkeyname batch_secret_1.data batch_last.cred" \
+>> batch.manifest
+trap - ERR
+tpm2 makecredential -T none --batch=batch.manifest --jobs=4 > batch.out
+if [ $? -eq 0 ]; then
+    echo "Expected the batch with an invalid name to fail"
+    exit 1
+fi
+trap onerror ERR
+yaml_get_kv batch.out "batch" "failed" | grep -q "^3$"
+yaml_get_kv batch.out "batch" "credentials" | grep -q "^12$"
+test -f batch_last.cred
+test ! -f batch_stdin.cred
+
 exit 0
@@ -21,7 +21,8 @@ cleanup() {
   tpm2 nvundefine -Q   0x1500015 -C o -P owner 2>/dev/null || true
 
   rm -f policy.bin test.bin nv.test_w $large_file_name $large_file_read_name \
-  nv.readlock foo.dat cmp.dat $file_pcr_value $file_policy nv.out cap.out yaml.out
+  nv.readlock foo.dat cmp.dat $file_pcr_value $file_policy nv.out nv.one cap.out \
+  yaml.out
 
   if [ "$1" != "no-shut-down" ]; then
      shut_down
@@ -57,6 +58,16 @@ tpm2 nvreadpublic > nv.out
 yaml_get_kv nv.out "$nv_test_index" > /dev/null
 yaml_get_kv nv.out "$nv_test_index" "name" > /dev/null
 
+# The names of the listing match the names of the per-index reads
+tpm2 nvdefine -Q 0x1500017 -C o -s 8 -a "ownerread|ownerwrite"
+tpm2 nvreadpublic > nv.out
+for index in $nv_test_index 0x1500017; do
+    tpm2 nvreadpublic $index > nv.one
+    test "$(yaml_get_kv nv.out $index name)" == \
+         "$(yaml_get_kv nv.one $index name)"
+done
+tpm2 nvundefine -Q 0x1500017 -C o
+
 
 # Test writing to and reading from an offset by:
 # 1. writing "foo" into the nv file at an offset
@@ -0,0 +1,82 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+source helpers.sh
+
+cleanup() {
+    rm -f nv.manifest nv.yaml content.bin
+
+    if [ "$1" != "no-shut-down" ]; then
+        shut_down
+    fi
+}
+trap cleanup EXIT
+
+start_up
+
+cleanup "no-shut-down"
+
+tpm2 clear
+
+echo -n "hello" > content.bin
+
+cat > nv.manifest << EOF
+# index     size  attributes                         policy  content
+0x1500016   32    -                                  -       content.bin
+0x1500017   8     nt=counter|ownerread|ownerwrite
+0x1500018   -     ownerread|ownerwrite|authread|authwrite
+EOF
+
+# Every declared index is defined and the content written
+tpm2 nvdefine -C o --batch=nv.manifest > nv.yaml
+test "$(yaml_get_kv nv.yaml batch indices)" -eq 3
+test "$(yaml_get_kv nv.yaml batch define)" -eq 3
+test "$(yaml_get_kv nv.yaml batch write)" -eq 1
+test "$(yaml_get_kv nv.yaml batch failed)" -eq 0
+test "$(tpm2 nvread -C o -s 5 0x1500016)" == "hello"
+
+# Applying the same manifest again changes nothing
+tpm2 nvdefine -C o --batch=nv.manifest > nv.yaml
+test "$(yaml_get_kv nv.yaml batch keep)" -eq 3
+test "$(yaml_get_kv nv.yaml batch write)" -eq 0
+
+# A dry run of a changed manifest reports the plan without applying it
+cat > nv.manifest << EOF
+0x1500016   32    -                                  -       content.bin
+0x1500018   64    ownerread|ownerwrite|authread|authwrite
+EOF
+
+tpm2 nvdefine -C o --batch=nv.manifest --prune --dry-run > nv.yaml
+test "$(yaml_get_kv nv.yaml batch keep)" -eq 1
+test "$(yaml_get_kv nv.yaml batch redefine)" -eq 1
+test "$(yaml_get_kv nv.yaml batch undefine)" -eq 1
+tpm2 nvreadpublic 0x1500017 > /dev/null
+test "$(tpm2 nvreadpublic 0x1500018 | grep size | awk '{print $2}')" -ne 64
+
+# Applying it redefines the resized index and prunes the dropped one
+tpm2 nvdefine -C o --batch=nv.manifest --prune > nv.yaml
+test "$(yaml_get_kv nv.yaml batch failed)" -eq 0
+test "$(tpm2 nvreadpublic 0x1500018 | grep size | awk '{print $2}')" -eq 64
+if tpm2 getcap handles-nv-index | grep -q 0x1500017; then
+    echo "Expected NV index 0x1500017 to be pruned"
+    exit 1
+fi
+test "$(tpm2 nvread -C o -s 5 0x1500016)" == "hello"
+
+trap - ERR
+
+# The manifest replaces the index options
+tpm2 nvdefine -C o --batch=nv.manifest -s 32 0x1500019
+if [ $? -eq 0 ]; then
+    echo "Expected --batch with an index and a size to fail"
+    exit 1
+fi
+
+# Content is only written to ordinary indices
+echo "0x1500019 8 nt=counter|ownerread|ownerwrite - content.bin" > nv.manifest
+tpm2 nvdefine -C o --batch=nv.manifest
+if [ $? -eq 0 ]; then
+    echo "Expected content for a counter index to fail"
+    exit 1
+fi
+
+exit 0
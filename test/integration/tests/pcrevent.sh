@@ -61,6 +61,19 @@ if [ "$new_pcr_value" == "$old_pcr_value" ]; then
   exit 1;
 fi
 
+# Verify the event sequence digests of piped and regular multi-buffer inputs,
+# including sizes on and around buffer boundaries
+for size in 1024 1025 2048 5000; do
+  dd if=/dev/urandom of=$hash_in_file count=1 bs=$size 2> /dev/null
+  check=`sha256sum $hash_in_file | cut -d' ' -f 1-1`
+
+  cat $hash_in_file | tpm2 pcrevent > $hash_out_file
+  test "`yaml_get_kv $hash_out_file sha256`" == "$check"
+
+  tpm2 pcrevent $hash_in_file > $hash_out_file
+  test "`yaml_get_kv $hash_out_file sha256`" == "$check"
+done
+
 # verify that specifying -P without -i fails
 trap - ERR
 
@@ -2,8 +2,19 @@
 
 source helpers.sh
 
+cleanup() {
+    rm -f measured.bin batch.manifest batch.log batch.yaml eventlog.yaml
+
+    if [ "$1" != "no-shut-down" ]; then
+        shut_down
+    fi
+}
+trap cleanup EXIT
+
 start_up
 
+cleanup "no-shut-down"
+
 declare -A alg_hashes=(
   ["sha1"]="f1d2d2f924e986ac86fdf7b36c94bcdf32beec15"
   ["sha256"]="6ea40aa7267bb71251c1de1c3605a3df759b86b22fa9f62aa298d4197cd88a38"
@@ -46,4 +57,59 @@ else
     true
 fi
 
+#
+# Batch mode: measure a file and extend a digest into PCR 10, which starts
+# out zeroed, and replay the event log against the PCR values.
+#
+tpm2 pcrreset 10
+echo "measured in software" > measured.bin
+cat > batch.manifest << EOF
+# a file, then a digest specification
+10 measured.bin
+
+10:sha256=${alg_hashes["sha256"]}
+EOF
+
+tpm2 pcrextend --batch=batch.manifest --eventlog=batch.log --jobs=2 \
+    > batch.yaml
+test "$(yaml_get_kv batch.yaml batch measurements)" -eq 2
+test "$(yaml_get_kv batch.yaml batch failed)" -eq 0
+
+file_digest=$(sha256sum measured.bin | cut -d' ' -f1)
+expected=$(echo -n "0000000000000000000000000000000000000000000000000000000000000000$file_digest" \
+    | xxd -r -p | sha256sum | cut -d' ' -f1)
+expected=$(echo -n "$expected${alg_hashes["sha256"]}" | xxd -r -p | sha256sum \
+    | cut -d' ' -f1)
+actual=$(tpm2 pcrread sha256:10 | grep "10" | awk '{print tolower($2)}')
+test "$actual" == "0x$expected"
+
+tpm2 eventlog batch.log > eventlog.yaml
+grep -q "PCRIndex: 10" eventlog.yaml
+replayed=$(sed -n '/^  sha256:/,$p' eventlog.yaml | grep "10 :" | \
+    awk '{print $3}' | head -n1)
+test "$replayed" == "0x$expected"
+
+# Appending to the log keeps a single Spec ID event
+tpm2 pcrextend --batch=batch.manifest --eventlog=batch.log > batch.yaml
+tpm2 eventlog batch.log > eventlog.yaml
+test "$(grep -c "EV_NO_ACTION" eventlog.yaml)" -eq 1
+test "$(grep -c "EV_IPL" eventlog.yaml)" -eq 4
+
+# A missing file is skipped and fails the batch
+echo "10 missing.bin" > batch.manifest
+trap - ERR
+tpm2 pcrextend --batch=batch.manifest
+if [ $? -eq 0 ]; then
+    echo "Expected a batch with a missing file to fail"
+    exit 1
+fi
+
+# The event log is only written in batch mode
+tpm2 pcrextend --eventlog=batch.log 10:sha256=${alg_hashes["sha256"]}
+if [ $? -eq 0 ]; then
+    echo "Expected --eventlog without --batch to fail"
+    exit 1
+fi
+trap onerror ERR
+
 exit 0
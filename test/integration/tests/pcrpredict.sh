@@ -0,0 +1,102 @@
+# SPDX-License-Identifier: BSD-3-Clause
+
+source helpers.sh
+
+eventlog=${srcdir}/test/integration/fixtures/event-gce-ubuntu-2104-log.bin
+new_digest=b5bb9d8014a0f9b1d61e21e796d78dccdf1352f23cd32812f4850b878ae4944c
+
+cleanup() {
+    rm -f pcrs.bin policy.bin policy.ref subst.yaml orig.yaml same.bin \
+          candidates.manifest candidates.yaml eventlog.yaml
+
+    if [ "$1" != "no-shut-down" ]; then
+        shut_down
+    fi
+}
+trap cleanup EXIT
+
+start_up
+
+cleanup "no-shut-down"
+
+# The predicted policy matches the one the TPM computes from the predicted PCRs
+tpm2 pcrpredict -l sha256:0,7 -o pcrs.bin -L policy.bin $eventlog > orig.yaml
+tpm2 createpolicy --policy-pcr -l sha256:0,7 -f pcrs.bin -L policy.ref
+cmp policy.bin policy.ref
+test "$(yaml_get_kv orig.yaml policy)" == "$(xxd -p -c 256 policy.bin)"
+
+# Substituting the digest of event 1 (PCR 0) only changes PCR 0
+tpm2 pcrpredict -l sha256:0,7 -s 1:sha256=$new_digest -o pcrs.bin \
+    -L policy.bin $eventlog > subst.yaml
+tpm2 createpolicy --policy-pcr -l sha256:0,7 -f pcrs.bin -L policy.ref
+cmp policy.bin policy.ref
+test "$(grep "^    7 *:" orig.yaml)" == "$(grep "^    7 *:" subst.yaml)"
+if [ "$(grep "^    0 *:" orig.yaml)" == "$(grep "^    0 *:" subst.yaml)" ]; then
+    echo "Substituting a digest of event 1 should change PCR 0"
+    exit 1
+fi
+if [ "$(yaml_get_kv orig.yaml policy)" == \
+     "$(yaml_get_kv subst.yaml policy)" ]; then
+    echo "Substituting a digest should change the policy"
+    exit 1
+fi
+
+# Substituting the original digest changes nothing
+tpm2 eventlog $eventlog > eventlog.yaml
+orig_digest=$(python << pyscript
+import yaml
+
+with open("eventlog.yaml") as f:
+    y = yaml.load(f, Loader=yaml.BaseLoader)
+    for event in y["events"]:
+        if event["EventNum"] == "1":
+            for digest in event["Digests"]:
+                if digest["AlgorithmId"] == "sha256":
+                    print(digest["Digest"])
+pyscript
+)
+tpm2 pcrpredict -l sha256:0,7 -s 1:sha256=$orig_digest -L same.bin $eventlog
+tpm2 pcrpredict -l sha256:0,7 -L policy.bin $eventlog
+cmp same.bin policy.bin
+
+# Candidates are predicted like single substitutions, in manifest order
+cat > candidates.manifest << EOF
+# name      substitutions
+current
+updated     1:sha256=$new_digest
+EOF
+
+tpm2 pcrpredict -l sha256:0,7 --candidates=candidates.manifest --jobs=2 \
+    $eventlog > candidates.yaml
+test "$(yaml_get_kv candidates.yaml batch candidates)" -eq 2
+test "$(yaml_get_kv candidates.yaml batch failed)" -eq 0
+grep -A3 "name: current" candidates.yaml | grep -q \
+    "policy: $(yaml_get_kv orig.yaml policy)"
+grep -A3 "name: updated" candidates.yaml | grep -q \
+    "policy: $(yaml_get_kv subst.yaml policy)"
+
+trap - ERR
+
+# An event out of the log fails the candidate and the run
+echo "missing 100000:sha256=$new_digest" > candidates.manifest
+tpm2 pcrpredict -l sha256:0,7 --candidates=candidates.manifest $eventlog
+if [ $? -eq 0 ]; then
+    echo "Expected a candidate with a missing event to fail"
+    exit 1
+fi
+
+# A substitution for a bank the event does not have fails
+tpm2 pcrpredict -l sha256:0 -s 1:sm3_256=$new_digest $eventlog
+if [ $? -eq 0 ]; then
+    echo "Expected a substitution of a missing bank to fail"
+    exit 1
+fi
+
+# A PCR selection is required
+tpm2 pcrpredict $eventlog
+if [ $? -eq 0 ]; then
+    echo "Expected a missing PCR selection to fail"
+    exit 1
+fi
+
+exit 0
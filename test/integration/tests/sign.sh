@@ -25,7 +25,9 @@ cleanup() {
     rm -f $file_input_data $file_primary_key_ctx $file_signing_key_pub \
           $file_signing_key_priv $file_signing_key_ctx $file_signing_key_name \
           $file_output_data $file_input_digest $file_output_ticket \
-          $file_output_hash $file_signing_key_pub_pem
+          $file_output_hash $file_signing_key_pub_pem \
+          artifact_*.bin artifact_*.proof artifacts.manifest batch.sig \
+          batch.out
 
     tpm2 evictcontrol -Q -Co -c $handle_signing_key 2>/dev/null || true
 
@@ -282,6 +284,48 @@ tpm2 commit -c key.ctx -t commit.ctr --eccpoint-K K.bin --eccpoint-L L.bin -u E.
 tpm2 sign -c key.ctx -g sha256 -o test.sig test.rnd -s ecdaa --commit-index 1
 tpm2 sign -c key.ctx -g sha256 -o test.sig test.rnd -s ecdaa
 
+# Test signing a batch of artifacts with one signature
+cleanup "no-shut-down"
+
+tpm2 createprimary -Q -C o -c $file_primary_key_ctx
+tpm2 create -Q -C $file_primary_key_ctx -G rsa -u $file_signing_key_pub \
+-r $file_signing_key_priv
+tpm2 load -Q -C $file_primary_key_ctx -u $file_signing_key_pub \
+-r $file_signing_key_priv -c $file_signing_key_ctx
+
+for i in 1 2 3 4 5; do
+    head -c $((i * 4096)) /dev/urandom > artifact_$i.bin
+    echo "artifact_$i.bin artifact_$i.proof" >> artifacts.manifest
+done
+
+tpm2 sign -c $file_signing_key_ctx -g sha256 -o batch.sig \
+--batch=artifacts.manifest --jobs=3 > batch.out
+yaml_get_kv batch.out "batch" "artifacts" | grep -q "^5$"
+
+for i in 1 2 3 4 5; do
+    tpm2 verifysignature -Q -c $file_signing_key_ctx -s batch.sig \
+    -m artifact_$i.bin --proof=artifact_$i.proof
+done
+
+# Negative test, remove error handler
+trap - ERR
+
+tpm2 verifysignature -Q -c $file_signing_key_ctx -s batch.sig \
+-m artifact_1.bin --proof=artifact_2.proof
+if [ $? -eq 0 ]; then
+  echo "Expected the artifact to fail with the proof of another artifact"
+  exit 1
+fi
+
+tpm2 sign -Q -c $file_signing_key_ctx -o batch.sig -d \
+--batch=artifacts.manifest artifact_1.bin
+if [ $? -eq 0 ]; then
+  echo "Expected --batch to fail with -d"
+  exit 1
+fi
+
+trap onerror ERR
+
 # Test that invalid password returns the proper code
 cleanup "no-shut-down"
 
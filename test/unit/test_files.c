@@ -238,6 +238,62 @@ static void test_file_exists_bad_args(void **state) {
     assert_false(res);
 }
 
+static void test_file_save_load_bytes(void **state) {
+
+    test_file *tf = test_file_from_state(state);
+
+    UINT8 data[128];
+    size_t i;
+    for (i = 0; i < sizeof(data); i++) {
+        data[i] = i;
+    }
+
+    bool res = files_save_bytes_to_file(tf->path, data, sizeof(data));
+    assert_true(res);
+
+    UINT8 buf[256] = { 0 };
+    UINT16 size = sizeof(buf);
+    res = files_load_bytes_from_path(tf->path, buf, &size);
+    assert_true(res);
+
+    assert_int_equal(size, sizeof(data));
+    assert_memory_equal(buf, data, sizeof(data));
+
+    /* exactly the size of the file */
+    size = sizeof(data);
+    res = files_load_bytes_from_path(tf->path, buf, &size);
+    assert_true(res);
+    assert_int_equal(size, sizeof(data));
+
+    /* saving again truncates the file */
+    res = files_save_bytes_to_file(tf->path, data, 16);
+    assert_true(res);
+
+    size = sizeof(buf);
+    res = files_load_bytes_from_path(tf->path, buf, &size);
+    assert_true(res);
+    assert_int_equal(size, 16);
+}
+
+static void test_file_load_bytes_too_big(void **state) {
+
+    test_file *tf = test_file_from_state(state);
+
+    UINT8 data[128] = { 0 };
+
+    bool res = files_save_bytes_to_file(tf->path, data, sizeof(data));
+    assert_true(res);
+
+    UINT8 buf[64];
+    UINT16 size = sizeof(buf);
+    res = files_load_bytes_from_path(tf->path, buf, &size);
+    assert_false(res);
+
+    size = sizeof(buf);
+    res = files_load_bytes_from_path("this_should_be_a_bad_path", buf, &size);
+    assert_false(res);
+}
+
 /* link required symbol, but tpm2_tool.c declares it AND main, which
  * we have a main below for cmocka tests.
  */
@@ -279,6 +335,11 @@ int main(int argc, char* argv[]) {
                 test_setup, test_teardown),
         cmocka_unit_test_setup_teardown(test_file_exists_bad_args,
                 test_setup, test_teardown),
+
+        cmocka_unit_test_setup_teardown(test_file_save_load_bytes,
+                test_setup, test_teardown),
+        cmocka_unit_test_setup_teardown(test_file_load_bytes_too_big,
+                test_setup, test_teardown),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <openssl/sha.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+#include "tpm2_audit.h"
+
+/* more than a batch of extends */
+#define COMMAND_COUNT 1000
+
+static void command_phashes(unsigned command, TPM2B_DIGEST *cp_hash,
+        TPM2B_DIGEST *rp_hash) {
+
+    cp_hash->size = rp_hash->size = SHA256_DIGEST_LENGTH;
+    memset(cp_hash->buffer, command & 0xff, SHA256_DIGEST_LENGTH);
+    memset(rp_hash->buffer, ~command & 0xff, SHA256_DIGEST_LENGTH);
+    cp_hash->buffer[0] = command >> 8;
+}
+
+/* digest = SHA256(digest || cpHash || rpHash) */
+static void expected_extend(BYTE *digest, unsigned command) {
+
+    TPM2B_DIGEST cp_hash;
+    TPM2B_DIGEST rp_hash;
+    command_phashes(command, &cp_hash, &rp_hash);
+
+    BYTE data[3 * SHA256_DIGEST_LENGTH];
+    memcpy(data, digest, SHA256_DIGEST_LENGTH);
+    memcpy(data + SHA256_DIGEST_LENGTH, cp_hash.buffer, SHA256_DIGEST_LENGTH);
+    memcpy(data + 2 * SHA256_DIGEST_LENGTH, rp_hash.buffer,
+            SHA256_DIGEST_LENGTH);
+    SHA256(data, sizeof(data), digest);
+}
+
+static void extend_commands(tpm2_audit *audit, unsigned first,
+        unsigned last) {
+
+    unsigned i;
+    for (i = first; i < last; i++) {
+        TPM2B_DIGEST cp_hash;
+        TPM2B_DIGEST rp_hash;
+        command_phashes(i, &cp_hash, &rp_hash);
+        assert_true(tpm2_audit_extend(audit, &cp_hash, &rp_hash));
+    }
+}
+
+static void test_extend(void **state) {
+
+    (void) state;
+
+    tpm2_audit *audit = tpm2_audit_new(TPM2_ALG_SHA256, NULL);
+    assert_non_null(audit);
+
+    /* a cleared audit digest is all zeros */
+    TPM2B_DIGEST digest;
+    assert_true(tpm2_audit_get_digest(audit, &digest));
+    assert_int_equal(digest.size, SHA256_DIGEST_LENGTH);
+    BYTE expected[SHA256_DIGEST_LENGTH] = { 0 };
+    assert_memory_equal(digest.buffer, expected, sizeof(expected));
+
+    unsigned i;
+    for (i = 0; i < COMMAND_COUNT; i++) {
+        expected_extend(expected, i);
+    }
+
+    extend_commands(audit, 0, COMMAND_COUNT);
+    assert_int_equal(tpm2_audit_get_count(audit), COMMAND_COUNT);
+    assert_true(tpm2_audit_get_digest(audit, &digest));
+    assert_memory_equal(digest.buffer, expected, sizeof(expected));
+
+    tpm2_audit_free(audit);
+}
+
+static void test_resume(void **state) {
+
+    (void) state;
+
+    tpm2_audit *audit = tpm2_audit_new(TPM2_ALG_SHA256, NULL);
+    assert_non_null(audit);
+    extend_commands(audit, 0, 300);
+
+    TPM2B_DIGEST checkpoint;
+    assert_true(tpm2_audit_get_digest(audit, &checkpoint));
+
+    extend_commands(audit, 300, COMMAND_COUNT);
+    TPM2B_DIGEST digest;
+    assert_true(tpm2_audit_get_digest(audit, &digest));
+    tpm2_audit_free(audit);
+
+    /* resuming from the checkpoint replays only the commands after it */
+    audit = tpm2_audit_new(TPM2_ALG_SHA256, &checkpoint);
+    assert_non_null(audit);
+    extend_commands(audit, 300, COMMAND_COUNT);
+    assert_int_equal(tpm2_audit_get_count(audit), COMMAND_COUNT - 300);
+
+    TPM2B_DIGEST resumed;
+    assert_true(tpm2_audit_get_digest(audit, &resumed));
+    assert_int_equal(resumed.size, digest.size);
+    assert_memory_equal(resumed.buffer, digest.buffer, digest.size);
+
+    tpm2_audit_free(audit);
+}
+
+static void test_bad_sizes(void **state) {
+
+    (void) state;
+
+    assert_null(tpm2_audit_new(TPM2_ALG_NULL, NULL));
+
+    TPM2B_DIGEST initial = { .size = 20 };
+    assert_null(tpm2_audit_new(TPM2_ALG_SHA256, &initial));
+
+    tpm2_audit *audit = tpm2_audit_new(TPM2_ALG_SHA256, NULL);
+    assert_non_null(audit);
+
+    TPM2B_DIGEST cp_hash;
+    TPM2B_DIGEST rp_hash;
+    command_phashes(0, &cp_hash, &rp_hash);
+    rp_hash.size = 20;
+    assert_false(tpm2_audit_extend(audit, &cp_hash, &rp_hash));
+    assert_int_equal(tpm2_audit_get_count(audit), 0);
+
+    tpm2_audit_free(audit);
+}
+
+int main(void) {
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_extend),
+        cmocka_unit_test(test_resume),
+        cmocka_unit_test(test_bad_sizes),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
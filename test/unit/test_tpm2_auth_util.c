@@ -3,7 +3,9 @@
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <setjmp.h>
 #include <cmocka.h>
@@ -89,77 +91,29 @@ static void test_tpm2_auth_util_from_optarg_str_escaped_hex_prefix(
     tpm2_session_close(&session);
 }
 
-FILE mocked_file_stream;
-const char *mocked_file_data = "sekretpasswrd";
-
-FILE * __real_fopen(const char *path, const char *mode);
-FILE * __wrap_fopen(const char *path, const char *mode) {
-    if (strcmp(path, "test_tpm2_auth_util_foobar")) {
-        return __real_fopen(path, mode);
-    }
-    return mock_ptr_type(FILE*);
-}
-
-size_t __real_fread(void *ptr, size_t size, size_t nmemb, FILE *stream);
-size_t __wrap_fread(void *ptr, size_t size, size_t nmemb, FILE *stream) {
-    if (stream != &mocked_file_stream) {
-        return __real_fread(ptr, size, nmemb, stream);
-    }
-    strncpy(ptr, mocked_file_data, size * nmemb);
-    return mock_type(size_t);
-}
-
-long __real_ftell(FILE *stream);
-long __wrap_ftell(FILE *stream) {
-    if (stream != &mocked_file_stream) {
-        return __real_ftell(stream);
-    }
-    return mock_type(long);
-}
-
-int __real_fseek(FILE *stream, long offset, int whence);
-int __wrap_fseek(FILE *stream, long offset, int whence) {
-    if (stream != &mocked_file_stream) {
-        return __real_fseek(stream, offset, whence);
-    }
-    return 0;
-}
-
-int __real_feof(FILE *stream);
-int __wrap_feof(FILE *stream) {
-    if (stream != &mocked_file_stream) {
-        return __real_feof(stream);
-    }
-    return 0;
-}
-
-int __real_fclose(FILE *stream);
-int __wrap_fclose(FILE *stream) {
-    if (stream != &mocked_file_stream) {
-        return __real_fclose(stream);
-    }
-    return 0;
-}
-
 static void test_tpm2_auth_util_from_optarg_file(void **state) {
     UNUSED(state);
 
-    tpm2_session *session;
+    static const char secret[] = "sekretpasswrd";
 
-    will_return(__wrap_fopen, &mocked_file_stream);
+    char path[] = "/tmp/test_tpm2_auth_util.XXXXXX";
+    int fd = mkstemp(path);
+    assert_int_not_equal(fd, -1);
+    assert_int_equal(write(fd, secret, strlen(secret)), strlen(secret));
+    assert_int_equal(close(fd), 0);
 
-    will_return(__wrap_fread, (size_t) strlen(mocked_file_data));
-    will_return(__wrap_ftell, (long) strlen(mocked_file_data));
-    will_return(__wrap_ftell, (long) strlen(mocked_file_data));
+    char password[sizeof(path) + sizeof("file:")];
+    snprintf(password, sizeof(password), "file:%s", path);
 
-    tool_rc rc = tpm2_auth_util_from_optarg(NULL, "file:test_tpm2_auth_util_foobar",
-        &session, true);
+    tpm2_session *session;
+    tool_rc rc = tpm2_auth_util_from_optarg(NULL, password, &session, true);
+    unlink(path);
     assert_int_equal(rc, tool_rc_success);
 
     const TPM2B_AUTH *auth = tpm2_session_get_auth_value(session);
 
-    assert_int_equal(auth->size, strlen(mocked_file_data));
-    assert_memory_equal(auth->buffer, mocked_file_data, strlen(mocked_file_data));
+    assert_int_equal(auth->size, strlen(secret));
+    assert_memory_equal(auth->buffer, secret, strlen(secret));
 
     tpm2_session_close(&session);
 }
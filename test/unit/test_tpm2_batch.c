@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "tpm2_batch.h"
+
+/* more than two chunks, the last one partial */
+#define ITEM_COUNT (2 * TPM2_BATCH_CHUNK + 100)
+
+typedef struct test_batch test_batch;
+struct test_batch {
+    unsigned long values[TPM2_BATCH_CHUNK];
+    bool is_allocated[TPM2_BATCH_CHUNK];
+    bool is_invalid[TPM2_BATCH_CHUNK];
+    /* the next value expected by complete, checks the manifest order */
+    unsigned long next;
+    size_t chunks;
+    size_t allocated;
+};
+
+static bool test_parse(void *userdata, size_t index, char **fields,
+        size_t count, size_t line) {
+
+    test_batch *batch = (test_batch *) userdata;
+
+    assert_false(batch->is_allocated[index]);
+    batch->is_allocated[index] = true;
+    batch->allocated++;
+
+    char *end;
+    batch->values[index] = strtoul(fields[0], &end, 10);
+    batch->is_invalid[index] = count != 1 || *end;
+    if (batch->is_invalid[index]) {
+        return false;
+    }
+
+    /* value n is on line n + 2, after the comment */
+    assert_int_equal(line, batch->values[index] + 2);
+
+    return true;
+}
+
+/* Runs on the worker threads, the multiples of 7 fail */
+static bool test_process(void *userdata, size_t index) {
+
+    test_batch *batch = (test_batch *) userdata;
+
+    return batch->values[index] % 7;
+}
+
+static tool_rc test_complete(void *userdata, size_t count) {
+
+    test_batch *batch = (test_batch *) userdata;
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        if (!batch->is_invalid[i]) {
+            assert_int_equal(batch->values[i], batch->next++);
+        }
+    }
+    batch->chunks++;
+
+    return tool_rc_success;
+}
+
+static void test_free(void *userdata, size_t count) {
+
+    test_batch *batch = (test_batch *) userdata;
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        assert_true(batch->is_allocated[i]);
+        batch->is_allocated[i] = false;
+        batch->allocated--;
+    }
+}
+
+static const tpm2_batch_ops test_ops = {
+    .max_fields = 2,
+    .parse = test_parse,
+    .process = test_process,
+    .complete = test_complete,
+    .free = test_free,
+};
+
+static char *manifest_new(size_t count, const char *last) {
+
+    char *path = strdup("/tmp/test_tpm2_batch.XXXXXX");
+    assert_non_null(path);
+
+    int fd = mkstemp(path);
+    assert_int_not_equal(fd, -1);
+    FILE *f = fdopen(fd, "w");
+    assert_non_null(f);
+
+    fprintf(f, "# values\n");
+    size_t i;
+    for (i = 0; i < count; i++) {
+        fprintf(f, "%zu\n", i);
+    }
+    if (last) {
+        fprintf(f, "%s\n", last);
+    }
+    assert_int_equal(fclose(f), 0);
+
+    return path;
+}
+
+static void manifest_free(char *path) {
+
+    unlink(path);
+    free(path);
+}
+
+static void test_run(void **state) {
+
+    (void) state;
+
+    char *path = manifest_new(ITEM_COUNT, NULL);
+
+    unsigned jobs;
+    for (jobs = 1; jobs <= 4; jobs += 3) {
+        test_batch *batch = calloc(1, sizeof(*batch));
+        assert_non_null(batch);
+
+        tpm2_batch_stats stats;
+        tool_rc rc = tpm2_batch_run(path, &test_ops, jobs, batch, &stats);
+        assert_int_equal(rc, tool_rc_general_error);
+        assert_true(stats.is_complete);
+        assert_int_equal(stats.processed, ITEM_COUNT);
+        assert_int_equal(stats.failed, (ITEM_COUNT - 1) / 7 + 1);
+        assert_true(stats.seconds >= 0);
+
+        assert_int_equal(batch->next, ITEM_COUNT);
+        assert_int_equal(batch->chunks, 3);
+        assert_int_equal(batch->allocated, 0);
+
+        tpm2_batch_output(&stats, "values", jobs);
+
+        free(batch);
+    }
+
+    manifest_free(path);
+}
+
+static void test_run_invalid_item(void **state) {
+
+    (void) state;
+
+    char *path = manifest_new(TPM2_BATCH_CHUNK + 1, "invalid");
+
+    test_batch *batch = calloc(1, sizeof(*batch));
+    assert_non_null(batch);
+
+    tpm2_batch_stats stats;
+    tool_rc rc = tpm2_batch_run(path, &test_ops, 2, batch, &stats);
+    assert_int_equal(rc, tool_rc_general_error);
+
+    /* the invalid item fails, the other items of its chunk are processed */
+    assert_true(stats.is_complete);
+    assert_int_equal(stats.processed, TPM2_BATCH_CHUNK + 2);
+    assert_int_equal(stats.failed, TPM2_BATCH_CHUNK / 7 + 1 + 1);
+    assert_int_equal(batch->next, TPM2_BATCH_CHUNK + 1);
+    assert_int_equal(batch->chunks, 2);
+    assert_int_equal(batch->allocated, 0);
+
+    free(batch);
+    manifest_free(path);
+}
+
+static void test_run_no_manifest(void **state) {
+
+    (void) state;
+
+    test_batch *batch = calloc(1, sizeof(*batch));
+    assert_non_null(batch);
+
+    tpm2_batch_stats stats;
+    tool_rc rc = tpm2_batch_run("/nonexistent/manifest", &test_ops, 1, batch,
+            &stats);
+    assert_int_equal(rc, tool_rc_general_error);
+    assert_false(stats.is_complete);
+    assert_int_equal(stats.processed, 0);
+    assert_int_equal(batch->allocated, 0);
+
+    free(batch);
+}
+
+/* link required symbol, but tpm2_tool.c declares it AND main, which
+ * we have a main below for cmocka tests.
+ */
+bool output_enabled = true;
+
+int main(void) {
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_run),
+        cmocka_unit_test(test_run_invalid_item),
+        cmocka_unit_test(test_run_no_manifest),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
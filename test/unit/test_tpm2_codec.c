@@ -0,0 +1,219 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+#include "tpm2_codec.h"
+#include "tpm2_convert.h"
+#include "tpm2_util.h"
+
+static void fill(BYTE *data, size_t size) {
+
+    size_t i;
+    for (i = 0; i < size; i++) {
+        data[i] = i * 7 + 3;
+    }
+}
+
+static void test_hex_encode(void **state) {
+
+    (void) state;
+
+    BYTE data[256];
+    fill(data, sizeof(data));
+
+    char hex[TPM2_CODEC_HEX_SIZE(sizeof(data)) + 1];
+    size_t length = tpm2_codec_hex_encode(data, sizeof(data), hex, false);
+    assert_int_equal(length, TPM2_CODEC_HEX_SIZE(sizeof(data)));
+    assert_int_equal(strlen(hex), length);
+
+    size_t i;
+    for (i = 0; i < sizeof(data); i++) {
+        char expected[3];
+        snprintf(expected, sizeof(expected), "%02x", data[i]);
+        assert_memory_equal(&hex[i * 2], expected, 2);
+    }
+
+    BYTE upper[] = { 0xab, 0x0f, 0x90 };
+    tpm2_codec_hex_encode(upper, sizeof(upper), hex, true);
+    assert_string_equal(hex, "AB0F90");
+
+    assert_int_equal(tpm2_codec_hex_encode(upper, 0, hex, false), 0);
+    assert_string_equal(hex, "");
+}
+
+static void test_hex_decode(void **state) {
+
+    (void) state;
+
+    BYTE data[3];
+    assert_true(tpm2_codec_hex_decode("aB0f90", 6, data));
+    BYTE expected[] = { 0xab, 0x0f, 0x90 };
+    assert_memory_equal(data, expected, sizeof(expected));
+
+    /* only the given length is decoded */
+    assert_true(tpm2_codec_hex_decode("ffzz", 2, data));
+    assert_int_equal(data[0], 0xff);
+
+    assert_false(tpm2_codec_hex_decode("abc", 3, data));
+    assert_false(tpm2_codec_hex_decode("0g", 2, data));
+    assert_false(tpm2_codec_hex_decode("0 ", 2, data));
+}
+
+static void test_hex_round_trip(void **state) {
+
+    (void) state;
+
+    BYTE data[1000];
+    fill(data, sizeof(data));
+
+    char hex[TPM2_CODEC_HEX_SIZE(sizeof(data)) + 1];
+    BYTE decoded[sizeof(data)];
+    size_t size;
+    for (size = 0; size <= sizeof(data); size += 37) {
+        size_t length = tpm2_codec_hex_encode(data, size, hex, size % 2);
+        assert_true(tpm2_codec_hex_decode(hex, length, decoded));
+        assert_memory_equal(decoded, data, size);
+    }
+}
+
+static void test_base64_encode(void **state) {
+
+    (void) state;
+
+    /* the vectors of RFC 4648 */
+    static const char *const vectors[] = {
+        "", "Zg==", "Zm8=", "Zm9v", "Zm9vYg==", "Zm9vYmE=", "Zm9vYmFy",
+    };
+
+    char base64[16];
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(vectors); i++) {
+        size_t length = tpm2_codec_base64_encode((const BYTE *) "foobar", i,
+                base64);
+        assert_int_equal(length, TPM2_CODEC_BASE64_SIZE(i));
+        assert_string_equal(base64, vectors[i]);
+    }
+}
+
+static void test_base64_decode(void **state) {
+
+    (void) state;
+
+    BYTE data[16];
+    size_t size = sizeof(data);
+    assert_true(tpm2_codec_base64_decode("Zm9v\nYmE=\n", 10, data, &size));
+    assert_int_equal(size, 5);
+    assert_memory_equal(data, "fooba", 5);
+
+    /* unpadded */
+    size = sizeof(data);
+    assert_true(tpm2_codec_base64_decode("Zm8", 3, data, &size));
+    assert_int_equal(size, 2);
+    assert_memory_equal(data, "fo", 2);
+
+    size = sizeof(data);
+    assert_true(tpm2_codec_base64_decode("", 0, data, &size));
+    assert_int_equal(size, 0);
+
+    static const char *const invalid[] = {
+        "Z", "Z===", "Zg=", "Zg=g", "Zg==Zg==", "Zm9*", "Zm9v=",
+    };
+
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(invalid); i++) {
+        size = sizeof(data);
+        assert_false(tpm2_codec_base64_decode(invalid[i], strlen(invalid[i]),
+                data, &size));
+    }
+
+    /* too small */
+    size = 5;
+    assert_false(tpm2_codec_base64_decode("Zm9vYmFy", 8, data, &size));
+}
+
+static void test_base64_round_trip(void **state) {
+
+    (void) state;
+
+    BYTE data[1000];
+    fill(data, sizeof(data));
+
+    char base64[TPM2_CODEC_BASE64_SIZE(sizeof(data)) + 1];
+    BYTE decoded[sizeof(data)];
+    size_t size;
+    for (size = 0; size <= sizeof(data); size += 37) {
+        size_t length = tpm2_codec_base64_encode(data, size, base64);
+        size_t decoded_size = size;
+        assert_true(tpm2_codec_base64_decode(base64, length, decoded,
+                &decoded_size));
+        assert_int_equal(decoded_size, size);
+        assert_memory_equal(decoded, data, size);
+    }
+}
+
+static void test_base64_pem_lines(void **state) {
+
+    (void) state;
+
+    BYTE data[100];
+    fill(data, sizeof(data));
+
+    /* 48 bytes per line of 64 characters */
+    char base64[256];
+    assert_true(tpm2_base64_encode(data, sizeof(data), base64));
+    assert_int_equal(strlen(base64), 64 + 1 + 64 + 1 + 8 + 1);
+    assert_int_equal(base64[64], '\n');
+    assert_int_equal(base64[129], '\n');
+    assert_int_equal(base64[138], '\n');
+
+    BYTE decoded[sizeof(data)];
+    size_t size = sizeof(decoded);
+    assert_true(tpm2_base64_decode(base64, decoded, &size));
+    assert_int_equal(size, sizeof(data));
+    assert_memory_equal(decoded, data, sizeof(data));
+}
+
+static void test_hex_to_byte_structure(void **state) {
+
+    (void) state;
+
+    BYTE data[3];
+    UINT16 size = sizeof(data);
+    assert_int_equal(tpm2_util_hex_to_byte_structure("aB0f90", &size, data),
+            0);
+    assert_int_equal(size, 3);
+    BYTE expected[] = { 0xab, 0x0f, 0x90 };
+    assert_memory_equal(data, expected, sizeof(expected));
+
+    assert_int_equal(tpm2_util_hex_to_byte_structure(NULL, &size, data), -1);
+    assert_int_equal(tpm2_util_hex_to_byte_structure("abc", &size, data), -2);
+    assert_int_equal(tpm2_util_hex_to_byte_structure("abcx", &size, data),
+            -3);
+
+    size = 1;
+    assert_int_equal(tpm2_util_hex_to_byte_structure("abcd", &size, data),
+            -4);
+}
+
+int main(void) {
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_hex_encode),
+        cmocka_unit_test(test_hex_decode),
+        cmocka_unit_test(test_hex_round_trip),
+        cmocka_unit_test(test_base64_encode),
+        cmocka_unit_test(test_base64_decode),
+        cmocka_unit_test(test_base64_round_trip),
+        cmocka_unit_test(test_base64_pem_lines),
+        cmocka_unit_test(test_hex_to_byte_structure),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
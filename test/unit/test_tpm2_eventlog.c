@@ -10,6 +10,7 @@
 #include <tss2/tss2_tpm2_types.h>
 
 #include "tpm2_eventlog.h"
+#include "tpm2_pcr_banks.h"
 
 #define TCG_DIGEST2_SHA1_SIZE (sizeof(TCG_DIGEST2) + TPM2_SHA_DIGEST_SIZE)
 #define TCG_DIGEST2_SHA256_SIZE (sizeof(TCG_DIGEST2) + TPM2_SHA256_DIGEST_SIZE)
@@ -72,9 +73,13 @@ static void test_sha1(void **state){
     digest->AlgorithmId = TPM2_ALG_SHA1,
     memcpy(digest->Digest, "the magic words are:", TPM2_SHA1_DIGEST_SIZE);
 
-    tpm2_eventlog_context ctx = {0};
+    tpm2_eventlog_context ctx = { .banks = tpm2_pcr_banks_new(TPM2_MAX_PCRS) };
+    assert_non_null(ctx.banks);
     assert_true(foreach_digest2(&ctx, pcr_index, digest, 1, TCG_DIGEST2_SHA1_SIZE));
-    assert_memory_equal(ctx.sha1_pcrs[pcr_index], sha1sum, sizeof(sha1sum));
+    assert_true(tpm2_pcr_banks_is_extended(ctx.banks, TPM2_ALG_SHA1, pcr_index));
+    assert_memory_equal(tpm2_pcr_banks_value(ctx.banks, TPM2_ALG_SHA1, pcr_index),
+            sha1sum, sizeof(sha1sum));
+    tpm2_pcr_banks_free(ctx.banks);
 }
 static void test_sha256(void **state){
 
@@ -92,9 +97,29 @@ static void test_sha256(void **state){
     digest->AlgorithmId = TPM2_ALG_SHA256,
     memcpy(digest->Digest, "The Magic Words are Squeamish Ossifrage, for RSA-129 (from 1977)", TPM2_SHA256_DIGEST_SIZE);
 
-    tpm2_eventlog_context ctx = {0};
+    tpm2_eventlog_context ctx = { .banks = tpm2_pcr_banks_new(TPM2_MAX_PCRS) };
+    assert_non_null(ctx.banks);
     assert_true(foreach_digest2(&ctx, pcr_index, digest, 1, TCG_DIGEST2_SHA256_SIZE));
-    assert_memory_equal(ctx.sha256_pcrs[pcr_index], sha256sum, sizeof(sha256sum));
+    assert_true(tpm2_pcr_banks_is_extended(ctx.banks, TPM2_ALG_SHA256, pcr_index));
+    assert_memory_equal(tpm2_pcr_banks_value(ctx.banks, TPM2_ALG_SHA256, pcr_index),
+            sha256sum, sizeof(sha256sum));
+    tpm2_pcr_banks_free(ctx.banks);
+}
+static void test_foreach_digest2_not_replayed(void **state){
+
+    (void)state;
+    uint8_t buf [TCG_DIGEST2_SHA256_SIZE] = { 0, };
+    TCG_DIGEST2 *digest = (TCG_DIGEST2*) buf;
+    digest->AlgorithmId = TPM2_ALG_SHA256;
+
+    /* a PCR the banks do not hold is skipped, the walk goes on */
+    tpm2_eventlog_context ctx = { .banks = tpm2_pcr_banks_new(8) };
+    assert_non_null(ctx.banks);
+    assert_true(foreach_digest2(&ctx, 10, digest, 1, TCG_DIGEST2_SHA256_SIZE));
+    assert_false(tpm2_pcr_banks_is_extended(ctx.banks, TPM2_ALG_SHA256, 10));
+    assert_true(foreach_digest2(&ctx, 3, digest, 1, TCG_DIGEST2_SHA256_SIZE));
+    assert_true(tpm2_pcr_banks_is_extended(ctx.banks, TPM2_ALG_SHA256, 3));
+    tpm2_pcr_banks_free(ctx.banks);
 }
 static void test_foreach_digest2_cbfail(void **state){
 
@@ -352,6 +377,91 @@ static void test_foreach_event2_event2body_version2_fail(void **state){
     };
     assert_false(foreach_event2(&ctx, eventhdr, sizeof(buf)));
 }
+static size_t write_sha1_event2(BYTE *buf, UINT32 pcr, UINT32 type,
+        BYTE digest_byte, UINT32 event_size) {
+
+    TCG_EVENT_HEADER2 *eventhdr = (TCG_EVENT_HEADER2*)buf;
+    TCG_DIGEST2 *digest = eventhdr->Digests;
+    TCG_EVENT2 *event = (TCG_EVENT2*)((uintptr_t)digest + TCG_DIGEST2_SHA1_SIZE);
+
+    eventhdr->PCRIndex = pcr;
+    eventhdr->EventType = type;
+    eventhdr->DigestCount = 1;
+    digest->AlgorithmId = TPM2_ALG_SHA1;
+    memset(digest->Digest, digest_byte, TPM2_SHA1_DIGEST_SIZE);
+    event->EventSize = event_size;
+
+    return sizeof(*eventhdr) + TCG_DIGEST2_SHA1_SIZE + sizeof(*event) +
+            event_size;
+}
+static bool test_event2skip_callback(TCG_EVENT_HEADER2 const *eventhdr,
+        size_t size, void *data) {
+
+    (void)eventhdr;
+    (void)size;
+
+    size_t *skipped = (size_t*)data;
+    (*skipped)++;
+
+    return true;
+}
+static void test_foreach_event2_query(void **state){
+
+    (void)state;
+    BYTE buf[2 * (sizeof(TCG_EVENT_HEADER2) + TCG_DIGEST2_SHA1_SIZE +
+                  sizeof(TCG_EVENT2)) + 6 + 1] = { 0, };
+
+    size_t size = write_sha1_event2(buf, 0, EV_POST_CODE, 0x11, 6);
+    /* too small for UEFI variable data, an error when the body is parsed */
+    size += write_sha1_event2(buf + size, 7, EV_EFI_VARIABLE_AUTHORITY, 0x22,
+            1);
+    assert_int_equal(size, sizeof(buf));
+
+    tpm2_eventlog_query query;
+    tpm2_eventlog_query_init(&query);
+    query.pcrs = 1 << 0;
+
+    size_t skipped = 0;
+    tpm2_eventlog_context ctx = {
+        .data = &skipped,
+        .event2hdr_cb = test_event2hdr_callback,
+        .event2_cb = test_event2_callback,
+        .event2skip_cb = test_event2skip_callback,
+        .eventlog_version = 1,
+        .query = &query,
+    };
+
+    /* the second event is skipped from its header */
+    will_return(test_event2hdr_callback, true);
+    will_return(test_event2_callback, true);
+    assert_true(foreach_event2(&ctx, (TCG_EVENT_HEADER2*)buf, sizeof(buf)));
+    assert_int_equal(skipped, 1);
+
+    /* the events are numbered from 1, after the Spec ID event */
+    tpm2_eventlog_query_init(&query);
+    query.first = 2;
+    skipped = 0;
+    will_return(test_event2hdr_callback, true);
+    assert_false(foreach_event2(&ctx, (TCG_EVENT_HEADER2*)buf, sizeof(buf)));
+    assert_int_equal(skipped, 1);
+
+    tpm2_eventlog_query_init(&query);
+    query.types[query.type_count++] = EV_EFI_ACTION;
+    query.types[query.type_count++] = EV_POST_CODE;
+    query.digest.size = TPM2_SHA1_DIGEST_SIZE;
+    memset(query.digest.buffer, 0x11, TPM2_SHA1_DIGEST_SIZE);
+    skipped = 0;
+    will_return(test_event2hdr_callback, true);
+    will_return(test_event2_callback, true);
+    assert_true(foreach_event2(&ctx, (TCG_EVENT_HEADER2*)buf, sizeof(buf)));
+    assert_int_equal(skipped, 1);
+
+    /* no event with the digest */
+    query.digest.buffer[0] ^= 1;
+    skipped = 0;
+    assert_true(foreach_event2(&ctx, (TCG_EVENT_HEADER2*)buf, sizeof(buf)));
+    assert_int_equal(skipped, 2);
+}
 static void test_parse_event2body_uefivar_badsize(void **state){
 
     (void)state;
@@ -550,12 +660,81 @@ static void test_specid_event(void **state) {
 
     assert_true(specid_event(event, sizeof(buf), &next));
 }
+static bool test_specid_callback(TCG_EVENT const *event, void *data) {
+
+    (void)event;
+
+    size_t *count = (size_t*)data;
+    count[0]++;
+
+    return true;
+}
+static bool test_specidskip_callback(TCG_EVENT const *event, void *data) {
+
+    (void)event;
+
+    size_t *count = (size_t*)data;
+    count[1]++;
+
+    return true;
+}
+static void test_specid_event_query(void **state) {
+
+    (void)state;
+
+    TCG_EVENT *event;
+    TCG_SPECID_EVENT *event_specid;
+    TCG_SPECID_ALG *alg;
+    TCG_VENDOR_INFO *vendor;
+    char buf[sizeof(*event) + sizeof(*event_specid) + sizeof(*alg) + sizeof(*vendor)] = { 0, };
+
+    event = (TCG_EVENT*)buf;
+    event->eventType = EV_NO_ACTION;
+    event->eventDataSize = sizeof(*event_specid);
+    event_specid = (TCG_SPECID_EVENT*)event->event;
+    event_specid->numberOfAlgorithms = 1;
+
+    tpm2_eventlog_query query;
+    tpm2_eventlog_query_init(&query);
+
+    /* the parsed and the skipped Spec ID events */
+    size_t count[2] = { 0 };
+    tpm2_eventlog_context ctx = {
+        .data = count,
+        .specid_cb = test_specid_callback,
+        .specidskip_cb = test_specidskip_callback,
+        .query = &query,
+    };
+
+    assert_true(parse_eventlog(&ctx, (BYTE*)buf, sizeof(buf)));
+    assert_int_equal(count[0], 1);
+    assert_int_equal(count[1], 0);
+
+    /* the Spec ID event is event 0, extending no PCR */
+    query.first = 1;
+    assert_true(parse_eventlog(&ctx, (BYTE*)buf, sizeof(buf)));
+    assert_int_equal(count[0], 1);
+    assert_int_equal(count[1], 1);
+
+    tpm2_eventlog_query_init(&query);
+    query.pcrs = 1 << 7;
+    assert_true(parse_eventlog(&ctx, (BYTE*)buf, sizeof(buf)));
+    assert_int_equal(count[1], 2);
+
+    tpm2_eventlog_query_init(&query);
+    query.types[query.type_count++] = EV_NO_ACTION;
+    query.pcrs = 1 << 0;
+    assert_true(parse_eventlog(&ctx, (BYTE*)buf, sizeof(buf)));
+    assert_int_equal(count[0], 2);
+    assert_int_equal(count[1], 2);
+}
 int main(void) {
 
     const struct CMUnitTest tests[] = {
         cmocka_unit_test(test_foreach_digest2_null),
         cmocka_unit_test(test_foreach_digest2_size),
         cmocka_unit_test(test_foreach_digest2),
+        cmocka_unit_test(test_foreach_digest2_not_replayed),
         cmocka_unit_test(test_foreach_digest2_cbfail),
         cmocka_unit_test(test_foreach_digest2_cbnull),
         cmocka_unit_test(test_sha1),
@@ -573,6 +752,8 @@ int main(void) {
         cmocka_unit_test(test_foreach_event2_event2body_version2_fail),
         cmocka_unit_test(test_foreach_event2_digest2_fail),
         cmocka_unit_test(test_foreach_event2_parse_event2body_fail),
+        cmocka_unit_test(test_foreach_event2_query),
+        cmocka_unit_test(test_specid_event_query),
         cmocka_unit_test(test_parse_event2body_uefivar_badsize),
         cmocka_unit_test(test_parse_event2body_uefivar_badlength),
         cmocka_unit_test(test_parse_event2body_firmware_blob_badlength),
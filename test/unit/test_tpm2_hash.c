@@ -0,0 +1,140 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "tpm2_hash.h"
+#include "tpm2_util.h"
+
+#define BLOCK_SIZE BUFFER_SIZE(TPM2B_MAX_BUFFER, buffer)
+
+typedef struct test_sequence test_sequence;
+struct test_sequence {
+    unsigned oneshot_calls;
+    unsigned start_calls;
+    UINT16 oneshot_size;
+};
+
+static tool_rc test_oneshot(ESYS_CONTEXT *ectx, void *userdata,
+        const TPM2B_MAX_BUFFER *data) {
+
+    UNUSED(ectx);
+
+    test_sequence *seq = (test_sequence *) userdata;
+    seq->oneshot_calls++;
+    seq->oneshot_size = data->size;
+
+    return tool_rc_success;
+}
+
+static tool_rc test_start(ESYS_CONTEXT *ectx, void *userdata,
+        ESYS_TR *sequence_handle, ESYS_TR *shandle1) {
+
+    UNUSED(ectx);
+    UNUSED(sequence_handle);
+    UNUSED(shandle1);
+
+    /* stop before any TPM command */
+    test_sequence *seq = (test_sequence *) userdata;
+    seq->start_calls++;
+
+    return tool_rc_general_error;
+}
+
+static const tpm2_hash_sequence_ops test_ops = {
+    .oneshot = test_oneshot,
+    .start = test_start,
+};
+
+static FILE *input_of_size(size_t size) {
+
+    FILE *f = tmpfile();
+    assert_non_null(f);
+
+    size_t i;
+    for (i = 0; i < size; i++) {
+        assert_int_not_equal(fputc((int) (i & 0xff), f), EOF);
+    }
+    rewind(f);
+
+    return f;
+}
+
+static void test_stream_sizes(void **state) {
+
+    UNUSED(state);
+
+    /* input of exactly the block size is a single block */
+    static const struct {
+        size_t size;
+        bool is_oneshot;
+    } cases[] = {
+        { 0, true },
+        { 1, true },
+        { BLOCK_SIZE - 1, true },
+        { BLOCK_SIZE, true },
+        { BLOCK_SIZE + 1, false },
+        { 2 * BLOCK_SIZE, false },
+    };
+
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(cases); i++) {
+        test_sequence seq = { 0 };
+        FILE *f = input_of_size(cases[i].size);
+
+        tool_rc rc = tpm2_hash_sequence_stream(NULL, &test_ops, &seq, f,
+                NULL, 0);
+        fclose(f);
+
+        if (cases[i].is_oneshot) {
+            assert_int_equal(rc, tool_rc_success);
+            assert_int_equal(seq.oneshot_calls, 1);
+            assert_int_equal(seq.start_calls, 0);
+            assert_int_equal(seq.oneshot_size, cases[i].size);
+        } else {
+            assert_int_equal(rc, tool_rc_general_error);
+            assert_int_equal(seq.oneshot_calls, 0);
+            assert_int_equal(seq.start_calls, 1);
+        }
+    }
+}
+
+static void test_buffer_sizes(void **state) {
+
+    UNUSED(state);
+
+    static BYTE buffer[2 * BLOCK_SIZE];
+
+    test_sequence seq = { 0 };
+    tool_rc rc = tpm2_hash_sequence_stream(NULL, &test_ops, &seq, NULL,
+            buffer, BLOCK_SIZE);
+    assert_int_equal(rc, tool_rc_success);
+    assert_int_equal(seq.oneshot_calls, 1);
+    assert_int_equal(seq.oneshot_size, BLOCK_SIZE);
+
+    memset(&seq, 0, sizeof(seq));
+    rc = tpm2_hash_sequence_stream(NULL, &test_ops, &seq, NULL,
+            buffer, BLOCK_SIZE + 1);
+    assert_int_equal(rc, tool_rc_general_error);
+    assert_int_equal(seq.start_calls, 1);
+}
+
+/* link required symbol, but tpm2_tool.c declares it AND main, which
+ * we have a main below for cmocka tests.
+ */
+bool output_enabled = true;
+
+int main(void) {
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_stream_sizes),
+        cmocka_unit_test(test_buffer_sizes),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -0,0 +1,193 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+#include "tpm2_merkle.h"
+#include "tpm2_util.h"
+
+#define MAX_LEAVES 33
+
+static void fill_leaves(TPM2B_DATA *leaves, size_t count) {
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        leaves[i].size = 1 + i % 20;
+        memset(leaves[i].buffer, (int) i, leaves[i].size);
+    }
+}
+
+static void test_proofs(void **state) {
+
+    (void) state;
+
+    TPM2B_DATA leaves[MAX_LEAVES];
+    fill_leaves(leaves, ARRAY_LEN(leaves));
+
+    /* every shape of tree, with and without promoted nodes */
+    size_t count;
+    for (count = 1; count <= ARRAY_LEN(leaves); count++) {
+        tpm2_merkle_tree *tree = tpm2_merkle_tree_new(TPM2_ALG_SHA256,
+                leaves, count);
+        assert_non_null(tree);
+
+        TPM2B_DATA root;
+        tpm2_merkle_tree_root(tree, &root);
+        assert_int_equal(root.size, TPM2_SHA256_DIGEST_SIZE);
+
+        size_t i;
+        for (i = 0; i < count; i++) {
+            tpm2_merkle_proof proof;
+            assert_true(tpm2_merkle_tree_proof(tree, i, &proof));
+            assert_true(tpm2_merkle_proof_verify(&proof, &leaves[i], &root));
+
+            TPM2B_DATA computed;
+            assert_true(tpm2_merkle_proof_root(&proof, &leaves[i], &computed));
+            assert_int_equal(computed.size, root.size);
+            assert_memory_equal(computed.buffer, root.buffer, root.size);
+
+            /* the proof of a leaf does not hold for another leaf */
+            if (count > 1) {
+                assert_false(tpm2_merkle_proof_verify(&proof,
+                        &leaves[(i + 1) % count], &root));
+            }
+        }
+
+        tpm2_merkle_proof proof;
+        assert_false(tpm2_merkle_tree_proof(tree, count, &proof));
+
+        tpm2_merkle_tree_free(tree);
+    }
+}
+
+static void test_single_leaf(void **state) {
+
+    (void) state;
+
+    TPM2B_DATA leaf;
+    fill_leaves(&leaf, 1);
+
+    tpm2_merkle_tree *tree = tpm2_merkle_tree_new(TPM2_ALG_SHA256, &leaf, 1);
+    assert_non_null(tree);
+
+    TPM2B_DATA root;
+    tpm2_merkle_tree_root(tree, &root);
+
+    /* the root is not the nonce itself */
+    assert_false(root.size == leaf.size &&
+            !memcmp(root.buffer, leaf.buffer, leaf.size));
+
+    tpm2_merkle_proof proof;
+    assert_true(tpm2_merkle_tree_proof(tree, 0, &proof));
+    assert_int_equal(proof.length, 0);
+    assert_true(tpm2_merkle_proof_verify(&proof, &leaf, &root));
+
+    tpm2_merkle_tree_free(tree);
+}
+
+static void test_tampered(void **state) {
+
+    (void) state;
+
+    TPM2B_DATA leaves[5];
+    fill_leaves(leaves, ARRAY_LEN(leaves));
+
+    tpm2_merkle_tree *tree = tpm2_merkle_tree_new(TPM2_ALG_SHA256, leaves,
+            ARRAY_LEN(leaves));
+    assert_non_null(tree);
+
+    TPM2B_DATA root;
+    tpm2_merkle_tree_root(tree, &root);
+
+    tpm2_merkle_proof proof;
+    assert_true(tpm2_merkle_tree_proof(tree, 2, &proof));
+    tpm2_merkle_tree_free(tree);
+
+    tpm2_merkle_proof tampered = proof;
+    tampered.path[1][0] ^= 1;
+    assert_false(tpm2_merkle_proof_verify(&tampered, &leaves[2], &root));
+
+    tampered = proof;
+    tampered.index = 3;
+    assert_false(tpm2_merkle_proof_verify(&tampered, &leaves[2], &root));
+
+    tampered = proof;
+    tampered.length--;
+    assert_false(tpm2_merkle_proof_verify(&tampered, &leaves[2], &root));
+
+    tampered = proof;
+    tampered.count = 9;
+    assert_false(tpm2_merkle_proof_verify(&tampered, &leaves[2], &root));
+
+    root.buffer[0] ^= 1;
+    assert_false(tpm2_merkle_proof_verify(&proof, &leaves[2], &root));
+}
+
+static void test_bad_tree(void **state) {
+
+    (void) state;
+
+    TPM2B_DATA leaf;
+    fill_leaves(&leaf, 1);
+
+    assert_null(tpm2_merkle_tree_new(TPM2_ALG_SHA256, &leaf, 0));
+    assert_null(tpm2_merkle_tree_new(TPM2_ALG_NULL, &leaf, 1));
+}
+
+static void test_save_load(void **state) {
+
+    (void) state;
+
+    TPM2B_DATA leaves[7];
+    fill_leaves(leaves, ARRAY_LEN(leaves));
+
+    tpm2_merkle_tree *tree = tpm2_merkle_tree_new(TPM2_ALG_SHA384, leaves,
+            ARRAY_LEN(leaves));
+    assert_non_null(tree);
+
+    TPM2B_DATA root;
+    tpm2_merkle_tree_root(tree, &root);
+
+    tpm2_merkle_proof proof;
+    assert_true(tpm2_merkle_tree_proof(tree, 6, &proof));
+    tpm2_merkle_tree_free(tree);
+
+    char path[] = "/tmp/test_tpm2_merkle_XXXXXX";
+    int fd = mkstemp(path);
+    assert_true(fd >= 0);
+    close(fd);
+
+    assert_true(tpm2_merkle_proof_save(&proof, path));
+
+    tpm2_merkle_proof loaded;
+    bool result = tpm2_merkle_proof_load(path, &loaded);
+    unlink(path);
+    assert_true(result);
+
+    assert_int_equal(loaded.halg, proof.halg);
+    assert_int_equal(loaded.index, proof.index);
+    assert_int_equal(loaded.count, proof.count);
+    assert_int_equal(loaded.length, proof.length);
+    assert_true(tpm2_merkle_proof_verify(&loaded, &leaves[6], &root));
+}
+
+int main(void) {
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_proofs),
+        cmocka_unit_test(test_single_leaf),
+        cmocka_unit_test(test_tampered),
+        cmocka_unit_test(test_bad_tree),
+        cmocka_unit_test(test_save_load),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
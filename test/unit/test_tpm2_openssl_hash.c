@@ -0,0 +1,210 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+#include "tpm2_alg_util.h"
+#include "tpm2_openssl.h"
+#include "tpm2_util.h"
+
+static const TPMI_ALG_HASH algs[] = {
+    TPM2_ALG_SHA1,
+    TPM2_ALG_SHA256,
+    TPM2_ALG_SHA384,
+    TPM2_ALG_SHA512,
+};
+
+static void fill(BYTE *buf, size_t size, unsigned seed) {
+
+    size_t i;
+    for (i = 0; i < size; i++) {
+        buf[i] = (BYTE) (seed * 31 + i * 7);
+    }
+}
+
+static void test_hash_batch(bool is_hasher) {
+
+    BYTE data[1024];
+    fill(data, sizeof(data), 1);
+
+    static const size_t lengths[] = { 0, 1, 55, 56, 64, 111, 128, 1024 };
+
+    tpm2_openssl_hasher *hasher = is_hasher ? tpm2_openssl_hasher_new() : NULL;
+    assert_true(!is_hasher || hasher);
+
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(lengths); i++) {
+        BYTE digests[ARRAY_LEN(algs)][TPM2_SHA512_DIGEST_SIZE];
+        tpm2_openssl_hash_msg msgs[ARRAY_LEN(algs)];
+
+        size_t j;
+        for (j = 0; j < ARRAY_LEN(algs); j++) {
+            msgs[j] = (tpm2_openssl_hash_msg) {
+                .halg = algs[j],
+                .data = data,
+                .length = lengths[i],
+                .digest = digests[j]
+            };
+        }
+
+        assert_true(tpm2_openssl_hash_batch(hasher, msgs, ARRAY_LEN(msgs)));
+
+        for (j = 0; j < ARRAY_LEN(algs); j++) {
+            TPM2B_DIGEST expected = TPM2B_EMPTY_INIT;
+            assert_true(tpm2_openssl_hash_compute_data(algs[j], data,
+                    lengths[i], &expected));
+            assert_int_equal(expected.size,
+                    tpm2_alg_util_get_hash_size(algs[j]));
+            assert_memory_equal(digests[j], expected.buffer, expected.size);
+        }
+    }
+
+    tpm2_openssl_hasher_free(hasher);
+}
+
+static void test_hash_batch_hasher(void **state) {
+
+    (void) state;
+
+    test_hash_batch(true);
+}
+
+static void test_hash_batch_no_hasher(void **state) {
+
+    (void) state;
+
+    test_hash_batch(false);
+}
+
+static void test_hash_batch_extend(void **state) {
+
+    (void) state;
+
+    BYTE pcr[TPM2_SHA256_DIGEST_SIZE] = { 0 };
+    BYTE expected[TPM2_SHA256_DIGEST_SIZE] = { 0 };
+    BYTE digests[3][TPM2_SHA256_DIGEST_SIZE];
+
+    tpm2_openssl_hash_msg msgs[ARRAY_LEN(digests)];
+    size_t i;
+    for (i = 0; i < ARRAY_LEN(digests); i++) {
+        fill(digests[i], sizeof(digests[i]), i);
+        msgs[i] = (tpm2_openssl_hash_msg) {
+            .halg = TPM2_ALG_SHA256,
+            .prefix = pcr,
+            .prefix_len = sizeof(pcr),
+            .data = digests[i],
+            .length = sizeof(digests[i]),
+            .digest = pcr
+        };
+        assert_true(tpm2_openssl_pcr_extend(TPM2_ALG_SHA256, expected,
+                digests[i], sizeof(digests[i])));
+    }
+
+    /* successive extends of a PCR depend on each other */
+    tpm2_openssl_hasher *hasher = tpm2_openssl_hasher_new();
+    assert_non_null(hasher);
+    assert_true(tpm2_openssl_hash_batch(hasher, msgs, ARRAY_LEN(msgs)));
+    tpm2_openssl_hasher_free(hasher);
+
+    assert_memory_equal(pcr, expected, sizeof(pcr));
+}
+
+static void test_hash_batch_bad_alg(void **state) {
+
+    (void) state;
+
+    BYTE data[1] = { 0 };
+    BYTE digest[TPM2_SHA512_DIGEST_SIZE];
+    tpm2_openssl_hash_msg msg = {
+        .halg = TPM2_ALG_NULL,
+        .data = data,
+        .length = sizeof(data),
+        .digest = digest
+    };
+
+    tpm2_openssl_hasher *hasher = tpm2_openssl_hasher_new();
+    assert_non_null(hasher);
+    assert_false(tpm2_openssl_hash_batch(hasher, &msg, 1));
+    tpm2_openssl_hasher_free(hasher);
+
+    assert_false(tpm2_openssl_hash_batch(NULL, &msg, 1));
+}
+
+/*
+ * Number of synthetic events, with SHA1 and SHA256 digests of payloads below
+ * 1 KiB like most of the events of a boot log.
+ */
+#define EVENTS 64
+
+static void test_hash_batch_events(void **state) {
+
+    (void) state;
+
+    BYTE *payloads = malloc(EVENTS * 1024);
+    BYTE (*before)[2][TPM2_SHA256_DIGEST_SIZE] = calloc(EVENTS,
+            sizeof(*before));
+    BYTE (*after)[2][TPM2_SHA256_DIGEST_SIZE] = calloc(EVENTS,
+            sizeof(*after));
+    assert_non_null(payloads);
+    assert_non_null(before);
+    assert_non_null(after);
+    fill(payloads, EVENTS * 1024, 2);
+
+    static const TPMI_ALG_HASH banks[] = { TPM2_ALG_SHA1, TPM2_ALG_SHA256 };
+
+    /* a context per digest, as the event log verification used to do */
+    size_t i;
+    for (i = 0; i < EVENTS; i++) {
+        size_t j;
+        for (j = 0; j < ARRAY_LEN(banks); j++) {
+            TPM2B_DIGEST digest = TPM2B_EMPTY_INIT;
+            assert_true(tpm2_openssl_hash_compute_data(banks[j],
+                    payloads + i * 1024, 16 + (i * 37) % 1008, &digest));
+            memcpy(before[i][j], digest.buffer, digest.size);
+        }
+    }
+
+    /* the banks of an event in a batch, over contexts kept across events */
+    tpm2_openssl_hasher *hasher = tpm2_openssl_hasher_new();
+    assert_non_null(hasher);
+    for (i = 0; i < EVENTS; i++) {
+        tpm2_openssl_hash_msg msgs[ARRAY_LEN(banks)];
+        size_t j;
+        for (j = 0; j < ARRAY_LEN(banks); j++) {
+            msgs[j] = (tpm2_openssl_hash_msg) {
+                .halg = banks[j],
+                .data = payloads + i * 1024,
+                .length = 16 + (i * 37) % 1008,
+                .digest = after[i][j]
+            };
+        }
+        assert_true(tpm2_openssl_hash_batch(hasher, msgs, ARRAY_LEN(msgs)));
+    }
+    tpm2_openssl_hasher_free(hasher);
+
+    /* the SHA1 digests are zero padded in both */
+    assert_memory_equal(before, after, EVENTS * sizeof(*before));
+
+    free(after);
+    free(before);
+    free(payloads);
+}
+
+int main(void) {
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_hash_batch_hasher),
+        cmocka_unit_test(test_hash_batch_no_hasher),
+        cmocka_unit_test(test_hash_batch_extend),
+        cmocka_unit_test(test_hash_batch_bad_alg),
+        cmocka_unit_test(test_hash_batch_events),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
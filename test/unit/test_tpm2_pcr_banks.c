@@ -0,0 +1,232 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include <tss2/tss2_tpm2_types.h>
+
+#include "tpm2_openssl.h"
+#include "tpm2_pcr_banks.h"
+#include "tpm2_util.h"
+
+#define PCR_COUNT 24
+
+static void select_pcr(TPMS_PCR_SELECTION *sel, TPMI_ALG_HASH halg,
+        unsigned pcr) {
+
+    sel->hash = halg;
+    sel->sizeofSelect = 3;
+    sel->pcrSelect[pcr / 8] |= 1 << (pcr % 8);
+}
+
+static void test_extend(void **state) {
+
+    (void) state;
+
+    tpm2_pcr_banks *banks = tpm2_pcr_banks_new(PCR_COUNT);
+    assert_non_null(banks);
+
+    BYTE expected_sha1[TPM2_SHA1_DIGEST_SIZE] = { 0 };
+    BYTE expected_sha256[TPM2_SHA256_DIGEST_SIZE] = { 0 };
+    BYTE digest[TPM2_SHA256_DIGEST_SIZE];
+
+    unsigned i;
+    for (i = 0; i < 3; i++) {
+        memset(digest, i + 1, sizeof(digest));
+        assert_true(tpm2_pcr_banks_extend(banks, TPM2_ALG_SHA1, 7, digest));
+        assert_true(tpm2_pcr_banks_extend(banks, TPM2_ALG_SHA256, 7, digest));
+        assert_true(tpm2_openssl_pcr_extend(TPM2_ALG_SHA1, expected_sha1,
+                digest, TPM2_SHA1_DIGEST_SIZE));
+        assert_true(tpm2_openssl_pcr_extend(TPM2_ALG_SHA256, expected_sha256,
+                digest, TPM2_SHA256_DIGEST_SIZE));
+    }
+
+    assert_memory_equal(tpm2_pcr_banks_value(banks, TPM2_ALG_SHA1, 7),
+            expected_sha1, sizeof(expected_sha1));
+    assert_memory_equal(tpm2_pcr_banks_value(banks, TPM2_ALG_SHA256, 7),
+            expected_sha256, sizeof(expected_sha256));
+
+    assert_true(tpm2_pcr_banks_is_extended(banks, TPM2_ALG_SHA1, 7));
+    assert_false(tpm2_pcr_banks_is_extended(banks, TPM2_ALG_SHA1, 6));
+    assert_false(tpm2_pcr_banks_is_extended(banks, TPM2_ALG_SHA384, 7));
+
+    /* PCRs and banks never extended are zero */
+    static const BYTE zero[TPM2_SHA384_DIGEST_SIZE] = { 0 };
+    assert_memory_equal(tpm2_pcr_banks_value(banks, TPM2_ALG_SHA256, 6),
+            zero, TPM2_SHA256_DIGEST_SIZE);
+    assert_memory_equal(tpm2_pcr_banks_value(banks, TPM2_ALG_SHA384, 7),
+            zero, TPM2_SHA384_DIGEST_SIZE);
+
+    tpm2_pcr_banks_free(banks);
+}
+
+static void test_extend_bad_pcr(void **state) {
+
+    (void) state;
+
+    tpm2_pcr_banks *banks = tpm2_pcr_banks_new(PCR_COUNT);
+    assert_non_null(banks);
+
+    BYTE digest[TPM2_SHA256_DIGEST_SIZE] = { 0 };
+    assert_false(tpm2_pcr_banks_extend(banks, TPM2_ALG_SHA256, PCR_COUNT,
+            digest));
+    assert_false(tpm2_pcr_banks_extend(banks, TPM2_ALG_NULL, 0, digest));
+
+    assert_null(tpm2_pcr_banks_value(banks, TPM2_ALG_SHA256, PCR_COUNT));
+    assert_null(tpm2_pcr_banks_value(banks, TPM2_ALG_NULL, 0));
+
+    tpm2_pcr_banks_free(banks);
+}
+
+static void test_read_compare(void **state) {
+
+    (void) state;
+
+    tpm2_pcr_banks *banks = tpm2_pcr_banks_new(PCR_COUNT);
+    assert_non_null(banks);
+
+    BYTE digest[TPM2_SHA256_DIGEST_SIZE];
+    memset(digest, 0xa5, sizeof(digest));
+    assert_true(tpm2_pcr_banks_extend(banks, TPM2_ALG_SHA256, 0, digest));
+    assert_true(tpm2_pcr_banks_extend(banks, TPM2_ALG_SHA1, 1, digest));
+
+    TPML_PCR_SELECTION pcr_select = { .count = 2 };
+    select_pcr(&pcr_select.pcrSelections[0], TPM2_ALG_SHA256, 0);
+    select_pcr(&pcr_select.pcrSelections[0], TPM2_ALG_SHA256, 2);
+    select_pcr(&pcr_select.pcrSelections[1], TPM2_ALG_SHA1, 1);
+
+    tpm2_pcrs pcrs;
+    assert_true(tpm2_pcr_banks_read(banks, &pcr_select, &pcrs));
+    assert_int_equal(pcrs.count, 1);
+    assert_int_equal(pcrs.pcr_values[0].count, 3);
+    assert_int_equal(pcrs.pcr_values[0].digests[0].size,
+            TPM2_SHA256_DIGEST_SIZE);
+    assert_memory_equal(pcrs.pcr_values[0].digests[0].buffer,
+            tpm2_pcr_banks_value(banks, TPM2_ALG_SHA256, 0),
+            TPM2_SHA256_DIGEST_SIZE);
+    assert_int_equal(pcrs.pcr_values[0].digests[2].size,
+            TPM2_SHA1_DIGEST_SIZE);
+    assert_memory_equal(pcrs.pcr_values[0].digests[2].buffer,
+            tpm2_pcr_banks_value(banks, TPM2_ALG_SHA1, 1),
+            TPM2_SHA1_DIGEST_SIZE);
+
+    assert_true(tpm2_pcr_banks_compare(banks, &pcr_select, &pcrs));
+
+    /* a quoted PCR which differs from the replay */
+    pcrs.pcr_values[0].digests[1].buffer[0] ^= 1;
+    assert_false(tpm2_pcr_banks_compare(banks, &pcr_select, &pcrs));
+    pcrs.pcr_values[0].digests[1].buffer[0] ^= 1;
+
+    /* fewer PCR values than selected */
+    pcrs.pcr_values[0].count = 2;
+    assert_false(tpm2_pcr_banks_compare(banks, &pcr_select, &pcrs));
+
+    tpm2_pcr_banks_free(banks);
+}
+
+static void test_read_bad_pcr(void **state) {
+
+    (void) state;
+
+    tpm2_pcr_banks *banks = tpm2_pcr_banks_new(16);
+    assert_non_null(banks);
+
+    TPML_PCR_SELECTION pcr_select = { .count = 1 };
+    select_pcr(&pcr_select.pcrSelections[0], TPM2_ALG_SHA256, 16);
+
+    tpm2_pcrs pcrs;
+    assert_false(tpm2_pcr_banks_read(banks, &pcr_select, &pcrs));
+
+    tpm2_pcr_banks_free(banks);
+}
+
+static void test_save_load(void **state) {
+
+    (void) state;
+
+    tpm2_pcr_banks *banks = tpm2_pcr_banks_new(PCR_COUNT);
+    assert_non_null(banks);
+
+    BYTE digest[TPM2_SHA256_DIGEST_SIZE];
+    memset(digest, 0x5a, sizeof(digest));
+    assert_true(tpm2_pcr_banks_extend(banks, TPM2_ALG_SHA256, 4, digest));
+    assert_true(tpm2_pcr_banks_extend(banks, TPM2_ALG_SHA1, 7, digest));
+
+    FILE *f = tmpfile();
+    assert_non_null(f);
+    assert_true(tpm2_pcr_banks_save(banks, f));
+    rewind(f);
+
+    tpm2_pcr_banks *loaded = tpm2_pcr_banks_load(f);
+    assert_non_null(loaded);
+
+    assert_memory_equal(tpm2_pcr_banks_value(loaded, TPM2_ALG_SHA256, 4),
+            tpm2_pcr_banks_value(banks, TPM2_ALG_SHA256, 4),
+            TPM2_SHA256_DIGEST_SIZE);
+    assert_memory_equal(tpm2_pcr_banks_value(loaded, TPM2_ALG_SHA1, 7),
+            tpm2_pcr_banks_value(banks, TPM2_ALG_SHA1, 7),
+            TPM2_SHA1_DIGEST_SIZE);
+    assert_true(tpm2_pcr_banks_is_extended(loaded, TPM2_ALG_SHA256, 4));
+    assert_false(tpm2_pcr_banks_is_extended(loaded, TPM2_ALG_SHA256, 7));
+    assert_false(tpm2_pcr_banks_is_extended(loaded, TPM2_ALG_SHA384, 4));
+
+    /* the loaded banks can be extended further */
+    assert_true(tpm2_pcr_banks_extend(loaded, TPM2_ALG_SHA256, 4, digest));
+    assert_true(tpm2_pcr_banks_extend(banks, TPM2_ALG_SHA256, 4, digest));
+    assert_memory_equal(tpm2_pcr_banks_value(loaded, TPM2_ALG_SHA256, 4),
+            tpm2_pcr_banks_value(banks, TPM2_ALG_SHA256, 4),
+            TPM2_SHA256_DIGEST_SIZE);
+
+    tpm2_pcr_banks_free(loaded);
+    fclose(f);
+    tpm2_pcr_banks_free(banks);
+}
+
+static void test_load_truncated(void **state) {
+
+    (void) state;
+
+    tpm2_pcr_banks *banks = tpm2_pcr_banks_new(PCR_COUNT);
+    assert_non_null(banks);
+
+    BYTE digest[TPM2_SHA256_DIGEST_SIZE] = { 0 };
+    assert_true(tpm2_pcr_banks_extend(banks, TPM2_ALG_SHA256, 0, digest));
+
+    FILE *f = tmpfile();
+    assert_non_null(f);
+    assert_true(tpm2_pcr_banks_save(banks, f));
+    long size = ftell(f);
+    tpm2_pcr_banks_free(banks);
+
+    /* drop the last byte of the data */
+    char buffer[4096];
+    assert_true(size > 1 && size <= (long) sizeof(buffer));
+    rewind(f);
+    assert_int_equal(fread(buffer, 1, size, f), size);
+    fclose(f);
+
+    f = tmpfile();
+    assert_non_null(f);
+    assert_int_equal(fwrite(buffer, 1, size - 1, f), size - 1);
+    rewind(f);
+    assert_null(tpm2_pcr_banks_load(f));
+    fclose(f);
+}
+
+int main(void) {
+
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test(test_extend),
+        cmocka_unit_test(test_extend_bad_pcr),
+        cmocka_unit_test(test_read_compare),
+        cmocka_unit_test(test_read_bad_pcr),
+        cmocka_unit_test(test_save_load),
+        cmocka_unit_test(test_load_truncated),
+    };
+
+    return cmocka_run_group_tests(tests, NULL, NULL);
+}
@@ -2,6 +2,7 @@
 
 #include <stdbool.h>
 #include <stdio.h>
+#include <string.h>
 
 #include <setjmp.h>
 #include <cmocka.h>
@@ -168,6 +169,45 @@ static void test_tpm2_util_handle_from_optarg_nv_invalid_offset(void **state) {
     assert_false(result);
 }
 
+static void rsa_template(TPMT_PUBLIC *template) {
+
+    memset(template, 0, sizeof(*template));
+    template->type = TPM2_ALG_RSA;
+    template->nameAlg = TPM2_ALG_SHA256;
+    template->objectAttributes = TPMA_OBJECT_SIGN_ENCRYPT
+            | TPMA_OBJECT_FIXEDTPM | TPMA_OBJECT_FIXEDPARENT
+            | TPMA_OBJECT_SENSITIVEDATAORIGIN | TPMA_OBJECT_USERWITHAUTH;
+    template->parameters.rsaDetail.symmetric.algorithm = TPM2_ALG_NULL;
+    template->parameters.rsaDetail.scheme.scheme = TPM2_ALG_NULL;
+    template->parameters.rsaDetail.keyBits = 2048;
+}
+
+static void test_tpm2_util_public_matches_template(void **state) {
+    UNUSED(state);
+
+    TPMT_PUBLIC template;
+    rsa_template(&template);
+
+    /* the TPM sets the unique field to the public key */
+    TPMT_PUBLIC public = template;
+    public.unique.rsa.size = 256;
+    memset(public.unique.rsa.buffer, 0xa5, public.unique.rsa.size);
+    assert_true(tpm2_util_public_matches_template(&public, &template));
+
+    /* an object with a policy set by someone else */
+    public.authPolicy.size = TPM2_SHA256_DIGEST_SIZE;
+    memset(public.authPolicy.buffer, 0x5a, public.authPolicy.size);
+    assert_false(tpm2_util_public_matches_template(&public, &template));
+
+    public.authPolicy.size = 0;
+    public.objectAttributes &= ~TPMA_OBJECT_FIXEDTPM;
+    assert_false(tpm2_util_public_matches_template(&public, &template));
+
+    public.objectAttributes = template.objectAttributes;
+    public.parameters.rsaDetail.keyBits = 3072;
+    assert_false(tpm2_util_public_matches_template(&public, &template));
+}
+
 /* link required symbol, but tpm2_tool.c declares it AND main, which
  * we have a main below for cmocka tests.
  */
@@ -187,6 +227,7 @@ int main(int argc, char* argv[]) {
         cmocka_unit_test(test_tpm2_util_handle_from_optarg_valid_ids_enabled),
         cmocka_unit_test(test_tpm2_util_handle_from_optarg_nv_valid_range),
         cmocka_unit_test(test_tpm2_util_handle_from_optarg_nv_invalid_offset),
+        cmocka_unit_test(test_tpm2_util_public_matches_template),
     };
 
     return cmocka_run_group_tests(tests, NULL, NULL);
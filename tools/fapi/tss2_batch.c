@@ -0,0 +1,183 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tools/fapi/tss2_template.h"
+
+/* Context struct used to store passed commandline parameters */
+static struct cxt {
+    char const *path;
+} ctx;
+
+/*
+ * Splits a line of a batch into arguments, in place. Whitespace separates
+ * the arguments, single and double quotes group them and a backslash escapes
+ * the next character outside of single quotes.
+ */
+static bool split_line(char *line, char ***argv, int *argc,
+    size_t *capacity) {
+
+    char *r = line;
+    *argc = 0;
+
+    while (true) {
+        while (isspace ((unsigned char) *r))
+            r++;
+
+        /* end of line or comment */
+        if (!*r || (!*argc && *r == '#'))
+            break;
+
+        char *arg = r;
+        char *w = r;
+        char quote = '\0';
+        for (; *r; r++) {
+            if (quote == '\'' && *r != '\'') {
+                *w++ = *r;
+            } else if (*r == quote) {
+                quote = '\0';
+            } else if (!quote && (*r == '\'' || *r == '"')) {
+                quote = *r;
+            } else if (*r == '\\' && r[1]) {
+                *w++ = *++r;
+            } else if (!quote && isspace ((unsigned char) *r)) {
+                break;
+            } else {
+                *w++ = *r;
+            }
+        }
+
+        if (quote) {
+            fprintf (stderr, "Unterminated %c quote\n", quote);
+            return false;
+        }
+
+        if (*r)
+            r++;
+        *w = '\0';
+
+        /* keep room for the terminating NULL */
+        if ((size_t) *argc + 1 >= *capacity) {
+            size_t new_capacity = *capacity ? *capacity * 2 : 16;
+            char **new_argv = realloc (*argv, new_capacity * sizeof (char *));
+            if (!new_argv) {
+                fprintf (stderr, "OOM\n");
+                return false;
+            }
+            *argv = new_argv;
+            *capacity = new_capacity;
+        }
+        (*argv)[(*argc)++] = arg;
+    }
+
+    if (*argc)
+        (*argv)[*argc] = NULL;
+
+    return true;
+}
+
+/* Parse commandline parameters */
+static bool on_option(__attribute__((unused)) char key,
+    __attribute__((unused)) char *value) {
+    return true;
+}
+
+static bool on_arg(int argc, char **argv) {
+    if (argc > 1) {
+        fprintf (stderr, "Expected at most one batch file, got: %d\n", argc);
+        return false;
+    }
+    ctx.path = argv[0];
+    return true;
+}
+
+/* Define possible commandline parameters */
+static bool tss2_tool_onstart(tpm2_options **opts) {
+    return (*opts = tpm2_options_new (NULL, 0, NULL, on_option, on_arg, 0))
+        != NULL;
+}
+
+/*
+ * Runs the tss2 commands of a file, or stdin, one per line, over the FAPI
+ * context of the batch so FAPI and the TCTI are only initialized once.
+ * Stops at the first failing command.
+ */
+static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
+
+    bool is_stdin = !ctx.path || !strcmp (ctx.path, "-");
+    const char *path = is_stdin ? "stdin" : ctx.path;
+    FILE *f = stdin;
+    if (!is_stdin) {
+        f = fopen (ctx.path, "r");
+        if (!f) {
+            fprintf (stderr, "Opening %s failed: %m\n", ctx.path);
+            return 1;
+        }
+    }
+
+    int ret = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    char **args = NULL;
+    size_t capacity = 0;
+    size_t lineno = 0;
+    while (getline (&line, &line_size, f) != -1) {
+        lineno++;
+
+        int argc;
+        if (!split_line (line, &args, &argc, &capacity)) {
+            fprintf (stderr, "Invalid command on line %zu of %s\n", lineno,
+                path);
+            ret = 1;
+            break;
+        }
+
+        /* commands may be written as "tss2 <tool> ..." */
+        char **argv = args;
+        if (argc > 1 && !strcmp (tss2_tool_name (argv[0]), "tss2")) {
+            argv++;
+            argc--;
+        }
+
+        if (!argc)
+            continue;
+
+        const tss2_tool *tool = tss2_tool_find (tss2_tool_name (argv[0]));
+        if (!tool || tool->onrun == tss2_tool_onrun) {
+            fprintf (stderr, "Unknown command \"%s\" on line %zu of %s\n",
+                argv[0], lineno, path);
+            ret = 1;
+            break;
+        }
+
+        /* start from the state of a fresh process */
+        memset (tool->ctx, 0, tool->ctx_size);
+        optind = 0;
+
+        ret = tss2_tool_run (tool, &fctx, argc, argv);
+        if (ret) {
+            fprintf (stderr, "Command \"%s\" on line %zu of %s failed\n",
+                tool->name, lineno, path);
+            break;
+        }
+    }
+
+    if (!ret && ferror (f)) {
+        fprintf (stderr, "Reading %s failed: %m\n", path);
+        ret = 1;
+    }
+
+    free (args);
+    free (line);
+    if (!is_stdin) {
+        fclose (f);
+    }
+
+    return ret;
+}
+
+TSS2_TOOL_REGISTER("batch", tss2_tool_onstart, tss2_tool_onrun, NULL)
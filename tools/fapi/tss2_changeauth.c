@@ -6,13 +6,12 @@
 
 #include "tools/fapi/tss2_template.h"
 
-/* needed to conditionally free variable authValue */
-static bool has_asked_for_password = false;
-
 /* Context struct used to store passed commandline parameters */
 static struct cxt {
     char *entityPath;
     char *authValue;
+    /* needed to conditionally free variable authValue */
+    bool  has_asked_for_password;
 } ctx;
 
 /* Parse commandline parameters */
@@ -49,7 +48,7 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
     /* If no authValue was given, prompt the user interactively */
     if (!ctx.authValue) {
         ctx.authValue = ask_for_password ();
-        has_asked_for_password = true;
+        ctx.has_asked_for_password = true;
         if (!ctx.authValue){
             return 1; /* User entered two different passwords */
         }
@@ -58,14 +57,14 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
     /* Execute FAPI command with passed arguments */
     TSS2_RC r = Fapi_ChangeAuth(fctx, ctx.entityPath, ctx.authValue);
     if (r != TSS2_RC_SUCCESS) {
-        if(has_asked_for_password){
+        if(ctx.has_asked_for_password){
             free (ctx.authValue);
         }
         LOG_PERR ("Fapi_ChangeAuth", r);
         return 1;
     }
 
-    if(has_asked_for_password){
+    if(ctx.has_asked_for_password){
         free (ctx.authValue);
     }
 
@@ -5,9 +5,7 @@
 #include <string.h>
 
 #include "tools/fapi/tss2_template.h"
-
-/* needed to conditionally free variable authValue */
-static bool has_asked_for_password = false;
+#include "tools/fapi/tss2_index.h"
 
 /* Context struct used to store passed commandline parameters */
 static struct cxt {
@@ -15,6 +13,8 @@ static struct cxt {
     char const *keyType;
     char const *policyPath;
     char       *authValue;
+    /* needed to conditionally free variable authValue */
+    bool        has_asked_for_password;
 } ctx;
 
 /* Parse commandline parameters */
@@ -59,7 +59,7 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
     /* If no authValue was given, prompt the user interactively */
     if (!ctx.authValue) {
         ctx.authValue = ask_for_password ();
-        has_asked_for_password = true;
+        ctx.has_asked_for_password = true;
         if (!ctx.authValue){
             return 1; /* User entered two different passwords */
         }
@@ -69,17 +69,18 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
     TSS2_RC r = Fapi_CreateKey (fctx, ctx.keyPath, ctx.keyType, ctx.policyPath,
         ctx.authValue);
     if (r != TSS2_RC_SUCCESS){
-        if(has_asked_for_password){
+        if(ctx.has_asked_for_password){
             free (ctx.authValue);
         }
         LOG_PERR ("Fapi_CreateKey", r);
         return 1;
     }
 
-    if(has_asked_for_password){
+    if(ctx.has_asked_for_password){
         free (ctx.authValue);
     }
 
+    tss2_index_update (fctx, ctx.keyPath);
     return 0;
 }
 
@@ -6,9 +6,7 @@
 #include <string.h>
 
 #include "tools/fapi/tss2_template.h"
-
-/* needed to conditionally free variable authValue */
-static bool has_asked_for_password = false;
+#include "tools/fapi/tss2_index.h"
 
 /* Context struct used to store passed commandline parameters */
 static struct cxt {
@@ -17,6 +15,8 @@ static struct cxt {
     char           *authValue;
     uint32_t        size;
     char     const *policyPath;
+    /* needed to conditionally free variable authValue */
+    bool            has_asked_for_password;
 } ctx;
 
 /* Parse commandline parameters */
@@ -86,7 +86,7 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
     /* If no authValue was given, prompt the user interactively */
     if (!ctx.authValue) {
         ctx.authValue = ask_for_password ();
-        has_asked_for_password = true;
+        ctx.has_asked_for_password = true;
         if (!ctx.authValue){
             return 1; /* User entered two different passwords */
         }
@@ -96,17 +96,18 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
     TSS2_RC r = Fapi_CreateNv(fctx, ctx.nvPath, ctx.nvTemplate,
         size, ctx.policyPath, ctx.authValue);
     if (r != TSS2_RC_SUCCESS){
-        if(has_asked_for_password){
+        if(ctx.has_asked_for_password){
             free (ctx.authValue);
         }
         LOG_PERR ("Fapi_CreateNv", r);
         return 1;
     }
 
-    if(has_asked_for_password){
+    if(ctx.has_asked_for_password){
         free (ctx.authValue);
     }
 
+    tss2_index_update (fctx, ctx.nvPath);
     return 0;
 }
 
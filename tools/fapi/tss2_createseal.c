@@ -5,9 +5,7 @@
 #include <string.h>
 
 #include "tools/fapi/tss2_template.h"
-
-/* needed to conditionally free variable authValue */
-static bool has_asked_for_password = false;
+#include "tools/fapi/tss2_index.h"
 
 /* Context struct used to store passed command line parameters */
 static struct cxt {
@@ -17,6 +15,8 @@ static struct cxt {
     char       *authValue;
     char const *data;
     uint32_t        size;
+    /* needed to conditionally free variable authValue */
+    bool        has_asked_for_password;
 } ctx;
 
 /* Parse command line parameters */
@@ -89,7 +89,7 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
     /* If no authValue was given, prompt the user interactively */
     if (!ctx.authValue) {
         ctx.authValue = ask_for_password ();
-        has_asked_for_password = true;
+        ctx.has_asked_for_password = true;
         if (!ctx.authValue){
             return 1; /* User entered two different passwords */
         }
@@ -115,7 +115,7 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
     r = Fapi_CreateSeal (fctx, ctx.keyPath, ctx.keyType,
         dataSize, ctx.policyPath, ctx.authValue, data);
     if (r != TSS2_RC_SUCCESS){
-        if(has_asked_for_password){
+        if(ctx.has_asked_for_password){
             free (ctx.authValue);
         }
         free (data);
@@ -123,9 +123,10 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
         return 1;
     }
     free (data);
-    if(has_asked_for_password){
+    if(ctx.has_asked_for_password){
         free (ctx.authValue);
     }
+    tss2_index_update (fctx, ctx.keyPath);
     return 0;
 }
 
@@ -3,14 +3,18 @@
 #include <stdio.h>
 
 #include "tools/fapi/tss2_template.h"
+#include "tools/fapi/tss2_index.h"
 
-static char *path;
+/* Context struct used to store passed commandline parameters */
+static struct cxt {
+    char *path;
+} ctx;
 
 /* Parse commandline parameters */
 static bool on_option(char key, char *value) {
     switch (key) {
     case 'p':
-        path = value;
+        ctx.path = value;
         break;
     }
     return true;
@@ -27,17 +31,23 @@ static bool tss2_tool_onstart(tpm2_options **opts) {
 
 /* Execute specific tool */
 static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
-    if (!path) {
+    if (!ctx.path) {
         fprintf (stderr, "No path to the entity provided, use --path\n");
         return -1;
     }
 
+    /* Learn the indexed paths that are going to be deleted */
+    char *indexed = tss2_index_paths_to_delete (fctx, ctx.path);
+
     /* Execute FAPI command with passed arguments */
-    TSS2_RC r = Fapi_Delete(fctx, path);
+    TSS2_RC r = Fapi_Delete(fctx, ctx.path);
     if (r != TSS2_RC_SUCCESS){
+        free (indexed);
         LOG_PERR ("Fapi_Delete", r);
         return 1;
     }
+
+    tss2_index_remove (indexed);
     return 0;
 }
 
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include "tools/fapi/tss2_template.h"
+#include "tools/fapi/tss2_index.h"
 
 /* Context struct used to store passed command line parameters */
 static struct cxt {
@@ -62,6 +63,7 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
 
     free (importData);
 
+    tss2_index_update (fctx, ctx.path);
     return 0;
 }
 
@@ -0,0 +1,769 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <tss2/tss2_mu.h>
+
+#include "lib/log.h"
+#include "lib/tpm2_util.h"
+#include "tools/fapi/tss2_index.h"
+#include "tools/fapi/tss2_template.h"
+
+#define TSS2_INDEX_MAGIC "tss2-index 1"
+
+char *tss2_index_file(void) {
+
+    const char *file = getenv ("TSS2_FAPI_INDEX");
+    if (file && *file) {
+        return strdup (file);
+    }
+
+    /* one index per FAPI configuration, as each has its own keystore */
+    const char *config = getenv ("TSS2_FAPICONF");
+    if (!config) {
+        config = "";
+    }
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (const char *c = config; *c; c++) {
+        hash = (hash ^ (unsigned char) *c) * 0x100000001b3ULL;
+    }
+
+    const char *cache = getenv ("XDG_CACHE_HOME");
+    const char *home = getenv ("HOME");
+    char *path = NULL;
+    int rc;
+    if (cache && *cache) {
+        rc = asprintf (&path, "%s/tpm2-tools/fapi-%016" PRIx64 ".index",
+            cache, hash);
+    } else if (home && *home) {
+        rc = asprintf (&path, "%s/.cache/tpm2-tools/fapi-%016" PRIx64 ".index",
+            home, hash);
+    } else {
+        LOG_ERR ("Neither $XDG_CACHE_HOME nor $HOME are set");
+        return NULL;
+    }
+
+    return rc < 0 ? NULL : path;
+}
+
+void tss2_index_free(tss2_index *index) {
+
+    for (size_t i = 0; i < index->count; i++) {
+        free (index->entries[i].buf);
+    }
+    free (index->entries);
+    free (index->profile);
+    free (index->data);
+    memset (index, 0, sizeof (*index));
+}
+
+/* Splits a field off a line, undoing the escaping of tabs and newlines */
+static char *next_field(char **line) {
+
+    char *field = *line;
+    if (!field) {
+        return NULL;
+    }
+
+    char *w = field;
+    char *r = field;
+    for (; *r && *r != '\t'; r++) {
+        if (*r == '\\' && r[1]) {
+            r++;
+            *w++ = *r == 't' ? '\t' : *r == 'n' ? '\n' : *r;
+        } else {
+            *w++ = *r;
+        }
+    }
+
+    *line = *r ? r + 1 : NULL;
+    *w = '\0';
+    return field;
+}
+
+static bool add_entry(tss2_index *index, size_t pos) {
+
+    if (index->count == index->capacity) {
+        size_t capacity = index->capacity ? index->capacity * 2 : 256;
+        tss2_index_entry *entries = realloc (index->entries,
+            capacity * sizeof (*entries));
+        if (!entries) {
+            LOG_ERR ("oom");
+            return false;
+        }
+        index->entries = entries;
+        index->capacity = capacity;
+    }
+
+    memmove (&index->entries[pos + 1], &index->entries[pos],
+        (index->count - pos) * sizeof (*index->entries));
+    memset (&index->entries[pos], 0, sizeof (*index->entries));
+    index->count++;
+    return true;
+}
+
+bool tss2_index_load(const char *file, tss2_index *index, bool *exists) {
+
+    memset (index, 0, sizeof (*index));
+    *exists = false;
+
+    FILE *f = fopen (file, "rb");
+    if (!f) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        LOG_ERR ("Could not open index \"%s\": %s", file, strerror (errno));
+        return false;
+    }
+
+    bool result = false;
+    struct stat st;
+    if (fstat (fileno (f), &st)) {
+        LOG_ERR ("Could not stat index \"%s\": %s", file, strerror (errno));
+        goto out;
+    }
+
+    index->data = malloc (st.st_size + 1);
+    if (!index->data) {
+        LOG_ERR ("oom");
+        goto out;
+    }
+    if (fread (index->data, 1, st.st_size, f) != (size_t) st.st_size) {
+        LOG_ERR ("Could not read index \"%s\"", file);
+        goto out;
+    }
+    index->data[st.st_size] = '\0';
+
+    char *save = NULL;
+    char *line = strtok_r (index->data, "\n", &save);
+    size_t magic_len = strlen (TSS2_INDEX_MAGIC);
+    if (!line || strncmp (line, TSS2_INDEX_MAGIC, magic_len)
+            || (line[magic_len] != ' ' && line[magic_len])) {
+        LOG_ERR ("Index \"%s\" is not a tss2 keystore index", file);
+        goto out;
+    }
+    if (line[magic_len] && line[magic_len + 1]) {
+        index->profile = strdup (&line[magic_len + 1]);
+        if (!index->profile) {
+            LOG_ERR ("oom");
+            goto out;
+        }
+    }
+
+    /* the entries are saved sorted */
+    while ((line = strtok_r (NULL, "\n", &save))) {
+        if (!add_entry (index, index->count)) {
+            goto out;
+        }
+        tss2_index_entry *e = &index->entries[index->count - 1];
+        e->path = next_field (&line);
+        e->type = next_field (&line);
+        e->attributes = next_field (&line);
+        char *policy = next_field (&line);
+        e->description = next_field (&line);
+        if (!e->description) {
+            LOG_ERR ("Invalid entry %zu of index \"%s\"", index->count, file);
+            goto out;
+        }
+        e->policy = !strcmp (policy, "1");
+    }
+
+    *exists = true;
+    result = true;
+
+out:
+    fclose (f);
+    if (!result) {
+        tss2_index_free (index);
+    }
+    return result;
+}
+
+static void write_field(FILE *f, const char *field) {
+
+    for (const char *c = field; *c; c++) {
+        switch (*c) {
+        case '\t':
+            fputs ("\\t", f);
+            break;
+        case '\n':
+            fputs ("\\n", f);
+            break;
+        case '\\':
+            fputs ("\\\\", f);
+            break;
+        default:
+            fputc (*c, f);
+        }
+    }
+}
+
+/* Creates the missing directories of the index file */
+static bool make_parents(const char *file) {
+
+    char *dir = strdup (file);
+    if (!dir) {
+        LOG_ERR ("oom");
+        return false;
+    }
+
+    for (char *c = dir + 1; *c; c++) {
+        if (*c != '/') {
+            continue;
+        }
+        *c = '\0';
+        if (mkdir (dir, 0700) && errno != EEXIST) {
+            LOG_ERR ("Could not create \"%s\": %s", dir, strerror (errno));
+            free (dir);
+            return false;
+        }
+        *c = '/';
+    }
+
+    free (dir);
+    return true;
+}
+
+bool tss2_index_save(const char *file, const tss2_index *index) {
+
+    if (!make_parents (file)) {
+        return false;
+    }
+
+    char *tmp = NULL;
+    if (asprintf (&tmp, "%s.%d", file, (int) getpid ()) < 0) {
+        LOG_ERR ("oom");
+        return false;
+    }
+
+    FILE *f = fopen (tmp, "wb");
+    if (!f) {
+        LOG_ERR ("Could not create index \"%s\": %s", tmp, strerror (errno));
+        free (tmp);
+        return false;
+    }
+
+    fprintf (f, TSS2_INDEX_MAGIC " %s\n",
+        index->profile ? index->profile : "");
+    for (size_t i = 0; i < index->count; i++) {
+        const tss2_index_entry *e = &index->entries[i];
+        write_field (f, e->path);
+        fputc ('\t', f);
+        write_field (f, e->type);
+        fputc ('\t', f);
+        write_field (f, e->attributes);
+        fprintf (f, "\t%d\t", e->policy);
+        write_field (f, e->description);
+        fputc ('\n', f);
+    }
+
+    bool result = !ferror (f);
+    result &= !fclose (f);
+    if (!result || rename (tmp, file)) {
+        LOG_ERR ("Could not write index \"%s\": %s", file, strerror (errno));
+        unlink (tmp);
+        result = false;
+    }
+
+    free (tmp);
+    return result;
+}
+
+int tss2_index_lock(const char *file) {
+
+    if (!make_parents (file)) {
+        return -1;
+    }
+
+    /*
+     * The index itself is replaced on every save, so the lock is taken on a
+     * file next to it which stays in place.
+     */
+    char *lock_file = NULL;
+    if (asprintf (&lock_file, "%s.lock", file) < 0) {
+        LOG_ERR ("oom");
+        return -1;
+    }
+
+    int fd = open (lock_file, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        LOG_ERR ("Could not open the index lock \"%s\": %s", lock_file,
+            strerror (errno));
+        free (lock_file);
+        return -1;
+    }
+
+    while (flock (fd, LOCK_EX)) {
+        if (errno != EINTR) {
+            LOG_ERR ("Could not lock the index \"%s\": %s", lock_file,
+                strerror (errno));
+            close (fd);
+            free (lock_file);
+            return -1;
+        }
+    }
+
+    free (lock_file);
+    return fd;
+}
+
+void tss2_index_unlock(int lock) {
+
+    if (lock >= 0) {
+        /* closing releases the lock */
+        close (lock);
+    }
+}
+
+/* Binary search of path, returns the insert position if not found */
+static bool find(const tss2_index *index, const char *path, size_t *pos) {
+
+    size_t lo = 0;
+    size_t hi = index->count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        int cmp = strcmp (index->entries[mid].path, path);
+        if (!cmp) {
+            *pos = mid;
+            return true;
+        }
+        if (cmp < 0) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    *pos = lo;
+    return false;
+}
+
+static const char *object_attributes(TPMA_OBJECT attributes) {
+
+    static const char *names[] = {
+        "",
+        "restricted",
+        "decrypt",
+        "restricted,decrypt",
+        "sign",
+        "restricted,sign",
+        "decrypt,sign",
+        "restricted,decrypt,sign",
+    };
+
+    return names[(attributes & TPMA_OBJECT_RESTRICTED ? 1 : 0)
+               | (attributes & TPMA_OBJECT_DECRYPT ? 2 : 0)
+               | (attributes & TPMA_OBJECT_SIGN_ENCRYPT ? 4 : 0)];
+}
+
+/*
+ * Looks an object of the keystore up and indexes it. Returns false if the
+ * object does not exist, which is only checked when not listed by FAPI.
+ */
+static bool index_object(FAPI_CONTEXT *fctx, tss2_index *index,
+    const char *path, bool listed, bool *oom) {
+
+    char *description = NULL;
+    TSS2_RC r = Fapi_GetDescription (fctx, path, &description);
+    if (r != TSS2_RC_SUCCESS && !listed) {
+        return false;
+    }
+
+    const char *type = "object";
+    char attributes[64] = "";
+    bool policy = false;
+
+    const char *rest = path + 1 + strcspn (path + 1, "/");
+    if (!strncmp (path, "/nv/", 4)) {
+        type = "nv";
+    } else if (!strncmp (path, "/policy/", 8)) {
+        type = "policy";
+    } else if (!strncmp (path, "/ext/", 5)) {
+        type = "ext";
+    } else if (!*rest || !strchr (rest + 1, '/')) {
+        type = "hierarchy";
+    } else {
+        uint8_t *public = NULL;
+        size_t public_size = 0;
+        uint8_t *private = NULL;
+        size_t private_size = 0;
+        char *key_policy = NULL;
+        r = Fapi_GetTpmBlobs (fctx, path, &public, &public_size, &private,
+            &private_size, &key_policy);
+        TPM2B_PUBLIC pub = { 0 };
+        if (r == TSS2_RC_SUCCESS && Tss2_MU_TPM2B_PUBLIC_Unmarshal (public,
+                public_size, NULL, &pub) == TSS2_RC_SUCCESS) {
+            TPMA_OBJECT attrs = pub.publicArea.objectAttributes;
+            bool seal = pub.publicArea.type == TPM2_ALG_KEYEDHASH
+                && !(attrs & (TPMA_OBJECT_SIGN_ENCRYPT | TPMA_OBJECT_DECRYPT));
+            type = seal ? "seal" : "key";
+            snprintf (attributes, sizeof (attributes), "%s%s%s",
+                object_attributes (attrs),
+                *object_attributes (attrs) && (attrs & TPMA_OBJECT_NODA)
+                    ? "," : "",
+                attrs & TPMA_OBJECT_NODA ? "noDa" : "");
+            policy = (key_policy && *key_policy)
+                || pub.publicArea.authPolicy.size;
+        }
+        Fapi_Free (public);
+        Fapi_Free (private);
+        Fapi_Free (key_policy);
+    }
+
+    if (!description) {
+        description = strdup ("");
+        if (!description) {
+            *oom = true;
+            return true;
+        }
+    }
+
+    /* all the strings of the entry live in one allocation */
+    size_t path_len = strlen (path) + 1;
+    size_t type_len = strlen (type) + 1;
+    size_t attributes_len = strlen (attributes) + 1;
+    size_t description_len = strlen (description) + 1;
+    char *buf = malloc (path_len + type_len + attributes_len
+        + description_len);
+    if (!buf) {
+        Fapi_Free (description);
+        *oom = true;
+        return true;
+    }
+
+    tss2_index_entry entry = {
+        .path = memcpy (buf, path, path_len),
+        .type = memcpy (buf + path_len, type, type_len),
+        .attributes = memcpy (buf + path_len + type_len, attributes,
+            attributes_len),
+        .description = memcpy (buf + path_len + type_len + attributes_len,
+            description, description_len),
+        .policy = policy,
+        .buf = buf,
+    };
+    Fapi_Free (description);
+
+    size_t pos;
+    if (find (index, path, &pos)) {
+        free (index->entries[pos].buf);
+    } else if (!add_entry (index, pos)) {
+        free (buf);
+        *oom = true;
+        return true;
+    }
+    index->entries[pos] = entry;
+
+    return true;
+}
+
+/* Indexes the colon separated paths listed by Fapi_List */
+static bool index_list(FAPI_CONTEXT *fctx, tss2_index *index, char *list) {
+
+    bool oom = false;
+    char *save = NULL;
+    for (char *path = strtok_r (list, ":", &save); path && !oom;
+            path = strtok_r (NULL, ":", &save)) {
+        index_object (fctx, index, path, true, &oom);
+    }
+
+    if (oom) {
+        LOG_ERR ("oom");
+    }
+    return !oom;
+}
+
+bool tss2_index_rebuild(FAPI_CONTEXT *fctx, tss2_index *index) {
+
+    memset (index, 0, sizeof (*index));
+
+    char *list = NULL;
+    TSS2_RC r = Fapi_List (fctx, "", &list);
+    if (r != TSS2_RC_SUCCESS) {
+        LOG_PERR ("Fapi_List", r);
+        return false;
+    }
+
+    bool result = index_list (fctx, index, list);
+    Fapi_Free (list);
+    if (!result) {
+        tss2_index_free (index);
+        return false;
+    }
+
+    /* relative paths are in the default profile */
+    r = Fapi_List (fctx, "HS", &list);
+    if (r == TSS2_RC_SUCCESS) {
+        index->profile = strndup (list + 1, strcspn (list + 1, "/:"));
+        Fapi_Free (list);
+        if (!index->profile) {
+            LOG_ERR ("oom");
+            tss2_index_free (index);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool has_prefix(const char *path, const char *prefix, size_t len) {
+    return !strncmp (path, prefix, len) && (!path[len] || path[len] == '/');
+}
+
+/* Whether a path is relative to the profile, as FAPI resolves them */
+static bool is_profile_relative(const char *path) {
+
+    while (*path == '/') {
+        path++;
+    }
+
+    return !has_prefix (path, "nv", 2) && !has_prefix (path, "policy", 6)
+        && !has_prefix (path, "ext", 3) && strncmp (path, "P_", 2);
+}
+
+bool tss2_index_match(const tss2_index *index, const char *path,
+    const char *search_path) {
+
+    while (*search_path == '/') {
+        search_path++;
+    }
+    size_t len = strlen (search_path);
+    while (len && search_path[len - 1] == '/') {
+        len--;
+    }
+    if (!len) {
+        return true;
+    }
+
+    path++;
+    if (is_profile_relative (search_path)) {
+        /* without a known default profile, search all of them */
+        size_t profile_len = index->profile ? strlen (index->profile)
+            : strcspn (path, "/");
+        if ((index->profile && strncmp (path, index->profile, profile_len))
+                || path[profile_len] != '/') {
+            return false;
+        }
+        path += profile_len + 1;
+    }
+
+    return has_prefix (path, search_path, len);
+}
+
+static void invalidate(const char *file) {
+
+    if (unlink (file) && errno != ENOENT) {
+        LOG_ERR ("Could not remove the outdated index \"%s\": %s", file,
+            strerror (errno));
+        return;
+    }
+
+    LOG_WARN ("Removed the keystore index \"%s\", it could not be updated",
+        file);
+}
+
+/*
+ * Indexes the object at path and the objects below it, trying the
+ * directories FAPI stores relative paths in.
+ */
+static bool index_path(FAPI_CONTEXT *fctx, tss2_index *index,
+    const char *path) {
+
+    while (*path == '/') {
+        path++;
+    }
+
+    const char *dirs[] = { "", "ext/", "policy/" };
+    for (size_t i = 0; i < ARRAY_LEN(dirs); i++) {
+        char *resolved = NULL;
+        int rc;
+        if (!i && is_profile_relative (path) && index->profile) {
+            rc = asprintf (&resolved, "/%s/%s", index->profile, path);
+        } else if (!i || is_profile_relative (path)) {
+            rc = asprintf (&resolved, "/%s%s", dirs[i], path);
+        } else {
+            continue;
+        }
+        if (rc < 0) {
+            LOG_ERR ("oom");
+            return false;
+        }
+
+        bool oom = false;
+        bool found = index_object (fctx, index, resolved, false, &oom);
+
+        char *list = NULL;
+        TSS2_RC r = Fapi_List (fctx, resolved, &list);
+        free (resolved);
+        if (oom) {
+            LOG_ERR ("oom");
+            return false;
+        }
+        if (r == TSS2_RC_SUCCESS) {
+            bool result = index_list (fctx, index, list);
+            Fapi_Free (list);
+            return result;
+        }
+        if (found) {
+            return true;
+        }
+    }
+
+    LOG_ERR ("Could not find \"%s\" in the keystore", path);
+    return false;
+}
+
+void tss2_index_update(FAPI_CONTEXT *fctx, const char *path) {
+
+    char *file = tss2_index_file ();
+    if (!file) {
+        return;
+    }
+
+    /* held until the save, so concurrent updates do not lose entries */
+    int lock = tss2_index_lock (file);
+    if (lock < 0) {
+        invalidate (file);
+        free (file);
+        return;
+    }
+
+    tss2_index index;
+    bool exists;
+    if (!tss2_index_load (file, &index, &exists)) {
+        invalidate (file);
+        goto out;
+    }
+    if (!exists) {
+        goto out;
+    }
+
+    bool result;
+    if (!path[strspn (path, "/")]) {
+        tss2_index_free (&index);
+        result = tss2_index_rebuild (fctx, &index);
+    } else {
+        result = index_path (fctx, &index, path);
+    }
+
+    if (!result || !tss2_index_save (file, &index)) {
+        invalidate (file);
+    }
+
+    tss2_index_free (&index);
+
+out:
+    tss2_index_unlock (lock);
+    free (file);
+}
+
+char *tss2_index_paths_to_delete(FAPI_CONTEXT *fctx, const char *path) {
+
+    char *file = tss2_index_file ();
+    if (!file) {
+        return NULL;
+    }
+
+    tss2_index index;
+    bool exists;
+    if (!tss2_index_load (file, &index, &exists) || !exists) {
+        free (file);
+        return NULL;
+    }
+
+    /* index what will be deleted, to learn its paths */
+    tss2_index deleted = { .profile = index.profile };
+    char *paths = NULL;
+    if (!path[strspn (path, "/")]) {
+        paths = strdup ("");
+    } else if (index_path (fctx, &deleted, path)) {
+        size_t len = 0;
+        for (size_t i = 0; i < deleted.count; i++) {
+            len += strlen (deleted.entries[i].path) + 1;
+        }
+        paths = malloc (len + 1);
+        char *p = paths;
+        for (size_t i = 0; paths && i < deleted.count; i++) {
+            size_t path_len = strlen (deleted.entries[i].path);
+            memcpy (p, deleted.entries[i].path, path_len);
+            p += path_len;
+            *p++ = ':';
+        }
+        if (paths) {
+            *(p > paths ? p - 1 : p) = '\0';
+        }
+    }
+
+    if (!paths) {
+        invalidate (file);
+    }
+
+    deleted.profile = NULL;
+    tss2_index_free (&deleted);
+    tss2_index_free (&index);
+    free (file);
+    return paths;
+}
+
+void tss2_index_remove(char *paths) {
+
+    if (!paths) {
+        return;
+    }
+
+    char *file = tss2_index_file ();
+    if (!file) {
+        free (paths);
+        return;
+    }
+
+    int lock = tss2_index_lock (file);
+    if (lock < 0) {
+        invalidate (file);
+        free (file);
+        free (paths);
+        return;
+    }
+
+    tss2_index index;
+    bool exists;
+    if (!tss2_index_load (file, &index, &exists)) {
+        invalidate (file);
+    } else if (exists) {
+        if (!*paths) {
+            /* everything was deleted */
+            for (size_t i = 0; i < index.count; i++) {
+                free (index.entries[i].buf);
+            }
+            index.count = 0;
+        }
+
+        char *save = NULL;
+        for (char *path = strtok_r (paths, ":", &save); path;
+                path = strtok_r (NULL, ":", &save)) {
+            size_t pos;
+            if (find (&index, path, &pos)) {
+                free (index.entries[pos].buf);
+                memmove (&index.entries[pos], &index.entries[pos + 1],
+                    (index.count - pos - 1) * sizeof (*index.entries));
+                index.count--;
+            }
+        }
+
+        if (!tss2_index_save (file, &index)) {
+            invalidate (file);
+        }
+    }
+
+    tss2_index_free (&index);
+    tss2_index_unlock (lock);
+    free (file);
+    free (paths);
+}
@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#ifndef TSS2_INDEX_H
+#define TSS2_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <tss2/tss2_fapi.h>
+
+/*
+ * An on-disk index of the paths of the FAPI keystore, with the type,
+ * attributes, description and policy presence of every object, so that
+ * "tss2 list" does not need to parse every object file of the keystore.
+ *
+ * The index is only a cache: the tss2 tools creating or deleting objects keep
+ * an existing index up to date, and remove it when they fail to, but objects
+ * changed by other FAPI applications require a "tss2 list --rebuild".
+ */
+
+typedef struct tss2_index_entry tss2_index_entry;
+struct tss2_index_entry {
+    char *path;
+    char *type;
+    char *attributes;
+    char *description;
+    bool policy;
+    /* the strings of entries not loaded from the index file */
+    char *buf;
+};
+
+typedef struct tss2_index tss2_index;
+struct tss2_index {
+    /* the default profile, to resolve relative search paths */
+    char *profile;
+    /* sorted by path */
+    tss2_index_entry *entries;
+    size_t count;
+    size_t capacity;
+    char *data;
+};
+
+/**
+ * Returns the file of the index of the keystore of the FAPI configuration in
+ * use, $TSS2_FAPI_INDEX if set.
+ * @return
+ *  The allocated path, NULL on error.
+ */
+char *tss2_index_file(void);
+
+/**
+ * Loads an index file.
+ * @param file
+ *  The index file.
+ * @param index
+ *  The index to fill, to free with tss2_index_free().
+ * @param exists
+ *  Set to false, with an empty index, if the file does not exist.
+ * @return
+ *  True on success, false on error.
+ */
+bool tss2_index_load(const char *file, tss2_index *index, bool *exists);
+
+/**
+ * Atomically replaces an index file. Concurrent updates must hold
+ * tss2_index_lock() from the load to the save.
+ * @return
+ *  True on success, false on error.
+ */
+bool tss2_index_save(const char *file, const tss2_index *index);
+
+/**
+ * Takes the lock serializing the updates of an index file among the tss2
+ * tools, waiting for the tools holding it.
+ * @param file
+ *  The index file.
+ * @return
+ *  The lock to release with tss2_index_unlock(), -1 on error.
+ */
+int tss2_index_lock(const char *file);
+
+void tss2_index_unlock(int lock);
+
+void tss2_index_free(tss2_index *index);
+
+/**
+ * Builds the index of every object of the keystore.
+ * @return
+ *  True on success, false on error.
+ */
+bool tss2_index_rebuild(FAPI_CONTEXT *fctx, tss2_index *index);
+
+/**
+ * Checks whether an indexed path is at or below a search path, as Fapi_List
+ * would search it.
+ */
+bool tss2_index_match(const tss2_index *index, const char *path,
+    const char *search_path);
+
+/**
+ * Adds or refreshes the entries of the objects at and below path in the index
+ * of the keystore, if there is one. Called by the tools after they created or
+ * changed objects, never fails them.
+ */
+void tss2_index_update(FAPI_CONTEXT *fctx, const char *path);
+
+/**
+ * Collects the indexed paths an upcoming deletion of path will remove, to
+ * drop them from the index once the deletion succeeded. This does not list
+ * the index: the paths are those of the objects found at and below path in
+ * the keystore, before the deletion.
+ * @param fctx
+ *  The FAPI context the deletion uses.
+ * @param path
+ *  The path about to be deleted.
+ * @return
+ *  The colon separated paths, an empty string when path is the root of the
+ *  keystore, or NULL if there is no index or it could not be updated, in
+ *  which case it was removed. The result is freed by tss2_index_remove(), or
+ *  with free() when the deletion failed.
+ */
+char *tss2_index_paths_to_delete(FAPI_CONTEXT *fctx, const char *path);
+
+/**
+ * Removes the paths returned by tss2_index_paths_to_delete() from the index
+ * of the keystore, and frees them.
+ */
+void tss2_index_remove(char *paths);
+
+#endif /* TSS2_INDEX_H */
@@ -3,14 +3,21 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
 #include "tools/fapi/tss2_template.h"
+#include "tools/fapi/tss2_index.h"
 
 /* Context struct used to store passed command line parameters */
 static struct cxt {
     bool  overwrite;
     char *searchPath;
     char *pathList;
+    char *type;
+    char *attributes;
+    char *description;
+    bool  policy;
+    bool  rebuild;
 } ctx;
 
 /* Parse command line parameters */
@@ -25,6 +32,21 @@ static bool on_option(char key, char *value) {
     case 'o':
         ctx.pathList = value ? value : "-";
         break;
+    case 't':
+        ctx.type = value;
+        break;
+    case 'a':
+        ctx.attributes = value;
+        break;
+    case 'd':
+        ctx.description = value;
+        break;
+    case 'P':
+        ctx.policy = true;
+        break;
+    case 'r':
+        ctx.rebuild = true;
+        break;
     }
     return true;
 }
@@ -34,15 +56,132 @@ static bool tss2_tool_onstart(tpm2_options **opts) {
     struct option topts[] = {
         {"force"   , no_argument      , NULL, 'f'},
         {"searchPath", required_argument, NULL, 'p'},
-        {"pathList",   required_argument, NULL, 'o'}
+        {"pathList",   required_argument, NULL, 'o'},
+        {"type",       required_argument, NULL, 't'},
+        {"attributes", required_argument, NULL, 'a'},
+        {"description", required_argument, NULL, 'd'},
+        {"policy",     no_argument      , NULL, 'P'},
+        {"rebuild",    no_argument      , NULL, 'r'}
     };
-    return (*opts = tpm2_options_new ("fp:o:", ARRAY_LEN(topts), topts,
+    return (*opts = tpm2_options_new ("fp:o:t:a:d:Pr", ARRAY_LEN(topts), topts,
                                       on_option, NULL, 0)) != NULL;
 }
 
+/* Checks that every comma separated attribute is one of the entry's */
+static bool has_attributes(const char *attributes, const char *wanted) {
+
+    while (*wanted) {
+        size_t len = strcspn (wanted, ",");
+        bool found = false;
+        for (const char *a = attributes; *a && !found; ) {
+            size_t a_len = strcspn (a, ",");
+            found = a_len == len && !strncasecmp (a, wanted, len);
+            a += a_len + (a[a_len] == ',');
+        }
+        if (len && !found) {
+            return false;
+        }
+        wanted += len + (wanted[len] == ',');
+    }
+
+    return true;
+}
+
+static bool is_selected(const tss2_index_entry *e) {
+
+    return (!ctx.type || !strcasecmp (e->type, ctx.type))
+        && (!ctx.attributes || has_attributes (e->attributes, ctx.attributes))
+        && (!ctx.description || strstr (e->description, ctx.description))
+        && (!ctx.policy || e->policy);
+}
+
+/* Lists the paths of the index instead of searching the keystore */
+static int list_index(const tss2_index *index) {
+
+    const char *search_path = ctx.searchPath ? ctx.searchPath : "";
+
+    size_t len = 0;
+    size_t found = 0;
+    for (size_t i = 0; i < index->count; i++) {
+        if (tss2_index_match (index, index->entries[i].path, search_path)) {
+            found++;
+            if (is_selected (&index->entries[i])) {
+                len += strlen (index->entries[i].path) + 1;
+            }
+        }
+    }
+
+    /* like Fapi_List, searching a path that does not exist is an error */
+    if (!found && *search_path) {
+        fprintf (stderr, "Path %s not found in the keystore index\n",
+            search_path);
+        return 1;
+    }
+
+    char *pathList = malloc (len + 1);
+    if (!pathList) {
+        fprintf (stderr, "OOM\n");
+        return 1;
+    }
+
+    char *p = pathList;
+    for (size_t i = 0; i < index->count; i++) {
+        const tss2_index_entry *e = &index->entries[i];
+        if (tss2_index_match (index, e->path, search_path)
+                && is_selected (e)) {
+            if (p != pathList) {
+                *p++ = ':';
+            }
+            size_t path_len = strlen (e->path);
+            memcpy (p, e->path, path_len);
+            p += path_len;
+        }
+    }
+    *p = '\0';
+
+    int r = open_write_and_close (ctx.pathList, ctx.overwrite, pathList,
+        strlen(pathList));
+    free (pathList);
+    return r ? 1 : 0;
+}
+
 /* Execute specific tool */
 static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
-    (void) fctx;
+
+    bool filtered = ctx.type || ctx.attributes || ctx.description
+        || ctx.policy;
+
+    char *file = tss2_index_file ();
+    if (!file) {
+        return 1;
+    }
+
+    /* Consult the keystore index, building it when it is needed */
+    tss2_index index;
+    bool exists = false;
+    if (!ctx.rebuild && !tss2_index_load (file, &index, &exists)) {
+        free (file);
+        return 1;
+    }
+    if (ctx.rebuild || (!exists && filtered)) {
+        int lock = tss2_index_lock (file);
+        bool result = lock >= 0 && tss2_index_rebuild (fctx, &index)
+            && tss2_index_save (file, &index);
+        tss2_index_unlock (lock);
+        if (!result) {
+            free (file);
+            return 1;
+        }
+        exists = true;
+    }
+    free (file);
+
+    if (exists) {
+        int ret = list_index (&index);
+        tss2_index_free (&index);
+        return ret;
+    }
+
     /* Execute FAPI command with passed arguments */
     char *pathList = NULL;
     TSS2_RC r = Fapi_List(fctx,
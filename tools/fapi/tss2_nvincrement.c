@@ -4,14 +4,16 @@
 
 #include "tools/fapi/tss2_template.h"
 
-/* Variable used to store passed command line parameter */
-static char const *nvPath;
+/* Context struct used to store passed command line parameters */
+static struct cxt {
+    char const *nvPath;
+} ctx;
 
 /* Parse command line parameters */
 static bool on_option(char key, char *value) {
     switch (key) {
     case 'p':
-        nvPath = value;
+        ctx.nvPath = value;
         break;
     }
     return true;
@@ -29,13 +31,13 @@ static bool tss2_tool_onstart(tpm2_options **opts) {
 /* Execute specific tool */
 static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
     /* Check availability of required parameters */
-    if (!nvPath) {
+    if (!ctx.nvPath) {
         fprintf (stderr, "No path to the NV provided, use --nvPath\n");
         return -1;
     }
 
     /* Execute FAPI command with passed arguments */
-    TSS2_RC r = Fapi_NvIncrement(fctx, nvPath);
+    TSS2_RC r = Fapi_NvIncrement(fctx, ctx.nvPath);
     if (r != TSS2_RC_SUCCESS){
         LOG_PERR("Fapi_NV_Increment", r);
         return 1;
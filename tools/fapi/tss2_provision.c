@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include "tools/fapi/tss2_template.h"
+#include "tools/fapi/tss2_index.h"
 
 /* Context struct used to store passed commandline parameters */
 static struct cxt {
@@ -48,6 +49,7 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
         return 1;
     }
 
+    tss2_index_update (fctx, "/");
     return 0;
 }
 
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "tools/fapi/tss2_template.h"
+#include "tools/fapi/tss2_index.h"
 
 /* Context struct used to store passed command line parameters */
 static struct cxt {
@@ -51,6 +52,8 @@ static int tss2_tool_onrun (FAPI_CONTEXT *fctx) {
         LOG_PERR ("Fapi_SetDescription", r);
         return 1;
     }
+
+    tss2_index_update (fctx, ctx.path);
     return 0;
 }
 
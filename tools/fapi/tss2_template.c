@@ -416,6 +416,36 @@ static FAPI_CONTEXT* ctx_init(char const * uri) {
     return ret;
 }
 
+/* Initialize the FAPI context and register the interactive callbacks */
+static FAPI_CONTEXT* fapi_init(void) {
+    FAPI_CONTEXT *fctx = ctx_init (NULL);
+    if (!fctx)
+        return NULL;
+
+    TSS2_RC r = Fapi_SetAuthCB (fctx, auth_callback, NULL);
+    if (r != TSS2_RC_SUCCESS) {
+        fprintf (stderr, "Fapi_SetAuthCB returned %u\n", r);
+        Fapi_Finalize (&fctx);
+        return NULL;
+    }
+
+    r = Fapi_SetSignCB (fctx, sign_callback, NULL);
+    if (r != TSS2_RC_SUCCESS) {
+        fprintf (stderr, "Fapi_SetSignCB returned %u\n", r);
+        Fapi_Finalize (&fctx);
+        return NULL;
+    }
+
+    r = Fapi_SetBranchCB (fctx, branch_callback, NULL);
+    if (r != TSS2_RC_SUCCESS) {
+        fprintf (stderr, "Fapi_SetBranchCB returned %u\n", r);
+        Fapi_Finalize (&fctx);
+        return NULL;
+    }
+
+    return fctx;
+}
+
 /*
  * Build a list of the TSS2 tools linked into this executable
  */
@@ -435,7 +465,7 @@ void tss2_tool_register(const tss2_tool *tool) {
     }
 }
 
-static const char *tss2_tool_name(const char *arg) {
+const char *tss2_tool_name(const char *arg) {
 
     const char *name = rindex(arg, '/');
     if (name) {
@@ -451,6 +481,22 @@ static const char *tss2_tool_name(const char *arg) {
     return name;
 }
 
+const tss2_tool *tss2_tool_find(const char *name) {
+
+    for(unsigned i = 0 ; i < tool_count ; i++)
+    {
+        const tss2_tool * const tool = tools[i];
+        if (!tool || !tool->name) {
+            continue;
+        }
+        if (strcmp(name, tool->name) == 0) {
+            return tool;
+        }
+    }
+
+    return NULL;
+}
+
 static const tss2_tool *tss2_tool_lookup(int *argc, char ***argv)
 {
     // find the executable name in the path
@@ -468,41 +514,13 @@ static const tss2_tool *tss2_tool_lookup(int *argc, char ***argv)
 
 
     // search the tools array for a matching name
-    for(unsigned i = 0 ; i < tool_count ; i++)
-    {
-        const tss2_tool * const tool = tools[i];
-        if (!tool || !tool->name) {
-            continue;
-        }
-        if (strcmp(name, tool->name) == 0) {
-            return tool;
-        }
-    }
-
     // not found? should print a table of the tools
-    return NULL;
+    return tss2_tool_find(name);
 }
 
-/*
- * This program is a template for TPM2 tools that use the FAPI. It does
- * nothing more than parsing command line options that allow the caller to
- * specify which FAPI function to call.
- */
-int main(int argc, char *argv[]) {
-
-    /* get rid of:
-     *   other write + read + execute (7)
-     */
-    umask(0007);
+int tss2_tool_run(const tss2_tool *tool, FAPI_CONTEXT **fctx,
+    int argc, char *argv[]) {
 
-    const tss2_tool * const tool = tss2_tool_lookup(&argc, &argv);
-    if (!tool) {
-        LOG_ERR("%s: unknown tool. Available tss2 commands:\n", argv[0]);
-        for(unsigned i = 0 ; i < tool_count ; i++) {
-            fprintf(stderr, "%s\n", tools[i]->name);
-        }
-        return EXIT_FAILURE;
-    }
     tpm2_options *tool_opts = NULL;
     if (tool->onstart && !tool->onstart (&tool_opts)) {
         fprintf (stderr,"error retrieving tool options\n");
@@ -517,29 +535,10 @@ int main(int argc, char *argv[]) {
         goto free_opts;
     }
 
-    FAPI_CONTEXT *fctx = ctx_init (NULL);
-    if (!fctx)
-        goto free_opts;
-
-    TSS2_RC r = Fapi_SetAuthCB (fctx, auth_callback, NULL);
-    if (r != TSS2_RC_SUCCESS) {
-        fprintf (stderr, "Fapi_SetAuthCB returned %u\n", r);
-        Fapi_Finalize (&fctx);
-        goto free_opts;
-    }
-
-    r = Fapi_SetSignCB (fctx, sign_callback, NULL);
-    if (r != TSS2_RC_SUCCESS) {
-        fprintf (stderr, "Fapi_SetSignCB returned %u\n", r);
-        Fapi_Finalize (&fctx);
-        goto free_opts;
-    }
-
-    r = Fapi_SetBranchCB (fctx, branch_callback, NULL);
-    if (r != TSS2_RC_SUCCESS) {
-        fprintf (stderr, "Fapi_SetBranchCB returned %u\n", r);
-        Fapi_Finalize (&fctx);
-        goto free_opts;
+    if (!*fctx) {
+        *fctx = fapi_init ();
+        if (!*fctx)
+            goto free_opts;
     }
 
     /*
@@ -549,7 +548,7 @@ int main(int argc, char *argv[]) {
      * rc 0 = success
      * rc -1 = show usage
      */
-    ret = tool->onrun(fctx);
+    ret = tool->onrun(*fctx);
     if (ret < 0) {
         tpm2_print_usage(argv[0], tool_opts);
         ret = 1;
@@ -559,14 +558,43 @@ int main(int argc, char *argv[]) {
         tool->onexit();
     }
 
+free_opts:
+    if (tool_opts)
+        tpm2_options_free (tool_opts);
+
+    return ret;
+}
+
+/*
+ * This program is a template for TPM2 tools that use the FAPI. It does
+ * nothing more than parsing command line options that allow the caller to
+ * specify which FAPI function to call.
+ */
+int main(int argc, char *argv[]) {
+
+    /* get rid of:
+     *   other write + read + execute (7)
+     */
+    umask(0007);
+
+    const tss2_tool * const tool = tss2_tool_lookup(&argc, &argv);
+    if (!tool) {
+        LOG_ERR("%s: unknown tool. Available tss2 commands:\n", argv[0]);
+        for(unsigned i = 0 ; i < tool_count ; i++) {
+            fprintf(stderr, "%s\n", tools[i]->name);
+        }
+        return EXIT_FAILURE;
+    }
+
+    FAPI_CONTEXT *fctx = NULL;
+    int ret = tss2_tool_run (tool, &fctx, argc, argv);
+
     /*
      * Cleanup contexts & memory allocated for the modified argument vector
      * passed to execute_tool.
      */
-    Fapi_Finalize (&fctx);
-free_opts:
-    if (tool_opts)
-        tpm2_options_free (tool_opts);
+    if (fctx)
+        Fapi_Finalize (&fctx);
     free (password);
     if (ret == 0){
         free (input_signature);
@@ -45,16 +45,25 @@ typedef struct {
 	tss2_tool_onstart_t onstart;
 	tss2_tool_onrun_t onrun;
 	tss2_tool_onexit_t onexit;
+	/* the command line state, cleared between the commands of a batch */
+	void * ctx;
+	size_t ctx_size;
 } tss2_tool;
 
 void tss2_tool_register(const tss2_tool * tool);
 
+/*
+ * Tools keep their command line parameters in a static struct named ctx, so
+ * that "tss2 batch" can run the same tool many times in one process.
+ */
 #define TSS2_TOOL_REGISTER(tool_name,tool_onstart,tool_onrun,tool_onexit) \
 	static const tss2_tool tool = { \
 		.name		= tool_name, \
 		.onstart	= tool_onstart, \
 		.onrun		= tool_onrun, \
 		.onexit		= tool_onexit, \
+		.ctx		= &ctx, \
+		.ctx_size	= sizeof(ctx), \
 	}; \
 	static void \
 	__attribute__((__constructor__)) \
@@ -65,6 +74,30 @@ void tss2_tool_register(const tss2_tool * tool);
 	}
 
 
+/**
+ * Strips the path and the "tss2_" prefix from a tool name.
+ */
+const char *tss2_tool_name(const char *arg);
+
+/**
+ * Looks up a registered tool by name, NULL if not found.
+ */
+const tss2_tool *tss2_tool_find(const char *name);
+
+/**
+ * Parses the options of a tool and runs it.
+ * @param tool
+ *  The tool to run.
+ * @param fctx
+ *  The fapi api context, initialized once the options are parsed if *fctx is
+ *  NULL.
+ * @return
+ *  0 on success
+ *  1 on failure
+ */
+int tss2_tool_run(const tss2_tool *tool, FAPI_CONTEXT **fctx, int argc,
+    char *argv[]);
+
 TSS2_RC policy_auth_callback(FAPI_CONTEXT*, char const*, char**, void*);
 int open_write_and_close(const char *path, bool overwrite, const void* output, size_t output_len);
 int open_read_and_close(const char *path, void **input, size_t *size);
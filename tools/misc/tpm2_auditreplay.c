@@ -0,0 +1,577 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "files.h"
+#include "log.h"
+#include "tpm2_alg_util.h"
+#include "tpm2_audit.h"
+#include "tpm2_codec.h"
+#include "tpm2_convert.h"
+#include "tpm2_openssl.h"
+#include "tpm2_tool.h"
+
+/*
+ * Default number of commands between two checkpoints.
+ */
+#define AUDITREPLAY_CHECKPOINT_INTERVAL 65536
+
+/*
+ * The state of the replay after some commands, saved as a line of the
+ * checkpoint file:
+ *
+ *   <commands> <offset> <algorithm> <digest>
+ *
+ * Where offset is the offset of the record following the commands.
+ */
+typedef struct auditreplay_checkpoint auditreplay_checkpoint;
+struct auditreplay_checkpoint {
+    UINT64 commands;
+    UINT64 offset;
+    TPMI_ALG_HASH halg;
+    TPM2B_DIGEST digest;
+};
+
+typedef struct tpm_auditreplay_ctx tpm_auditreplay_ctx;
+struct tpm_auditreplay_ctx {
+    const char *records_path;
+    TPMI_ALG_HASH halg;
+
+    const char *msg_path;
+    const char *sig_path;
+    /* the hash algorithm of a plain signature */
+    TPMI_ALG_HASH sig_halg;
+    const char *pubkey_path;
+    TPM2B_DATA extra_data;
+    bool is_extra_data;
+
+    const char *checkpoint_path;
+    UINT64 checkpoint_interval;
+    const char *resume_path;
+
+    tpm2_audit *audit;
+    /* commands replayed before the checkpoint resumed from */
+    UINT64 resumed_commands;
+    FILE *records;
+    FILE *checkpoints;
+};
+
+static tpm_auditreplay_ctx ctx = {
+    .halg = TPM2_ALG_ERROR,
+    .sig_halg = TPM2_ALG_ERROR,
+    .checkpoint_interval = AUDITREPLAY_CHECKPOINT_INTERVAL,
+};
+
+/*
+ * Parses a cpHash or rpHash of a record, either in hex or as the path of a
+ * file saved by the --cphash and --rphash options of the tools.
+ */
+static bool parse_phash(const char *field, size_t line, TPM2B_DIGEST *phash) {
+
+    size_t length = strlen(field);
+    if (length == TPM2_CODEC_HEX_SIZE(tpm2_alg_util_get_hash_size(ctx.halg))
+            && tpm2_codec_hex_decode(field, length, phash->buffer)) {
+        phash->size = length / 2;
+        return true;
+    }
+
+    if (!files_load_digest(field, phash)) {
+        LOG_ERR("Expected a digest in hex or a digest file on line %zu, got:"
+                " \"%s\"", line, field);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Parses a line of a checkpoint file, false if the line is not a checkpoint.
+ */
+static bool parse_checkpoint(char *str, auditreplay_checkpoint *checkpoint) {
+
+    char alg[32];
+    char hex[TPM2_CODEC_HEX_SIZE(sizeof(TPMU_HA)) + 1];
+    if (sscanf(str, "%" SCNu64 " %" SCNu64 " %31s %128s",
+            &checkpoint->commands, &checkpoint->offset, alg, hex) != 4) {
+        return false;
+    }
+
+    checkpoint->halg = tpm2_alg_util_from_optarg(alg,
+            tpm2_alg_util_flags_hash);
+    if (checkpoint->halg == TPM2_ALG_ERROR) {
+        return false;
+    }
+
+    size_t length = strlen(hex);
+    if (length != TPM2_CODEC_HEX_SIZE(
+            tpm2_alg_util_get_hash_size(checkpoint->halg)) ||
+        !tpm2_codec_hex_decode(hex, length, checkpoint->digest.buffer)) {
+        return false;
+    }
+    checkpoint->digest.size = length / 2;
+
+    return true;
+}
+
+/*
+ * Loads the last checkpoint of a checkpoint file, the ones before it are
+ * superseded.
+ */
+static bool checkpoint_load_last(const char *path,
+        auditreplay_checkpoint *checkpoint) {
+
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        LOG_ERR("Could not open checkpoint file \"%s\", error: %s", path,
+                strerror(errno));
+        return false;
+    }
+
+    bool result = false;
+    bool found = false;
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t lineno = 0;
+    while (getline(&line, &line_size, f) >= 0) {
+        lineno++;
+        if (line[0] == '#' || line[0] == '\n') {
+            continue;
+        }
+
+        if (!parse_checkpoint(line, checkpoint)) {
+            LOG_ERR("Invalid checkpoint on line %zu of \"%s\"", lineno, path);
+            goto out;
+        }
+        found = true;
+    }
+
+    if (!found) {
+        LOG_ERR("No checkpoint in \"%s\"", path);
+        goto out;
+    }
+
+    result = true;
+
+out:
+    free(line);
+    fclose(f);
+
+    return result;
+}
+
+static UINT64 commands(void) {
+
+    return ctx.resumed_commands + tpm2_audit_get_count(ctx.audit);
+}
+
+static bool checkpoint_save(UINT64 offset) {
+
+    TPM2B_DIGEST digest;
+    if (!tpm2_audit_get_digest(ctx.audit, &digest)) {
+        return false;
+    }
+
+    char hex[TPM2_CODEC_HEX_SIZE(sizeof(digest.buffer)) + 1];
+    tpm2_codec_hex_encode(digest.buffer, digest.size, hex, false);
+
+    /* flushed so that a replay interrupted later resumes from here */
+    int rc = fprintf(ctx.checkpoints, "%" PRIu64 " %" PRIu64 " %s %s\n",
+            commands(), offset,
+            tpm2_alg_util_algtostr(ctx.halg, tpm2_alg_util_flags_hash), hex);
+    if (rc < 0 || fflush(ctx.checkpoints)) {
+        LOG_ERR("Could not write checkpoint to \"%s\", error: %s",
+                ctx.checkpoint_path, strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Replays the records a line at a time:
+ *
+ *   <cpHash> <rpHash>
+ *
+ * Empty lines and lines starting with # are ignored.
+ */
+static bool replay(UINT64 offset) {
+
+    bool result = false;
+    char *line = NULL;
+    size_t line_size = 0;
+    size_t lineno = 0;
+    ssize_t length;
+    while ((length = getline(&line, &line_size, ctx.records)) >= 0) {
+        lineno++;
+        offset += length;
+
+        char *saveptr = NULL;
+        char *cp_field = strtok_r(line, " \t\r\n", &saveptr);
+        if (!cp_field || cp_field[0] == '#') {
+            continue;
+        }
+
+        char *rp_field = strtok_r(NULL, " \t\r\n", &saveptr);
+        if (!rp_field || strtok_r(NULL, " \t\r\n", &saveptr)) {
+            LOG_ERR("Expected a cpHash and an rpHash on line %zu", lineno);
+            goto out;
+        }
+
+        TPM2B_DIGEST cp_hash;
+        TPM2B_DIGEST rp_hash;
+        if (!parse_phash(cp_field, lineno, &cp_hash) ||
+            !parse_phash(rp_field, lineno, &rp_hash)) {
+            goto out;
+        }
+
+        if (!tpm2_audit_extend(ctx.audit, &cp_hash, &rp_hash)) {
+            LOG_ERR("Could not replay the command on line %zu", lineno);
+            goto out;
+        }
+
+        if (ctx.checkpoints && commands() % ctx.checkpoint_interval == 0 &&
+            !checkpoint_save(offset)) {
+            goto out;
+        }
+    }
+
+    if (ferror(ctx.records)) {
+        LOG_ERR("Could not read records \"%s\", error: %s", ctx.records_path,
+                strerror(errno));
+        goto out;
+    }
+
+    /* the last checkpoint is at the end of the records */
+    result = !ctx.checkpoints ||
+            commands() % ctx.checkpoint_interval == 0 ||
+            checkpoint_save(offset);
+
+out:
+    free(line);
+
+    return result;
+}
+
+/*
+ * Returns the audit digest signed in an attestation of
+ * tpm2_getcommandauditdigest or tpm2_getsessionauditdigest.
+ */
+static TPM2B_DIGEST *attested_digest(TPMS_ATTEST *attest) {
+
+    switch (attest->type) {
+    case TPM2_ST_ATTEST_COMMAND_AUDIT:
+        return &attest->attested.commandAudit.auditDigest;
+    case TPM2_ST_ATTEST_SESSION_AUDIT:
+        return &attest->attested.sessionAudit.sessionDigest;
+    default:
+        LOG_ERR("Expected a command or session audit attestation, got type"
+                " 0x%x", attest->type);
+        return NULL;
+    }
+}
+
+static bool load_attest(TPM2B_ATTEST *msg, TPMS_ATTEST *attest) {
+
+    msg->size = sizeof(msg->attestationData);
+    if (!files_load_bytes_from_path(ctx.msg_path, msg->attestationData,
+            &msg->size)) {
+        return false;
+    }
+
+    return files_tpm2b_attest_to_tpms_attest(msg, attest) == tool_rc_success;
+}
+
+static bool verify_signature(TPM2B_ATTEST *msg) {
+
+    /*
+     * Plain signatures do not carry their hash algorithm, the one of the
+     * signing scheme which may differ from the one of the audit digest.
+     */
+    TPMI_ALG_HASH sig_halg = TPM2_ALG_ERROR;
+    TPM2B_MAX_BUFFER signature;
+    if (!tpm2_convert_sig_load_plain(ctx.sig_path, &signature, &sig_halg)) {
+        return false;
+    }
+    if (sig_halg == TPM2_ALG_NULL) {
+        if (ctx.sig_halg == TPM2_ALG_ERROR) {
+            LOG_ERR("A plain signature requires its hash algorithm, given "
+                    "with --signature-hash-algorithm");
+            return false;
+        }
+        sig_halg = ctx.sig_halg;
+    } else if (ctx.sig_halg != TPM2_ALG_ERROR && ctx.sig_halg != sig_halg) {
+        LOG_ERR("The signature uses the hash algorithm %s, not %s",
+                tpm2_alg_util_algtostr(sig_halg, tpm2_alg_util_flags_hash),
+                tpm2_alg_util_algtostr(ctx.sig_halg,
+                        tpm2_alg_util_flags_hash));
+        return false;
+    }
+
+    TPM2B_DIGEST msg_hash = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
+    if (!tpm2_openssl_hash_compute_data(sig_halg, msg->attestationData,
+            msg->size, &msg_hash)) {
+        LOG_ERR("Compute message hash failed!");
+        return false;
+    }
+
+    EVP_PKEY *pkey = NULL;
+    if (!tpm2_public_load_pkey(ctx.pubkey_path, &pkey)) {
+        return false;
+    }
+
+    bool result = tpm2_openssl_verify_signature(pkey, sig_halg, &signature,
+            &msg_hash);
+    EVP_PKEY_free(pkey);
+
+    return result;
+}
+
+static bool verify(TPM2B_ATTEST *msg, TPMS_ATTEST *attest,
+        TPM2B_DIGEST *digest) {
+
+    if (ctx.sig_path && !verify_signature(msg)) {
+        LOG_ERR("Error validating the signature of the attestation");
+        return false;
+    }
+
+    if (ctx.is_extra_data && (attest->extraData.size != ctx.extra_data.size ||
+        memcmp(attest->extraData.buffer, ctx.extra_data.buffer,
+        ctx.extra_data.size))) {
+        LOG_ERR("Error validating the qualification of the attestation");
+        return false;
+    }
+
+    TPM2B_DIGEST *attested = attested_digest(attest);
+    if (!attested || !tpm2_util_verify_digests(attested, digest)) {
+        LOG_ERR("Error validating the replayed audit digest against the"
+                " attestation");
+        return false;
+    }
+
+    return true;
+}
+
+static bool on_option(char key, char *value) {
+
+    switch (key) {
+    case 'g':
+        ctx.halg = tpm2_alg_util_from_optarg(value, tpm2_alg_util_flags_hash);
+        if (ctx.halg == TPM2_ALG_ERROR) {
+            LOG_ERR("Invalid audit hash algorithm, got \"%s\"", value);
+            return false;
+        }
+        break;
+    case 'm':
+        ctx.msg_path = value;
+        break;
+    case 's':
+        ctx.sig_path = value;
+        break;
+    case 'u':
+        ctx.pubkey_path = value;
+        break;
+    case 'q':
+        ctx.extra_data.size = sizeof(ctx.extra_data.buffer);
+        ctx.is_extra_data = true;
+        return tpm2_util_bin_from_hex_or_file(value, &ctx.extra_data.size,
+                ctx.extra_data.buffer);
+    case 0:
+        ctx.checkpoint_path = value;
+        break;
+    case 1:
+        if (!tpm2_util_string_to_uint64(value, &ctx.checkpoint_interval) ||
+            !ctx.checkpoint_interval) {
+            LOG_ERR("Invalid checkpoint interval, got \"%s\"", value);
+            return false;
+        }
+        break;
+    case 2:
+        ctx.resume_path = value;
+        break;
+    case 3:
+        ctx.sig_halg = tpm2_alg_util_from_optarg(value,
+                tpm2_alg_util_flags_hash);
+        if (ctx.sig_halg == TPM2_ALG_ERROR) {
+            LOG_ERR("Invalid signature hash algorithm, got \"%s\"", value);
+            return false;
+        }
+        break;
+    }
+
+    return true;
+}
+
+static bool on_positional(int argc, char **argv) {
+
+    if (argc != 1) {
+        LOG_ERR("Expected one record file as a positional parameter. "
+                "Got: %d", argc);
+        return false;
+    }
+
+    ctx.records_path = argv[0];
+
+    return true;
+}
+
+static bool tpm2_tool_onstart(tpm2_options **opts) {
+
+    static struct option topts[] = {
+        { "hash-algorithm",      required_argument, NULL, 'g' },
+        { "message",             required_argument, NULL, 'm' },
+        { "signature",           required_argument, NULL, 's' },
+        { "public",              required_argument, NULL, 'u' },
+        { "qualification",       required_argument, NULL, 'q' },
+        { "checkpoint",          required_argument, NULL,  0  },
+        { "checkpoint-interval", required_argument, NULL,  1  },
+        { "resume",              required_argument, NULL,  2  },
+        { "signature-hash-algorithm", required_argument, NULL, 3 },
+    };
+
+    *opts = tpm2_options_new("g:m:s:u:q:", ARRAY_LEN(topts), topts, on_option,
+                             on_positional, TPM2_OPTIONS_NO_SAPI);
+
+    return *opts != NULL;
+}
+
+static tool_rc check_options(void) {
+
+    if (!ctx.records_path) {
+        LOG_ERR("Missing required positional parameter, try -h / --help");
+        return tool_rc_option_error;
+    }
+
+    if (!ctx.sig_path != !ctx.pubkey_path) {
+        LOG_ERR("Options -s and -u must be specified together");
+        return tool_rc_option_error;
+    }
+
+    if (ctx.sig_halg != TPM2_ALG_ERROR && !ctx.sig_path) {
+        LOG_ERR("Option --signature-hash-algorithm requires -s");
+        return tool_rc_option_error;
+    }
+
+    if ((ctx.sig_path || ctx.is_extra_data) && !ctx.msg_path) {
+        LOG_ERR("Options -s, -u and -q verify the attestation given with -m");
+        return tool_rc_option_error;
+    }
+
+    return tool_rc_success;
+}
+
+static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
+
+    UNUSED(ectx);
+    UNUSED(flags);
+
+    tool_rc rc = check_options();
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    TPM2B_ATTEST msg;
+    TPMS_ATTEST attest = { 0 };
+    if (ctx.msg_path && !load_attest(&msg, &attest)) {
+        return tool_rc_general_error;
+    }
+
+    /* the command audit attestation names the algorithm of its digest */
+    if (ctx.halg == TPM2_ALG_ERROR) {
+        ctx.halg = ctx.msg_path && attest.type == TPM2_ST_ATTEST_COMMAND_AUDIT ?
+                attest.attested.commandAudit.digestAlg : TPM2_ALG_SHA256;
+    }
+
+    auditreplay_checkpoint checkpoint = { 0 };
+    if (ctx.resume_path) {
+        if (!checkpoint_load_last(ctx.resume_path, &checkpoint)) {
+            return tool_rc_general_error;
+        }
+
+        if (checkpoint.halg != ctx.halg) {
+            LOG_ERR("The checkpoint is of the %s audit digest, not %s",
+                    tpm2_alg_util_algtostr(checkpoint.halg,
+                            tpm2_alg_util_flags_hash),
+                    tpm2_alg_util_algtostr(ctx.halg,
+                            tpm2_alg_util_flags_hash));
+            return tool_rc_general_error;
+        }
+    }
+
+    ctx.resumed_commands = checkpoint.commands;
+    ctx.audit = tpm2_audit_new(ctx.halg,
+            ctx.resume_path ? &checkpoint.digest : NULL);
+    if (!ctx.audit) {
+        return tool_rc_general_error;
+    }
+
+    bool is_stdin = !strcmp(ctx.records_path, "-");
+    ctx.records = is_stdin ? stdin : fopen(ctx.records_path, "r");
+    if (!ctx.records) {
+        LOG_ERR("Could not open records \"%s\", error: %s", ctx.records_path,
+                strerror(errno));
+        return tool_rc_general_error;
+    }
+
+    /* the records before the checkpoint are not read again */
+    if (checkpoint.offset &&
+        fseeko(ctx.records, checkpoint.offset, SEEK_SET)) {
+        LOG_ERR("Could not resume records \"%s\" at offset %" PRIu64
+                ", error: %s", ctx.records_path, checkpoint.offset,
+                strerror(errno));
+        return tool_rc_general_error;
+    }
+
+    if (ctx.checkpoint_path) {
+        ctx.checkpoints = fopen(ctx.checkpoint_path, "a");
+        if (!ctx.checkpoints) {
+            LOG_ERR("Could not open checkpoint file \"%s\", error: %s",
+                    ctx.checkpoint_path, strerror(errno));
+            return tool_rc_general_error;
+        }
+    }
+
+    if (!replay(checkpoint.offset)) {
+        return tool_rc_general_error;
+    }
+
+    TPM2B_DIGEST digest;
+    if (!tpm2_audit_get_digest(ctx.audit, &digest)) {
+        return tool_rc_general_error;
+    }
+
+    tpm2_tool_output("commands: %" PRIu64 "\n", commands());
+    tpm2_tool_output("hash-algorithm: %s\n",
+            tpm2_alg_util_algtostr(ctx.halg, tpm2_alg_util_flags_hash));
+    tpm2_tool_output("digest: ");
+    tpm2_util_hexdump(digest.buffer, digest.size);
+    tpm2_tool_output("\n");
+
+    if (!ctx.msg_path) {
+        return tool_rc_success;
+    }
+
+    bool result = verify(&msg, &attest, &digest);
+    tpm2_tool_output("verified: %s\n", result ? "true" : "false");
+
+    return result ? tool_rc_success : tool_rc_general_error;
+}
+
+static void tpm2_tool_onexit(void) {
+
+    tpm2_audit_free(ctx.audit);
+
+    if (ctx.records && ctx.records != stdin) {
+        fclose(ctx.records);
+    }
+
+    if (ctx.checkpoints) {
+        fclose(ctx.checkpoints);
+    }
+}
+
+// Register this tool with tpm2_tool.c
+TPM2_TOOL_REGISTER("auditreplay", tpm2_tool_onstart, tpm2_tool_onrun, NULL, tpm2_tool_onexit)
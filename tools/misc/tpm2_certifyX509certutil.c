@@ -1,54 +1,76 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
-#include <fcntl.h>
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <unistd.h>
 
 #include <openssl/x509.h>
 #include <openssl/x509v3.h>
 #include <openssl/bio.h>
 
+#include "files.h"
 #include "log.h"
+#include "tpm2_batch.h"
 #include "tpm2_tool.h"
+#include "tpm2_worker.h"
 
-struct tpm_gen_partial_cert {
+struct partial_cert {
     const char *out_path;
     const char *valid_str;
     const char *subject;
     const char *issuer;
+    const char *key_usage;
+};
+
+struct tpm_gen_partial_cert {
+    /* the certificate, or the defaults of the manifest items */
+    struct partial_cert cert;
+    bool is_out_path_set;
+    char *batch_path; /* manifest of certificates, see batch_run() */
+    unsigned jobs;
 };
 
 #define CERT_FILE "partial_cert.der"
 #define VALID_DAYS "3560"
 #define SUBJ "C=US;O=CA org;OU=CA unit;CN=example"
 #define ISSUER "C=US;O=CA org;OU=CA unit;CN=example"
+#define KEY_USAGE "critical,digitalSignature,keyCertSign,cRLSign"
 
 static struct tpm_gen_partial_cert ctx = {
-    .out_path = CERT_FILE,
-    .valid_str = VALID_DAYS,
-    .subject = SUBJ,
-    .issuer = ISSUER
+    .cert = {
+        .out_path = CERT_FILE,
+        .valid_str = VALID_DAYS,
+        .subject = SUBJ,
+        .issuer = ISSUER,
+        .key_usage = KEY_USAGE
+    },
+    .jobs = 1
 };
 
 static bool on_option(char key, char *value) {
 
     switch (key) {
     case 'o':
-        ctx.out_path = value;
+        ctx.cert.out_path = value;
+        ctx.is_out_path_set = true;
         break;
     case 'd':
-        ctx.valid_str = value;
+        ctx.cert.valid_str = value;
         break;
     case 's':
-        ctx.subject = value;
+        ctx.cert.subject = value;
         break;
     case 'i':
-        ctx.issuer = value;
+        ctx.cert.issuer = value;
+        break;
+    case 0:
+        ctx.cert.key_usage = value;
+        break;
+    case 1:
+        ctx.batch_path = value;
         break;
+    case 2:
+        return tpm2_worker_jobs_from_optarg(value, &ctx.jobs);
     }
 
     return true;
@@ -60,7 +82,10 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
       { "outcert", optional_argument, NULL, 'o' },
       { "days",    optional_argument, NULL, 'd' },
       { "subject", optional_argument, NULL, 's' },
-      { "issuer", optional_argument, NULL, 'i' }
+      { "issuer", optional_argument, NULL, 'i' },
+      { "key-usage", required_argument, NULL, 0 },
+      { "batch",   required_argument, NULL, 1 },
+      { "jobs",    required_argument, NULL, 2 }
     };
 
     *opts = tpm2_options_new("o:d:s:i:", ARRAY_LEN(topts), topts, on_option,
@@ -95,78 +120,28 @@ static struct name_fields names[] = {
       .def = "CA Unit" },
 };
 
-static tool_rc fixup_cert(const char *cert) {
-
-    int fd = open(cert, O_RDONLY);
-    if (fd < 0) {
-        LOG_ERR("open failed");
-        return tool_rc_general_error;
-    }
-
-    struct stat fs;
-    int ret = fstat(fd, &fs);
-    if (ret < 0) {
-        close(fd);
-        return tool_rc_general_error;
-    }
+/*
+ * Turns the DER encoding of the certificate into the partial certificate, in
+ * place.
+ */
+static bool fixup_cert(UINT8 *buf, int *size) {
 
-    ssize_t size = fs.st_size;
-    if (size < 100 || size > 255) {
-        LOG_ERR("Wrong cert size %zd", size);
-        close(fd);
-        return tool_rc_general_error; /* there is something wrong with this cert */
-    }
-
-    char* buf = calloc(1, size);
-    if (!buf) {
-        LOG_ERR("Alloc failed");
-        close(fd);
-        return tool_rc_general_error;
-    }
-
-    tool_rc rc = tool_rc_success;
-    ret = read(fd, buf, size);
-    close(fd);
-    if (ret != size) {
-        LOG_ERR("read failed");
-        rc = tool_rc_general_error;
-        goto out;
-    }
-
-    fd = open(cert, O_WRONLY | O_TRUNC);
-    if (fd < 0) {
-        LOG_ERR("second open failed");
-        rc = tool_rc_general_error;
-        goto out;
+    if (*size < 100 || *size > 255) {
+        LOG_ERR("Wrong cert size %d", *size);
+        return false; /* there is something wrong with this cert */
     }
 
     /* We need to skip one wrapping sequence (8 bytes) and one
      * sequence with one empty byte field at the end (5 bytes).
      * Fix the size here */
-    buf[2] = size - 16;
-
-    /* Write the external sequence with the fixed size */
-    ret = write(fd, buf, 3);
-    if (ret != 3) {
-        LOG_ERR("write failed");
-        rc = tool_rc_general_error;
-        close(fd);
-        goto out;
-    }
-
-    /* skip the wrapping sequence the write the rest
-     * without the 5 bytes at the end */
-    ret = write(fd, buf + 11, size - 16);
-    close(fd);
-    if (ret != size - 16) {
-        LOG_ERR("second write failed");
-        rc = tool_rc_general_error;
-    }
+    buf[2] = *size - 16;
 
-out:
-    free(buf);
+    /* keep the external sequence with the fixed size, skip the wrapping
+     * sequence and keep the rest without the 5 bytes at the end */
+    memmove(buf + 3, buf + 11, *size - 16);
+    *size -= 13;
 
-    return rc;
+    return true;
 }
 
 static int populate_fields(X509_NAME *name, const char *opt) {
@@ -177,7 +152,9 @@ static int populate_fields(X509_NAME *name, const char *opt) {
         return -1;
     }
 
-    const char *tok = strtok(name_opt, ";");
+    /* runs on the worker threads in batch mode */
+    char *saveptr = NULL;
+    const char *tok = strtok_r(name_opt, ";", &saveptr);
 
     unsigned i = 0;
     int fields_added = 0;
@@ -211,7 +188,7 @@ static int populate_fields(X509_NAME *name, const char *opt) {
                 fields_added++;
             }
         }
-        tok = strtok(NULL, ";");
+        tok = strtok_r(NULL, ";", &saveptr);
     }
 
     free(name_opt);
@@ -219,15 +196,52 @@ static int populate_fields(X509_NAME *name, const char *opt) {
     return fields_added;
 }
 
-static tool_rc generate_partial_X509() {
+/*
+ * The validity is either a number of days starting now, or the ASN.1 times
+ * NOTBEFORE,NOTAFTER, like 20260101000000Z,20360101000000Z.
+ */
+static bool set_validity(X509 *cert, const char *validity) {
+
+    const char *sep = strchr(validity, ',');
+    if (!sep) {
+        uint32_t valid_days;
+        if (!tpm2_util_string_to_uint32(validity, &valid_days)) {
+            LOG_ERR("Invalid number of days \"%s\"", validity);
+            return false;
+        }
+
+        X509_gmtime_adj(X509_get_notBefore(cert), 0); // add valid not before
+        X509_gmtime_adj(X509_get_notAfter(cert),
+                (long) valid_days * 86400); // add valid not after
+        return true;
+    }
 
-    BIO *cert_out = BIO_new_file(ctx.out_path, "wb");
-    if (!cert_out) {
-        LOG_ERR("Can not create file %s", ctx.out_path);
-        return -1;
+    char not_before[32];
+    size_t len = sep - validity;
+    if (len >= sizeof(not_before)) {
+        LOG_ERR("Invalid validity \"%s\"", validity);
+        return false;
     }
+    memcpy(not_before, validity, len);
+    not_before[len] = '\0';
+
+    ASN1_TIME *before = X509_get_notBefore(cert);
+    ASN1_TIME *after = X509_get_notAfter(cert);
+    if (ASN1_TIME_set_string(before, not_before) != 1
+            || ASN1_TIME_set_string(after, sep + 1) != 1
+            || ASN1_TIME_check(before) != 1 || ASN1_TIME_check(after) != 1) {
+        LOG_ERR("Invalid validity \"%s\", expected NOTBEFORE,NOTAFTER ASN.1 "
+                "times", validity);
+        return false;
+    }
+
+    return true;
+}
+
+static tool_rc generate_partial_X509(const struct partial_cert *params) {
 
     X509_EXTENSION *extv3 = NULL;
+    UINT8 *der = NULL;
     X509 *cert = X509_new();
     if (!cert) {
         LOG_ERR("X509_new");
@@ -240,7 +254,7 @@ static tool_rc generate_partial_X509() {
         goto out_err;
     }
 
-    int fields_added = populate_fields(issuer, ctx.issuer);
+    int fields_added = populate_fields(issuer, params->issuer);
     if (fields_added <= 0) {
         LOG_ERR("Could not parse any issuer fields");
         goto out_err;
@@ -254,22 +268,17 @@ static tool_rc generate_partial_X509() {
         goto out_err;
     }
 
-    unsigned int valid_days;
-    if (!tpm2_util_string_to_uint32(ctx.valid_str, &valid_days)) {
-        LOG_ERR("string_to_uint32");
+    if (!set_validity(cert, params->valid_str)) {
         goto out_err;
     }
 
-    X509_gmtime_adj(X509_get_notBefore(cert), 0); // add valid not before
-    X509_gmtime_adj(X509_get_notAfter(cert), valid_days * 86400); // add valid not after
-
     X509_NAME *subject = X509_get_subject_name(cert);
     if (!subject) {
         LOG_ERR("X509_get_subject_name");
         goto out_err;
     }
 
-    fields_added = populate_fields(subject, ctx.subject);
+    fields_added = populate_fields(subject, params->subject);
     if (fields_added <= 0) {
         LOG_ERR("Could not parse any subject fields");
         goto out_err;
@@ -284,9 +293,9 @@ static tool_rc generate_partial_X509() {
     }
 
     extv3 = X509V3_EXT_conf_nid(NULL, NULL, NID_key_usage,
-    "critical,digitalSignature,keyCertSign,cRLSign");
+            (char *) params->key_usage);
     if (!extv3) {
-        LOG_ERR("X509V3_EXT_conf_nid");
+        LOG_ERR("Invalid key usage \"%s\"", params->key_usage);
         goto out_err;
     }
 
@@ -296,26 +305,30 @@ static tool_rc generate_partial_X509() {
         goto out_err;
     }
 
-    ret = i2d_X509_bio(cert_out, cert); // print cert in DER format
-    if (ret != 1) {
-        LOG_ERR("i2d_X509_bio");
+    int size = i2d_X509(cert, &der); // encode cert in DER format
+    if (size <= 0) {
+        LOG_ERR("i2d_X509");
         goto out_err;
     }
 
-    X509_EXTENSION_free(extv3);
-    X509_free(cert);
-    BIO_free_all(cert_out);
-
-    ret = fixup_cert(ctx.out_path);
-    if (ret) {
+    if (!fixup_cert(der, &size)) {
         LOG_ERR("fixup_cert");
-        return tool_rc_general_error;
+        goto out_err;
     }
 
+    if (!files_save_bytes_to_file(params->out_path, der, size)) {
+        LOG_ERR("Can not create file %s", params->out_path);
+        goto out_err;
+    }
+
+    OPENSSL_free(der);
+    X509_EXTENSION_free(extv3);
+    X509_free(cert);
+
     return tool_rc_success;
 
 out_err:
-    BIO_free_all(cert_out);
+    OPENSSL_free(der);
     if (cert) {
         X509_free(cert);
     }
@@ -326,13 +339,142 @@ out_err:
     return tool_rc_general_error;
 }
 
+typedef struct certutil_batch_item certutil_batch_item;
+struct certutil_batch_item {
+    struct partial_cert cert;
+    /* the fields of the manifest line the cert points into */
+    char *fields;
+    size_t line;
+};
+
+typedef struct certutil_batch certutil_batch;
+struct certutil_batch {
+    certutil_batch_item items[TPM2_BATCH_CHUNK];
+};
+
+/* Runs on the worker threads, an item only touches its own certificate */
+static bool batch_process_item(void *userdata, size_t index) {
+
+    certutil_batch *batch = (certutil_batch *) userdata;
+    certutil_batch_item *item = &batch->items[index];
+
+    tool_rc rc = generate_partial_X509(&item->cert);
+    if (rc != tool_rc_success) {
+        LOG_ERR("Failed to generate the certificate on line %zu of the "
+                "manifest", item->line);
+        return false;
+    }
+
+    return true;
+}
+
+static void batch_free_items(void *userdata, size_t count) {
+
+    certutil_batch *batch = (certutil_batch *) userdata;
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        free(batch->items[i].fields);
+    }
+}
+
+/*
+ * Copies the fields of a manifest line into the item, a missing field or "-"
+ * selects the value given on the command line.
+ */
+static bool batch_parse_item(void *userdata, size_t index, char **fields,
+        size_t count, size_t line) {
+
+    certutil_batch *batch = (certutil_batch *) userdata;
+    certutil_batch_item *item = &batch->items[index];
+    item->line = line;
+    item->cert = ctx.cert;
+    item->fields = NULL;
+
+    if (!strcmp(fields[0], "-")) {
+        LOG_ERR("Expected an OUTPUT file");
+        return false;
+    }
+
+    size_t len = 0;
+    size_t i;
+    for (i = 0; i < count; i++) {
+        len += strlen(fields[i]) + 1;
+    }
+
+    item->fields = malloc(len);
+    if (!item->fields) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    const char **values[] = {
+        &item->cert.out_path,
+        &item->cert.subject,
+        &item->cert.valid_str,
+        &item->cert.issuer,
+        &item->cert.key_usage
+    };
+
+    char *p = item->fields;
+    for (i = 0; i < count; i++) {
+        size_t field_len = strlen(fields[i]) + 1;
+        memcpy(p, fields[i], field_len);
+        if (strcmp(p, "-")) {
+            *values[i] = p;
+        }
+        p += field_len;
+    }
+
+    return true;
+}
+
+static const tpm2_batch_ops batch_ops = {
+    .max_fields = 5,
+    .parse = batch_parse_item,
+    .process = batch_process_item,
+    .free = batch_free_items,
+};
+
+/*
+ * Generates the partial certificates of a manifest, one per line:
+ * OUTPUT [SUBJECT [VALIDITY [ISSUER [KEYUSAGE]]]]
+ */
+static tool_rc batch_run(void) {
+
+    certutil_batch *batch = malloc(sizeof(*batch));
+    if (!batch) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    tpm2_batch_stats stats;
+    tool_rc rc = tpm2_batch_run(ctx.batch_path, &batch_ops, ctx.jobs, batch,
+            &stats);
+    if (stats.is_complete) {
+        tpm2_batch_output(&stats, "certificates", ctx.jobs);
+    }
+
+    free(batch);
+
+    return rc;
+}
 
 static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
 
     UNUSED(flags);
     UNUSED(ectx);
 
-    return generate_partial_X509();
+    if (ctx.batch_path) {
+        if (ctx.is_out_path_set) {
+            LOG_ERR("The output files come from the manifest with "
+                    "**--batch**");
+            return tool_rc_option_error;
+        }
+        return batch_run();
+    }
+
+    return generate_partial_X509(&ctx.cert);
 }
 
 TPM2_TOOL_REGISTER("certifyX509certutil", tpm2_tool_onstart, tpm2_tool_onrun, NULL, NULL)
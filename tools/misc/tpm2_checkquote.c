@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
 #include <inttypes.h>
+#include <search.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -13,12 +14,17 @@
 #include "log.h"
 #include "object.h"
 #include "tpm2_alg_util.h"
+#include "tpm2_batch.h"
 #include "tpm2_convert.h"
 #include "tpm2_openssl.h"
 #include "tpm2_options.h"
+#include "tpm2_pcr_banks.h"
 #include "tpm2_systemdeps.h"
 #include "tpm2_tool.h"
 #include "tpm2_eventlog.h"
+#include "tpm2_eventlog_cache.h"
+#include "tpm2_merkle.h"
+#include "tpm2_worker.h"
 
 typedef struct tpm2_verifysig_ctx tpm2_verifysig_ctx;
 struct tpm2_verifysig_ctx {
@@ -44,49 +50,62 @@ struct tpm2_verifysig_ctx {
     char *pcr_file_path;
     const char *pubkey_file_path;
     char *eventlog_path;
+    char *proof_path; /* inclusion proof of the nonce in an aggregated quote */
     tpm2_loaded_object key_context_object;
     const char *pcr_selection_string;
+    char *batch_path; /* manifest of quotes to verify, see batch_run() */
+    unsigned jobs;
+    char *eventlog_cache_path;
+    UINT64 eventlog_cache_size;
+    tpm2_eventlog_cache *eventlog_cache; /* PCR banks replayed from the logs */
 };
 
 static tpm2_verifysig_ctx ctx = {
         .halg = TPM2_ALG_SHA256,
         .msg_hash = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer),
         .pcr_hash = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer),
+        .jobs = 1,
+        .eventlog_cache_size = TPM2_EVENTLOG_CACHE_DEFAULT_SIZE,
 };
 
-static bool verify(void) {
-
-    bool result = false;
+static bool verify_attest(TPMS_ATTEST *attest, TPM2B_DATA *extra_data,
+        const char *proof_path, TPM2B_DIGEST *pcr_hash) {
 
-    /* read the public key */
-    EVP_PKEY *pkey = NULL;
-    bool ret = tpm2_public_load_pkey(ctx.pubkey_file_path, &pkey);
-    if (!ret) {
+    // Ensure nonce is the same as given, or aggregated into the quoted root
+    if (proof_path) {
+        tpm2_merkle_proof proof;
+        if (!tpm2_merkle_proof_load(proof_path, &proof) ||
+            !tpm2_merkle_proof_verify(&proof, extra_data,
+                &attest->extraData)) {
+            LOG_ERR("Error validating nonce against aggregated quote");
+            return false;
+        }
+    } else if (attest->extraData.size != extra_data->size ||
+        memcmp(attest->extraData.buffer, extra_data->buffer,
+        extra_data->size) != 0) {
+        LOG_ERR("Error validating nonce from quote");
         return false;
     }
 
-    EVP_PKEY_CTX *pkey_ctx = EVP_PKEY_CTX_new(pkey, NULL);
-    if (!pkey_ctx) {
-        LOG_ERR("EVP_PKEY_CTX_new failed: %s", ERR_error_string(ERR_get_error(), NULL));
-        goto err;
+    // Also ensure digest from quote matches PCR digest
+    if (pcr_hash) {
+        if (!tpm2_util_verify_digests(&attest->attested.quote.pcrDigest,
+                pcr_hash)) {
+            LOG_ERR("Error validating PCR composite against signed message");
+            return false;
+        }
     }
 
-    /* get the digest alg */
-    /* TODO SPlit loading on plain vs tss format to detect the hash alg */
-    /* If its a plain sig we need -g */
-    const EVP_MD *md = tpm2_openssl_halg_from_tpmhalg(ctx.halg);
-    // TODO error handling
+    return true;
+}
 
-    int rc = EVP_PKEY_verify_init(pkey_ctx);
-    if (!rc) {
-        LOG_ERR("EVP_PKEY_verify_init failed: %s", ERR_error_string(ERR_get_error(), NULL));
-        goto err;
-    }
+static bool verify(void) {
 
-    rc = EVP_PKEY_CTX_set_signature_md(pkey_ctx, md);
-    if (!rc) {
-        LOG_ERR("EVP_PKEY_CTX_set_signature_md failed: %s", ERR_error_string(ERR_get_error(), NULL));
-        goto err;
+    /* read the public key */
+    EVP_PKEY *pkey = NULL;
+    bool ret = tpm2_public_load_pkey(ctx.pubkey_file_path, &pkey);
+    if (!ret) {
+        return false;
     }
 
     /* TODO dump actual signature */
@@ -94,42 +113,14 @@ static bool verify(void) {
     tpm2_util_hexdump(ctx.signature.buffer, ctx.signature.size);
     tpm2_tool_output("\n");
 
-    // Verify the signature matches message digest
-
-    rc = EVP_PKEY_verify(pkey_ctx, ctx.signature.buffer, ctx.signature.size,
-            ctx.msg_hash.buffer, ctx.msg_hash.size);
-    if (rc != 1) {
-        if (rc == 0) {
-            LOG_ERR("Error validating signed message with public key provided");
-        } else {
-            LOG_ERR("Error %s", ERR_error_string(ERR_get_error(), NULL));
-        }
-        goto err;
-    }
-
-    // Ensure nonce is the same as given
-    if (ctx.attest.extraData.size != ctx.extra_data.size ||
-        memcmp(ctx.attest.extraData.buffer, ctx.extra_data.buffer,
-        ctx.extra_data.size) != 0) {
-        LOG_ERR("Error validating nonce from quote");
-        goto err;
-    }
-
-    // Also ensure digest from quote matches PCR digest
-    if (ctx.flags.pcr) {
-        if (!tpm2_util_verify_digests(&ctx.attest.attested.quote.pcrDigest,
-                &ctx.pcr_hash)) {
-            LOG_ERR("Error validating PCR composite against signed message");
-            goto err;
-        }
+    bool result = tpm2_openssl_verify_signature(pkey, ctx.halg, &ctx.signature,
+            &ctx.msg_hash);
+    if (result) {
+        result = verify_attest(&ctx.attest, &ctx.extra_data, ctx.proof_path,
+                ctx.flags.pcr ? &ctx.pcr_hash : NULL);
     }
 
-    result = true;
-
-err:
-
     EVP_PKEY_free(pkey);
-    EVP_PKEY_CTX_free(pkey_ctx);
 
     return result;
 }
@@ -329,35 +320,102 @@ out:
     return result;
 }
 
-static bool eventlog_from_file(tpm2_eventlog_context *evctx, const char *file_path) {
+/*
+ * Replays the event log into PCR banks, through the event log cache when one
+ * is given.
+ */
+static tpm2_pcr_banks *eventlog_from_file(const char *file_path) {
 
     unsigned long size;
 
     if (!files_get_file_size_path(file_path, &size)) {
-        return false;
+        return NULL;
     }
 
     if (!size) {
         LOG_ERR("The eventlog file \"%s\" is empty", file_path);
-        return false;
+        return NULL;
     }
 
     uint8_t *eventlog = calloc(1, size);
     if (!eventlog) {
         LOG_ERR("OOM");
-        return false;
+        return NULL;
     }
 
-    uint16_t size_tmp = size;
-    if (!files_load_bytes_from_path(file_path, eventlog, &size_tmp)) {
+    /* read the whole log, files_load_bytes_from_path() is limited to 64KiB */
+    FILE *f = fopen(file_path, "rb");
+    if (!f) {
+        LOG_ERR("Could not open eventlog file \"%s\"", file_path);
         free(eventlog);
-        return false;
+        return NULL;
     }
 
-    bool rc = parse_eventlog(evctx, eventlog, size);
+    bool result = files_read_bytes(f, eventlog, size);
+    fclose(f);
+    if (!result) {
+        LOG_ERR("Could not read eventlog file \"%s\"", file_path);
+        free(eventlog);
+        return NULL;
+    }
+
+    tpm2_pcr_banks *banks = tpm2_eventlog_cache_replay(ctx.eventlog_cache,
+            eventlog, size);
     free(eventlog);
 
-    return rc;
+    return banks;
+}
+
+/*
+ * Loads the quoted PCR values and computes their digest for comparison with
+ * the PCR digest of the quote.
+ */
+static bool quote_pcrs_from_file(const char *pcr_file_path,
+        TPMI_ALG_HASH halg, TPML_PCR_SELECTION *pcr_select, tpm2_pcrs *pcrs,
+        TPM2B_DIGEST *pcr_hash) {
+
+    if (!pcrs_from_file(pcr_file_path, pcr_select, pcrs)) {
+        /* pcrs_from_file() logs specific error no need to here */
+        return false;
+    }
+
+    if (le32toh(pcr_select->count) > TPM2_NUM_PCR_BANKS)
+        return false;
+
+    UINT32 i;
+    for (i = 0; i < le32toh(pcr_select->count); i++)
+        if (le16toh(pcr_select->pcrSelections[i].hash) == TPM2_ALG_ERROR)
+        return false;
+
+    if (!tpm2_openssl_hash_pcr_banks_le(halg, pcr_select, pcrs, pcr_hash)) {
+        LOG_ERR("Failed to hash PCR values related to quote!");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Compares the quoted PCR values against the PCR values computed by replaying
+ * the event log.
+ */
+static bool eventlog_matches_pcrs(const char *eventlog_path,
+        const TPML_PCR_SELECTION *pcr_select, const tpm2_pcrs *pcrs) {
+
+    tpm2_pcr_banks *banks = eventlog_from_file(eventlog_path);
+    if (!banks) {
+        LOG_ERR("Failed to process eventlog");
+        return false;
+    }
+
+    bool result = tpm2_pcr_banks_compare(banks, pcr_select, pcrs);
+    if (!result) {
+        LOG_ERR("Eventlog and quote PCR mismatch");
+    }
+
+    tpm2_pcr_banks_free(banks);
+
+    return result;
 }
 
 static tool_rc init(void) {
@@ -426,26 +484,14 @@ static tool_rc init(void) {
     }
 
     if (ctx.flags.pcr) {
-        if (pcrs_from_file(ctx.pcr_file_path, &pcr_select, &temp_pcrs)) {
-            /* pcrs_from_file() logs specific error no need to here */
+        if (quote_pcrs_from_file(ctx.pcr_file_path, ctx.halg, &pcr_select,
+                &temp_pcrs, &ctx.pcr_hash)) {
+            /* quote_pcrs_from_file() logs specific error no need to here */
             pcrs = &temp_pcrs;
         } else {
             goto err;
         }
 
-        if (le32toh(pcr_select.count) > TPM2_NUM_PCR_BANKS)
-            goto err;
-
-        UINT32 i;
-        for (i = 0; i < le32toh(pcr_select.count); i++)
-            if (le16toh(pcr_select.pcrSelections[i].hash) == TPM2_ALG_ERROR)
-            goto err;
-
-        if (!tpm2_openssl_hash_pcr_banks_le(ctx.halg, &pcr_select, pcrs,
-                &ctx.pcr_hash)) {
-            LOG_ERR("Failed to hash PCR values related to quote!");
-            goto err;
-        }
         if (!pcr_print_pcr_struct_le(&pcr_select, pcrs)) {
             LOG_ERR("Failed to print PCR values related to quote!");
             goto err;
@@ -463,70 +509,7 @@ static tool_rc init(void) {
         if (pcr_select.count > TPM2_NUM_PCR_BANKS)
             goto err;
 
-        tpm2_eventlog_context eventlog_ctx = { 0 };
-        bool rc = eventlog_from_file(&eventlog_ctx, ctx.eventlog_path);
-        if (!rc) {
-            LOG_ERR("Failed to process eventlog");
-            goto err;
-        }
-
-        bool eventlog_fail = false;
-        unsigned vi = 0;
-        unsigned di = 0;
-        for (unsigned i = 0; i < pcr_select.count; i++) {
-            const TPMS_PCR_SELECTION *const sel = &pcr_select.pcrSelections[i];
-
-            // Loop through all PCRs in this bank
-            const unsigned bank_size = sel->sizeofSelect * 8;
-            for (unsigned pcr_id = 0; pcr_id < bank_size; pcr_id++) {
-                // skip non-selected banks
-                if (!tpm2_util_is_pcr_select_bit_set(sel, pcr_id)) {
-                    continue;
-                }
-                if (vi >= pcrs->count || di >= pcrs->pcr_values[vi].count) {
-                    LOG_ERR("Something wrong, trying to print but nothing more");
-                    eventlog_fail = true;
-                    break;
-                }
-
-                // Compare this digest to the computed value from the eventlog
-                const TPM2B_DIGEST *pcr = &pcrs->pcr_values[vi].digests[di];
-                const uint8_t *pcr_q = pcr->buffer;
-                const uint8_t *pcr_e = NULL;
-
-                if (sel->hash == TPM2_ALG_SHA1 && pcr->size == TPM2_SHA1_DIGEST_SIZE) {
-                    pcr_e = eventlog_ctx.sha1_pcrs[pcr_id];
-                } else if (sel->hash == TPM2_ALG_SHA256 && pcr->size == TPM2_SHA256_DIGEST_SIZE) {
-                    pcr_e = eventlog_ctx.sha256_pcrs[pcr_id];
-                } else if (sel->hash == TPM2_ALG_SHA384 && pcr->size == TPM2_SHA384_DIGEST_SIZE) {
-                    pcr_e = eventlog_ctx.sha384_pcrs[pcr_id];
-                } else if (sel->hash == TPM2_ALG_SHA512 && pcr->size == TPM2_SHA512_DIGEST_SIZE) {
-                    pcr_e = eventlog_ctx.sha512_pcrs[pcr_id];
-                } else if (sel->hash == TPM2_ALG_SM3_256 && pcr->size == TPM2_SM3_256_DIGEST_SIZE) {
-                    pcr_e = eventlog_ctx.sm3_256_pcrs[pcr_id];
-                } else {
-                    LOG_WARN("PCR%u unsupported algorithm/size %u/%u", pcr_id, sel->hash, pcr->size);
-                    eventlog_fail = 1;
-                }
-
-                if (pcr_e && memcmp(pcr_e, pcr_q, pcr->size) != 0) {
-                    LOG_WARN("PCR%u mismatch", pcr_id);
-                    eventlog_fail = 1;
-                }
-
-                if (++di < pcrs->pcr_values[vi].count) {
-                    continue;
-                }
-
-                di = 0;
-                if (++vi < pcrs->count) {
-                    continue;
-                }
-            }
-        }
-
-        if (eventlog_fail) {
-            LOG_ERR("Eventlog and quote PCR mismatch");
+        if (!eventlog_matches_pcrs(ctx.eventlog_path, &pcr_select, pcrs)) {
             goto err;
         }
     }
@@ -553,6 +536,344 @@ err:
     return return_value;
 }
 
+/*
+ * Public keys of the attestation keys referenced by the manifest, parsed once
+ * per batch however many quotes they signed.
+ */
+typedef struct checkquote_key checkquote_key;
+struct checkquote_key {
+    char *path;
+    EVP_PKEY *pkey; /* NULL if the key failed to load */
+    checkquote_key *next;
+};
+
+typedef struct checkquote_batch_item checkquote_batch_item;
+struct checkquote_batch_item {
+    EVP_PKEY *pkey;
+    char *msg_path;
+    char *sig_path;
+    char *pcr_path;
+    char *eventlog_path;
+    char *proof_path;
+    TPM2B_DATA extra_data;
+    bool is_valid;
+    bool is_verified;
+    size_t line;
+};
+
+typedef struct checkquote_batch checkquote_batch;
+struct checkquote_batch {
+    void *key_tree;
+    checkquote_key *keys;
+    checkquote_batch_item items[TPM2_BATCH_CHUNK];
+};
+
+static int key_compare(const void *a, const void *b) {
+
+    const checkquote_key *key_a = a;
+    const checkquote_key *key_b = b;
+
+    return strcmp(key_a->path, key_b->path);
+}
+
+static EVP_PKEY *batch_get_pkey(checkquote_batch *batch, const char *path) {
+
+    checkquote_key lookup = { .path = (char *) path };
+    checkquote_key **found = tfind(&lookup, &batch->key_tree, key_compare);
+    if (found) {
+        return (*found)->pkey;
+    }
+
+    checkquote_key *key = calloc(1, sizeof(*key));
+    if (!key) {
+        LOG_ERR("oom");
+        return NULL;
+    }
+
+    key->path = strdup(path);
+    if (!key->path) {
+        LOG_ERR("oom");
+        free(key);
+        return NULL;
+    }
+
+    if (!tsearch(key, &batch->key_tree, key_compare)) {
+        LOG_ERR("oom");
+        free(key->path);
+        free(key);
+        return NULL;
+    }
+
+    key->next = batch->keys;
+    batch->keys = key;
+
+    /* failures are cached as well so the error is only reported once */
+    bool result = tpm2_public_load_pkey(path, &key->pkey);
+    if (!result) {
+        key->pkey = NULL;
+    }
+
+    return key->pkey;
+}
+
+static void batch_free_keys(checkquote_batch *batch) {
+
+    checkquote_key *key = batch->keys;
+    while (key) {
+        checkquote_key *next = key->next;
+        tdelete(key, &batch->key_tree, key_compare);
+        EVP_PKEY_free(key->pkey);
+        free(key->path);
+        free(key);
+        key = next;
+    }
+
+    batch->keys = NULL;
+}
+
+/*
+ * Runs on the worker threads, only touches the item at index and the shared,
+ * read only, public keys.
+ */
+static bool batch_verify_item(void *userdata, size_t index) {
+
+    checkquote_batch *batch = (checkquote_batch *) userdata;
+    checkquote_batch_item *item = &batch->items[index];
+
+    bool result = false;
+    TPM2B_ATTEST *msg = NULL;
+
+    if (!item->is_valid) {
+        goto out;
+    }
+
+    msg = message_from_file(item->msg_path);
+    if (!msg) {
+        goto out;
+    }
+
+    TPMI_ALG_HASH halg = ctx.halg;
+    TPMI_ALG_HASH expected_halg = TPM2_ALG_ERROR;
+    TPM2B_MAX_BUFFER signature;
+    result = tpm2_convert_sig_load_plain(item->sig_path, &signature,
+            &expected_halg);
+    if (!result) {
+        goto out;
+    }
+
+    if (expected_halg != TPM2_ALG_NULL) {
+        halg = expected_halg;
+    }
+
+    TPMS_ATTEST attest;
+    tool_rc rc = files_tpm2b_attest_to_tpms_attest(msg, &attest);
+    if (rc != tool_rc_success) {
+        result = false;
+        goto out;
+    }
+
+    TPM2B_DIGEST msg_hash = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
+    result = tpm2_openssl_hash_compute_data(halg, msg->attestationData,
+            msg->size, &msg_hash);
+    if (!result) {
+        LOG_ERR("Compute message hash failed!");
+        goto out;
+    }
+
+    result = tpm2_openssl_verify_signature(item->pkey, halg, &signature, &msg_hash);
+    if (!result) {
+        goto out;
+    }
+
+    TPML_PCR_SELECTION pcr_select;
+    tpm2_pcrs pcrs = {};
+    TPM2B_DIGEST pcr_hash = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
+    if (item->pcr_path) {
+        result = quote_pcrs_from_file(item->pcr_path, halg, &pcr_select,
+                &pcrs, &pcr_hash);
+        if (!result) {
+            goto out;
+        }
+    }
+
+    result = verify_attest(&attest, &item->extra_data, item->proof_path,
+            item->pcr_path ? &pcr_hash : NULL);
+    if (!result) {
+        goto out;
+    }
+
+    if (item->eventlog_path) {
+        result = eventlog_matches_pcrs(item->eventlog_path, &pcr_select,
+                &pcrs);
+        if (!result) {
+            goto out;
+        }
+    }
+
+out:
+    free(msg);
+
+    item->is_verified = result;
+    if (!result) {
+        LOG_ERR("Failed to verify the quote on line %zu of the manifest",
+                item->line);
+    }
+
+    return result;
+}
+
+static void batch_free_items(void *userdata, size_t count) {
+
+    checkquote_batch *batch = (checkquote_batch *) userdata;
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        free(batch->items[i].msg_path);
+        free(batch->items[i].sig_path);
+        free(batch->items[i].pcr_path);
+        free(batch->items[i].eventlog_path);
+        free(batch->items[i].proof_path);
+    }
+}
+
+static char *optional_field_dup(char **fields, size_t count, size_t index,
+        bool *is_oom) {
+
+    if (index >= count || !strcmp(fields[index], "-")) {
+        return NULL;
+    }
+
+    char *value = strdup(fields[index]);
+    if (!value) {
+        *is_oom = true;
+    }
+
+    return value;
+}
+
+/*
+ * Manifest lines are:
+ *   PUBLIC MESSAGE SIGNATURE [PCR [EVENTLOG [QUALIFICATION [PROOF]]]]
+ * where "-" skips an optional field. With a PROOF, QUALIFICATION is the nonce
+ * aggregated into the quote.
+ */
+static bool batch_parse_item(void *userdata, size_t index, char **fields,
+        size_t count, size_t line) {
+
+    checkquote_batch *batch = (checkquote_batch *) userdata;
+    checkquote_batch_item *item = &batch->items[index];
+    memset(item, 0, sizeof(*item));
+    item->line = line;
+
+    if (count < 3) {
+        LOG_ERR("Expected PUBLIC MESSAGE SIGNATURE [PCR [EVENTLOG "
+                "[QUALIFICATION [PROOF]]]]");
+        return false;
+    }
+
+    bool is_oom = false;
+    item->msg_path = strdup(fields[1]);
+    item->sig_path = strdup(fields[2]);
+    item->pcr_path = optional_field_dup(fields, count, 3, &is_oom);
+    item->eventlog_path = optional_field_dup(fields, count, 4, &is_oom);
+    item->proof_path = optional_field_dup(fields, count, 6, &is_oom);
+    if (!item->msg_path || !item->sig_path || is_oom) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    /* the item is not verified, but the rest of the batch is */
+    item->pkey = batch_get_pkey(batch, fields[0]);
+    if (!item->pkey) {
+        return true;
+    }
+
+    if (item->eventlog_path && !item->pcr_path) {
+        LOG_ERR("PCR file is required to validate eventlog");
+        return true;
+    }
+
+    if (count > 5 && strcmp(fields[5], "-")) {
+        item->extra_data.size = sizeof(item->extra_data.buffer);
+        bool result = tpm2_util_bin_from_hex_or_file(fields[5],
+                &item->extra_data.size, item->extra_data.buffer);
+        if (!result) {
+            LOG_ERR("Invalid qualification \"%s\"", fields[5]);
+            return true;
+        }
+    }
+
+    if (item->proof_path && !item->extra_data.size) {
+        LOG_ERR("PROOF requires the aggregated nonce as QUALIFICATION");
+        return true;
+    }
+
+    item->is_valid = true;
+
+    return true;
+}
+
+/* the verdicts are output in manifest order */
+static tool_rc batch_print_items(void *userdata, size_t count) {
+
+    checkquote_batch *batch = (checkquote_batch *) userdata;
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        checkquote_batch_item *item = &batch->items[i];
+        tpm2_tool_output("  - line: %zu\n", item->line);
+        /* unset for the items of invalid manifest lines */
+        if (item->msg_path) {
+            tpm2_tool_output("    message: %s\n", item->msg_path);
+        }
+        tpm2_tool_output("    verified: %s\n",
+                item->is_verified ? "true" : "false");
+    }
+
+    return tool_rc_success;
+}
+
+static const tpm2_batch_ops batch_ops = {
+    .max_fields = 7,
+    .parse = batch_parse_item,
+    .process = batch_verify_item,
+    .complete = batch_print_items,
+    .free = batch_free_items,
+};
+
+/*
+ * Verifies the quotes of the manifest, the public keys are parsed once for the
+ * whole manifest.
+ */
+static tool_rc batch_run(void) {
+
+    checkquote_batch *batch = calloc(1, sizeof(*batch));
+    if (!batch) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    tpm2_tool_output("quotes:\n");
+
+    tpm2_batch_stats stats;
+    tool_rc rc = tpm2_batch_run(ctx.batch_path, &batch_ops, ctx.jobs, batch,
+            &stats);
+    if (stats.is_complete) {
+        tpm2_batch_output(&stats, "quotes", ctx.jobs);
+        if (ctx.eventlog_cache) {
+            size_t hits, misses;
+            tpm2_eventlog_cache_stats(ctx.eventlog_cache, &hits, &misses);
+            tpm2_tool_output("  eventlog-cache-hits: %zu\n", hits);
+            tpm2_tool_output("  eventlog-cache-misses: %zu\n", misses);
+        }
+    }
+
+    batch_free_keys(batch);
+    free(batch);
+
+    return rc;
+}
+
 static bool on_option(char key, char *value) {
 
     switch (key) {
@@ -596,6 +917,24 @@ static bool on_option(char key, char *value) {
     case 'l':
         ctx.pcr_selection_string = value;
         break;
+    case 0:
+        ctx.batch_path = value;
+        break;
+    case 1:
+        return tpm2_worker_jobs_from_optarg(value, &ctx.jobs);
+    case 2:
+        ctx.proof_path = value;
+        break;
+    case 3:
+        ctx.eventlog_cache_path = value;
+        break;
+    case 4:
+        if (!tpm2_util_string_to_uint64(value, &ctx.eventlog_cache_size)) {
+            LOG_ERR("Could not convert eventlog cache size, got: \"%s\"",
+                    value);
+            return false;
+        }
+        break;
         /* no default */
     }
 
@@ -614,6 +953,11 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
             { "pcr-list",           required_argument, NULL, 'l' },
             { "public",             required_argument, NULL, 'u' },
             { "qualification",      required_argument, NULL, 'q' },
+            { "batch",              required_argument, NULL,  0  },
+            { "jobs",               required_argument, NULL,  1  },
+            { "proof",              required_argument, NULL,  2  },
+            { "eventlog-cache",     required_argument, NULL,  3  },
+            { "eventlog-cache-size",required_argument, NULL,  4  },
     };
 
 
@@ -628,6 +972,31 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
     UNUSED(ectx);
     UNUSED(flags);
 
+    if (ctx.eventlog_cache_path) {
+        ctx.eventlog_cache = tpm2_eventlog_cache_open(ctx.eventlog_cache_path,
+                ctx.eventlog_cache_size);
+        if (!ctx.eventlog_cache) {
+            return tool_rc_general_error;
+        }
+    }
+
+    if (ctx.batch_path) {
+        if (ctx.pubkey_file_path || ctx.flags.msg || ctx.flags.sig ||
+            ctx.flags.pcr || ctx.flags.eventlog || ctx.extra_data.size ||
+            ctx.proof_path) {
+            LOG_ERR("Options u, m, s, f, e, q and --proof come from the "
+                    "manifest with --batch");
+            return tool_rc_option_error;
+        }
+
+        return batch_run();
+    }
+
+    if (ctx.proof_path && !ctx.extra_data.size) {
+        LOG_ERR("--proof requires the aggregated nonce given with -q");
+        return tool_rc_option_error;
+    }
+
     /* initialize and process */
     tool_rc rc = init();
     if (rc != tool_rc_success) {
@@ -643,5 +1012,10 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
     return tool_rc_success;
 }
 
+static void tpm2_tool_onexit(void) {
+
+    tpm2_eventlog_cache_close(ctx.eventlog_cache);
+}
+
 // Register this tool with tpm2_tool.c
-TPM2_TOOL_REGISTER("checkquote", tpm2_tool_onstart, tpm2_tool_onrun, NULL, NULL)
+TPM2_TOOL_REGISTER("checkquote", tpm2_tool_onstart, tpm2_tool_onrun, NULL, tpm2_tool_onexit)
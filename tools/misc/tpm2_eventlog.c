@@ -14,22 +14,115 @@
 
 #define CHUNK_SIZE 16384
 
-static char *filename = NULL;
+static char **filenames = NULL;
+static int filename_count = 0;
 
 /* Set the default YAML version */
 static uint32_t eventlog_version = 1;
 
+/* the events to print, every event when not is_query */
+static tpm2_eventlog_query query;
+static bool is_query = false;
+
 static bool on_positional(int argc, char **argv) {
 
-    if (argc != 1) {
-        LOG_ERR("Expected one file name as a positional parameter. Got: %d",
+    if (argc < 1) {
+        LOG_ERR("Expected file names as positional parameters. Got: %d",
                 argc);
         return false;
     }
 
-    filename = argv[0];
+    filenames = argv;
+    filename_count = argc;
+
+    return true;
+}
+
+static void query_init(void) {
+
+    if (!is_query) {
+        tpm2_eventlog_query_init(&query);
+        is_query = true;
+    }
+}
+
+static bool query_pcrs_from_optarg(char *value) {
+
+    char *saveptr = NULL;
+    char *token;
+    for (token = strtok_r(value, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        uint32_t pcr;
+        if (!tpm2_util_string_to_uint32(token, &pcr) ||
+            pcr >= sizeof(query.pcrs) * 8) {
+            LOG_ERR("Invalid PCR index, got: \"%s\"", token);
+            return false;
+        }
+        query.pcrs |= 1u << pcr;
+    }
+
+    return true;
+}
+
+static bool query_types_from_optarg(char *value) {
+
+    char *saveptr = NULL;
+    char *token;
+    for (token = strtok_r(value, ",", &saveptr); token;
+         token = strtok_r(NULL, ",", &saveptr)) {
+        if (query.type_count == ARRAY_LEN(query.types)) {
+            LOG_ERR("Expected at most %zu event types",
+                    ARRAY_LEN(query.types));
+            return false;
+        }
+        if (!eventtype_from_string(token,
+                &query.types[query.type_count])) {
+            LOG_ERR("Unknown event type, got: \"%s\"", token);
+            return false;
+        }
+        query.type_count++;
+    }
+
+    return true;
+}
+
+/*
+ * Parses a range of event numbers, FIRST:LAST where either number may be
+ * omitted, or a single event number.
+ */
+static bool query_events_from_optarg(char *value) {
+
+    char *last = strchr(value, ':');
+    if (last) {
+        *last++ = '\0';
+    }
+
+    uint64_t number;
+    if (*value) {
+        if (!tpm2_util_string_to_uint64(value, &number)) {
+            goto err;
+        }
+        query.first = number;
+    }
+
+    if (!last) {
+        query.last = query.first;
+    } else if (*last) {
+        if (!tpm2_util_string_to_uint64(last, &number)) {
+            goto err;
+        }
+        query.last = number;
+    }
+
+    if (query.first > query.last) {
+        goto err;
+    }
 
     return true;
+
+err:
+    LOG_ERR("Invalid range of event numbers, expected FIRST:LAST");
+    return false;
 }
 
 static bool on_option(char key, char *value) {
@@ -48,6 +141,27 @@ static bool on_option(char key, char *value) {
         }
         eventlog_version = version;
         break;
+    case 1:
+        query_init();
+        return query_pcrs_from_optarg(value);
+    case 2:
+        query_init();
+        return query_types_from_optarg(value);
+    case 3:
+        query_init();
+        return query_events_from_optarg(value);
+    case 4: {
+        query_init();
+        query.digest.size = sizeof(query.digest.buffer);
+        int rc = tpm2_util_hex_to_byte_structure(value, &query.digest.size,
+                query.digest.buffer);
+        if (rc || !query.digest.size) {
+            LOG_ERR("Invalid digest, expected a hex string, got: \"%s\"",
+                    value);
+            return false;
+        }
+    }
+        break;
     }
     return true;
 }
@@ -56,6 +170,10 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
 
     static struct option topts[] = {
          { "eventlog-version",         required_argument, NULL, 0 },
+         { "pcr",                      required_argument, NULL, 1 },
+         { "type",                     required_argument, NULL, 2 },
+         { "events",                   required_argument, NULL, 3 },
+         { "digest",                   required_argument, NULL, 4 },
     };
 
     *opts = tpm2_options_new("y:", ARRAY_LEN(topts), topts, on_option,
@@ -64,55 +182,76 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
     return *opts != NULL;
 }
 
-static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
-
-    UNUSED(flags);
-    UNUSED(ectx);
-
-    if (filename == NULL) {
-        LOG_ERR("Missing required positional parameter, try -h / --help");
-        return tool_rc_option_error;
-    }
+/*
+ * Reads the file in chunks. Usually the file will reside in securityfs, and
+ * those files do not have a public file size.
+ */
+static UINT8 *eventlog_read(const char *path, size_t *size) {
 
-    /* Read the file in chunks.  Usually the file will reside in
-       securityfs, and those files do not have a public file size */
-    tool_rc rc = tool_rc_success;
-    FILE *fileptr = fopen(filename, "rb");
+    FILE *fileptr = fopen(path, "rb");
     if (!fileptr) {
-        return tool_rc_general_error;
+        LOG_ERR("Could not open file \"%s\" error: \"%s\"", path,
+                strerror(errno));
+        return NULL;
     }
 
     /* Reserve the buffer for the first chunk */
     UINT8 *eventlog = calloc(1, CHUNK_SIZE);
     if (eventlog == NULL){
         LOG_ERR("failed to allocate %d bytes: %s", CHUNK_SIZE, strerror(errno));
-        return tool_rc_general_error;
+        fclose(fileptr);
+        return NULL;
     }
 
-    unsigned long size = 0;
+    *size = 0;
     bool is_file_read = false;
     do {
-        is_file_read = files_read_bytes_chunk(fileptr, eventlog, CHUNK_SIZE, &size);
-        UINT8 *eventlog_tmp = realloc(eventlog, size + CHUNK_SIZE);
+        /* every chunk is read after the previous ones */
+        is_file_read = files_read_bytes_chunk(fileptr, eventlog + *size,
+                CHUNK_SIZE, size);
+        UINT8 *eventlog_tmp = realloc(eventlog, *size + CHUNK_SIZE);
         if (!eventlog_tmp){
-            LOG_ERR("failed to allocate %lu bytes: %s", size + CHUNK_SIZE, strerror(errno));
-            rc = tool_rc_general_error;
-            goto out;
+            LOG_ERR("failed to allocate %zu bytes: %s", *size + CHUNK_SIZE,
+                    strerror(errno));
+            free(eventlog);
+            eventlog = NULL;
+            break;
         }
         eventlog = eventlog_tmp;
     } while (is_file_read);
     fclose(fileptr);
 
-    /* Parse eventlog data */
-    bool ret = yaml_eventlog(eventlog, size, eventlog_version);
-    if (!ret) {
-        LOG_ERR("failed to parse tpm2 eventlog");
-        rc = tool_rc_general_error;
+    return eventlog;
+}
+
+static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
+
+    UNUSED(flags);
+    UNUSED(ectx);
+
+    if (!filename_count) {
+        LOG_ERR("Missing required positional parameter, try -h / --help");
+        return tool_rc_option_error;
     }
 
-out:
-    if (eventlog) {
+    /* every log is a YAML document of its own */
+    tool_rc rc = tool_rc_success;
+    int i;
+    for (i = 0; i < filename_count; i++) {
+        size_t size;
+        UINT8 *eventlog = eventlog_read(filenames[i], &size);
+        if (!eventlog) {
+            return tool_rc_general_error;
+        }
+
+        /* Parse eventlog data */
+        bool ret = yaml_eventlog_query(eventlog, size, eventlog_version,
+                is_query ? &query : NULL);
         free(eventlog);
+        if (!ret) {
+            LOG_ERR("failed to parse tpm2 eventlog \"%s\"", filenames[i]);
+            rc = tool_rc_general_error;
+        }
     }
 
     return rc;
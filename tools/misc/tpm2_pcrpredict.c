@@ -0,0 +1,603 @@
+/* SPDX-License-Identifier: BSD-3-Clause */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <tss2/tss2_mu.h>
+
+#include "files.h"
+#include "log.h"
+#include "pcr.h"
+#include "tpm2_alg_util.h"
+#include "tpm2_batch.h"
+#include "tpm2_eventlog.h"
+#include "tpm2_openssl.h"
+#include "tpm2_pcr_banks.h"
+#include "tpm2_tool.h"
+#include "tpm2_worker.h"
+
+#define CHUNK_SIZE 16384
+
+/*
+ * Maximum number of substitutions of a candidate, or given with -s.
+ */
+#define PCRPREDICT_MAX_RULES 16
+
+/*
+ * Replaces the digests of an event, identified by its EventNum as output by
+ * tpm2_eventlog.
+ */
+typedef struct pcrpredict_rule pcrpredict_rule;
+struct pcrpredict_rule {
+    UINT32 event;
+    TPML_DIGEST_VALUES digests;
+};
+
+typedef struct tpm_pcrpredict_ctx tpm_pcrpredict_ctx;
+struct tpm_pcrpredict_ctx {
+    const char *eventlog_path;
+    BYTE *eventlog;
+    size_t eventlog_size;
+    /* offsets of the TCG_PCR_EVENT2 records, events[0] is EventNum 1 */
+    size_t *events;
+    size_t event_count;
+
+    TPML_PCR_SELECTION pcr_selection;
+    bool is_pcr_selection;
+    TPMI_ALG_HASH halg;
+
+    pcrpredict_rule rules[PCRPREDICT_MAX_RULES];
+    size_t rule_count;
+
+    const char *pcrs_output_path;
+    const char *policy_output_path;
+
+    const char *candidates_path;
+    unsigned jobs;
+};
+
+static tpm_pcrpredict_ctx ctx = {
+    .halg = TPM2_ALG_SHA256,
+    .jobs = 1,
+};
+
+/*
+ * Parses EVENT:<hash alg>=<hash value>,...
+ */
+static bool parse_rule(char *str, pcrpredict_rule *rule) {
+
+    char *digests = strchr(str, ':');
+    if (!digests) {
+        LOG_ERR("Expecting : in substitution, not found, got: \"%s\"", str);
+        return false;
+    }
+
+    *digests++ = '\0';
+
+    bool result = tpm2_util_string_to_uint32(str, &rule->event);
+    if (!result || !rule->event) {
+        LOG_ERR("Invalid event number, got: \"%s\"", str);
+        return false;
+    }
+
+    result = pcr_parse_digest_values(digests, &rule->digests);
+    if (!result) {
+        LOG_ERR("Missing or invalid <hash alg>=<hash value> spec for event:"
+                " \"%s\"", str);
+    }
+
+    return result;
+}
+
+typedef struct eventlog_index eventlog_index;
+struct eventlog_index {
+    /* first, foreach_event2() reads it to report digest mismatches */
+    size_t eventnum;
+    size_t capacity;
+    size_t *events;
+};
+
+static bool index_event2hdr_callback(TCG_EVENT_HEADER2 const *eventhdr,
+        size_t size, void *data) {
+
+    UNUSED(size);
+
+    eventlog_index *index = (eventlog_index *) data;
+
+    if (index->eventnum > index->capacity) {
+        size_t capacity = index->capacity ? index->capacity * 2 : 256;
+        size_t *events = realloc(index->events, capacity * sizeof(*events));
+        if (!events) {
+            LOG_ERR("oom");
+            return false;
+        }
+        index->events = events;
+        index->capacity = capacity;
+    }
+
+    index->events[index->eventnum - 1] =
+            (uintptr_t) eventhdr - (uintptr_t) ctx.eventlog;
+    index->eventnum++;
+
+    return true;
+}
+
+static bool eventlog_load(void) {
+
+    FILE *fileptr = fopen(ctx.eventlog_path, "rb");
+    if (!fileptr) {
+        LOG_ERR("Could not open event log \"%s\", error: %s",
+                ctx.eventlog_path, strerror(errno));
+        return false;
+    }
+
+    /* securityfs files do not have a public file size, read in chunks */
+    size_t size = 0;
+    bool is_file_read = false;
+    do {
+        BYTE *eventlog = realloc(ctx.eventlog, size + CHUNK_SIZE);
+        if (!eventlog) {
+            LOG_ERR("failed to allocate %zu bytes: %s", size + CHUNK_SIZE,
+                    strerror(errno));
+            fclose(fileptr);
+            return false;
+        }
+        ctx.eventlog = eventlog;
+        is_file_read = files_read_bytes_chunk(fileptr, ctx.eventlog + size,
+                CHUNK_SIZE, &size);
+    } while (is_file_read);
+    fclose(fileptr);
+
+    ctx.eventlog_size = size;
+
+    /* EventNum 0 is the Spec ID event */
+    eventlog_index index = { .eventnum = 1 };
+    tpm2_eventlog_context evctx = {
+        .data = &index,
+        .event2hdr_cb = index_event2hdr_callback,
+    };
+
+    bool result = parse_eventlog(&evctx, ctx.eventlog, ctx.eventlog_size);
+    if (!result) {
+        LOG_ERR("Failed to parse event log \"%s\"", ctx.eventlog_path);
+        free(index.events);
+        return false;
+    }
+
+    ctx.events = index.events;
+    ctx.event_count = index.eventnum - 1;
+
+    return true;
+}
+
+static bool apply_rules(BYTE *eventlog, const pcrpredict_rule *rules,
+        size_t count) {
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        const pcrpredict_rule *rule = &rules[i];
+        if (rule->event > ctx.event_count) {
+            LOG_ERR("Event %u is not in the crypto agile event log, "
+                    "got %zu events", rule->event, ctx.event_count);
+            return false;
+        }
+
+        TCG_EVENT_HEADER2 *eventhdr =
+                (TCG_EVENT_HEADER2 *) (eventlog + ctx.events[rule->event - 1]);
+
+        UINT32 j;
+        for (j = 0; j < rule->digests.count; j++) {
+            const TPMT_HA *ha = &rule->digests.digests[j];
+
+            TCG_DIGEST2 *digest = eventhdr->Digests;
+            UINT32 k;
+            for (k = 0; k < eventhdr->DigestCount; k++) {
+                UINT16 size = tpm2_alg_util_get_hash_size(
+                        digest->AlgorithmId);
+                if (digest->AlgorithmId == ha->hashAlg) {
+                    memcpy(digest->Digest, &ha->digest, size);
+                    break;
+                }
+                digest = (TCG_DIGEST2 *) (digest->Digest + size);
+            }
+
+            if (k == eventhdr->DigestCount) {
+                LOG_ERR("Event %u has no %s digest", rule->event,
+                        tpm2_alg_util_algtostr(ha->hashAlg,
+                                tpm2_alg_util_flags_hash));
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * The policy digest of a trial session after TPM2_PolicyPCR:
+ *   H(0...0 || TPM_CC_PolicyPCR || pcrs || H(selected PCR values))
+ */
+static bool policy_pcr_digest(tpm2_pcrs *pcrs, TPM2B_DIGEST *policy) {
+
+    TPM2B_DIGEST pcr_digest = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
+    bool result = tpm2_openssl_hash_pcr_banks(ctx.halg, &ctx.pcr_selection,
+            pcrs, &pcr_digest);
+    if (!result) {
+        LOG_ERR("Could not hash pcr values");
+        return false;
+    }
+
+    BYTE buffer[sizeof(TPMU_HA) + sizeof(TPM2_CC) + sizeof(TPML_PCR_SELECTION)
+                + sizeof(TPMU_HA)] = { 0 };
+    size_t offset = tpm2_alg_util_get_hash_size(ctx.halg);
+
+    TSS2_RC rval = Tss2_MU_TPM2_CC_Marshal(TPM2_CC_PolicyPCR, buffer,
+            sizeof(buffer), &offset);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Tss2_MU_TPM2_CC_Marshal, rval);
+        return false;
+    }
+
+    rval = Tss2_MU_TPML_PCR_SELECTION_Marshal(&ctx.pcr_selection, buffer,
+            sizeof(buffer), &offset);
+    if (rval != TSS2_RC_SUCCESS) {
+        LOG_PERR(Tss2_MU_TPML_PCR_SELECTION_Marshal, rval);
+        return false;
+    }
+
+    memcpy(&buffer[offset], pcr_digest.buffer, pcr_digest.size);
+    offset += pcr_digest.size;
+
+    return tpm2_openssl_hash_compute_data(ctx.halg, buffer, offset, policy);
+}
+
+/*
+ * Replays a copy of the event log with the rules applied, the log with the
+ * -s rules applied is never modified so candidates can share it.
+ */
+static bool predict(const pcrpredict_rule *rules, size_t count,
+        tpm2_pcrs *pcrs, TPM2B_DIGEST *policy) {
+
+    BYTE *eventlog = malloc(ctx.eventlog_size);
+    if (!eventlog) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    memcpy(eventlog, ctx.eventlog, ctx.eventlog_size);
+
+    tpm2_eventlog_context evctx = {
+        .banks = tpm2_pcr_banks_new(TPM2_MAX_PCRS),
+    };
+    bool result = evctx.banks && apply_rules(eventlog, rules, count);
+    if (result) {
+        result = parse_eventlog(&evctx, eventlog, ctx.eventlog_size);
+        if (!result) {
+            LOG_ERR("Failed to replay the event log");
+        }
+    }
+
+    free(eventlog);
+
+    result = result &&
+            tpm2_pcr_banks_read(evctx.banks, &ctx.pcr_selection, pcrs) &&
+            policy_pcr_digest(pcrs, policy);
+
+    tpm2_pcr_banks_free(evctx.banks);
+
+    return result;
+}
+
+static void print_digest(const TPM2B_DIGEST *digest) {
+
+    UINT16 i;
+    for (i = 0; i < digest->size; i++) {
+        tpm2_tool_output("%02x", digest->buffer[i]);
+    }
+    tpm2_tool_output("\n");
+}
+
+static tool_rc predict_one(void) {
+
+    tpm2_pcrs pcrs;
+    TPM2B_DIGEST policy = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
+    bool result = predict(NULL, 0, &pcrs, &policy);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    result = pcr_print_pcr_struct(&ctx.pcr_selection, &pcrs);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    tpm2_tool_output("policy: ");
+    print_digest(&policy);
+
+    if (ctx.pcrs_output_path) {
+        FILE *f = fopen(ctx.pcrs_output_path, "wb+");
+        if (!f) {
+            LOG_ERR("Cannot open \"%s\": %s", ctx.pcrs_output_path,
+                    strerror(errno));
+            return tool_rc_general_error;
+        }
+
+        result = pcr_fwrite_values(&ctx.pcr_selection, &pcrs, f);
+        fclose(f);
+        if (!result) {
+            return tool_rc_general_error;
+        }
+    }
+
+    if (ctx.policy_output_path) {
+        result = files_save_bytes_to_file(ctx.policy_output_path,
+                policy.buffer, policy.size);
+        if (!result) {
+            return tool_rc_general_error;
+        }
+    }
+
+    return tool_rc_success;
+}
+
+typedef struct pcrpredict_batch_item pcrpredict_batch_item;
+struct pcrpredict_batch_item {
+    char *name;
+    pcrpredict_rule *rules;
+    size_t rule_count;
+    TPM2B_DIGEST policy;
+    bool is_predicted;
+    size_t line;
+};
+
+typedef struct pcrpredict_batch pcrpredict_batch;
+struct pcrpredict_batch {
+    pcrpredict_batch_item items[TPM2_BATCH_CHUNK];
+};
+
+/*
+ * Runs on the worker threads, only touches the item at index and the shared,
+ * read only, event log.
+ */
+static bool batch_predict_item(void *userdata, size_t index) {
+
+    pcrpredict_batch *batch = (pcrpredict_batch *) userdata;
+    pcrpredict_batch_item *item = &batch->items[index];
+
+    tpm2_pcrs pcrs;
+    item->policy.size = sizeof(item->policy.buffer);
+    item->is_predicted = predict(item->rules, item->rule_count, &pcrs,
+            &item->policy);
+    if (!item->is_predicted) {
+        LOG_ERR("Failed to predict the candidate on line %zu of the manifest",
+                item->line);
+    }
+
+    return item->is_predicted;
+}
+
+static void batch_free_items(void *userdata, size_t count) {
+
+    pcrpredict_batch *batch = (pcrpredict_batch *) userdata;
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        free(batch->items[i].name);
+        free(batch->items[i].rules);
+    }
+}
+
+/*
+ * Manifest lines are:
+ *   NAME [RULE ...]
+ */
+static bool batch_parse_item(void *userdata, size_t index, char **fields,
+        size_t count, size_t line) {
+
+    pcrpredict_batch *batch = (pcrpredict_batch *) userdata;
+    pcrpredict_batch_item *item = &batch->items[index];
+    memset(item, 0, sizeof(*item));
+    item->line = line;
+
+    item->name = strdup(fields[0]);
+    item->rules = calloc(count, sizeof(*item->rules));
+    if (!item->name || !item->rules) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    size_t i;
+    for (i = 1; i < count; i++) {
+        bool result = parse_rule(fields[i], &item->rules[item->rule_count++]);
+        if (!result) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/* the predictions are output in manifest order */
+static tool_rc batch_print_items(void *userdata, size_t count) {
+
+    pcrpredict_batch *batch = (pcrpredict_batch *) userdata;
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        pcrpredict_batch_item *item = &batch->items[i];
+        tpm2_tool_output("  - line: %zu\n", item->line);
+        /* unset for the items of invalid manifest lines */
+        if (item->name) {
+            tpm2_tool_output("    name: %s\n", item->name);
+        }
+        tpm2_tool_output("    predicted: %s\n",
+                item->is_predicted ? "true" : "false");
+        if (item->is_predicted) {
+            tpm2_tool_output("    policy: ");
+            print_digest(&item->policy);
+        }
+    }
+
+    return tool_rc_success;
+}
+
+static const tpm2_batch_ops batch_ops = {
+    .max_fields = 1 + PCRPREDICT_MAX_RULES,
+    .parse = batch_parse_item,
+    .process = batch_predict_item,
+    .complete = batch_print_items,
+    .free = batch_free_items,
+};
+
+/*
+ * Predicts the policy of every candidate of the manifest, the candidates are
+ * replayed in parallel against the shared event log.
+ */
+static tool_rc batch_run(void) {
+
+    pcrpredict_batch *batch = malloc(sizeof(*batch));
+    if (!batch) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    tpm2_tool_output("candidates:\n");
+
+    tpm2_batch_stats stats;
+    tool_rc rc = tpm2_batch_run(ctx.candidates_path, &batch_ops, ctx.jobs,
+            batch, &stats);
+    if (stats.is_complete) {
+        tpm2_batch_output(&stats, "candidates", ctx.jobs);
+    }
+
+    free(batch);
+
+    return rc;
+}
+
+static bool on_option(char key, char *value) {
+
+    switch (key) {
+    case 'l':
+        ctx.is_pcr_selection = pcr_parse_selections(value,
+                &ctx.pcr_selection);
+        if (!ctx.is_pcr_selection) {
+            LOG_ERR("Could not parse PCR selections");
+            return false;
+        }
+        break;
+    case 'g':
+        ctx.halg = tpm2_alg_util_from_optarg(value, tpm2_alg_util_flags_hash);
+        if (ctx.halg == TPM2_ALG_ERROR) {
+            LOG_ERR("Invalid policy hash algorithm, got \"%s\"", value);
+            return false;
+        }
+        break;
+    case 's':
+        if (ctx.rule_count == ARRAY_LEN(ctx.rules)) {
+            LOG_ERR("Specified too many substitutions, max is: %zu",
+                    ARRAY_LEN(ctx.rules));
+            return false;
+        }
+        return parse_rule(value, &ctx.rules[ctx.rule_count++]);
+    case 'o':
+        ctx.pcrs_output_path = value;
+        break;
+    case 'L':
+        ctx.policy_output_path = value;
+        break;
+    case 0:
+        ctx.candidates_path = value;
+        break;
+    case 1:
+        return tpm2_worker_jobs_from_optarg(value, &ctx.jobs);
+    }
+
+    return true;
+}
+
+static bool on_positional(int argc, char **argv) {
+
+    if (argc != 1) {
+        LOG_ERR("Expected one event log file as a positional parameter. "
+                "Got: %d", argc);
+        return false;
+    }
+
+    ctx.eventlog_path = argv[0];
+
+    return true;
+}
+
+static bool tpm2_tool_onstart(tpm2_options **opts) {
+
+    static struct option topts[] = {
+        { "pcr-list",       required_argument, NULL, 'l' },
+        { "hash-algorithm", required_argument, NULL, 'g' },
+        { "substitute",     required_argument, NULL, 's' },
+        { "output",         required_argument, NULL, 'o' },
+        { "policy",         required_argument, NULL, 'L' },
+        { "candidates",     required_argument, NULL,  0  },
+        { "jobs",           required_argument, NULL,  1  },
+    };
+
+    *opts = tpm2_options_new("l:g:s:o:L:", ARRAY_LEN(topts), topts, on_option,
+                             on_positional, TPM2_OPTIONS_NO_SAPI);
+
+    return *opts != NULL;
+}
+
+static tool_rc check_options(void) {
+
+    if (!ctx.eventlog_path) {
+        LOG_ERR("Missing required positional parameter, try -h / --help");
+        return tool_rc_option_error;
+    }
+
+    if (!ctx.is_pcr_selection) {
+        LOG_ERR("Must specify the PCR selection of the policy with -l");
+        return tool_rc_option_error;
+    }
+
+    if (ctx.candidates_path &&
+            (ctx.pcrs_output_path || ctx.policy_output_path)) {
+        LOG_ERR("Options -o and -L cannot be combined with **--candidates**");
+        return tool_rc_option_error;
+    }
+
+    return tool_rc_success;
+}
+
+static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
+
+    UNUSED(flags);
+    UNUSED(ectx);
+
+    tool_rc rc = check_options();
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    bool result = eventlog_load();
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    /* the -s substitutions are common to every candidate */
+    result = apply_rules(ctx.eventlog, ctx.rules, ctx.rule_count);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    return ctx.candidates_path ? batch_run() : predict_one();
+}
+
+static void tpm2_tool_onexit(void) {
+
+    free(ctx.eventlog);
+    free(ctx.events);
+}
+
+// Register this tool with tpm2_tool.c
+TPM2_TOOL_REGISTER("pcrpredict", tpm2_tool_onstart, tpm2_tool_onrun, NULL, tpm2_tool_onexit)
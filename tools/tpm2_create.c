@@ -2,6 +2,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "files.h"
 #include "log.h"
@@ -11,6 +12,7 @@
 #include "tpm2_tool.h"
 #include "tpm2_alg_util.h"
 #include "tpm2_auth_util.h"
+#include "tpm2_key_pool.h"
 #include "tpm2_options.h"
 
 typedef struct tpm_create_ctx tpm_create_ctx;
@@ -85,6 +87,17 @@ struct tpm_create_ctx {
     char *output_path;
     bool format_set;
     tpm2_convert_pubkey_fmt format;
+
+    /*
+     * Key pool
+     */
+    struct {
+        const char *dir;
+        UINT32 fill_depth;
+        bool is_from_pool;
+        bool is_claimed;
+        tpm2_key_pool pool;
+    } pool;
 };
 
 #define DEFAULT_KEY_ALG "rsa2048"
@@ -165,6 +178,126 @@ static tool_rc create(ESYS_CONTEXT *ectx) {
     return tool_rc_success;
 }
 
+static tool_rc pool_open(ESYS_CONTEXT *ectx) {
+
+    TPM2B_NAME *parent_name = NULL;
+    tool_rc rc = tpm2_tr_get_name(ectx, ctx.parent.object.tr_handle,
+        &parent_name);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    bool result = tpm2_key_pool_open(&ctx.pool.pool, ctx.pool.dir,
+        parent_name, &ctx.object.in_public);
+    Esys_Free(parent_name);
+
+    return result ? tool_rc_success : tool_rc_general_error;
+}
+
+static tool_rc pool_fill(ESYS_CONTEXT *ectx) {
+
+    size_t depth;
+    bool result = tpm2_key_pool_depth(&ctx.pool.pool, &depth);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    tool_rc rc = tool_rc_success;
+    size_t created = 0;
+    while (depth + created < ctx.pool.fill_depth) {
+        TPM2B_PRIVATE *out_private = NULL;
+        TPM2B_PUBLIC *out_public = NULL;
+        TPM2B_CREATION_DATA *creation_data = NULL;
+        TPM2B_DIGEST *creation_hash = NULL;
+        TPMT_TK_CREATION *creation_ticket = NULL;
+        rc = tpm2_create(ectx, &ctx.parent.object, &ctx.object.sensitive,
+            &ctx.object.in_public, &ctx.object.outside_info,
+            &ctx.object.creation_pcr, &out_private, &out_public,
+            &creation_data, &creation_hash, &creation_ticket, &ctx.cp_hash,
+            &ctx.rp_hash, ctx.parameter_hash_algorithm,
+            ctx.aux_session_handle[0], ctx.aux_session_handle[1]);
+        free(creation_data);
+        free(creation_hash);
+        free(creation_ticket);
+        if (rc != tool_rc_success) {
+            break;
+        }
+
+        result = tpm2_key_pool_put(&ctx.pool.pool, out_public, out_private);
+        free(out_public);
+        free(out_private);
+        if (!result) {
+            rc = tool_rc_general_error;
+            break;
+        }
+
+        created++;
+    }
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double seconds = (end.tv_sec - start.tv_sec)
+        + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    tpm2_tool_output("pool:\n");
+    tpm2_tool_output("  depth: %zu\n", depth + created);
+    tpm2_tool_output("  created: %zu\n", created);
+    tpm2_tool_output("  seconds: %f\n", seconds);
+    tpm2_tool_output("  keys-per-second: %f\n",
+        seconds > 0 ? created / seconds : 0);
+
+    return rc;
+}
+
+static tool_rc pool_claim(ESYS_CONTEXT *ectx) {
+
+    ctx.object.out_public = calloc(1, sizeof(*ctx.object.out_public));
+    ctx.object.out_private = calloc(1, sizeof(*ctx.object.out_private));
+    if (!ctx.object.out_public || !ctx.object.out_private) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    bool result = tpm2_key_pool_claim(&ctx.pool.pool, ctx.object.out_public,
+        ctx.object.out_private, &ctx.pool.is_claimed);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    if (!ctx.pool.is_claimed) {
+        LOG_WARN("Key pool is empty, creating the key");
+        free(ctx.object.out_public);
+        ctx.object.out_public = NULL;
+        free(ctx.object.out_private);
+        ctx.object.out_private = NULL;
+        return create(ectx);
+    }
+
+    /* pre-created keys are plain TPM2_CC_Create outputs, load on demand */
+    if (ctx.object.ctx_path) {
+        return tpm2_load(ectx, &ctx.parent.object, ctx.object.out_private,
+            ctx.object.out_public, &ctx.object.object_handle, NULL);
+    }
+
+    return tool_rc_success;
+}
+
+static void pool_output(void) {
+
+    size_t depth;
+    bool result = tpm2_key_pool_depth(&ctx.pool.pool, &depth);
+    if (!result) {
+        return;
+    }
+
+    tpm2_tool_output("pool:\n");
+    tpm2_tool_output("  hit: %s\n", ctx.pool.is_claimed ? "true" : "false");
+    tpm2_tool_output("  depth: %zu\n", depth);
+}
+
 #define DEFAULT_ATTRS \
      TPMA_OBJECT_DECRYPT|TPMA_OBJECT_SIGN_ENCRYPT|TPMA_OBJECT_FIXEDTPM \
     |TPMA_OBJECT_FIXEDPARENT|TPMA_OBJECT_SENSITIVEDATAORIGIN \
@@ -445,6 +578,36 @@ static tool_rc check_options(void) {
         return tool_rc_option_error;
     }
 
+    bool is_pool_op = ctx.pool.fill_depth || ctx.pool.is_from_pool;
+    if (is_pool_op != !!ctx.pool.dir) {
+        LOG_ERR("Specify --pool with one of --pool-fill or --from-pool");
+        return tool_rc_option_error;
+    }
+
+    if (ctx.pool.fill_depth && ctx.pool.is_from_pool) {
+        LOG_ERR("Cannot specify --pool-fill and --from-pool together");
+        return tool_rc_option_error;
+    }
+
+    /*
+     * Pooled keys are created ahead of time, so they can't carry secrets or
+     * creation data of the request that claims them.
+     */
+    if (is_pool_op && (ctx.object.auth_str ||
+        ctx.object.is_sealing_input_specified || ctx.cp_hash_path ||
+        ctx.rp_hash_path || ctx.object.creation_data_file ||
+        ctx.object.creation_ticket_file || ctx.object.creation_hash_file)) {
+        LOG_ERR("Key pools cannot be used with -p, -i, cpHash, rpHash or "
+                "creation outputs");
+        return tool_rc_option_error;
+    }
+
+    if (ctx.pool.fill_depth && (ctx.object.public_path ||
+        ctx.object.private_path || ctx.object.ctx_path || ctx.output_path)) {
+        LOG_ERR("Cannot specify key outputs with --pool-fill");
+        return tool_rc_option_error;
+    }
+
     return tool_rc_success;
 }
 
@@ -547,6 +710,20 @@ static bool on_option(char key, char *value) {
     case 'o':
         ctx.output_path = value;
         break;
+    case 4:
+        ctx.pool.dir = value;
+        break;
+    case 5: {
+        bool result = tpm2_util_string_to_uint32(value, &ctx.pool.fill_depth);
+        if (!result || !ctx.pool.fill_depth) {
+            LOG_ERR("Invalid pool depth, got: \"%s\"", value);
+            return false;
+        }
+    }
+        break;
+    case 6:
+        ctx.pool.is_from_pool = true;
+        break;
         /* no default */
     };
 
@@ -578,6 +755,9 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
       { "session",        required_argument, NULL, 'S' },
       { "format",         required_argument, NULL, 'f' },
       { "output",         required_argument, NULL, 'o' },
+      { "pool",           required_argument, NULL,  4  },
+      { "pool-fill",      required_argument, NULL,  5  },
+      { "from-pool",      no_argument,       NULL,  6  },
     };
 
     *opts = tpm2_options_new("P:p:g:G:a:i:L:u:r:C:c:t:d:q:l:S:o:f:",
@@ -607,9 +787,20 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
     }
 
     /*
-     * 3. TPM2_CC_<command> call
+     * 3. TPM2_CC_<command> call, or a key from the pool
      */
-    rc = create(ectx);
+    if (ctx.pool.dir) {
+        rc = pool_open(ectx);
+        if (rc != tool_rc_success) {
+            return rc;
+        }
+    }
+
+    if (ctx.pool.fill_depth) {
+        return pool_fill(ectx);
+    }
+
+    rc = ctx.pool.is_from_pool ? pool_claim(ectx) : create(ectx);
     if (rc != tool_rc_success) {
         return rc;
     }
@@ -617,7 +808,12 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
     /*
      * 4. Process outputs
      */
-    return process_output(ectx);
+    rc = process_output(ectx);
+    if (rc == tool_rc_success && ctx.pool.is_from_pool) {
+        pool_output();
+    }
+
+    return rc;
 }
 
 static tool_rc tpm2_tool_onstop(ESYS_CONTEXT *ectx) {
@@ -11,6 +11,7 @@
 #include "tpm2_convert.h"
 #include "tpm2_ctx_mgmt.h"
 #include "tpm2_nv_util.h"
+#include "tpm2_primary_cache.h"
 #include "tpm2_tool.h"
 
 #define RSA_EK_NONCE_NV_INDEX 0x01c00003
@@ -48,6 +49,8 @@ struct createek_context {
     } flags;
 
     bool find_persistent_handle;
+
+    char *cache_dir;
 };
 
 static createek_context ctx = {
@@ -193,8 +196,9 @@ static tool_rc create_ek_handle(ESYS_CONTEXT *ectx) {
         }
     }
 
-    tool_rc rc = tpm2_hierarchy_create_primary(ectx,
-        ctx.auth_endorse_hierarchy.object.session, &ctx.objdata, NULL);
+    tool_rc rc = tpm2_primary_cache_create(ectx,
+        ctx.auth_endorse_hierarchy.object.session, &ctx.objdata, ctx.cache_dir,
+        NULL);
     if (rc != tool_rc_success) {
         return rc;
     }
@@ -275,6 +279,9 @@ static bool on_option(char key, char *value) {
     case 't':
         ctx.flags.t = true;
         break;
+    case 0:
+        ctx.cache_dir = value;
+        break;
     }
 
     return true;
@@ -290,6 +297,7 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
         { "format",               required_argument, NULL, 'f' },
         { "ek-context",           required_argument, NULL, 'c' },
         { "template",             no_argument,       NULL, 't' },
+        { "cache-dir",            required_argument, NULL,  0  },
     };
 
     *opts = tpm2_options_new("P:w:G:u:f:c:t", ARRAY_LEN(topts), topts,
@@ -11,6 +11,7 @@
 #include "tpm2_convert.h"
 #include "tpm2_hierarchy.h"
 #include "tpm2_options.h"
+#include "tpm2_primary_cache.h"
 
 #define DEFAULT_ATTRS \
      TPMA_OBJECT_RESTRICTED|TPMA_OBJECT_DECRYPT \
@@ -46,6 +47,8 @@ struct tpm_createprimary_ctx {
     char *output_path;
     bool format_set;
     tpm2_convert_pubkey_fmt format;
+
+    char *cache_dir;
 };
 
 static tpm_createprimary_ctx ctx = {
@@ -131,6 +134,9 @@ static bool on_option(char key, char *value) {
     case 'o':
         ctx.output_path = value;
         break;
+    case 3:
+        ctx.cache_dir = value;
+        break;
         /* no default */
     }
 
@@ -158,6 +164,7 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
         { "cphash",         required_argument, NULL,  2  },
         { "format",         required_argument, NULL, 'f' },
         { "output",         required_argument, NULL, 'o' },
+        { "cache-dir",      required_argument, NULL,  3  },
     };
 
     *opts = tpm2_options_new("C:P:p:g:G:c:L:a:u:t:d:q:l:o:f:", ARRAY_LEN(topts), topts,
@@ -174,6 +181,12 @@ static tool_rc validate_input_options(void) {
         return tool_rc_option_error;
     }
 
+    if (ctx.cache_dir && (ctx.cp_hash_path || ctx.creation_data_file ||
+    ctx.creation_hash_file || ctx.creation_ticket_file)) {
+        LOG_ERR("Cannot use a primary cache with cpHash or creation outputs");
+        return tool_rc_option_error;
+    }
+
     if (ctx.format_set && !ctx.output_path) {
         LOG_ERR("Cannot specify --format/-f without specifying --output/-o");
         return tool_rc_option_error;
@@ -343,9 +356,9 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
         return no_execute_only_process_params(ectx);
     }
 
-    /* Dispatch TPM2_CC_CreatePrimary */
-    rc = tpm2_hierarchy_create_primary(ectx, ctx.parent.session, &ctx.objdata,
-    NULL);
+    /* Dispatch TPM2_CC_CreatePrimary, unless cached */
+    rc = tpm2_primary_cache_create(ectx, ctx.parent.session, &ctx.objdata,
+    ctx.cache_dir, NULL);
     if (rc != tool_rc_success) {
         return rc;
     }
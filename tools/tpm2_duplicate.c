@@ -11,9 +11,12 @@
 #include "tpm2.h"
 #include "tpm2_tool.h"
 #include "tpm2_alg_util.h"
+#include "tpm2_auth_util.h"
+#include "tpm2_batch.h"
 #include "tpm2_options.h"
 #include "tpm2_openssl.h"
 #include "tpm2_identity_util.h"
+#include "tpm2_worker.h"
 
 typedef struct tpm_duplicate_ctx tpm_duplicate_ctx;
 struct tpm_duplicate_ctx {
@@ -55,10 +58,14 @@ struct tpm_duplicate_ctx {
     } flags;
 
     char *cp_hash_path;
+
+    char *batch_path; /* manifest of keys to wrap, see batch_run() */
+    unsigned jobs;
 };
 
 static tpm_duplicate_ctx ctx = {
     .key_type = TPM2_ALG_ERROR,
+    .jobs = 1,
 };
 
 static tool_rc do_duplicate(ESYS_CONTEXT *ectx, TPM2B_DATA *in_key,
@@ -142,6 +149,11 @@ static bool on_option(char key, char *value) {
     case 0:
         ctx.cp_hash_path = value;
         break;
+    case 1:
+        ctx.batch_path = value;
+        break;
+    case 2:
+        return tpm2_worker_jobs_from_optarg(value, &ctx.jobs);
     default:
         LOG_ERR("Invalid option");
         return false;
@@ -166,6 +178,8 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
       { "parent-public",     required_argument, NULL, 'U'},
       { "key-context",       required_argument, NULL, 'c'},
       { "cphash",            required_argument, NULL,  0 },
+      { "batch",             required_argument, NULL,  1 },
+      { "jobs",              required_argument, NULL,  2 },
     };
 
     *opts = tpm2_options_new("p:L:G:i:C:o:s:r:c:U:k:u:", ARRAY_LEN(topts), topts,
@@ -209,7 +223,20 @@ static bool check_options(void) {
         }
     }
 
-    if (ctx.flags.U != ctx.flags.k)
+    if (ctx.batch_path) {
+        if (!ctx.flags.U) {
+            LOG_ERR("Expected parent public to be specified via \"-U\" with "
+                    "\"--batch\", missing option.");
+            result = false;
+        }
+
+        if (ctx.flags.k || ctx.flags.u || ctx.flags.r || ctx.flags.s ||
+            ctx.flags.c || ctx.flags.C || ctx.cp_hash_path) {
+            LOG_ERR("Options k, u, r, s, c, C and cphash are not supported "
+                    "with \"--batch\", the keys come from the manifest.");
+            result = false;
+        }
+    } else if (ctx.flags.U != ctx.flags.k)
     {
         LOG_ERR("Conflicting options: remote public key and local private key must both be specified");
         result = false;
@@ -264,14 +291,11 @@ static bool set_key_algorithm(TPMI_ALG_PUBLIC alg, TPMT_SYM_DEF_OBJECT * obj) {
 }
 
 
-static tool_rc tpm2_create_duplicate(
-    TPM2B_PUBLIC *parent_pub,
-    TPM2B_SENSITIVE *privkey,
-    TPM2B_PUBLIC *public,
-    TPM2B_ENCRYPTED_SECRET *encrypted_seed)
-{
+static bool create_duplicate(TPM2B_PUBLIC *parent_pub,
+        TPM2B_SENSITIVE *privkey, TPM2B_PUBLIC *public,
+        TPM2B_PRIVATE *private) {
+
     bool result;
-    tool_rc rc = tool_rc_success;
     TSS2_RC rval;
 
     /*
@@ -329,54 +353,75 @@ static tool_rc tpm2_create_duplicate(
     /*
      * Build the private data structure for writing out
      */
-    TPM2B_PRIVATE private = TPM2B_EMPTY_INIT;
     UINT16 parent_hash_size = tpm2_alg_util_get_hash_size(parent_pub->publicArea.nameAlg);
-    private.size = sizeof(parent_hash_size) + parent_hash_size
+    private->size = sizeof(parent_hash_size) + parent_hash_size
 	+ encrypted_duplicate_sensitive.size;
 
     size_t hmac_size_offset = 0;
-    rval = Tss2_MU_UINT16_Marshal(parent_hash_size, private.buffer,
+    rval = Tss2_MU_UINT16_Marshal(parent_hash_size, private->buffer,
             sizeof(parent_hash_size), &hmac_size_offset);
     if (rval != TPM2_RC_SUCCESS) {
         LOG_ERR("Error serializing hmac size");
         return false;
     }
 
-    memcpy(private.buffer + hmac_size_offset, outer_hmac.buffer,
+    memcpy(private->buffer + hmac_size_offset, outer_hmac.buffer,
             parent_hash_size);
-    memcpy(private.buffer + hmac_size_offset + parent_hash_size,
+    memcpy(private->buffer + hmac_size_offset + parent_hash_size,
             encrypted_duplicate_sensitive.buffer,
             encrypted_duplicate_sensitive.size);
 
-    /*
-     * Write out the generated files
-     */
-    result = files_save_encrypted_seed(encrypted_seed, ctx.enc_seed_out);
+    return true;
+}
+
+static bool save_duplicate(TPM2B_PUBLIC *public, TPM2B_PRIVATE *private,
+        TPM2B_ENCRYPTED_SECRET *encrypted_seed, const char *public_path,
+        const char *private_path, const char *seed_path) {
+
+    bool result = files_save_encrypted_seed(encrypted_seed, seed_path);
     if (!result) {
         LOG_ERR("Failed to save encryption seed into file \"%s\"",
-                ctx.enc_seed_out);
-        rc = tool_rc_general_error;
-        goto out;
+                seed_path);
+        return false;
     }
 
-    result = files_save_private(&private, ctx.duplicate_key_private_file);
+    result = files_save_private(private, private_path);
     if (!result) {
         LOG_ERR("Failed to save private key into file \"%s\"",
-                ctx.duplicate_key_private_file);
-        rc = tool_rc_general_error;
-        goto out;
+                private_path);
+        return false;
     }
 
-    result = files_save_public(public, ctx.duplicate_key_public_file);
+    result = files_save_public(public, public_path);
     if (!result) {
         LOG_ERR("Failed to save public key into file \"%s\"",
-                ctx.duplicate_key_public_file);
-        rc = tool_rc_general_error;
-        goto out;
+                public_path);
+        return false;
     }
 
-out:
-    return rc;
+    return true;
+}
+
+static tool_rc tpm2_create_duplicate(
+    TPM2B_PUBLIC *parent_pub,
+    TPM2B_SENSITIVE *privkey,
+    TPM2B_PUBLIC *public,
+    TPM2B_ENCRYPTED_SECRET *encrypted_seed)
+{
+    TPM2B_PRIVATE private = TPM2B_EMPTY_INIT;
+    bool result = create_duplicate(parent_pub, privkey, public, &private);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
+    /*
+     * Write out the generated files
+     */
+    result = save_duplicate(public, &private, encrypted_seed,
+            ctx.duplicate_key_public_file, ctx.duplicate_key_private_file,
+            ctx.enc_seed_out);
+
+    return result ? tool_rc_success : tool_rc_general_error;
 }
 
 static tool_rc openssl_duplicate(void)
@@ -411,6 +456,178 @@ static tool_rc openssl_duplicate(void)
     return tpm2_create_duplicate(&parent_public, &private, &public, &encrypted_seed);
 }
 
+typedef struct duplicate_batch_item duplicate_batch_item;
+struct duplicate_batch_item {
+    char *key_path;
+    char *public_path;
+    char *private_path;
+    char *seed_path;
+    size_t line;
+};
+
+typedef struct duplicate_batch duplicate_batch;
+struct duplicate_batch {
+    TPM2B_PUBLIC parent_pub;
+    tpm2_identity_util_seed_ctx *seed_ctx;
+    const TPM2B_AUTH *auth;
+    duplicate_batch_item items[TPM2_BATCH_CHUNK];
+};
+
+/*
+ * Runs on the worker threads. Everything that only depends on the parent, ie
+ * the parent public key and the key authorization, is prepared once by
+ * batch_run() and shared read only by the workers.
+ */
+static bool batch_process_item(void *userdata, size_t index) {
+
+    duplicate_batch *batch = (duplicate_batch *) userdata;
+    duplicate_batch_item *item = &batch->items[index];
+
+    TPM2B_PUBLIC public = TPM2B_EMPTY_INIT;
+    TPM2B_SENSITIVE private = TPM2B_EMPTY_INIT;
+    TPM2B_ENCRYPTED_SECRET encrypted_seed = TPM2B_EMPTY_INIT;
+    TPM2B_PRIVATE duplicate = TPM2B_EMPTY_INIT;
+
+    /*
+     * The seed is shared before the key is loaded as symmetric keys derive
+     * their unique field from it, same as tpm2_openssl_import_keys().
+     */
+    static const unsigned char label[] = {
+        'D', 'U', 'P', 'L', 'I', 'C', 'A', 'T', 'E', '\0'
+    };
+    bool result = tpm2_identity_util_seed_ctx_share_secret(batch->seed_ctx,
+            label, sizeof(label), &private.sensitiveArea.seedValue,
+            &encrypted_seed);
+    if (!result) {
+        goto out;
+    }
+
+    result = tpm2_openssl_import_keys(&batch->parent_pub, &private, &public,
+            NULL, item->key_path, ctx.key_type, NULL,
+            ctx.duplicable_key.policy_str, NULL, NULL, NULL);
+    if (!result) {
+        goto out;
+    }
+
+    if (batch->auth) {
+        private.sensitiveArea.authValue = *batch->auth;
+    }
+
+    result = create_duplicate(&batch->parent_pub, &private, &public,
+            &duplicate);
+    if (!result) {
+        goto out;
+    }
+
+    result = save_duplicate(&public, &duplicate, &encrypted_seed,
+            item->public_path, item->private_path, item->seed_path);
+
+out:
+    if (!result) {
+        LOG_ERR("Failed to wrap the key on line %zu of the manifest",
+                item->line);
+    }
+
+    return result;
+}
+
+static void batch_free_items(void *userdata, size_t count) {
+
+    duplicate_batch *batch = (duplicate_batch *) userdata;
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        free(batch->items[i].key_path);
+        free(batch->items[i].public_path);
+        free(batch->items[i].private_path);
+        free(batch->items[i].seed_path);
+    }
+}
+
+static bool batch_parse_item(void *userdata, size_t index, char **fields,
+        size_t count, size_t line) {
+
+    duplicate_batch *batch = (duplicate_batch *) userdata;
+    duplicate_batch_item *item = &batch->items[index];
+    memset(item, 0, sizeof(*item));
+    item->line = line;
+
+    if (count != 4) {
+        LOG_ERR("Expected KEY PUBLIC PRIVATE SEED");
+        return false;
+    }
+
+    item->key_path = strdup(fields[0]);
+    item->public_path = strdup(fields[1]);
+    item->private_path = strdup(fields[2]);
+    item->seed_path = strdup(fields[3]);
+    if (!item->key_path || !item->public_path || !item->private_path ||
+        !item->seed_path) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    return true;
+}
+
+static const tpm2_batch_ops batch_ops = {
+    .max_fields = 4,
+    .parse = batch_parse_item,
+    .process = batch_process_item,
+    .free = batch_free_items,
+};
+
+/*
+ * Wraps the keys of the manifest for the parent given with -U. The parent is
+ * parsed once and shared by the workers wrapping the keys in parallel.
+ */
+static tool_rc batch_run(void) {
+
+    tool_rc rc = tool_rc_general_error;
+    tpm2_session *auth_session = NULL;
+
+    duplicate_batch *batch = calloc(1, sizeof(*batch));
+    if (!batch) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    bool result = files_load_public(ctx.parent_public_key_file,
+            &batch->parent_pub);
+    if (!result) {
+        goto out;
+    }
+
+    batch->seed_ctx = tpm2_identity_util_seed_ctx_new(&batch->parent_pub);
+    if (!batch->seed_ctx) {
+        goto out;
+    }
+
+    if (ctx.duplicable_key.auth_str) {
+        tool_rc tmp_rc = tpm2_auth_util_from_optarg(NULL,
+                ctx.duplicable_key.auth_str, &auth_session, true);
+        if (tmp_rc != tool_rc_success) {
+            LOG_ERR("Invalid key authorization");
+            rc = tmp_rc;
+            goto out;
+        }
+        batch->auth = tpm2_session_get_auth_value(auth_session);
+    }
+
+    tpm2_batch_stats stats;
+    rc = tpm2_batch_run(ctx.batch_path, &batch_ops, ctx.jobs, batch, &stats);
+    if (stats.is_complete) {
+        tpm2_batch_output(&stats, "keys", ctx.jobs);
+    }
+
+out:
+    tpm2_session_close(&auth_session);
+    tpm2_identity_util_seed_ctx_free(batch->seed_ctx);
+    free(batch);
+
+    return rc;
+}
+
 static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
     UNUSED(flags);
 
@@ -426,6 +643,10 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
         return tool_rc_option_error;
     }
 
+    if (ctx.batch_path) {
+        return batch_run();
+    }
+
     if (ctx.flags.U) {
         return openssl_duplicate();
     }
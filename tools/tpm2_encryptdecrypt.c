@@ -133,6 +133,26 @@ static void strip_pkcs7_padding_data_from_output(uint8_t *pad_data,
     out_data->size -= *pad_data;
 }
 
+typedef struct pending_output pending_output;
+struct pending_output {
+    FILE *file;
+    TPM2B_MAX_BUFFER *data;
+    bool result;
+};
+
+static bool write_pending_output(void *userdata) {
+
+    pending_output *pending = (pending_output *) userdata;
+    if (pending->data) {
+        pending->result = files_write_bytes(pending->file,
+                pending->data->buffer, pending->data->size);
+        free(pending->data);
+        pending->data = NULL;
+    }
+
+    return false;
+}
+
 static tool_rc encrypt_decrypt(ESYS_CONTEXT *ectx) {
 
     tool_rc rc = tool_rc_general_error;
@@ -157,6 +177,7 @@ static tool_rc encrypt_decrypt(ESYS_CONTEXT *ectx) {
     TPM2B_IV *iv_out = NULL;
     TPM2B_IV *iv_in = &ctx.iv_start;
     uint8_t pad_data = 0;
+    pending_output pending = { .file = out_file_ptr, .result = true };
 
     uint16_t remaining_bytes = ctx.input_data_size;
     if (ctx.mode == TPM2_ALG_ECB) {
@@ -186,6 +207,10 @@ static tool_rc encrypt_decrypt(ESYS_CONTEXT *ectx) {
         return rc;
     }
 
+    /*
+     * The output of a block is written while the TPM processes the next one.
+     * The blocks chain through the IV, so a single command is in flight.
+     */
     while (remaining_bytes > 0) {
         in_data.size =
                 remaining_bytes > TPM2_MAX_DIGEST_BUFFER ?
@@ -198,13 +223,28 @@ static tool_rc encrypt_decrypt(ESYS_CONTEXT *ectx) {
 
         memcpy(in_data.buffer, &ctx.input_data[data_offset], in_data.size);
 
-        rc = tpm2_encryptdecrypt(ectx, &ctx.encryption_key.object,
-                ctx.is_decrypt, ctx.mode, iv_in, &in_data, &out_data, &iv_out,
-                NULL);
+        rc = tpm2_encryptdecrypt_async(ectx, &ctx.encryption_key.object,
+                ctx.is_decrypt, ctx.mode, iv_in, &in_data);
+        if (rc != tool_rc_success) {
+            goto out;
+        }
+
+        tool_rc wait_rc = tpm2_async_wait(ectx, write_pending_output,
+                &pending);
+
+        rc = tpm2_encryptdecrypt_finish(ectx, &ctx.encryption_key.object,
+                ctx.is_decrypt, ctx.mode, iv_in, &in_data, &out_data, &iv_out);
         if (rc != tool_rc_success) {
             goto out;
         }
 
+        if (wait_rc != tool_rc_success) {
+            free(out_data);
+            free(iv_out);
+            rc = wait_rc;
+            goto out;
+        }
+
         /*
          * Copy iv_out iv_in to use it in next loop iteration.
          * This copy is also output from the tool for further chaining.
@@ -213,24 +253,33 @@ static tool_rc encrypt_decrypt(ESYS_CONTEXT *ectx) {
             assert(iv_in);
             assert(iv_out);
             *iv_in = *iv_out;
-            free(iv_out);
         }
+        free(iv_out);
 
         strip_pkcs7_padding_data_from_output(&pad_data, out_data,
                 &remaining_bytes);
 
-        result = files_write_bytes(out_file_ptr, out_data->buffer,
-                out_data->size);
-        free(out_data);
-        if (!result) {
+        /* the poll may have returned before the previous block was written */
+        write_pending_output(&pending);
+        if (!pending.result) {
+            free(out_data);
             LOG_ERR("Failed to save output data to file");
+            rc = tool_rc_general_error;
             goto out;
         }
+        pending.data = out_data;
 
         remaining_bytes -= in_data.size;
         data_offset += in_data.size;
     }
 
+    write_pending_output(&pending);
+    if (!pending.result) {
+        LOG_ERR("Failed to save output data to file");
+        rc = tool_rc_general_error;
+        goto out;
+    }
+
     /*
      * iv_in here is the copy of final iv_out from the loop above.
      */
@@ -246,6 +295,7 @@ static tool_rc encrypt_decrypt(ESYS_CONTEXT *ectx) {
     rc = tool_rc_success;
 
 out:
+    free(pending.data);
     if (out_file_ptr != stdout) {
         fclose(out_file_ptr);
     }
@@ -1,9 +1,12 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <curl/curl.h>
 #include <openssl/buffer.h>
@@ -20,6 +23,8 @@
 #include "tpm2_nv_util.h"
 #include "tpm2_tool.h"
 
+#define MAX_EK_PUBLIC_COUNT 2
+
 typedef struct tpm_getekcertificate_ctx tpm_getekcertificate_ctx;
 struct tpm_getekcertificate_ctx {
     // TPM Device properties
@@ -43,9 +48,13 @@ struct tpm_getekcertificate_ctx {
     // EK certificate hosting particulars
     char *ek_server_addr;
     unsigned int SSL_NO_VERIFY;
-    char *ek_path;
+    char *ek_path[MAX_EK_PUBLIC_COUNT];
+    uint8_t ek_count;
     bool verbose;
     TPM2B_PUBLIC *out_public;
+    // EK certificate cache
+    char *cache_dir;
+    bool is_curl_initialized;
 };
 
 static tpm_getekcertificate_ctx ctx = {
@@ -55,7 +64,7 @@ static tpm_getekcertificate_ctx ctx = {
     .cert_count = 0,
 };
 
-static unsigned char *hash_ek_public(void) {
+static unsigned char *hash_ek_public(TPM2B_PUBLIC *ek_public) {
 
     unsigned char *hash = (unsigned char*) malloc(SHA256_DIGEST_LENGTH);
     if (!hash) {
@@ -70,17 +79,17 @@ static unsigned char *hash_ek_public(void) {
         goto err;
     }
 
-    switch (ctx.out_public->publicArea.type) {
+    switch (ek_public->publicArea.type) {
     case TPM2_ALG_RSA:
         is_success = SHA256_Update(&sha256,
-                ctx.out_public->publicArea.unique.rsa.buffer,
-                ctx.out_public->publicArea.unique.rsa.size);
+                ek_public->publicArea.unique.rsa.buffer,
+                ek_public->publicArea.unique.rsa.size);
         if (!is_success) {
             LOG_ERR("SHA256_Update failed");
             goto err;
         }
 
-        if (ctx.out_public->publicArea.parameters.rsaDetail.exponent != 0) {
+        if (ek_public->publicArea.parameters.rsaDetail.exponent != 0) {
             LOG_ERR("non-default exponents unsupported");
             goto err;
         }
@@ -94,16 +103,16 @@ static unsigned char *hash_ek_public(void) {
 
     case TPM2_ALG_ECC:
         is_success = SHA256_Update(&sha256,
-                ctx.out_public->publicArea.unique.ecc.x.buffer,
-                ctx.out_public->publicArea.unique.ecc.x.size);
+                ek_public->publicArea.unique.ecc.x.buffer,
+                ek_public->publicArea.unique.ecc.x.size);
         if (!is_success) {
             LOG_ERR("SHA256_Update failed");
             goto err;
         }
 
         is_success = SHA256_Update(&sha256,
-                ctx.out_public->publicArea.unique.ecc.y.buffer,
-                ctx.out_public->publicArea.unique.ecc.y.size);
+                ek_public->publicArea.unique.ecc.y.buffer,
+                ek_public->publicArea.unique.ecc.y.size);
         if (!is_success) {
             LOG_ERR("SHA256_Update failed");
             goto err;
@@ -183,69 +192,214 @@ static char *base64_encode(const unsigned char* buffer)
         }
     }
     curl_easy_cleanup(curl);
-    curl_global_cleanup();
     BIO_free_all(bio);
 
     /* format to a proper NULL terminated string */
     return final_string;
 }
 
+typedef struct ek_web_request ek_web_request;
+struct ek_web_request {
+    TPM2B_PUBLIC *ek_public;
+    unsigned char **cert_buffer;
+    uint16_t *cert_buffer_size;
+    size_t cert_buffer_capacity;
+    char *weblink;
+    char cache_path[PATH_MAX];
+    bool is_cached;
+};
+
 static size_t writecallback(char *contents, size_t size, size_t nitems,
-    void *CERT_BUFFER) {
+    void *userdata) {
 
-    strncpy(CERT_BUFFER, (const char *)contents, nitems * size);
-    ctx.rsa_cert_buffer_size = nitems * size;
+    ek_web_request *request = (ek_web_request *)userdata;
+    size_t chunk_size = size * nitems;
+    size_t new_size = *request->cert_buffer_size + chunk_size;
 
-    return ctx.rsa_cert_buffer_size;
+    /* the certificate sizes are tracked in 16 bits, same as the NV path */
+    if (new_size > UINT16_MAX) {
+        LOG_ERR("EK certificate exceeds the maximum size of %u bytes",
+            UINT16_MAX);
+        return 0;
+    }
+
+    /*
+     * Keep a NUL terminator behind the data, process_output() treats the
+     * manufacturer responses as strings.
+     */
+    if (new_size + 1 > request->cert_buffer_capacity) {
+        size_t capacity = request->cert_buffer_capacity ?
+            request->cert_buffer_capacity : CURL_MAX_WRITE_SIZE;
+        while (capacity < new_size + 1) {
+            capacity *= 2;
+        }
+        unsigned char *tmp = realloc(*request->cert_buffer, capacity);
+        if (!tmp) {
+            LOG_ERR("oom");
+            return 0;
+        }
+        *request->cert_buffer = tmp;
+        request->cert_buffer_capacity = capacity;
+    }
+
+    memcpy(*request->cert_buffer + *request->cert_buffer_size, contents,
+        chunk_size);
+    (*request->cert_buffer)[new_size] = '\0';
+    *request->cert_buffer_size = new_size;
+
+    return chunk_size;
 }
 
-static bool retrieve_web_endorsement_certificate(char *b64h) {
+static bool curl_init_once(void) {
 
-    #define NULL_TERM_LEN 1                 // '\0'
-    #define PATH_JOIN_CHAR_LEN 1            // '/'
-    size_t len = strlen(ctx.ek_server_addr) + strlen(b64h) + NULL_TERM_LEN +
-        PATH_JOIN_CHAR_LEN;
-    char *weblink = (char *) malloc(len);
-    if (!weblink) {
-        LOG_ERR("oom");
-        return false;
+    if (ctx.is_curl_initialized) {
+        return true;
     }
 
-    bool ret = true;
     CURLcode rc = curl_global_init(CURL_GLOBAL_DEFAULT);
     if (rc != CURLE_OK) {
         LOG_ERR("curl_global_init failed: %s", curl_easy_strerror(rc));
-        ret = false;
-        goto out_memory;
+        return false;
+    }
+
+    ctx.is_curl_initialized = true;
+    return true;
+}
+
+/*
+ * The cache is content addressed on the SHA256 of the EK public, the same
+ * digest used to look the certificate up on the manufacturer server. Entries
+ * hold the raw server response so that the cached and fresh paths share
+ * process_output().
+ */
+static bool cache_path_from_hash(const unsigned char *hash, char *path,
+    size_t len) {
+
+    char hex[SHA256_DIGEST_LENGTH * 2 + 1];
+    unsigned i;
+    for (i = 0; i < SHA256_DIGEST_LENGTH; i++) {
+        snprintf(&hex[i * 2], 3, "%02x", hash[i]);
     }
 
+    int written = snprintf(path, len, "%s/%s.ekcert", ctx.cache_dir, hex);
+    if (written < 0 || (size_t)written >= len) {
+        LOG_ERR("EK certificate cache path too long");
+        return false;
+    }
+
+    return true;
+}
+
+static bool cache_load(ek_web_request *request) {
+
+    FILE *f = fopen(request->cache_path, "rb");
+    if (!f) {
+        /* a miss is not an error, the certificate is fetched instead */
+        return false;
+    }
+
+    bool result = false;
+    unsigned long file_size;
+    bool is_size_known = files_get_file_size(f, &file_size,
+        request->cache_path);
+    if (!is_size_known || file_size == 0 || file_size > UINT16_MAX) {
+        LOG_WARN("Ignoring invalid EK certificate cache entry \"%s\"",
+            request->cache_path);
+        goto out;
+    }
+
+    /* same sizing and termination guarantees as writecallback() */
+    request->cert_buffer_capacity = file_size + 1 > CURL_MAX_WRITE_SIZE ?
+        file_size + 1 : CURL_MAX_WRITE_SIZE;
+    *request->cert_buffer = calloc(1, request->cert_buffer_capacity);
+    if (!*request->cert_buffer) {
+        LOG_ERR("oom");
+        goto out;
+    }
+
+    result = files_read_bytes(f, *request->cert_buffer, file_size);
+    if (!result) {
+        LOG_WARN("Could not read EK certificate cache entry \"%s\"",
+            request->cache_path);
+        free(*request->cert_buffer);
+        *request->cert_buffer = NULL;
+        goto out;
+    }
+
+    *request->cert_buffer_size = file_size;
+    LOG_INFO("EK certificate loaded from cache \"%s\"", request->cache_path);
+
+out:
+    fclose(f);
+    return result;
+}
+
+static void cache_store(ek_web_request *request) {
+
+    /*
+     * Write to a temporary file and rename it in place so that concurrent
+     * enrollments sharing a cache directory never observe partial entries.
+     * Failing to populate the cache is not fatal.
+     */
+    char tmp_path[PATH_MAX];
+    int written = snprintf(tmp_path, sizeof(tmp_path), "%s.XXXXXX",
+        request->cache_path);
+    if (written < 0 || (size_t)written >= sizeof(tmp_path)) {
+        LOG_WARN("EK certificate cache path too long");
+        return;
+    }
+
+    int fd = mkstemp(tmp_path);
+    if (fd < 0) {
+        LOG_WARN("Could not create EK certificate cache entry in \"%s\": %s",
+            ctx.cache_dir, strerror(errno));
+        return;
+    }
+
+    FILE *f = fdopen(fd, "wb");
+    if (!f) {
+        LOG_WARN("fdopen failed: %s", strerror(errno));
+        close(fd);
+        unlink(tmp_path);
+        return;
+    }
+
+    bool result = files_write_bytes(f, *request->cert_buffer,
+        *request->cert_buffer_size);
+    result &= (fclose(f) == 0);
+    if (!result || rename(tmp_path, request->cache_path) != 0) {
+        LOG_WARN("Could not save EK certificate cache entry \"%s\"",
+            request->cache_path);
+        unlink(tmp_path);
+    }
+}
+
+static CURL *prepare_web_request(ek_web_request *request) {
+
     CURL *curl = curl_easy_init();
     if (!curl) {
         LOG_ERR("curl_easy_init failed");
-        ret = false;
-        goto out_global_cleanup;
+        return NULL;
     }
 
     /*
      * should not be used - Used only on platforms with older CA certificates.
      */
+    CURLcode rc;
     if (ctx.SSL_NO_VERIFY) {
         rc = curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
         if (rc != CURLE_OK) {
             LOG_ERR("curl_easy_setopt for CURLOPT_SSL_VERIFYPEER failed: %s",
                     curl_easy_strerror(rc));
-            ret = false;
-            goto out_easy_cleanup;
+            goto err;
         }
     }
 
-    snprintf(weblink, len, "%s%s%s", ctx.ek_server_addr, "/", b64h);
-    rc = curl_easy_setopt(curl, CURLOPT_URL, weblink);
+    rc = curl_easy_setopt(curl, CURLOPT_URL, request->weblink);
     if (rc != CURLE_OK) {
         LOG_ERR("curl_easy_setopt for CURLOPT_URL failed: %s",
                 curl_easy_strerror(rc));
-        ret = false;
-        goto out_easy_cleanup;
+        goto err;
     }
 
     /*
@@ -256,63 +410,193 @@ static bool retrieve_web_endorsement_certificate(char *b64h) {
     if (rc != CURLE_OK) {
         LOG_ERR("curl_easy_setopt for CURLOPT_VERBOSE failed: %s",
                 curl_easy_strerror(rc));
-        ret = false;
-        goto out_easy_cleanup;
+        goto err;
     }
 
     rc = curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writecallback);
     if (rc != CURLE_OK) {
         LOG_ERR("curl_easy_setopt for CURLOPT_WRITEFUNCTION failed: %s",
                 curl_easy_strerror(rc));
-        ret = false;
-        goto out_easy_cleanup;
+        goto err;
     }
-    /*
-     * As only one cert is downloaded at a time, we can simply use
-     * rsa_cert_buffer for either RSA EK cert or ECC EK cert.
-     */
-    ctx.rsa_cert_buffer = malloc(CURL_MAX_WRITE_SIZE);
-    rc = curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)ctx.rsa_cert_buffer);
+
+    rc = curl_easy_setopt(curl, CURLOPT_WRITEDATA, (void *)request);
     if (rc != CURLE_OK) {
         LOG_ERR("curl_easy_setopt for CURLOPT_WRITEDATA failed: %s",
                 curl_easy_strerror(rc));
-        ret = false;
-        goto out_easy_cleanup;
+        goto err;
+    }
+
+    rc = curl_easy_setopt(curl, CURLOPT_PRIVATE, (void *)request);
+    if (rc != CURLE_OK) {
+        LOG_ERR("curl_easy_setopt for CURLOPT_PRIVATE failed: %s",
+                curl_easy_strerror(rc));
+        goto err;
     }
 
     rc = curl_easy_setopt(curl, CURLOPT_FAILONERROR, true);
     if (rc != CURLE_OK) {
         LOG_ERR("curl_easy_setopt for CURLOPT_FAILONERROR failed: %s",
                 curl_easy_strerror(rc));
-        goto out_easy_cleanup;
+        goto err;
     }
 
-    rc = curl_easy_perform(curl);
+    /*
+     * Prefer waiting for a connection to the same server to become available
+     * for multiplexing over opening a new one for each EK.
+     */
+    rc = curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
     if (rc != CURLE_OK) {
-        LOG_ERR("curl_easy_perform() failed: %s", curl_easy_strerror(rc));
-        ret = false;
-        goto out_easy_cleanup;
+        LOG_ERR("curl_easy_setopt for CURLOPT_PIPEWAIT failed: %s",
+                curl_easy_strerror(rc));
+        goto err;
     }
 
-out_easy_cleanup:
+    return curl;
+
+err:
     curl_easy_cleanup(curl);
-out_global_cleanup:
-    curl_global_cleanup();
-out_memory:
-    free(weblink);
+    return NULL;
+}
+
+/*
+ * Downloads all the requested certificates concurrently over a single curl
+ * multi handle, which also lets the transfers share the connection cache.
+ */
+static bool retrieve_web_endorsement_certificates(ek_web_request *requests,
+    uint8_t count) {
+
+    CURLM *multi = curl_multi_init();
+    if (!multi) {
+        LOG_ERR("curl_multi_init failed");
+        return false;
+    }
+
+    bool ret = true;
+    CURL *handles[MAX_EK_PUBLIC_COUNT] = { 0 };
+    CURLMcode mrc = curl_multi_setopt(multi, CURLMOPT_PIPELINING,
+        CURLPIPE_MULTIPLEX);
+    if (mrc != CURLM_OK) {
+        LOG_ERR("curl_multi_setopt for CURLMOPT_PIPELINING failed: %s",
+            curl_multi_strerror(mrc));
+        ret = false;
+        goto out;
+    }
+
+    uint8_t i;
+    for (i = 0; i < count; i++) {
+        if (requests[i].is_cached) {
+            continue;
+        }
+
+        handles[i] = prepare_web_request(&requests[i]);
+        if (!handles[i]) {
+            ret = false;
+            goto out;
+        }
+
+        mrc = curl_multi_add_handle(multi, handles[i]);
+        if (mrc != CURLM_OK) {
+            LOG_ERR("curl_multi_add_handle failed: %s",
+                curl_multi_strerror(mrc));
+            curl_easy_cleanup(handles[i]);
+            handles[i] = NULL;
+            ret = false;
+            goto out;
+        }
+    }
+
+    int running = 0;
+    do {
+        mrc = curl_multi_perform(multi, &running);
+        if (mrc == CURLM_OK && running) {
+            mrc = curl_multi_wait(multi, NULL, 0, 1000, NULL);
+        }
+    } while (mrc == CURLM_OK && running);
+
+    if (mrc != CURLM_OK) {
+        LOG_ERR("curl_multi_perform() failed: %s", curl_multi_strerror(mrc));
+        ret = false;
+        goto out;
+    }
+
+    int msgs_left = 0;
+    CURLMsg *msg;
+    while ((msg = curl_multi_info_read(multi, &msgs_left))) {
+        if (msg->msg != CURLMSG_DONE) {
+            continue;
+        }
+
+        ek_web_request *request = NULL;
+        curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &request);
+        if (msg->data.result != CURLE_OK) {
+            LOG_ERR("Fetching \"%s\" failed: %s",
+                request ? request->weblink : "EK certificate",
+                curl_easy_strerror(msg->data.result));
+            ret = false;
+        }
+    }
+
+out:
+    for (i = 0; i < count; i++) {
+        if (handles[i]) {
+            curl_multi_remove_handle(multi, handles[i]);
+            curl_easy_cleanup(handles[i]);
+        }
+    }
+    curl_multi_cleanup(multi);
 
     return ret;
 }
 
-static bool get_web_ek_certificate(void) {
+static bool setup_web_request(ek_web_request *request,
+    TPM2B_PUBLIC *ek_public) {
 
-    if (ctx.SSL_NO_VERIFY) {
-        LOG_WARN("TLS communication with the said TPM manufacturer server setup"
-                 " with SSL_NO_VERIFY!");
+    request->ek_public = ek_public;
+
+    switch (ek_public->publicArea.type) {
+    case TPM2_ALG_RSA:
+        request->cert_buffer = &ctx.rsa_cert_buffer;
+        request->cert_buffer_size = &ctx.rsa_cert_buffer_size;
+        break;
+    case TPM2_ALG_ECC:
+        request->cert_buffer = &ctx.ecc_cert_buffer;
+        request->cert_buffer_size = &ctx.ecc_cert_buffer_size;
+        break;
+    default:
+        LOG_ERR("unsupported EK algorithm");
+        return false;
+    }
+
+    /* drop anything left behind by a failed NV lookup */
+    free(*request->cert_buffer);
+    *request->cert_buffer = NULL;
+    *request->cert_buffer_size = 0;
+
+    unsigned char *hash = hash_ek_public(ek_public);
+    if (!hash) {
+        return false;
     }
 
     bool ret = true;
-    unsigned char *hash = hash_ek_public();
+    if (ctx.cache_dir) {
+        ret = cache_path_from_hash(hash, request->cache_path,
+            sizeof(request->cache_path));
+        if (!ret) {
+            goto out;
+        }
+
+        request->is_cached = cache_load(request);
+        if (request->is_cached) {
+            goto out;
+        }
+    }
+
+    ret = curl_init_once();
+    if (!ret) {
+        goto out;
+    }
+
     char *b64 = base64_encode(hash);
     if (!b64) {
         LOG_ERR("base64_encode returned null");
@@ -322,7 +606,17 @@ static bool get_web_ek_certificate(void) {
 
     LOG_INFO("%s", b64);
 
-    ret = retrieve_web_endorsement_certificate(b64);
+    #define NULL_TERM_LEN 1                 // '\0'
+    #define PATH_JOIN_CHAR_LEN 1            // '/'
+    size_t len = strlen(ctx.ek_server_addr) + strlen(b64) + NULL_TERM_LEN +
+        PATH_JOIN_CHAR_LEN;
+    request->weblink = (char *) malloc(len);
+    if (!request->weblink) {
+        LOG_ERR("oom");
+        ret = false;
+    } else {
+        snprintf(request->weblink, len, "%s%s%s", ctx.ek_server_addr, "/", b64);
+    }
 
     free(b64);
 out:
@@ -330,6 +624,53 @@ out:
     return ret;
 }
 
+static bool get_web_ek_certificate(void) {
+
+    if (ctx.SSL_NO_VERIFY) {
+        LOG_WARN("TLS communication with the said TPM manufacturer server setup"
+                 " with SSL_NO_VERIFY!");
+    }
+
+    if (ctx.ek_count == MAX_EK_PUBLIC_COUNT &&
+        ctx.out_public[0].publicArea.type == ctx.out_public[1].publicArea.type) {
+        LOG_ERR("Specify at most one RSA and one ECC EK public key");
+        return false;
+    }
+
+    ek_web_request requests[MAX_EK_PUBLIC_COUNT] = { 0 };
+    bool is_fetch_needed = false;
+    bool ret = true;
+    uint8_t i;
+    for (i = 0; i < ctx.ek_count; i++) {
+        ret = setup_web_request(&requests[i], &ctx.out_public[i]);
+        if (!ret) {
+            goto out;
+        }
+        is_fetch_needed |= !requests[i].is_cached;
+    }
+
+    if (!is_fetch_needed) {
+        goto out;
+    }
+
+    ret = retrieve_web_endorsement_certificates(requests, ctx.ek_count);
+    if (!ret || !ctx.cache_dir) {
+        goto out;
+    }
+
+    for (i = 0; i < ctx.ek_count; i++) {
+        if (!requests[i].is_cached) {
+            cache_store(&requests[i]);
+        }
+    }
+
+out:
+    for (i = 0; i < ctx.ek_count; i++) {
+        free(requests[i].weblink);
+    }
+    return ret;
+}
+
 #define INTC 0x494E5443
 #define IBM  0x49424D20
 #define RSA_EK_CERT_NV_INDEX 0x01C00002
@@ -453,11 +794,6 @@ static tool_rc get_nv_ek_certificate(ESYS_CONTEXT *ectx) {
         LOG_WARN("Ignoring -X or --allow-unverified if EK certificate found on NV");
     }
 
-    if (ctx.ek_path) {
-        LOG_WARN("Ignoring -u or --ek-public option if EK certificate found on NV");
-        return tool_rc_option_error;
-    }
-
     if (ctx.is_rsa_ek_cert_nv_location_defined &&
     ctx.is_ecc_ek_cert_nv_location_defined && ctx.cert_count == 1) {
         LOG_WARN("Found 2 certficates on NV. Add another -o to save the ECC cert");
@@ -478,6 +814,17 @@ static tool_rc get_nv_ek_certificate(ESYS_CONTEXT *ectx) {
 
     if (ctx.is_ecc_ek_cert_nv_location_defined) {
         rc = nv_read(ectx, ECC_EK_CERT_NV_INDEX);
+        if (rc != tool_rc_success) {
+            return rc;
+        }
+    }
+
+    /*
+     * The NV indices are the authoritative and cheapest source, so they are
+     * consulted first even when EK publics for a web lookup were supplied.
+     */
+    if (ctx.ek_count) {
+        LOG_WARN("Ignoring -u or --ek-public option as EK certificate found on NV");
     }
 
     return rc;
@@ -520,12 +867,12 @@ static tool_rc get_ek_certificates(ESYS_CONTEXT *ectx) {
         return rc;
     }
 
-    if (!ctx.ek_path) {
+    if (!ctx.ek_count) {
         LOG_ERR("Must specify the EK public key path");
         return tool_rc_option_error;
     }
 
-    if (ctx.cert_count > 1) {
+    if (ctx.cert_count > ctx.ek_count) {
         LOG_ERR("Specify one output path for EK cert file per EK public key");
         return tool_rc_option_error;
     }
@@ -540,14 +887,21 @@ static tool_rc get_ek_certificates(ESYS_CONTEXT *ectx) {
 
 static tool_rc process_input(ESYS_CONTEXT *ectx) {
 
-    if (ctx.ek_path) {
-        ctx.out_public = malloc(sizeof(*ctx.out_public));
-        ctx.out_public->size = 0;
-        bool res = files_load_public(ctx.ek_path, ctx.out_public);
-        if (!res) {
-            LOG_ERR("Could not load EK public from file");
+    if (ctx.ek_count) {
+        ctx.out_public = calloc(ctx.ek_count, sizeof(*ctx.out_public));
+        if (!ctx.out_public) {
+            LOG_ERR("oom");
             return tool_rc_general_error;
         }
+
+        uint8_t i;
+        for (i = 0; i < ctx.ek_count; i++) {
+            bool res = files_load_public(ctx.ek_path[i], &ctx.out_public[i]);
+            if (!res) {
+                LOG_ERR("Could not load EK public from file");
+                return tool_rc_general_error;
+            }
+        }
     }
 
     tool_rc rc = tool_rc_success;
@@ -575,7 +929,6 @@ static char *base64_decode(char **split, unsigned int cert_length) {
         }
     }
     curl_easy_cleanup(curl);
-    curl_global_cleanup();
 
     if(final_string) {
         size_t i;
@@ -652,10 +1005,13 @@ static tool_rc process_output(void) {
     }
 
     if (ctx.ecc_cert_buffer) {
-        retval = files_write_bytes(
-            ctx.ec_cert_file_handle_2 ? ctx.ec_cert_file_handle_2 :
-            ctx.rsa_cert_buffer ? stdout : ctx.ec_cert_file_handle_1,
-            ctx.ecc_cert_buffer, ctx.ecc_cert_buffer_size);
+        FILE *ecc_cert_file_handle = ctx.ec_cert_file_handle_2;
+        if (!ecc_cert_file_handle) {
+            ecc_cert_file_handle = (ctx.rsa_cert_buffer ||
+                !ctx.ec_cert_file_handle_1) ? stdout : ctx.ec_cert_file_handle_1;
+        }
+        retval = files_write_bytes(ecc_cert_file_handle, ctx.ecc_cert_buffer,
+            ctx.ecc_cert_buffer_size);
         if (!retval) {
             return tool_rc_general_error;
         }
@@ -666,7 +1022,7 @@ static tool_rc process_output(void) {
 
 static tool_rc check_input_options(void) {
 
-    if (!ctx.ek_path && !ctx.is_cert_on_nv) {
+    if (!ctx.ek_count && !ctx.is_cert_on_nv) {
         LOG_ERR("Must specify the EK public key path");
         return tool_rc_option_error;
     }
@@ -731,7 +1087,11 @@ static bool on_option(char key, char *value) {
         ctx.SSL_NO_VERIFY = 1;
         break;
     case 'u':
-        ctx.ek_path = value;
+        if (ctx.ek_count == MAX_EK_PUBLIC_COUNT) {
+            LOG_ERR("Specify only 2 EK publics for RSA/ ECC certificates");
+            return false;
+        }
+        ctx.ek_path[ctx.ek_count++] = value;
         break;
     case 'x':
         ctx.is_tpm2_device_active = false;
@@ -740,6 +1100,9 @@ static bool on_option(char key, char *value) {
     case 0:
         ctx.is_cert_raw = true;
         break;
+    case 1:
+        ctx.cache_dir = value;
+        break;
     }
     return true;
 }
@@ -753,6 +1116,7 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
         { "ek-public",        required_argument, NULL, 'u' },
         { "offline",          no_argument,       NULL, 'x' },
         { "raw",              no_argument,       NULL,  0  },
+        { "cache-dir",        required_argument, NULL,  1  },
     };
 
     *opts = tpm2_options_new("o:u:Xx", ARRAY_LEN(topts), topts, on_option,
@@ -805,6 +1169,10 @@ static tool_rc tpm2_tool_onstop(ESYS_CONTEXT *ectx) {
         free(ctx.ecc_cert_buffer);
     }
 
+    if (ctx.is_curl_initialized) {
+        curl_global_cleanup();
+    }
+
     return tool_rc_success;
 }
 
@@ -11,6 +11,8 @@
 #include "log.h"
 #include "tpm2.h"
 #include "tpm2_alg_util.h"
+#include "tpm2_auth_util.h"
+#include "tpm2_hash.h"
 #include "tpm2_tool.h"
 
 typedef struct tpm_hmac_ctx tpm_hmac_ctx;
@@ -31,127 +33,88 @@ struct tpm_hmac_ctx {
 
 static tpm_hmac_ctx ctx;
 
-static tool_rc tpm_hmac_file(ESYS_CONTEXT *ectx, TPM2B_DIGEST **result,
-        TPMT_TK_HASHCHECK **validation) {
-
-    unsigned long file_size = 0;
-    FILE *input = ctx.input;
-
-    tool_rc rc;
-    /* Suppress error reporting with NULL path */
-    bool res = files_get_file_size(input, &file_size, NULL);
+typedef struct hmac_sequence hmac_sequence;
+struct hmac_sequence {
+    TPM2B_DIGEST **result;
+    TPMT_TK_HASHCHECK **validation;
+};
 
-    /*
-     * If we can get the file size and its less than 1024, just do it in one hash invocation.
-     * We can't use the one-shot command if we require ticket, as it doesn't provide it in
-     * the response from the TPM.
-     */
-    if (!ctx.ticket_path && res && file_size <= TPM2_MAX_DIGEST_BUFFER) {
+static tool_rc hmac_oneshot(ESYS_CONTEXT *ectx, void *userdata,
+        const TPM2B_MAX_BUFFER *data) {
 
-        TPM2B_MAX_BUFFER buffer = { .size = file_size };
+    hmac_sequence *seq = userdata;
 
-        res = files_read_bytes(ctx.input, buffer.buffer, buffer.size);
-        if (!res) {
-            LOG_ERR("Error reading input file!");
-            return tool_rc_general_error;
+    if (ctx.cp_hash_path) {
+        LOG_WARN("Exiting without performing HMAC when calculating cpHash");
+        TPM2B_DIGEST cp_hash = { .size = 0 };
+        tool_rc rc = tpm2_hmac(ectx, &ctx.hmac_key.object, ctx.halg, data,
+        seq->result, &cp_hash);
+        if (rc != tool_rc_success) {
+            return rc;
         }
 
-        if (ctx.cp_hash_path) {
-            LOG_WARN("Exiting without performing HMAC when calculating cpHash");
-            TPM2B_DIGEST cp_hash = { .size = 0 };
-            tool_rc rc = tpm2_hmac(ectx, &ctx.hmac_key.object, ctx.halg,
-            &buffer, result, &cp_hash);
-            if (rc != tool_rc_success) {
-                return rc;
-            }
-
-            bool result = files_save_digest(&cp_hash, ctx.cp_hash_path);
-            if (!result) {
-                rc = tool_rc_general_error;
-            }
-            return rc;
+        bool result = files_save_digest(&cp_hash, ctx.cp_hash_path);
+        if (!result) {
+            rc = tool_rc_general_error;
         }
-        /*
-         * hash algorithm specified in the key's scheme is used as the
-         * hash algorithm for the HMAC
-         */
-        return tpm2_hmac(ectx, &ctx.hmac_key.object, ctx.halg, &buffer, result,
-        NULL);
+        return rc;
     }
+    /*
+     * hash algorithm specified in the key's scheme is used as the
+     * hash algorithm for the HMAC
+     */
+    return tpm2_hmac(ectx, &ctx.hmac_key.object, ctx.halg, data, seq->result,
+    NULL);
+}
+
+static tool_rc hmac_start(ESYS_CONTEXT *ectx, void *userdata,
+        ESYS_TR *sequence_handle, ESYS_TR *shandle1) {
+
+    UNUSED(userdata);
 
     if (ctx.cp_hash_path) {
         LOG_ERR("Cannot calculate cpHash for buffers requiring HMAC sequence.");
         return tool_rc_general_error;
     }
 
-    ESYS_TR sequence_handle;
-    /*
-     * Size is either unknown because the FILE * is a fifo, or it's too big
-     * to do in a single hash call. Based on the size figure out the chunks
-     * to loop over, if possible. This way we can call Complete with data.
-     */
-    rc = tpm2_hmac_start(ectx, &ctx.hmac_key.object, ctx.halg,
-            &sequence_handle);
+    tool_rc rc = tpm2_hmac_start(ectx, &ctx.hmac_key.object, ctx.halg,
+            sequence_handle);
     if (rc != tool_rc_success) {
         return rc;
     }
 
-    /* If we know the file size, we decrement the amount read and terminate the
-     * loop when 1 block is left, else we go till feof.
-     */
-    size_t left = file_size;
-    bool use_left = !!res;
-
-    TPM2B_MAX_BUFFER data;
-
-    bool done = false;
-    while (!done) {
+    return tpm2_auth_util_get_shandle(ectx, ctx.hmac_key.object.tr_handle,
+            ctx.hmac_key.object.session, shandle1);
+}
 
-        size_t bytes_read = fread(data.buffer, 1,
-                BUFFER_SIZE(typeof(data), buffer), input);
-        if (ferror(input)) {
-            LOG_ERR("Error reading from input file");
-            return tool_rc_general_error;
-        }
+static tool_rc hmac_complete(ESYS_CONTEXT *ectx, void *userdata,
+        ESYS_TR sequence_handle, const TPM2B_MAX_BUFFER *data) {
 
-        data.size = bytes_read;
+    hmac_sequence *seq = userdata;
 
-        /* if data was read, update the sequence */
-        rc = tpm2_hmac_sequenceupdate(ectx, sequence_handle,
-                &ctx.hmac_key.object, &data);
-        if (rc != tool_rc_success) {
-            return rc;
-        }
+    return tpm2_hmac_sequencecomplete(ectx, sequence_handle,
+            &ctx.hmac_key.object, data, seq->result, seq->validation);
+}
 
-        if (use_left) {
-            left -= bytes_read;
-            if (left <= TPM2_MAX_DIGEST_BUFFER) {
-                done = true;
-                continue;
-            }
-        } else if (feof(input)) {
-            done = true;
-        }
-    } /* end file read/hash update loop */
+static tool_rc tpm_hmac_file(ESYS_CONTEXT *ectx, TPM2B_DIGEST **result,
+        TPMT_TK_HASHCHECK **validation) {
 
-    if (use_left) {
-        data.size = left;
-        bool res = files_read_bytes(input, data.buffer, left);
-        if (!res) {
-            LOG_ERR("Error reading from input file.");
-            return tool_rc_general_error;
-        }
-    } else {
-        data.size = 0;
-    }
+    /*
+     * We can't use the one-shot command if we require ticket, as it doesn't
+     * provide it in the response from the TPM.
+     */
+    const tpm2_hash_sequence_ops ops = {
+        .oneshot = ctx.ticket_path ? NULL : hmac_oneshot,
+        .start = hmac_start,
+        .complete = hmac_complete,
+    };
 
-    rc = tpm2_hmac_sequencecomplete(ectx, sequence_handle, &ctx.hmac_key.object,
-            &data, result, validation);
-    if (rc != tool_rc_success) {
-        return rc;
-    }
+    hmac_sequence seq = {
+        .result = result,
+        .validation = validation,
+    };
 
-    return tool_rc_success;
+    return tpm2_hash_sequence_stream(ectx, &ops, &seq, ctx.input, NULL, 0);
 }
 
 static tool_rc do_hmac_and_output(ESYS_CONTEXT *ectx) {
@@ -12,9 +12,11 @@
 #include "tpm2.h"
 #include "tpm2_tool.h"
 #include "tpm2_alg_util.h"
+#include "tpm2_batch.h"
 #include "tpm2_identity_util.h"
 #include "tpm2_options.h"
 #include "tpm2_openssl.h"
+#include "tpm2_worker.h"
 
 typedef struct tpm_makecred_ctx tpm_makecred_ctx;
 struct tpm_makecred_ctx {
@@ -32,12 +34,18 @@ struct tpm_makecred_ctx {
     } flags;
 
     char *key_type; //type of key attempting to load, defaults to auto attempt
+    TPMI_ALG_PUBLIC key_alg;
+
+    char *batch_path; /* manifest of credentials to make, see batch_run() */
+    unsigned jobs;
 };
 
 static tpm_makecred_ctx ctx = {
     .object_name = TPM2B_EMPTY_INIT,
     .public = TPM2B_EMPTY_INIT,
     .credential = TPM2B_EMPTY_INIT,
+    .key_alg = TPM2_ALG_NULL,
+    .jobs = 1,
 };
 
 static bool write_cred_and_secret(const char *path, TPM2B_ID_OBJECT *cred,
@@ -89,24 +97,25 @@ out:
     return result;
 }
 
-static tool_rc make_external_credential_and_save(void) {
+static bool make_external_credential(TPM2B_PUBLIC *public,
+        TPM2B_NAME *object_name, TPM2B_DIGEST *credential,
+        TPM2B_ID_OBJECT *cred_blob, TPM2B_ENCRYPTED_SECRET *encrypted_seed) {
 
     /*
      * Get name_alg from the public key
      */
-    TPMI_ALG_HASH name_alg = ctx.public.publicArea.nameAlg;
+    TPMI_ALG_HASH name_alg = public->publicArea.nameAlg;
 
     /*
      * Generate and encrypt seed
      */
     TPM2B_DIGEST seed = TPM2B_TYPE_INIT(TPM2B_DIGEST, buffer);
-    TPM2B_ENCRYPTED_SECRET encrypted_seed = TPM2B_EMPTY_INIT;
     unsigned char label[10] = { 'I', 'D', 'E', 'N', 'T', 'I', 'T', 'Y', 0 };
     bool res = tpm2_identity_util_share_secret_with_public_key(&seed,
-            &ctx.public, label, 9, &encrypted_seed);
+            public, label, 9, encrypted_seed);
     if (!res) {
         LOG_ERR("Failed Seed Encryption\n");
-        return tool_rc_general_error;
+        return false;
     }
 
     /*
@@ -114,32 +123,36 @@ static tool_rc make_external_credential_and_save(void) {
      */
     TPM2B_MAX_BUFFER hmac_key;
     TPM2B_MAX_BUFFER enc_key;
-    tpm2_identity_util_calc_outer_integrity_hmac_key_and_dupsensitive_enc_key(
-            &ctx.public, &ctx.object_name, &seed, &hmac_key, &enc_key);
+    res = tpm2_identity_util_calc_outer_integrity_hmac_key_and_dupsensitive_enc_key(
+            public, object_name, &seed, &hmac_key, &enc_key);
+    if (!res) {
+        LOG_ERR("Failed to calculate the protection keys");
+        return false;
+    }
 
     /*
-     * The ctx.credential needs to be marshalled into struct with
+     * The credential needs to be marshalled into struct with
      * both size and contents together (to be encrypted as a block)
      */
     TPM2B_MAX_BUFFER marshalled_inner_integrity = TPM2B_EMPTY_INIT;
-    marshalled_inner_integrity.size = ctx.credential.size
-            + sizeof(ctx.credential.size);
-    UINT16 cred_size = ctx.credential.size;
+    marshalled_inner_integrity.size = credential->size
+            + sizeof(credential->size);
+    UINT16 cred_size = credential->size;
     if (!tpm2_util_is_big_endian()) {
         cred_size = tpm2_util_endian_swap_16(cred_size);
     }
     memcpy(marshalled_inner_integrity.buffer, &cred_size, sizeof(cred_size));
-    memcpy(&marshalled_inner_integrity.buffer[2], ctx.credential.buffer,
-            ctx.credential.size);
+    memcpy(&marshalled_inner_integrity.buffer[2], credential->buffer,
+            credential->size);
 
     /*
      * Perform inner encryption (encIdentity) and outer HMAC (outerHMAC)
      */
     TPM2B_DIGEST outer_hmac = TPM2B_EMPTY_INIT;
     TPM2B_MAX_BUFFER encrypted_sensitive = TPM2B_EMPTY_INIT;
-    tpm2_identity_util_calculate_outer_integrity(name_alg, &ctx.object_name,
+    tpm2_identity_util_calculate_outer_integrity(name_alg, object_name,
             &marshalled_inner_integrity, &hmac_key, &enc_key,
-            &ctx.public.publicArea.parameters.rsaDetail.symmetric,
+            &public->publicArea.parameters.rsaDetail.symmetric,
             &encrypted_sensitive, &outer_hmac);
 
     /*
@@ -147,25 +160,36 @@ static tool_rc make_external_credential_and_save(void) {
      * cred_bloc = outer_hmac || encrypted_sensitive
      * secret = encrypted_seed (with pubEK)
      */
-    TPM2B_ID_OBJECT cred_blob = TPM2B_TYPE_INIT(TPM2B_ID_OBJECT, credential);
-
     UINT16 outer_hmac_size = outer_hmac.size;
     if (!tpm2_util_is_big_endian()) {
         outer_hmac_size = tpm2_util_endian_swap_16(outer_hmac_size);
     }
     int offset = 0;
-    memcpy(cred_blob.credential + offset, &outer_hmac_size,
+    memcpy(cred_blob->credential + offset, &outer_hmac_size,
             sizeof(outer_hmac.size));
     offset += sizeof(outer_hmac.size);
-    memcpy(cred_blob.credential + offset, outer_hmac.buffer, outer_hmac.size);
+    memcpy(cred_blob->credential + offset, outer_hmac.buffer, outer_hmac.size);
     offset += outer_hmac.size;
     //NOTE: do NOT include the encrypted_sensitive size, since it is encrypted with the blob!
-    memcpy(cred_blob.credential + offset, encrypted_sensitive.buffer,
+    memcpy(cred_blob->credential + offset, encrypted_sensitive.buffer,
             encrypted_sensitive.size);
 
-    cred_blob.size = outer_hmac.size + encrypted_sensitive.size
+    cred_blob->size = outer_hmac.size + encrypted_sensitive.size
             + sizeof(outer_hmac.size);
 
+    return true;
+}
+
+static tool_rc make_external_credential_and_save(void) {
+
+    TPM2B_ID_OBJECT cred_blob = TPM2B_TYPE_INIT(TPM2B_ID_OBJECT, credential);
+    TPM2B_ENCRYPTED_SECRET encrypted_seed = TPM2B_EMPTY_INIT;
+    bool result = make_external_credential(&ctx.public, &ctx.object_name,
+            &ctx.credential, &cred_blob, &encrypted_seed);
+    if (!result) {
+        return tool_rc_general_error;
+    }
+
     return write_cred_and_secret(ctx.out_file_path, &cred_blob,
             &encrypted_seed) ? tool_rc_success : tool_rc_general_error;
 }
@@ -201,6 +225,177 @@ static tool_rc make_credential_and_save(ESYS_CONTEXT *ectx) {
     return ret ? tool_rc_success : tool_rc_general_error;
 }
 
+typedef struct makecred_batch_item makecred_batch_item;
+struct makecred_batch_item {
+    char *public_path;
+    char *name;
+    char *secret_path;
+    char *out_path;
+    size_t line;
+};
+
+typedef struct makecred_batch makecred_batch;
+struct makecred_batch {
+    makecred_batch_item items[TPM2_BATCH_CHUNK];
+};
+
+static void set_default_TCG_EK_template(TPM2B_PUBLIC *public,
+        TPMI_ALG_PUBLIC alg);
+
+static bool load_secret(const char *path, TPM2B_DIGEST *credential) {
+
+    /*
+     * Maximum size of the allowed secret-data size  to fit in TPM2B_DIGEST
+     */
+    credential->size = TPM2_SHA512_DIGEST_SIZE;
+
+    bool result = files_load_bytes_from_buffer_or_file_or_stdin(NULL,
+        path, &credential->size, credential->buffer);
+    if (!result) {
+        return false;
+    }
+
+    /*
+     * If input was read from stdin, check if a larger data set was specified
+     * and error out.
+     */
+    if (credential->size > TPM2_SHA512_DIGEST_SIZE) {
+        LOG_ERR("Size is larger than buffer, got %d expected less than or equal"
+        "to %d", credential->size, TPM2_SHA512_DIGEST_SIZE);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Runs on the worker threads: everything an item needs is loaded, computed
+ * and written here so that only the manifest parsing is serialized.
+ */
+static bool batch_process_item(void *userdata, size_t index) {
+
+    makecred_batch *batch = (makecred_batch *) userdata;
+    makecred_batch_item *item = &batch->items[index];
+
+    TPM2B_PUBLIC public = TPM2B_EMPTY_INIT;
+    bool result = tpm2_openssl_load_public(item->public_path, ctx.key_alg,
+            &public);
+    if (!result) {
+        goto out;
+    }
+
+    if (ctx.key_type) {
+        set_default_TCG_EK_template(&public, ctx.key_alg);
+    }
+
+    TPM2B_NAME object_name = TPM2B_TYPE_INIT(TPM2B_NAME, name);
+    int q = tpm2_util_hex_to_byte_structure(item->name, &object_name.size,
+            object_name.name);
+    if (q != 0) {
+        LOG_ERR("Invalid name \"%s\"", item->name);
+        result = false;
+        goto out;
+    }
+
+    TPM2B_DIGEST credential = TPM2B_EMPTY_INIT;
+    result = load_secret(item->secret_path, &credential);
+    if (!result) {
+        goto out;
+    }
+
+    TPM2B_ID_OBJECT cred_blob = TPM2B_TYPE_INIT(TPM2B_ID_OBJECT, credential);
+    TPM2B_ENCRYPTED_SECRET encrypted_seed = TPM2B_EMPTY_INIT;
+    result = make_external_credential(&public, &object_name, &credential,
+            &cred_blob, &encrypted_seed);
+    if (!result) {
+        goto out;
+    }
+
+    result = write_cred_and_secret(item->out_path, &cred_blob,
+            &encrypted_seed);
+
+out:
+    if (!result) {
+        LOG_ERR("Failed to make the credential on line %zu of the manifest",
+                item->line);
+    }
+
+    return result;
+}
+
+static void batch_free_items(void *userdata, size_t count) {
+
+    makecred_batch *batch = (makecred_batch *) userdata;
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        free(batch->items[i].public_path);
+        free(batch->items[i].name);
+        free(batch->items[i].secret_path);
+        free(batch->items[i].out_path);
+    }
+}
+
+static bool batch_parse_item(void *userdata, size_t index, char **fields,
+        size_t count, size_t line) {
+
+    makecred_batch *batch = (makecred_batch *) userdata;
+    makecred_batch_item *item = &batch->items[index];
+    memset(item, 0, sizeof(*item));
+    item->line = line;
+
+    if (count != 4) {
+        LOG_ERR("Expected PUBLIC NAME SECRET OUTPUT");
+        return false;
+    }
+
+    /* stdin and stdout are shared by all of the items */
+    if (!strcmp(fields[0], "-") || !strcmp(fields[2], "-") ||
+        !strcmp(fields[3], "-")) {
+        LOG_ERR("Expected files, \"-\" cannot be used in a manifest");
+        return false;
+    }
+
+    item->public_path = strdup(fields[0]);
+    item->name = strdup(fields[1]);
+    item->secret_path = strdup(fields[2]);
+    item->out_path = strdup(fields[3]);
+    if (!item->public_path || !item->name || !item->secret_path ||
+        !item->out_path) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    return true;
+}
+
+static const tpm2_batch_ops batch_ops = {
+    .max_fields = 4,
+    .parse = batch_parse_item,
+    .process = batch_process_item,
+    .free = batch_free_items,
+};
+
+static tool_rc batch_run(void) {
+
+    makecred_batch *batch = malloc(sizeof(*batch));
+    if (!batch) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    tpm2_batch_stats stats;
+    tool_rc rc = tpm2_batch_run(ctx.batch_path, &batch_ops, ctx.jobs, batch,
+            &stats);
+    if (stats.is_complete) {
+        tpm2_batch_output(&stats, "credentials", ctx.jobs);
+    }
+
+    free(batch);
+
+    return rc;
+}
+
 static bool on_option(char key, char *value) {
 
     switch (key) {
@@ -241,6 +436,11 @@ static bool on_option(char key, char *value) {
     case 'G':
         ctx.key_type = value;
         break;
+    case 0:
+        ctx.batch_path = value;
+        break;
+    case 1:
+        return tpm2_worker_jobs_from_optarg(value, &ctx.jobs);
     }
 
     return true;
@@ -255,6 +455,8 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
       {"name",            required_argument, NULL, 'n'},
       {"credential-blob", required_argument, NULL, 'o'},
       { "key-algorithm",  required_argument, NULL, 'G'},
+      { "batch",          required_argument, NULL,  0 },
+      { "jobs",           required_argument, NULL,  1 },
     };
 
     *opts = tpm2_options_new("G:u:e:s:n:o:", ARRAY_LEN(topts), topts, on_option,
@@ -263,35 +465,36 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
     return *opts != NULL;
 }
 
-static void set_default_TCG_EK_template(TPMI_ALG_PUBLIC alg) {
+static void set_default_TCG_EK_template(TPM2B_PUBLIC *public,
+        TPMI_ALG_PUBLIC alg) {
 
     switch (alg) {
         case TPM2_ALG_RSA:
-            ctx.public.publicArea.parameters.rsaDetail.symmetric.algorithm =
+            public->publicArea.parameters.rsaDetail.symmetric.algorithm =
                     TPM2_ALG_AES;
-            ctx.public.publicArea.parameters.rsaDetail.symmetric.keyBits.aes = 128;
-            ctx.public.publicArea.parameters.rsaDetail.symmetric.mode.aes =
+            public->publicArea.parameters.rsaDetail.symmetric.keyBits.aes = 128;
+            public->publicArea.parameters.rsaDetail.symmetric.mode.aes =
                     TPM2_ALG_CFB;
-            ctx.public.publicArea.parameters.rsaDetail.scheme.scheme = TPM2_ALG_NULL;
-            ctx.public.publicArea.parameters.rsaDetail.keyBits = 2048;
-            ctx.public.publicArea.parameters.rsaDetail.exponent = 0;
-            ctx.public.publicArea.unique.rsa.size = 256;
+            public->publicArea.parameters.rsaDetail.scheme.scheme = TPM2_ALG_NULL;
+            public->publicArea.parameters.rsaDetail.keyBits = 2048;
+            public->publicArea.parameters.rsaDetail.exponent = 0;
+            public->publicArea.unique.rsa.size = 256;
             break;
         case TPM2_ALG_ECC:
-            ctx.public.publicArea.parameters.eccDetail.symmetric.algorithm =
+            public->publicArea.parameters.eccDetail.symmetric.algorithm =
                     TPM2_ALG_AES;
-            ctx.public.publicArea.parameters.eccDetail.symmetric.keyBits.aes = 128;
-            ctx.public.publicArea.parameters.eccDetail.symmetric.mode.sym =
+            public->publicArea.parameters.eccDetail.symmetric.keyBits.aes = 128;
+            public->publicArea.parameters.eccDetail.symmetric.mode.sym =
                     TPM2_ALG_CFB;
-            ctx.public.publicArea.parameters.eccDetail.scheme.scheme = TPM2_ALG_NULL;
-            ctx.public.publicArea.parameters.eccDetail.curveID = TPM2_ECC_NIST_P256;
-            ctx.public.publicArea.parameters.eccDetail.kdf.scheme = TPM2_ALG_NULL;
-            ctx.public.publicArea.unique.ecc.x.size = 32;
-            ctx.public.publicArea.unique.ecc.y.size = 32;
+            public->publicArea.parameters.eccDetail.scheme.scheme = TPM2_ALG_NULL;
+            public->publicArea.parameters.eccDetail.curveID = TPM2_ECC_NIST_P256;
+            public->publicArea.parameters.eccDetail.kdf.scheme = TPM2_ALG_NULL;
+            public->publicArea.unique.ecc.x.size = 32;
+            public->publicArea.unique.ecc.y.size = 32;
             break;
     }
 
-    ctx.public.publicArea.objectAttributes =
+    public->publicArea.objectAttributes =
           TPMA_OBJECT_RESTRICTED  | TPMA_OBJECT_ADMINWITHPOLICY
         | TPMA_OBJECT_DECRYPT     | TPMA_OBJECT_FIXEDTPM
         | TPMA_OBJECT_FIXEDPARENT | TPMA_OBJECT_SENSITIVEDATAORIGIN;
@@ -304,29 +507,37 @@ static void set_default_TCG_EK_template(TPMI_ALG_PUBLIC alg) {
             0x0B, 0x64, 0xF2, 0xA1, 0xDA, 0x1B, 0x33, 0x14, 0x69, 0xAA
         }
     };
-    TPM2B_DIGEST *authp = &ctx.public.publicArea.authPolicy;
+    TPM2B_DIGEST *authp = &public->publicArea.authPolicy;
     *authp = auth_policy;
 
-    ctx.public.publicArea.nameAlg = TPM2_ALG_SHA256;
+    public->publicArea.nameAlg = TPM2_ALG_SHA256;
 }
 
 static tool_rc process_input(void) {
 
-    TPMI_ALG_PUBLIC alg = TPM2_ALG_NULL;
     if (ctx.key_type) {
         LOG_WARN("Because **-G** is specified, assuming input encryption public key is in PEM format.");
-        alg = tpm2_alg_util_from_optarg(ctx.key_type,
+        ctx.key_alg = tpm2_alg_util_from_optarg(ctx.key_type,
             tpm2_alg_util_flags_asymmetric);
-        if (alg == TPM2_ALG_ERROR ||
-           (alg != TPM2_ALG_RSA && alg != TPM2_ALG_ECC)) {
+        if (ctx.key_alg == TPM2_ALG_ERROR ||
+           (ctx.key_alg != TPM2_ALG_RSA && ctx.key_alg != TPM2_ALG_ECC)) {
             LOG_ERR("Unsupported key type, got: \"%s\"", ctx.key_type);
             return tool_rc_general_error;
         }
     }
 
+    if (ctx.batch_path) {
+        if (ctx.flags.e || ctx.flags.s || ctx.flags.n || ctx.flags.o) {
+            LOG_ERR("Options e, u, s, n and o come from the manifest with "
+                    "**--batch**");
+            return tool_rc_option_error;
+        }
+        return tool_rc_success;
+    }
+
     if (ctx.public_key_path) {
-        bool result = tpm2_openssl_load_public(ctx.public_key_path, alg,
-            &ctx.public);
+        bool result = tpm2_openssl_load_public(ctx.public_key_path,
+            ctx.key_alg, &ctx.public);
         if (!result) {
             return tool_rc_general_error;
         }
@@ -337,7 +548,7 @@ static tool_rc process_input(void) {
      * template since we had to choose "a template".
      */
     if (ctx.key_type) {
-        set_default_TCG_EK_template(alg);
+        set_default_TCG_EK_template(&ctx.public, ctx.key_alg);
     }
 
     if (!ctx.flags.s) {
@@ -350,28 +561,8 @@ static tool_rc process_input(void) {
         return tool_rc_option_error;
     }
 
-    /*
-     * Maximum size of the allowed secret-data size  to fit in TPM2B_DIGEST
-     */
-    ctx.credential.size = TPM2_SHA512_DIGEST_SIZE;
-
-    bool result = files_load_bytes_from_buffer_or_file_or_stdin(NULL,
-        ctx.input_secret_data, &ctx.credential.size, ctx.credential.buffer);
-    if (!result) {
-        return tool_rc_general_error;
-    }
-
-    /*
-     * If input was read from stdin, check if a larger data set was specified
-     * and error out.
-     */
-    if (ctx.credential.size > TPM2_SHA512_DIGEST_SIZE) {
-        LOG_ERR("Size is larger than buffer, got %d expected less than or equal"
-        "to %d", ctx.credential.size, TPM2_SHA512_DIGEST_SIZE);
-        return tool_rc_general_error;
-    }
-
-    return tool_rc_success;
+    bool result = load_secret(ctx.input_secret_data, &ctx.credential);
+    return result ? tool_rc_success : tool_rc_general_error;
 }
 
 static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
@@ -383,6 +574,11 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
         return rc;
     }
 
+    /* batches always run in software, the TPM would serialize them */
+    if (ctx.batch_path) {
+        return batch_run();
+    }
+
     // Run it outside of a TPM
     return ectx ?
             make_credential_and_save(ectx) :
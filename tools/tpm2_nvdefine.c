@@ -2,6 +2,7 @@
 #include <inttypes.h>
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "files.h"
 #include "log.h"
@@ -9,6 +10,8 @@
 #include "tpm2_alg_util.h"
 #include "tpm2_attr_util.h"
 #include "tpm2_auth_util.h"
+#include "tpm2_batch.h"
+#include "tpm2_manifest.h"
 #include "tpm2_nv_util.h"
 #include "tpm2_options.h"
 #include "tpm2_tool.h"
@@ -38,6 +41,10 @@ struct tpm_nvdefine_ctx {
 
     TPM2B_NV_PUBLIC public_info;
 
+    char *batch_path; /* manifest of NV indices, see batch_run() */
+    bool prune;
+    bool is_dry_run;
+
     /*
      * Outputs
      */
@@ -124,26 +131,27 @@ static tool_rc process_output(ESYS_CONTEXT *ectx) {
 }
 
 
-static void handle_default_attributes(void) {
+static void handle_default_attributes(TPMA_NV *nv_attribute,
+        bool has_policy) {
 
     /* attributes set no need for defaults */
-    if (ctx.nv_attribute) {
+    if (*nv_attribute) {
         return;
     }
 
     ESYS_TR h = ctx.auth_hierarchy.object.tr_handle;
 
     if (h == ESYS_TR_RH_OWNER) {
-        ctx.nv_attribute |= TPMA_NV_OWNERWRITE | TPMA_NV_OWNERREAD;
+        *nv_attribute |= TPMA_NV_OWNERWRITE | TPMA_NV_OWNERREAD;
     } else if (h == ESYS_TR_RH_PLATFORM) {
-        ctx.nv_attribute |= TPMA_NV_PPWRITE | TPMA_NV_PPREAD;
+        *nv_attribute |= TPMA_NV_PPWRITE | TPMA_NV_PPREAD;
     } /* else it's an nv index for auth */
 
     /* if it has a policy file, set policy read and write vs auth read and write */
-    if (ctx.policy_file) {
-        ctx.nv_attribute |= TPMA_NV_POLICYWRITE | TPMA_NV_POLICYREAD;
+    if (has_policy) {
+        *nv_attribute |= TPMA_NV_POLICYWRITE | TPMA_NV_POLICYREAD;
     } else {
-        ctx.nv_attribute |= TPMA_NV_AUTHWRITE | TPMA_NV_AUTHREAD;
+        *nv_attribute |= TPMA_NV_AUTHWRITE | TPMA_NV_AUTHREAD;
     }
 }
 
@@ -229,32 +237,33 @@ out:
     return rc;
 }
 
-static tool_rc validate_size(ESYS_CONTEXT *ectx) {
+static tool_rc validate_size(ESYS_CONTEXT *ectx, TPMA_NV nv_attribute,
+        bool size_set, UINT16 *size) {
 
     UINT16 hash_size = tpm2_alg_util_get_hash_size(ctx.halg);
 
-    switch ((ctx.nv_attribute & TPMA_NV_TPM2_NT_MASK) >> TPMA_NV_TPM2_NT_SHIFT) {
+    switch ((nv_attribute & TPMA_NV_TPM2_NT_MASK) >> TPMA_NV_TPM2_NT_SHIFT) {
         case TPM2_NT_ORDINARY:
-            if (!ctx.size_set) {
-                ctx.size = tpm2_nv_util_max_allowed_nv_size(ectx, true);
+            if (!size_set) {
+                *size = tpm2_nv_util_max_allowed_nv_size(ectx, true);
             }
             break;
         case TPM2_NT_COUNTER:
         case TPM2_NT_BITS:
         case TPM2_NT_PIN_FAIL:
         case TPM2_NT_PIN_PASS:
-            if (!ctx.size_set) {
-                ctx.size = 8;
-            } else if (ctx.size != 8) {
+            if (!size_set) {
+                *size = 8;
+            } else if (*size != 8) {
                 LOG_ERR("Size is invalid for an NV index type,"
                         " it must be size of 8");
                 return tool_rc_general_error;
             }
             break;
         case TPM2_NT_EXTEND:
-            if (!ctx.size_set) {
-                ctx.size = hash_size;
-            } else if (ctx.size != hash_size) {
+            if (!size_set) {
+                *size = hash_size;
+            } else if (*size != hash_size) {
                 LOG_ERR("Size is invalid for an NV index type: \"extend\","
                         " it must match the name hash algorithm size of %"
                         PRIu16, hash_size);
@@ -310,7 +319,7 @@ static tool_rc process_inputs(ESYS_CONTEXT *ectx) {
     /*
      * 3. Command specific initializations dependent on loaded objects
      */
-    handle_default_attributes();
+    handle_default_attributes(&ctx.nv_attribute, ctx.policy_file != NULL);
 
     if (!ctx.nv_index) {
         rc = handle_no_index_specified(ectx, &ctx.nv_index);
@@ -319,7 +328,7 @@ static tool_rc process_inputs(ESYS_CONTEXT *ectx) {
         }
     }
 
-    rc = validate_size(ectx);
+    rc = validate_size(ectx, ctx.nv_attribute, ctx.size_set, &ctx.size);
     if (rc != tool_rc_success) {
         return rc;
     }
@@ -371,8 +380,668 @@ static tool_rc process_inputs(ESYS_CONTEXT *ectx) {
     return rc;
 }
 
+/*
+ * Indices at and above are reserved by the TCG, for instance for the EK
+ * certificates, and never pruned.
+ */
+#define NVDEFINE_TCG_RESERVED_FIRST 0x01C00000
+
+typedef enum nvdefine_action nvdefine_action;
+enum nvdefine_action {
+    nvdefine_action_keep,
+    nvdefine_action_define,
+    nvdefine_action_redefine,
+    nvdefine_action_undefine,
+};
+
+static const char *nvdefine_action_names[] = {
+    [nvdefine_action_keep] = "keep",
+    [nvdefine_action_define] = "define",
+    [nvdefine_action_redefine] = "redefine",
+    [nvdefine_action_undefine] = "undefine",
+};
+
+typedef struct nvdefine_batch_item nvdefine_batch_item;
+struct nvdefine_batch_item {
+    /* the declared index, or the index found on the TPM when pruning */
+    TPM2B_NV_PUBLIC public_info;
+    /* the initial content, NULL if none */
+    char *data_path;
+    /* 0 for indices not in the manifest */
+    size_t line;
+    nvdefine_action action;
+    bool is_defined;
+    bool is_written;
+    bool is_write;
+    bool is_failed;
+};
+
+typedef struct nvdefine_batch nvdefine_batch;
+struct nvdefine_batch {
+    nvdefine_batch_item *items;
+    size_t count;
+    size_t capacity;
+    size_t failed;
+};
+
+static nvdefine_batch_item *batch_new_item(nvdefine_batch *batch) {
+
+    if (batch->count == batch->capacity) {
+        size_t capacity = batch->capacity ? batch->capacity * 2 : 64;
+        nvdefine_batch_item *items = realloc(batch->items,
+                capacity * sizeof(*items));
+        if (!items) {
+            LOG_ERR("oom");
+            return NULL;
+        }
+        batch->items = items;
+        batch->capacity = capacity;
+    }
+
+    nvdefine_batch_item *item = &batch->items[batch->count++];
+    memset(item, 0, sizeof(*item));
+    return item;
+}
+
+static nvdefine_batch_item *batch_find_item(nvdefine_batch *batch,
+        TPMI_RH_NV_INDEX nv_index) {
+
+    size_t i;
+    for (i = 0; i < batch->count; i++) {
+        if (batch->items[i].public_info.nvPublic.nvIndex == nv_index) {
+            return &batch->items[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void batch_free_items(nvdefine_batch *batch) {
+
+    size_t i;
+    for (i = 0; i < batch->count; i++) {
+        free(batch->items[i].data_path);
+    }
+
+    free(batch->items);
+    memset(batch, 0, sizeof(*batch));
+}
+
+static bool is_unset(char **fields, size_t count, size_t field) {
+
+    return field >= count || !strcmp(fields[field], "-");
+}
+
+/*
+ * A manifest line declares an index as:
+ *   INDEX [SIZE [ATTRIBUTES [POLICY [DATA]]]]
+ * where "-" picks the default of the field, like the options of the tool.
+ */
+static bool batch_add_item(ESYS_CONTEXT *ectx, nvdefine_batch *batch,
+        char **fields, size_t count, size_t line) {
+
+    TPMI_RH_NV_INDEX nv_index;
+    bool result = tpm2_util_handle_from_optarg(fields[0], &nv_index,
+            TPM2_HANDLE_FLAGS_NV);
+    if (!result || !nv_index) {
+        LOG_ERR("Could not convert NV index to number, got: \"%s\"",
+                fields[0]);
+        return false;
+    }
+
+    if (batch_find_item(batch, nv_index)) {
+        LOG_ERR("NV index 0x%x is declared twice", nv_index);
+        return false;
+    }
+
+    nvdefine_batch_item *item = batch_new_item(batch);
+    if (!item) {
+        return false;
+    }
+    item->line = line;
+
+    bool size_set = !is_unset(fields, count, 1);
+    UINT16 size = 0;
+    if (size_set && !tpm2_util_string_to_uint16(fields[1], &size)) {
+        LOG_ERR("Could not convert size to number, got: \"%s\"", fields[1]);
+        return false;
+    }
+
+    TPMA_NV nv_attribute = 0;
+    if (!is_unset(fields, count, 2)
+            && !tpm2_util_string_to_uint32(fields[2], &nv_attribute)
+            && !tpm2_attr_util_nv_strtoattr(fields[2], &nv_attribute)) {
+        LOG_ERR("Could not convert NV attribute to number or keyword, "
+                "got: \"%s\"", fields[2]);
+        return false;
+    }
+
+    TPMS_NV_PUBLIC *nv_public = &item->public_info.nvPublic;
+    bool has_policy = !is_unset(fields, count, 3);
+    if (has_policy) {
+        nv_public->authPolicy.size = BUFFER_SIZE(TPM2B_DIGEST, buffer);
+        result = files_load_bytes_from_path(fields[3],
+                nv_public->authPolicy.buffer, &nv_public->authPolicy.size);
+        if (!result) {
+            return false;
+        }
+    }
+
+    handle_default_attributes(&nv_attribute, has_policy);
+
+    tool_rc rc = validate_size(ectx, nv_attribute, size_set, &size);
+    if (rc != tool_rc_success) {
+        return false;
+    }
+
+    if (!is_unset(fields, count, 4)) {
+        if (((nv_attribute & TPMA_NV_TPM2_NT_MASK) >> TPMA_NV_TPM2_NT_SHIFT)
+                != TPM2_NT_ORDINARY) {
+            LOG_ERR("Initial content is only supported for ordinary indices");
+            return false;
+        }
+
+        item->data_path = strdup(fields[4]);
+        if (!item->data_path) {
+            LOG_ERR("oom");
+            return false;
+        }
+    }
+
+    nv_public->nvIndex = nv_index;
+    nv_public->nameAlg = ctx.halg;
+    nv_public->attributes = nv_attribute;
+    nv_public->dataSize = size;
+
+    return true;
+}
+
+static tool_rc batch_load(ESYS_CONTEXT *ectx, nvdefine_batch *batch) {
+
+    tpm2_manifest *manifest = tpm2_manifest_open(ctx.batch_path);
+    if (!manifest) {
+        return tool_rc_general_error;
+    }
+
+    tool_rc rc = tool_rc_success;
+    char *fields[5];
+    size_t count = ARRAY_LEN(fields);
+    while (tpm2_manifest_next(manifest, fields, &count)) {
+        bool result = batch_add_item(ectx, batch, fields, count,
+                tpm2_manifest_line(manifest));
+        if (!result) {
+            LOG_ERR("Invalid NV index on line %zu of manifest \"%s\"",
+                    tpm2_manifest_line(manifest),
+                    tpm2_manifest_path(manifest));
+            rc = tool_rc_general_error;
+            break;
+        }
+        count = ARRAY_LEN(fields);
+    }
+
+    if (tpm2_manifest_is_error(manifest)) {
+        rc = tool_rc_general_error;
+    }
+
+    tpm2_manifest_close(manifest);
+
+    return rc;
+}
+
+static bool is_same_public(const TPMS_NV_PUBLIC *declared,
+        const TPMS_NV_PUBLIC *defined) {
+
+    /* set by the TPM as the index is used */
+    TPMA_NV state = TPMA_NV_WRITTEN | TPMA_NV_READLOCKED |
+            TPMA_NV_WRITELOCKED;
+
+    return declared->nameAlg == defined->nameAlg &&
+           (declared->attributes & ~state) == (defined->attributes & ~state) &&
+           declared->dataSize == defined->dataSize &&
+           declared->authPolicy.size == defined->authPolicy.size &&
+           !memcmp(declared->authPolicy.buffer, defined->authPolicy.buffer,
+                   declared->authPolicy.size);
+}
+
+static bool is_prunable(const TPMS_NV_PUBLIC *defined) {
+
+    if (defined->nvIndex >= NVDEFINE_TCG_RESERVED_FIRST) {
+        return false;
+    }
+
+    /* only the indices of the hierarchy the batch defines indices in */
+    bool is_platform = ctx.auth_hierarchy.object.handle == TPM2_RH_PLATFORM;
+    return is_platform == !!(defined->attributes & TPMA_NV_PLATFORMCREATE);
+}
+
+/*
+ * Diffs the declared indices against the indices defined on the TPM. The
+ * public area of the next index is read while the previous one is diffed.
+ */
+static tool_rc batch_scan(ESYS_CONTEXT *ectx, nvdefine_batch *batch) {
+
+    TPMS_CAPABILITY_DATA *capability_data = NULL;
+    tool_rc rc = tpm2_capability_get(ectx, TPM2_CAP_HANDLES, TPM2_HR_NV_INDEX,
+            TPM2_MAX_CAP_HANDLES, &capability_data);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    /* only the declared indices are read, unless pruning */
+    TPML_HANDLE *handles = &capability_data->data.handles;
+    UINT32 count = 0;
+    UINT32 i;
+    for (i = 0; i < handles->count; i++) {
+        if (ctx.prune || batch_find_item(batch, handles->handle[i])) {
+            handles->handle[count++] = handles->handle[i];
+        }
+    }
+    handles->count = count;
+
+    if (handles->count) {
+        rc = tpm2_nv_readpublic_async(ectx, handles->handle[0]);
+        if (rc != tool_rc_success) {
+            goto out;
+        }
+    }
+
+    for (i = 0; i < handles->count; i++) {
+        TPMI_RH_NV_INDEX nv_index = handles->handle[i];
+
+        TPM2B_NV_PUBLIC nv_public = { 0 };
+        TPM2B_NAME nv_name = { 0 };
+        rc = tpm2_nv_readpublic_finish(ectx, &nv_public, &nv_name);
+        if (rc != tool_rc_success) {
+            LOG_ERR("Failed to read the public area of NV index 0x%x",
+                    nv_index);
+            goto out;
+        }
+
+        if (i + 1 < handles->count) {
+            rc = tpm2_nv_readpublic_async(ectx, handles->handle[i + 1]);
+            if (rc != tool_rc_success) {
+                goto out;
+            }
+        }
+
+        nvdefine_batch_item *item = batch_find_item(batch, nv_index);
+        if (!item) {
+            if (is_prunable(&nv_public.nvPublic)) {
+                item = batch_new_item(batch);
+                if (!item) {
+                    rc = tool_rc_general_error;
+                    break;
+                }
+                item->public_info = nv_public;
+                item->action = nvdefine_action_undefine;
+                item->is_defined = true;
+            }
+            continue;
+        }
+
+        item->is_defined = true;
+        item->is_written = nv_public.nvPublic.attributes & TPMA_NV_WRITTEN;
+        if (!is_same_public(&item->public_info.nvPublic,
+                &nv_public.nvPublic)) {
+            item->action = nvdefine_action_redefine;
+            /* undefining needs the attributes of the index as defined */
+            item->public_info.nvPublic.attributes =
+                    nv_public.nvPublic.attributes;
+        }
+    }
+
+    if (rc != tool_rc_success) {
+        /* collect the read in flight before the ESAPI context is used */
+        if (i + 1 < handles->count) {
+            TPM2B_NV_PUBLIC nv_public = { 0 };
+            TPM2B_NAME nv_name = { 0 };
+            tpm2_nv_readpublic_finish(ectx, &nv_public, &nv_name);
+        }
+        goto out;
+    }
+
+    size_t j;
+    for (j = 0; j < batch->count; j++) {
+        nvdefine_batch_item *item = &batch->items[j];
+        if (!item->is_defined) {
+            item->action = nvdefine_action_define;
+        }
+
+        /* content is only written to fresh indices, it cannot be compared */
+        item->is_write = item->data_path &&
+                (item->action != nvdefine_action_keep || !item->is_written) &&
+                item->action != nvdefine_action_undefine;
+    }
+
+out:
+    free(capability_data);
+
+    return rc;
+}
+
+static void batch_fail(nvdefine_batch *batch, nvdefine_batch_item *item,
+        const char *step) {
+
+    TPMI_RH_NV_INDEX nv_index = item->public_info.nvPublic.nvIndex;
+    if (item->line) {
+        LOG_ERR("Failed to %s NV index 0x%x on line %zu of the manifest",
+                step, nv_index, item->line);
+    } else {
+        LOG_ERR("Failed to %s NV index 0x%x", step, nv_index);
+    }
+
+    if (!item->is_failed) {
+        item->is_failed = true;
+        batch->failed++;
+    }
+}
+
+static void batch_undefine(ESYS_CONTEXT *ectx, nvdefine_batch *batch) {
+
+    size_t i;
+    for (i = 0; i < batch->count; i++) {
+        nvdefine_batch_item *item = &batch->items[i];
+        if (item->action != nvdefine_action_undefine &&
+            item->action != nvdefine_action_redefine) {
+            continue;
+        }
+
+        /* the declared attributes of redefined indices were swapped in */
+        if (item->public_info.nvPublic.attributes & TPMA_NV_POLICY_DELETE) {
+            LOG_ERR("NV index 0x%x can only be undefined by tpm2_nvundefine "
+                    "with a policy session",
+                    item->public_info.nvPublic.nvIndex);
+            batch_fail(batch, item, "undefine");
+            continue;
+        }
+
+        tool_rc rc = tpm2_nvundefine(ectx, &ctx.auth_hierarchy.object,
+                item->public_info.nvPublic.nvIndex, NULL);
+        if (rc != tool_rc_success) {
+            batch_fail(batch, item, "undefine");
+        }
+    }
+}
+
+static void batch_define(ESYS_CONTEXT *ectx, nvdefine_batch *batch,
+        TPMA_NV *declared_attributes) {
+
+    size_t i;
+    for (i = 0; i < batch->count; i++) {
+        nvdefine_batch_item *item = &batch->items[i];
+        if (item->is_failed) {
+            continue;
+        }
+
+        if (item->action == nvdefine_action_redefine) {
+            item->public_info.nvPublic.attributes = declared_attributes[i];
+        } else if (item->action != nvdefine_action_define) {
+            continue;
+        }
+
+        TPM2B_DIGEST cp_hash = { .size = 0 };
+        TPM2B_DIGEST rp_hash = { .size = 0 };
+        tool_rc rc = tpm2_nv_definespace(ectx, &ctx.auth_hierarchy.object,
+                &ctx.nv_auth, &item->public_info, &cp_hash, &rp_hash,
+                TPM2_ALG_ERROR, ESYS_TR_NONE, ESYS_TR_NONE);
+        if (rc != tool_rc_success) {
+            batch_fail(batch, item, "define");
+        }
+    }
+}
+
+/*
+ * Writes the initial content with the hierarchy authorization when the index
+ * allows it, or else with the authorization of the index.
+ */
+static tool_rc batch_write_item(ESYS_CONTEXT *ectx,
+        nvdefine_batch_item *item, UINT16 max_data_size) {
+
+    const TPMS_NV_PUBLIC *nv_public = &item->public_info.nvPublic;
+
+    UINT16 data_size = nv_public->dataSize;
+    UINT8 *data = malloc(data_size ? data_size : 1);
+    if (!data) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    tpm2_loaded_object nv_object = { 0 };
+    tpm2_loaded_object *auth_object = &ctx.auth_hierarchy.object;
+    tool_rc rc = tool_rc_general_error;
+    bool result = files_load_bytes_from_path(item->data_path, data,
+            &data_size);
+    if (!result) {
+        goto out;
+    }
+
+    ESYS_TR h = ctx.auth_hierarchy.object.tr_handle;
+    bool is_hierarchy_write =
+            (h == ESYS_TR_RH_OWNER &&
+                    (nv_public->attributes & TPMA_NV_OWNERWRITE)) ||
+            (h == ESYS_TR_RH_PLATFORM &&
+                    (nv_public->attributes & TPMA_NV_PPWRITE));
+    if (!is_hierarchy_write) {
+        if (!(nv_public->attributes & TPMA_NV_AUTHWRITE)) {
+            LOG_ERR("NV index 0x%x has no write authorization usable for "
+                    "its initial content", nv_public->nvIndex);
+            goto out;
+        }
+
+        char index_str[16];
+        snprintf(index_str, sizeof(index_str), "0x%x", nv_public->nvIndex);
+        rc = tpm2_util_object_load_auth(ectx, index_str, ctx.index_auth_str,
+                &nv_object, false, TPM2_HANDLE_FLAGS_NV);
+        if (rc != tool_rc_success) {
+            goto out;
+        }
+        auth_object = &nv_object;
+    }
+
+    UINT16 offset = 0;
+    while (offset < data_size) {
+        TPM2B_MAX_NV_BUFFER nv_write_data;
+        nv_write_data.size = data_size - offset > max_data_size ?
+                max_data_size : data_size - offset;
+        memcpy(nv_write_data.buffer, &data[offset], nv_write_data.size);
+
+        rc = tpm2_nvwrite(ectx, auth_object, nv_public->nvIndex,
+                &nv_write_data, offset, NULL);
+        if (rc != tool_rc_success) {
+            break;
+        }
+        offset += nv_write_data.size;
+    }
+
+out:
+    if (auth_object == &nv_object) {
+        tool_rc tmp_rc = tpm2_close(ectx, &nv_object.tr_handle);
+        if (rc == tool_rc_success) {
+            rc = tmp_rc;
+        }
+    }
+    if (nv_object.session) {
+        tool_rc tmp_rc = tpm2_session_close(&nv_object.session);
+        if (rc == tool_rc_success) {
+            rc = tmp_rc;
+        }
+    }
+    free(data);
+
+    return rc;
+}
+
+static void batch_write(ESYS_CONTEXT *ectx, nvdefine_batch *batch) {
+
+    UINT16 max_data_size = 0;
+
+    size_t i;
+    for (i = 0; i < batch->count; i++) {
+        nvdefine_batch_item *item = &batch->items[i];
+        if (!item->is_write || item->is_failed) {
+            continue;
+        }
+
+        if (!max_data_size) {
+            max_data_size = tpm2_nv_util_max_allowed_nv_size(ectx, false);
+        }
+
+        tool_rc rc = batch_write_item(ectx, item, max_data_size);
+        if (rc != tool_rc_success) {
+            batch_fail(batch, item, "write");
+        }
+    }
+}
+
+static void batch_output(nvdefine_batch *batch, tpm2_batch_stats *stats,
+        const double *seconds) {
+
+    size_t actions[ARRAY_LEN(nvdefine_action_names)] = { 0 };
+    size_t written = 0;
+
+    tpm2_tool_output("nv-indices:\n");
+
+    size_t i;
+    for (i = 0; i < batch->count; i++) {
+        nvdefine_batch_item *item = &batch->items[i];
+        tpm2_tool_output("  - index: 0x%x\n",
+                item->public_info.nvPublic.nvIndex);
+        if (item->line) {
+            tpm2_tool_output("    line: %zu\n", item->line);
+        }
+        tpm2_tool_output("    action: %s\n",
+                nvdefine_action_names[item->action]);
+        tpm2_tool_output("    write: %s\n", item->is_write ? "yes" : "no");
+        if (!ctx.is_dry_run) {
+            tpm2_tool_output("    result: %s\n",
+                    item->is_failed ? "failed" : "done");
+        }
+
+        if (!item->is_failed) {
+            actions[item->action]++;
+            written += item->is_write;
+        }
+    }
+
+    stats->processed = batch->count;
+    stats->failed = batch->failed;
+    tpm2_batch_output(stats, "indices", 0);
+    for (i = 0; i < ARRAY_LEN(nvdefine_action_names); i++) {
+        tpm2_tool_output("  %s: %zu\n", nvdefine_action_names[i], actions[i]);
+    }
+    tpm2_tool_output("  write: %zu\n", written);
+    tpm2_tool_output("  dry-run: %s\n", ctx.is_dry_run ? "yes" : "no");
+    tpm2_tool_output("  phase-seconds:\n");
+    tpm2_tool_output("    scan: %.3f\n", seconds[0]);
+    tpm2_tool_output("    undefine: %.3f\n", seconds[1]);
+    tpm2_tool_output("    define: %.3f\n", seconds[2]);
+    tpm2_tool_output("    write: %.3f\n", seconds[3]);
+}
+
+/*
+ * Brings the NV indices of the TPM to the state declared by the manifest:
+ * the defined indices are diffed against the declared ones, then only the
+ * necessary undefines, defines and writes are issued, under the one
+ * hierarchy authorization.
+ */
+static tool_rc batch_run(ESYS_CONTEXT *ectx) {
+
+    tpm2_session *tmp;
+    tool_rc rc = tpm2_auth_util_from_optarg(NULL, ctx.index_auth_str, &tmp,
+            true);
+    if (rc != tool_rc_success) {
+        LOG_ERR("Invalid index authorization");
+        return rc;
+    }
+
+    ctx.nv_auth = *tpm2_session_get_auth_value(tmp);
+    tpm2_session_close(&tmp);
+
+    rc = tpm2_util_object_load_auth(ectx, ctx.auth_hierarchy.ctx_path,
+            ctx.auth_hierarchy.auth_str, &ctx.auth_hierarchy.object, false,
+            TPM2_HANDLE_FLAGS_O | TPM2_HANDLE_FLAGS_P);
+    if (rc != tool_rc_success) {
+        LOG_ERR("Invalid authorization");
+        return rc;
+    }
+
+    nvdefine_batch batch = { 0 };
+    TPMA_NV *declared_attributes = NULL;
+    /* scan, undefine, define and write */
+    double seconds[4] = { 0 };
+    tpm2_batch_stats stats;
+    tpm2_batch_stats_start(&stats);
+
+    rc = batch_load(ectx, &batch);
+    if (rc != tool_rc_success) {
+        goto out;
+    }
+
+    declared_attributes = calloc(batch.count ? batch.count : 1,
+            sizeof(*declared_attributes));
+    if (!declared_attributes) {
+        LOG_ERR("oom");
+        rc = tool_rc_general_error;
+        goto out;
+    }
+
+    size_t i;
+    for (i = 0; i < batch.count; i++) {
+        declared_attributes[i] = batch.items[i].public_info.nvPublic.attributes;
+    }
+
+    rc = batch_scan(ectx, &batch);
+    seconds[0] = tpm2_batch_stats_lap(&stats);
+    if (rc != tool_rc_success) {
+        goto out;
+    }
+
+    if (!ctx.is_dry_run) {
+        batch_undefine(ectx, &batch);
+        seconds[1] = tpm2_batch_stats_lap(&stats);
+        batch_define(ectx, &batch, declared_attributes);
+        seconds[2] = tpm2_batch_stats_lap(&stats);
+        batch_write(ectx, &batch);
+        seconds[3] = tpm2_batch_stats_lap(&stats);
+    }
+
+    batch_output(&batch, &stats, seconds);
+
+    if (batch.failed) {
+        rc = tool_rc_general_error;
+    }
+
+out:
+    free(declared_attributes);
+    batch_free_items(&batch);
+
+    return rc;
+}
+
 static tool_rc check_options(void) {
 
+    if (ctx.batch_path) {
+        if (ctx.nv_index || ctx.size_set || ctx.nv_attribute ||
+            ctx.policy_file) {
+            LOG_ERR("The NV index, size, attributes and policy come from the "
+                    "manifest with **--batch**");
+            return tool_rc_option_error;
+        }
+
+        if (ctx.cp_hash_path || ctx.rp_hash_path || ctx.aux_session_cnt) {
+            LOG_ERR("**--batch** cannot be used with **--cphash**, "
+                    "**--rphash** and **--session**");
+            return tool_rc_option_error;
+        }
+
+        return tool_rc_success;
+    }
+
+    if (ctx.prune || ctx.is_dry_run) {
+        LOG_ERR("**--prune** and **--dry-run** require **--batch**");
+        return tool_rc_option_error;
+    }
+
     if (!ctx.size && ctx.size_set) {
         LOG_WARN("Defining an index with size 0");
     }
@@ -427,6 +1096,15 @@ static bool on_option(char key, char *value) {
     case 1:
         ctx.rp_hash_path = value;
         break;
+    case 2:
+        ctx.batch_path = value;
+        break;
+    case 3:
+        ctx.prune = true;
+        break;
+    case 4:
+        ctx.is_dry_run = true;
+        break;
     case 'S':
         ctx.aux_session_path[ctx.aux_session_cnt] = value;
         if (ctx.aux_session_cnt < MAX_AUX_SESSIONS) {
@@ -466,6 +1144,9 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
         { "cphash",         required_argument, NULL,  0  },
         {"rphash",          required_argument, NULL,  1  },
         { "session",        required_argument, NULL, 'S' },
+        { "batch",          required_argument, NULL,  2  },
+        { "prune",          no_argument,       NULL,  3  },
+        { "dry-run",        no_argument,       NULL,  4  },
     };
 
     *opts = tpm2_options_new("S:C:s:a:P:p:L:g:", ARRAY_LEN(topts), topts,
@@ -486,6 +1167,10 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
         return rc;
     }
 
+    if (ctx.batch_path) {
+        return batch_run(ectx);
+    }
+
     /*
      * 2. Process inputs
      */
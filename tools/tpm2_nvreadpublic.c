@@ -4,6 +4,7 @@
 
 #include "tpm2_alg_util.h"
 #include "tpm2_attr_util.h"
+#include "tpm2_capability.h"
 #include "tpm2_nv_util.h"
 #include "tpm2_tool.h"
 
@@ -14,14 +15,8 @@ struct tpm2_nvreadpublic_ctx {
 
 static tpm2_nvreadpublic_ctx ctx;
 
-static tool_rc print_nv_public(ESYS_CONTEXT *context, TPMI_RH_NV_INDEX index, TPM2B_NV_PUBLIC *nv_public) {
-
-    ESYS_TR tr_handle = ESYS_TR_NONE;
-    tool_rc rc = tpm2_tr_from_tpm_public(context, index,
-            &tr_handle);
-    if (rc != tool_rc_success) {
-        return rc;
-    }
+static void print_nv_public(TPMI_RH_NV_INDEX index,
+        const TPM2B_NV_PUBLIC *nv_public, const TPM2B_NAME *name) {
 
     tpm2_tool_output("0x%x:\n", index);
 
@@ -37,14 +32,6 @@ static tool_rc print_nv_public(ESYS_CONTEXT *context, TPMI_RH_NV_INDEX index, TP
         LOG_ERR("Could not convert algorithm to string form");
     }
 
-    TPM2B_NAME *name = NULL;
-    rc = tpm2_tr_get_name(context, tr_handle,
-            &name);
-    if (rc != tool_rc_success) {
-        free(attrs);
-        return rc;
-    }
-
     tpm2_tool_output("  name: ");
     UINT16 i;
     for (i = 0; i < name->size; i++) {
@@ -52,8 +39,6 @@ static tool_rc print_nv_public(ESYS_CONTEXT *context, TPMI_RH_NV_INDEX index, TP
     }
     tpm2_tool_output("\n");
 
-    Esys_Free(name);
-
     tpm2_tool_output("  hash algorithm:\n");
     tpm2_tool_output("    friendly: %s\n", alg);
     tpm2_tool_output("    value: 0x%X\n", nv_public->nvPublic.nameAlg);
@@ -76,17 +61,20 @@ static tool_rc print_nv_public(ESYS_CONTEXT *context, TPMI_RH_NV_INDEX index, TP
     }
 
     free(attrs);
-
-    return tool_rc_success;
 }
 
+/*
+ * Reads the public areas of the indices one request ahead: the TPM works on
+ * the next index while the previous one is printed, and the name comes with
+ * the response instead of costing an ESYS_TR per index.
+ */
 static tool_rc nv_readpublic(ESYS_CONTEXT *context) {
 
 
     TPMS_CAPABILITY_DATA *capability_data = NULL;
     if (ctx.nv_index == 0) {
-        tool_rc rc = tpm2_getcap(context, TPM2_CAP_HANDLES, TPM2_HT_NV_INDEX << 24,
-                TPM2_PT_NV_INDEX_MAX, NULL, &capability_data);
+        tool_rc rc = tpm2_capability_get(context, TPM2_CAP_HANDLES,
+                TPM2_HR_NV_INDEX, TPM2_MAX_CAP_HANDLES, &capability_data);
         if (rc != tool_rc_success) {
             return rc;
         }
@@ -99,29 +87,35 @@ static tool_rc nv_readpublic(ESYS_CONTEXT *context) {
         capability_data->data.handles.count = 1;
         capability_data->data.handles.handle[0] = ctx.nv_index;
     }
+
+    TPML_HANDLE *handles = &capability_data->data.handles;
+    tool_rc rc = tool_rc_success;
+    if (handles->count) {
+        rc = tpm2_nv_readpublic_async(context, handles->handle[0]);
+    }
+
     UINT32 i;
-    for (i = 0; i < capability_data->data.handles.count; i++) {
-        TPMI_RH_NV_INDEX index = capability_data->data.handles.handle[i];
+    for (i = 0; i < handles->count && rc == tool_rc_success; i++) {
+        TPMI_RH_NV_INDEX index = handles->handle[i];
 
-        TPM2B_NV_PUBLIC *nv_public;
-        tool_rc rc = tpm2_util_nv_read_public(context, index, &nv_public);
+        TPM2B_NV_PUBLIC nv_public = { 0 };
+        TPM2B_NAME name = { 0 };
+        rc = tpm2_nv_readpublic_finish(context, &nv_public, &name);
         if (rc != tool_rc_success) {
             LOG_ERR("Failed to read the public part of NV index 0x%X", index);
-            free(capability_data);
-            return rc;
+            break;
         }
 
-        rc = print_nv_public(context, index, nv_public);
-        free(nv_public);
-        tpm2_tool_output("\n");
-        if (rc != tool_rc_success) {
-            free(capability_data);
-            return rc;
+        if (i + 1 < handles->count) {
+            rc = tpm2_nv_readpublic_async(context, handles->handle[i + 1]);
         }
+
+        print_nv_public(index, &nv_public, &name);
+        tpm2_tool_output("\n");
     }
 
     free(capability_data);
-    return tool_rc_success;
+    return rc;
 }
 
 static bool on_arg(int argc, char **argv) {
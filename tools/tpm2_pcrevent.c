@@ -13,6 +13,7 @@
 #include "tpm2_alg_util.h"
 #include "tpm2_hierarchy.h"
 #include "tpm2_auth_util.h"
+#include "tpm2_hash.h"
 #include "tpm2_tool.h"
 
 typedef struct tpm_pcrevent_ctx tpm_pcrevent_ctx;
@@ -29,93 +30,49 @@ static tpm_pcrevent_ctx ctx = {
     .pcr = ESYS_TR_RH_NULL,
 };
 
-static tool_rc tpm_pcrevent_file(ESYS_CONTEXT *ectx,
-        TPML_DIGEST_VALUES **result) {
-
-    unsigned long file_size = 0;
-    FILE *input = ctx.input;
+static tool_rc pcrevent_oneshot(ESYS_CONTEXT *ectx, void *userdata,
+        const TPM2B_MAX_BUFFER *data) {
 
-    /* Suppress error reporting with NULL path */
-    bool res = files_get_file_size(input, &file_size, NULL);
+    TPML_DIGEST_VALUES **result = userdata;
 
-    /* If we can get the file size and its less than 1024, just do it in one hash invocation */
-    if (res && file_size <= BUFFER_SIZE(TPM2B_EVENT, buffer)) {
+    TPM2B_EVENT buffer = TPM2B_INIT(data->size);
+    memcpy(buffer.buffer, data->buffer, data->size);
 
-        TPM2B_EVENT buffer = TPM2B_INIT(file_size);
+    return tpm2_pcr_event(ectx, ctx.pcr, ctx.auth.session, &buffer, result);
+}
 
-        res = files_read_bytes(ctx.input, buffer.buffer, buffer.size);
-        if (!res) {
-            LOG_ERR("Error reading input file!");
-            return tool_rc_general_error;
-        }
+static tool_rc pcrevent_start(ESYS_CONTEXT *ectx, void *userdata,
+        ESYS_TR *sequence_handle, ESYS_TR *shandle1) {
 
-        return tpm2_pcr_event(ectx, ctx.pcr, ctx.auth.session, &buffer, result);
-    }
+    UNUSED(userdata);
 
-    ESYS_TR sequence_handle;
     TPM2B_AUTH null_auth = TPM2B_EMPTY_INIT;
+    *shandle1 = ESYS_TR_PASSWORD;
 
-    /*
-     * Size is either unknown because the FILE * is a fifo, or it's too big
-     * to do in a single hash call. Based on the size figure out the chunks
-     * to loop over, if possible. This way we can call Complete with data.
-     */
-    tool_rc rc = tpm2_hash_sequence_start(ectx, &null_auth, TPM2_ALG_NULL,
-            &sequence_handle);
-    if (rc != tool_rc_success) {
-        return rc;
-    }
-
-    /* If we know the file size, we decrement the amount read and terminate the
-     * loop when 1 block is left, else we go till feof.
-     */
-    size_t left = file_size;
-    bool use_left = !!res;
-
-    TPM2B_MAX_BUFFER data;
+    return tpm2_hash_sequence_start(ectx, &null_auth, TPM2_ALG_NULL,
+            sequence_handle);
+}
 
-    bool done = false;
-    while (!done) {
+static tool_rc pcrevent_complete(ESYS_CONTEXT *ectx, void *userdata,
+        ESYS_TR sequence_handle, const TPM2B_MAX_BUFFER *data) {
 
-        size_t bytes_read = fread(data.buffer, 1,
-                BUFFER_SIZE(typeof(data), buffer), input);
-        if (ferror(input)) {
-            LOG_ERR("Error reading from input file");
-            return tool_rc_general_error;
-        }
+    TPML_DIGEST_VALUES **result = userdata;
 
-        data.size = bytes_read;
+    return tpm2_event_sequence_complete(ectx, ctx.pcr, sequence_handle,
+            ctx.auth.session, data, result);
+}
 
-        /* if data was read, update the sequence */
-        rc = tpm2_sequence_update(ectx, sequence_handle, &data);
-        if (rc != tool_rc_success) {
-            return rc;
-        }
+static tool_rc tpm_pcrevent_file(ESYS_CONTEXT *ectx,
+        TPML_DIGEST_VALUES **result) {
 
-        if (use_left) {
-            left -= bytes_read;
-            if (left <= TPM2_MAX_DIGEST_BUFFER) {
-                done = true;
-                continue;
-            }
-        } else if (feof(input)) {
-            done = true;
-        }
-    } /* end file read/hash update loop */
-
-    if (use_left) {
-        data.size = left;
-        bool res = files_read_bytes(input, data.buffer, left);
-        if (!res) {
-            LOG_ERR("Error reading from input file.");
-            return tool_rc_general_error;
-        }
-    } else {
-        data.size = 0;
-    }
+    /* TPM2B_EVENT and TPM2B_MAX_BUFFER hold the same amount of data */
+    static const tpm2_hash_sequence_ops ops = {
+        .oneshot = pcrevent_oneshot,
+        .start = pcrevent_start,
+        .complete = pcrevent_complete,
+    };
 
-    return tpm2_event_sequence_complete(ectx, ctx.pcr, sequence_handle,
-            ctx.auth.session, &data, result);
+    return tpm2_hash_sequence_stream(ectx, &ops, result, ctx.input, NULL, 0);
 }
 
 static tool_rc do_pcrevent_and_output(ESYS_CONTEXT *ectx) {
@@ -1,19 +1,38 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
+
+#include <openssl/evp.h>
 
 #include "log.h"
+#include "pcr.h"
+#include "tpm2_batch.h"
+#include "tpm2_eventlog.h"
+#include "tpm2_openssl.h"
 #include "tpm2_tool.h"
 #include "tpm2_alg_util.h"
 #include "tpm2_options.h"
+#include "tpm2_worker.h"
 
 typedef struct tpm_pcr_extend_ctx tpm_pcr_extend_ctx;
 struct tpm_pcr_extend_ctx {
     size_t digest_spec_len;
     tpm2_pcr_digest_spec *digest_spec;
+
+    char *batch_path; /* manifest of measurements, see batch_run() */
+    unsigned jobs;
+    char *eventlog_path;
+    FILE *eventlog;
+
+    /* the allocated PCR banks, for measuring files */
+    TPML_PCR_SELECTION banks;
 };
 
-static tpm_pcr_extend_ctx ctx;
+static tpm_pcr_extend_ctx ctx = {
+    .jobs = 1,
+};
 
 static tool_rc pcr_extend_one(ESYS_CONTEXT *ectx,
         TPMI_DH_PCR pcr_index, TPML_DIGEST_VALUES *digests) {;
@@ -45,6 +64,339 @@ static tool_rc pcr_extend(ESYS_CONTEXT *ectx) {
     return tool_rc_success;
 }
 
+#define PCREXTEND_FILE_BUFFER 65536
+
+typedef struct pcrextend_batch_item pcrextend_batch_item;
+struct pcrextend_batch_item {
+    tpm2_pcr_digest_spec spec;
+    /* the file to measure, NULL for precomputed digests */
+    char *path;
+    /* logged as the event data */
+    char *event;
+    size_t line;
+    bool is_measured;
+};
+
+typedef struct pcrextend_batch pcrextend_batch;
+struct pcrextend_batch {
+    ESYS_CONTEXT *ectx;
+    pcrextend_batch_item items[TPM2_BATCH_CHUNK];
+    size_t extended;
+};
+
+static bool is_pcr_allocated(const TPMS_PCR_SELECTION *bank, UINT32 pcr) {
+
+    return pcr / 8 < bank->sizeofSelect &&
+            (bank->pcrSelect[pcr / 8] & (1 << (pcr % 8)));
+}
+
+/*
+ * Digests a file in every bank the PCR is allocated in, reading the file
+ * once.
+ */
+static bool measure_file(pcrextend_batch_item *item) {
+
+    EVP_MD_CTX *mdctx[TPM2_NUM_PCR_BANKS] = { 0 };
+    bool result = false;
+
+    FILE *f = fopen(item->path, "rb");
+    if (!f) {
+        LOG_ERR("Could not open file \"%s\", error: %s", item->path,
+                strerror(errno));
+        return false;
+    }
+
+    TPML_DIGEST_VALUES *digests = &item->spec.digests;
+    digests->count = 0;
+
+    UINT32 i;
+    for (i = 0; i < ctx.banks.count; i++) {
+        const TPMS_PCR_SELECTION *bank = &ctx.banks.pcrSelections[i];
+        if (!is_pcr_allocated(bank, item->spec.pcr_index)) {
+            continue;
+        }
+
+        const EVP_MD *md = tpm2_openssl_halg_from_tpmhalg(bank->hash);
+        if (!md) {
+            LOG_ERR("Unsupported PCR bank algorithm, got: 0x%x", bank->hash);
+            goto out;
+        }
+
+        mdctx[digests->count] = EVP_MD_CTX_create();
+        if (!mdctx[digests->count]) {
+            LOG_ERR("oom");
+            goto out;
+        }
+
+        digests->digests[digests->count].hashAlg = bank->hash;
+        if (!EVP_DigestInit_ex(mdctx[digests->count++], md, NULL)) {
+            LOG_ERR("Could not initialize the digest");
+            goto out;
+        }
+    }
+
+    if (!digests->count) {
+        LOG_ERR("PCR %u is not allocated in any bank", item->spec.pcr_index);
+        goto out;
+    }
+
+    BYTE buffer[PCREXTEND_FILE_BUFFER];
+    size_t bytes_read;
+    while ((bytes_read = fread(buffer, 1, sizeof(buffer), f))) {
+        for (i = 0; i < digests->count; i++) {
+            if (!EVP_DigestUpdate(mdctx[i], buffer, bytes_read)) {
+                LOG_ERR("Could not update the digest");
+                goto out;
+            }
+        }
+    }
+
+    if (ferror(f)) {
+        LOG_ERR("Error reading from file \"%s\"", item->path);
+        goto out;
+    }
+
+    for (i = 0; i < digests->count; i++) {
+        if (!EVP_DigestFinal_ex(mdctx[i],
+                (unsigned char *)&digests->digests[i].digest, NULL)) {
+            LOG_ERR("Could not finalize the digest");
+            goto out;
+        }
+    }
+
+    result = true;
+
+out:
+    for (i = 0; i < ARRAY_LEN(mdctx); i++) {
+        if (mdctx[i]) {
+            EVP_MD_CTX_destroy(mdctx[i]);
+        }
+    }
+    fclose(f);
+
+    return result;
+}
+
+/*
+ * Runs on the worker threads: files are digested in parallel, the extends
+ * are then issued in manifest order since PCR values depend on it.
+ */
+static bool batch_process_item(void *userdata, size_t index) {
+
+    pcrextend_batch *batch = (pcrextend_batch *) userdata;
+    pcrextend_batch_item *item = &batch->items[index];
+
+    if (!item->path) {
+        item->is_measured = true;
+        return true;
+    }
+
+    item->is_measured = measure_file(item);
+    if (!item->is_measured) {
+        LOG_ERR("Failed to measure the file on line %zu of the manifest",
+                item->line);
+    }
+
+    return item->is_measured;
+}
+
+static tool_rc batch_extend(void *userdata, size_t count) {
+
+    pcrextend_batch *batch = (pcrextend_batch *) userdata;
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        pcrextend_batch_item *item = &batch->items[i];
+        if (!item->is_measured) {
+            continue;
+        }
+
+        tool_rc rc = pcr_extend_one(batch->ectx, item->spec.pcr_index,
+                &item->spec.digests);
+        if (rc != tool_rc_success) {
+            LOG_ERR("Failed to extend the measurement on line %zu of the "
+                    "manifest", item->line);
+            return rc;
+        }
+
+        batch->extended++;
+
+        if (ctx.eventlog) {
+            /* the event data is the NUL terminated path or digest list */
+            bool result = tpm2_eventlog_write_event2(ctx.eventlog,
+                    item->spec.pcr_index, EV_IPL, &item->spec.digests,
+                    (BYTE *)item->event, strlen(item->event) + 1);
+            if (!result) {
+                return tool_rc_general_error;
+            }
+        }
+    }
+
+    return tool_rc_success;
+}
+
+static void batch_free_items(void *userdata, size_t count) {
+
+    pcrextend_batch *batch = (pcrextend_batch *) userdata;
+
+    size_t i;
+    for (i = 0; i < count; i++) {
+        free(batch->items[i].path);
+        free(batch->items[i].event);
+    }
+}
+
+static bool batch_parse_item(void *userdata, size_t index, char **fields,
+        size_t count, size_t line) {
+
+    pcrextend_batch *batch = (pcrextend_batch *) userdata;
+    pcrextend_batch_item *item = &batch->items[index];
+    memset(item, 0, sizeof(*item));
+    item->line = line;
+
+    if (count != 1 && count != 2) {
+        LOG_ERR("Expected PCR FILE or a digest specification");
+        return false;
+    }
+
+    /* the digest list parser tokenizes in place, keep the text for the log */
+    item->event = strdup(fields[count - 1]);
+    if (!item->event) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    if (count == 1) {
+        return pcr_parse_digest_list(fields, 1, &item->spec);
+    }
+
+    item->path = strdup(fields[1]);
+    if (!item->path) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    bool result = tpm2_util_handle_from_optarg(fields[0],
+            &item->spec.pcr_index, TPM2_HANDLE_FLAGS_PCR);
+    if (!result) {
+        LOG_ERR("Invalid PCR index, got: \"%s\"", fields[0]);
+    }
+
+    return result;
+}
+
+static const tpm2_batch_ops batch_ops = {
+    .max_fields = 2,
+    .parse = batch_parse_item,
+    .process = batch_process_item,
+    .complete = batch_extend,
+    .free = batch_free_items,
+};
+
+static tool_rc batch_open_eventlog(void) {
+
+    ctx.eventlog = fopen(ctx.eventlog_path, "ab");
+    if (!ctx.eventlog) {
+        LOG_ERR("Could not open event log \"%s\", error: %s",
+                ctx.eventlog_path, strerror(errno));
+        return tool_rc_general_error;
+    }
+
+    /* appending to an existing log, its Spec ID event is already there */
+    if (fseek(ctx.eventlog, 0, SEEK_END)) {
+        LOG_ERR("Could not seek event log \"%s\", error: %s",
+                ctx.eventlog_path, strerror(errno));
+        return tool_rc_general_error;
+    }
+
+    if (ftell(ctx.eventlog) > 0) {
+        return tool_rc_success;
+    }
+
+    TPMI_ALG_HASH algs[TPM2_NUM_PCR_BANKS];
+    UINT32 count = 0;
+    UINT32 i;
+    for (i = 0; i < ctx.banks.count && count < ARRAY_LEN(algs); i++) {
+        if (ctx.banks.pcrSelections[i].sizeofSelect) {
+            algs[count++] = ctx.banks.pcrSelections[i].hash;
+        }
+    }
+
+    bool result = tpm2_eventlog_write_specid(ctx.eventlog, algs, count);
+
+    return result ? tool_rc_success : tool_rc_general_error;
+}
+
+/*
+ * The files of a chunk of the manifest are measured in parallel, then the
+ * chunk is extended back to back over the same TPM connection.
+ */
+static tool_rc batch_run(ESYS_CONTEXT *ectx) {
+
+    TPMS_CAPABILITY_DATA capability_data;
+    tpm2_algorithm algs;
+    tool_rc rc = pcr_get_banks(ectx, &capability_data, &algs);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    /* keep the banks with at least a PCR allocated */
+    UINT32 i;
+    for (i = 0; i < capability_data.data.assignedPCR.count; i++) {
+        TPMS_PCR_SELECTION *bank =
+                &capability_data.data.assignedPCR.pcrSelections[i];
+        UINT8 j;
+        for (j = 0; j < bank->sizeofSelect; j++) {
+            if (bank->pcrSelect[j]) {
+                ctx.banks.pcrSelections[ctx.banks.count++] = *bank;
+                break;
+            }
+        }
+    }
+
+    if (ctx.eventlog_path) {
+        rc = batch_open_eventlog();
+        if (rc != tool_rc_success) {
+            return rc;
+        }
+    }
+
+    pcrextend_batch *batch = calloc(1, sizeof(*batch));
+    if (!batch) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    batch->ectx = ectx;
+
+    tpm2_batch_stats stats;
+    rc = tpm2_batch_run(ctx.batch_path, &batch_ops, ctx.jobs, batch, &stats);
+    if (stats.is_complete) {
+        tpm2_batch_output(&stats, "measurements", ctx.jobs);
+        tpm2_tool_output("  extended: %zu\n", batch->extended);
+    }
+
+    free(batch);
+
+    return rc;
+}
+
+static bool on_option(char key, char *value) {
+
+    switch (key) {
+    case 0:
+        ctx.batch_path = value;
+        break;
+    case 1:
+        return tpm2_worker_jobs_from_optarg(value, &ctx.jobs);
+    case 2:
+        ctx.eventlog_path = value;
+        break;
+    }
+
+    return true;
+}
+
 static bool on_arg(int argc, char **argv) {
 
     if (argc < 1) {
@@ -67,7 +419,14 @@ static bool on_arg(int argc, char **argv) {
 
 static bool tpm2_tool_onstart(tpm2_options **opts) {
 
-    *opts = tpm2_options_new(NULL, 0, NULL, NULL, on_arg, 0);
+    const struct option topts[] = {
+      { "batch",    required_argument, NULL, 0 },
+      { "jobs",     required_argument, NULL, 1 },
+      { "eventlog", required_argument, NULL, 2 },
+    };
+
+    *opts = tpm2_options_new(NULL, ARRAY_LEN(topts), topts, on_option, on_arg,
+        0);
 
     return *opts != NULL;
 }
@@ -76,12 +435,35 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
 
     UNUSED(flags);
 
+    if (ctx.batch_path) {
+        if (ctx.digest_spec_len) {
+            LOG_ERR("Digest specifications come from the manifest with "
+                    "**--batch**");
+            return tool_rc_option_error;
+        }
+        return batch_run(ectx);
+    }
+
+    if (ctx.eventlog_path) {
+        LOG_ERR("**--eventlog** requires **--batch**");
+        return tool_rc_option_error;
+    }
+
+    if (!ctx.digest_spec_len) {
+        LOG_ERR("Expected at least one PCR Digest specification,"
+                "ie: <pcr index>:<hash alg>=<hash value>, got: 0");
+        return tool_rc_option_error;
+    }
+
     return pcr_extend(ectx);
 }
 
 static void tpm2_tool_onexit(void) {
 
     free(ctx.digest_spec);
+    if (ctx.eventlog) {
+        fclose(ctx.eventlog);
+    }
 }
 
 // Register this tool with tpm2_tool.c
@@ -10,10 +10,26 @@
 #include "tpm2.h"
 #include "tpm2_alg_util.h"
 #include "tpm2_convert.h"
+#include "tpm2_manifest.h"
+#include "tpm2_merkle.h"
 #include "tpm2_openssl.h"
 #include "tpm2_systemdeps.h"
 #include "tpm2_tool.h"
 
+/*
+ * The nonces of verifiers quoted at once, as the leaves of a Merkle tree
+ * whose root is the qualifying data, and the paths of their inclusion
+ * proofs.
+ */
+typedef struct quote_aggregate quote_aggregate;
+struct quote_aggregate {
+    TPM2B_DATA *nonces;
+    char **proof_paths;
+    size_t count;
+    size_t capacity;
+    tpm2_merkle_tree *tree;
+};
+
 typedef struct tpm_quote_ctx tpm_quote_ctx;
 struct tpm_quote_ctx {
     struct {
@@ -36,6 +52,9 @@ struct tpm_quote_ctx {
     tpm2_convert_pcrs_output_fmt pcrs_format;
 
     char *cp_hash_path;
+
+    char *aggregate_path; /* manifest of nonces, see aggregate_load() */
+    quote_aggregate aggregate;
 };
 
 static tpm_quote_ctx ctx = {
@@ -70,6 +89,136 @@ static bool write_output_files(TPM2B_ATTEST *quoted, TPMT_SIGNATURE *signature)
     return res;
 }
 
+static bool aggregate_add(const char *nonce, const char *proof_path,
+        size_t line) {
+
+    quote_aggregate *aggregate = &ctx.aggregate;
+
+    if (aggregate->count == aggregate->capacity) {
+        size_t capacity = aggregate->capacity ? 2 * aggregate->capacity : 64;
+        TPM2B_DATA *nonces = realloc(aggregate->nonces,
+                capacity * sizeof(*nonces));
+        if (nonces) {
+            aggregate->nonces = nonces;
+        }
+        char **proof_paths = realloc(aggregate->proof_paths,
+                capacity * sizeof(*proof_paths));
+        if (proof_paths) {
+            aggregate->proof_paths = proof_paths;
+        }
+        if (!nonces || !proof_paths) {
+            LOG_ERR("oom");
+            return false;
+        }
+        aggregate->capacity = capacity;
+    }
+
+    TPM2B_DATA *leaf = &aggregate->nonces[aggregate->count];
+    leaf->size = sizeof(leaf->buffer);
+    bool result = tpm2_util_bin_from_hex_or_file(nonce, &leaf->size,
+            leaf->buffer);
+    if (!result) {
+        LOG_ERR("Invalid nonce \"%s\" on line %zu", nonce, line);
+        return false;
+    }
+
+    aggregate->proof_paths[aggregate->count] = strdup(proof_path);
+    if (!aggregate->proof_paths[aggregate->count]) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    aggregate->count++;
+
+    return true;
+}
+
+/*
+ * Manifest lines are:
+ *   NONCE PROOF
+ * where NONCE is the qualification of a verifier, as with -q, and PROOF the
+ * file its inclusion proof is written to.
+ */
+static bool aggregate_load(void) {
+
+    tpm2_manifest *manifest = tpm2_manifest_open(ctx.aggregate_path);
+    if (!manifest) {
+        return false;
+    }
+
+    bool result = true;
+    char *fields[2];
+    size_t count = ARRAY_LEN(fields);
+    while (result && tpm2_manifest_next(manifest, fields, &count)) {
+        if (count != ARRAY_LEN(fields)) {
+            LOG_ERR("Expected NONCE PROOF on line %zu of manifest \"%s\"",
+                    tpm2_manifest_line(manifest),
+                    tpm2_manifest_path(manifest));
+            result = false;
+            break;
+        }
+
+        result = aggregate_add(fields[0], fields[1],
+                tpm2_manifest_line(manifest));
+        count = ARRAY_LEN(fields);
+    }
+
+    if (result && tpm2_manifest_is_error(manifest)) {
+        result = false;
+    }
+
+    if (result && !ctx.aggregate.count) {
+        LOG_ERR("No nonce in manifest \"%s\"", tpm2_manifest_path(manifest));
+        result = false;
+    }
+
+    tpm2_manifest_close(manifest);
+
+    return result;
+}
+
+/*
+ * Writes the inclusion proofs of the aggregated nonces once the root is
+ * quoted.
+ */
+static bool aggregate_save_proofs(void) {
+
+    quote_aggregate *aggregate = &ctx.aggregate;
+
+    size_t i;
+    for (i = 0; i < aggregate->count; i++) {
+        tpm2_merkle_proof proof;
+        bool result = tpm2_merkle_tree_proof(aggregate->tree, i, &proof) &&
+                tpm2_merkle_proof_save(&proof, aggregate->proof_paths[i]);
+        if (!result) {
+            return false;
+        }
+    }
+
+    tpm2_tool_output("aggregate:\n");
+    tpm2_tool_output("  nonces: %zu\n", aggregate->count);
+    tpm2_tool_output("  root: ");
+    tpm2_util_hexdump(ctx.qualification_data.buffer,
+            ctx.qualification_data.size);
+    tpm2_tool_output("\n");
+
+    return true;
+}
+
+static void aggregate_free(void) {
+
+    quote_aggregate *aggregate = &ctx.aggregate;
+
+    size_t i;
+    for (i = 0; i < aggregate->count; i++) {
+        free(aggregate->proof_paths[i]);
+    }
+
+    free(aggregate->proof_paths);
+    free(aggregate->nonces);
+    tpm2_merkle_tree_free(aggregate->tree);
+}
+
 static tool_rc quote(ESYS_CONTEXT *ectx, TPML_PCR_SELECTION *pcr_selection) {
 
     TPM2B_ATTEST *quoted = NULL;
@@ -83,6 +232,16 @@ static tool_rc quote(ESYS_CONTEXT *ectx, TPML_PCR_SELECTION *pcr_selection) {
         return rc;
     }
 
+    /* the nonces are aggregated with the hash of the signature */
+    if (ctx.aggregate_path) {
+        ctx.aggregate.tree = tpm2_merkle_tree_new(ctx.sig_hash_algorithm,
+                ctx.aggregate.nonces, ctx.aggregate.count);
+        if (!ctx.aggregate.tree) {
+            return tool_rc_general_error;
+        }
+        tpm2_merkle_tree_root(ctx.aggregate.tree, &ctx.qualification_data);
+    }
+
     if (ctx.cp_hash_path) {
         TPM2B_DIGEST cp_hash = { .size = 0 };
         rc = tpm2_quote(ectx, &ctx.key.object, &in_scheme,
@@ -168,6 +327,9 @@ static tool_rc quote(ESYS_CONTEXT *ectx, TPML_PCR_SELECTION *pcr_selection) {
 
     // Write everything out
     bool res = write_output_files(quoted, signature);
+    if (res && ctx.aggregate_path) {
+        res = aggregate_save_proofs();
+    }
 
     free(quoted);
     free(signature);
@@ -230,6 +392,9 @@ static bool on_option(char key, char *value) {
     case 0:
         ctx.cp_hash_path = value;
         break;
+    case 1:
+        ctx.aggregate_path = value;
+        break;
     }
 
     return true;
@@ -248,7 +413,8 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
         { "pcrs_format",    required_argument, NULL, 'F' },
         { "format",         required_argument, NULL, 'f' },
         { "hash-algorithm", required_argument, NULL, 'g' },
-        { "cphash",         required_argument, NULL,  0  }
+        { "cphash",         required_argument, NULL,  0  },
+        { "aggregate",      required_argument, NULL,  1  },
     };
 
     *opts = tpm2_options_new("c:p:l:q:s:m:o:F:f:g:", ARRAY_LEN(topts), topts,
@@ -272,6 +438,18 @@ static tool_rc tpm2_tool_onrun(ESYS_CONTEXT *ectx, tpm2_option_flags flags) {
         return tool_rc_option_error;
     }
 
+    if (ctx.aggregate_path) {
+        if (ctx.qualification_data.size) {
+            LOG_ERR("Cannot specify -q with --aggregate, the qualification "
+                    "is the root of the nonces");
+            return tool_rc_option_error;
+        }
+
+        if (!aggregate_load()) {
+            return tool_rc_general_error;
+        }
+    }
+
     tool_rc rc = tpm2_util_object_load_auth(ectx, ctx.key.ctx_path,
             ctx.key.auth_str, &ctx.key.object, false, TPM2_HANDLE_ALL_W_NV);
     if (rc != tool_rc_success) {
@@ -301,6 +479,7 @@ static tool_rc tpm2_tool_onstop(ESYS_CONTEXT *ectx) {
     if (ctx.pcr_output) {
         fclose(ctx.pcr_output);
     }
+    aggregate_free();
     return tpm2_session_close(&ctx.key.object.session);
 }
 
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <errno.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,9 +10,29 @@
 #include "tpm2.h"
 #include "tpm2_tool.h"
 #include "tpm2_alg_util.h"
+#include "tpm2_batch.h"
 #include "tpm2_convert.h"
 #include "tpm2_hash.h"
+#include "tpm2_manifest.h"
+#include "tpm2_merkle.h"
+#include "tpm2_openssl.h"
 #include "tpm2_options.h"
+#include "tpm2_worker.h"
+
+/*
+ * Artifacts signed at once, as the leaves of a Merkle tree whose root is
+ * signed, and the paths of their inclusion proofs.
+ */
+typedef struct sign_batch sign_batch;
+struct sign_batch {
+    char **artifact_paths;
+    char **proof_paths;
+    TPM2B_DATA *leaves;
+    size_t count;
+    size_t capacity;
+    size_t failed;
+    tpm2_merkle_tree *tree;
+};
 
 typedef struct tpm_sign_ctx tpm_sign_ctx;
 struct tpm_sign_ctx {
@@ -40,16 +61,269 @@ struct tpm_sign_ctx {
 
     char *cp_hash_path;
     char *commit_index;
+
+    char *batch_path; /* manifest of artifacts, see batch_load() */
+    unsigned jobs;
+    sign_batch batch;
 };
 
 static tpm_sign_ctx ctx = {
         .halg = TPM2_ALG_NULL,
-        .sig_scheme = TPM2_ALG_NULL
+        .sig_scheme = TPM2_ALG_NULL,
+        .jobs = 1,
 };
 
+static bool batch_add(const char *artifact_path, const char *proof_path) {
+
+    sign_batch *batch = &ctx.batch;
+
+    if (batch->count == batch->capacity) {
+        size_t capacity = batch->capacity ? 2 * batch->capacity : 64;
+        char **artifact_paths = realloc(batch->artifact_paths,
+                capacity * sizeof(*artifact_paths));
+        if (artifact_paths) {
+            batch->artifact_paths = artifact_paths;
+        }
+        char **proof_paths = realloc(batch->proof_paths,
+                capacity * sizeof(*proof_paths));
+        if (proof_paths) {
+            batch->proof_paths = proof_paths;
+        }
+        if (!artifact_paths || !proof_paths) {
+            LOG_ERR("oom");
+            return false;
+        }
+        batch->capacity = capacity;
+    }
+
+    batch->artifact_paths[batch->count] = strdup(artifact_path);
+    batch->proof_paths[batch->count] = strdup(proof_path);
+    batch->count++;
+    if (!batch->artifact_paths[batch->count - 1] ||
+        !batch->proof_paths[batch->count - 1]) {
+        LOG_ERR("oom");
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * Manifest lines are:
+ *   ARTIFACT PROOF
+ * where ARTIFACT is the file to sign and PROOF the file its inclusion proof
+ * is written to.
+ */
+static bool batch_load(void) {
+
+    tpm2_manifest *manifest = tpm2_manifest_open(ctx.batch_path);
+    if (!manifest) {
+        return false;
+    }
+
+    bool result = true;
+    char *fields[2];
+    size_t count = ARRAY_LEN(fields);
+    while (result && tpm2_manifest_next(manifest, fields, &count)) {
+        if (count != ARRAY_LEN(fields)) {
+            LOG_ERR("Expected ARTIFACT PROOF on line %zu of manifest \"%s\"",
+                    tpm2_manifest_line(manifest),
+                    tpm2_manifest_path(manifest));
+            result = false;
+            break;
+        }
+
+        result = batch_add(fields[0], fields[1]);
+        count = ARRAY_LEN(fields);
+    }
+
+    if (result && tpm2_manifest_is_error(manifest)) {
+        result = false;
+    }
+
+    if (result && !ctx.batch.count) {
+        LOG_ERR("No artifact in manifest \"%s\"",
+                tpm2_manifest_path(manifest));
+        result = false;
+    }
+
+    tpm2_manifest_close(manifest);
+
+    return result;
+}
+
+static bool batch_hash_artifact(void *userdata, size_t index) {
+
+    sign_batch *batch = (sign_batch *) userdata;
+    const char *path = batch->artifact_paths[index];
+
+    bool result = false;
+    FILE *input = fopen(path, "rb");
+    if (!input) {
+        LOG_ERR("Could not open file \"%s\" error: \"%s\"", path,
+                strerror(errno));
+    } else {
+        TPM2B_DIGEST digest = TPM2B_EMPTY_INIT;
+        result = tpm2_openssl_hash_file(ctx.halg, input, &digest);
+        fclose(input);
+        if (result) {
+            batch->leaves[index].size = digest.size;
+            memcpy(batch->leaves[index].buffer, digest.buffer, digest.size);
+        } else {
+            LOG_ERR("Could not hash artifact \"%s\"", path);
+        }
+    }
+
+    if (!result) {
+        __atomic_add_fetch(&batch->failed, 1, __ATOMIC_RELAXED);
+    }
+
+    return result;
+}
+
+/*
+ * Hashes the artifacts across the worker threads and takes the root of
+ * their Merkle tree as the digest to sign.
+ */
+static tool_rc batch_digest(void) {
+
+    sign_batch *batch = &ctx.batch;
+
+    if (!batch_load()) {
+        return tool_rc_general_error;
+    }
+
+    batch->leaves = calloc(batch->count, sizeof(*batch->leaves));
+    if (!batch->leaves) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    tpm2_batch_stats stats;
+    tpm2_batch_stats_start(&stats);
+
+    bool result = tpm2_worker_run(batch->count, ctx.jobs,
+            batch_hash_artifact, batch);
+    if (!result) {
+        LOG_ERR("Could not hash %zu of the %zu artifacts", batch->failed,
+                batch->count);
+        return tool_rc_general_error;
+    }
+
+    batch->tree = tpm2_merkle_tree_new(ctx.halg, batch->leaves,
+            batch->count);
+    if (!batch->tree) {
+        return tool_rc_general_error;
+    }
+
+    tpm2_batch_stats_lap(&stats);
+    stats.processed = batch->count;
+    stats.failed = batch->failed;
+
+    TPM2B_DATA root;
+    tpm2_merkle_tree_root(batch->tree, &root);
+
+    ctx.digest = malloc(sizeof(TPM2B_DIGEST));
+    if (!ctx.digest) {
+        LOG_ERR("oom");
+        return tool_rc_general_error;
+    }
+
+    ctx.digest->size = root.size;
+    memcpy(ctx.digest->buffer, root.buffer, root.size);
+
+    tpm2_batch_output(&stats, "artifacts", ctx.jobs);
+    tpm2_tool_output("  root: ");
+    tpm2_util_hexdump(root.buffer, root.size);
+    tpm2_tool_output("\n");
+
+    /* the root is computed outside of the TPM, like a digest given with -d */
+    ctx.validation.tag = TPM2_ST_HASHCHECK;
+    ctx.validation.hierarchy = TPM2_RH_NULL;
+    memset(&ctx.validation.digest, 0, sizeof(ctx.validation.digest));
+
+    return tool_rc_success;
+}
+
+/*
+ * The inclusion proofs saved while the TPM signs the root.
+ */
+typedef struct batch_proofs batch_proofs;
+struct batch_proofs {
+    size_t next;
+    bool result;
+};
+
+/*
+ * Saves the inclusion proof of the next artifact, see tpm2_async_idle_fn.
+ */
+static bool batch_save_proof(void *userdata) {
+
+    sign_batch *batch = &ctx.batch;
+    batch_proofs *proofs = (batch_proofs *) userdata;
+
+    if (!proofs->result || proofs->next == batch->count) {
+        return false;
+    }
+
+    tpm2_merkle_proof proof;
+    proofs->result = tpm2_merkle_tree_proof(batch->tree, proofs->next,
+            &proof) && tpm2_merkle_proof_save(&proof,
+            batch->proof_paths[proofs->next]);
+    proofs->next++;
+
+    return proofs->result;
+}
+
+/*
+ * Signs the root of the batch, saving the inclusion proofs while the TPM
+ * signs it.
+ */
+static tool_rc batch_sign(ESYS_CONTEXT *ectx, TPMT_SIGNATURE **signature) {
+
+    tool_rc rc = tpm2_sign_async(ectx, &ctx.signing_key.object, ctx.digest,
+            &ctx.in_scheme, &ctx.validation);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    batch_proofs proofs = { .result = true };
+    tool_rc wait_rc = tpm2_async_wait(ectx, batch_save_proof, &proofs);
+
+    rc = tpm2_sign_finish(ectx, signature);
+    if (rc != tool_rc_success) {
+        return rc;
+    }
+
+    if (wait_rc != tool_rc_success) {
+        return wait_rc;
+    }
+
+    /* the TPM may have answered before all of the proofs were saved */
+    while (batch_save_proof(&proofs));
+
+    return proofs.result ? tool_rc_success : tool_rc_general_error;
+}
+
+static void batch_free(void) {
+
+    sign_batch *batch = &ctx.batch;
+
+    size_t i;
+    for (i = 0; i < batch->count; i++) {
+        free(batch->artifact_paths[i]);
+        free(batch->proof_paths[i]);
+    }
+
+    free(batch->artifact_paths);
+    free(batch->proof_paths);
+    free(batch->leaves);
+    tpm2_merkle_tree_free(batch->tree);
+}
+
 static tool_rc sign_and_save(ESYS_CONTEXT *ectx) {
 
-    TPMT_SIGNATURE *signature;
+    TPMT_SIGNATURE *signature = NULL;
     bool result;
 
     if (ctx.cp_hash_path) {
@@ -68,8 +342,9 @@ static tool_rc sign_and_save(ESYS_CONTEXT *ectx) {
         return rc;
     }
 
-    tool_rc rc = tpm2_sign(ectx, &ctx.signing_key.object, ctx.digest,
-            &ctx.in_scheme, &ctx.validation, &signature, NULL);
+    tool_rc rc = ctx.batch_path ? batch_sign(ectx, &signature) :
+            tpm2_sign(ectx, &ctx.signing_key.object, ctx.digest,
+                    &ctx.in_scheme, &ctx.validation, &signature, NULL);
     if (rc != tool_rc_success) {
         goto out;
     }
@@ -136,6 +411,15 @@ static tool_rc init(ESYS_CONTEXT *ectx) {
         return tool_rc_option_error;
     }
 
+    if (ctx.batch_path) {
+        if (ctx.input_file || ctx.flags.d || ctx.flags.t) {
+            LOG_ERR("Cannot specify an input file, -d or -t with --batch");
+            return tool_rc_option_error;
+        }
+
+        return batch_digest();
+    }
+
     if (!ctx.flags.d && ctx.flags.t) {
         LOG_WARN("Ignoring the specified validation ticket since no TPM "
                  "calculated digest specified.");
@@ -250,6 +534,11 @@ static bool on_option(char key, char *value) {
     case 1:
         ctx.commit_index = value;
         break;
+    case 2:
+        ctx.batch_path = value;
+        break;
+    case 3:
+        return tpm2_worker_jobs_from_optarg(value, &ctx.jobs);
     case 'f':
         ctx.sig_format = tpm2_convert_sig_fmt_from_optarg(value);
 
@@ -287,6 +576,8 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
       { "format",               required_argument, NULL, 'f' },
       { "cphash",               required_argument, NULL,  0  },
       { "commit-index",       required_argument, NULL,  1  },
+      { "batch",                required_argument, NULL,  2  },
+      { "jobs",                 required_argument, NULL,  3  },
     };
 
     *opts = tpm2_options_new("p:g:dt:o:c:f:s:", ARRAY_LEN(topts), topts,
@@ -326,6 +617,7 @@ static void tpm2_tool_onexit(void) {
         free(ctx.digest);
     }
     free(ctx.msg);
+    batch_free();
 }
 
 // Register this tool with tpm2_tool.c
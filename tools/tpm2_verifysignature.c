@@ -1,6 +1,8 @@
 /* SPDX-License-Identifier: BSD-3-Clause */
 
+#include <errno.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "files.h"
 #include "log.h"
@@ -10,6 +12,8 @@
 #include "tpm2_alg_util.h"
 #include "tpm2_convert.h"
 #include "tpm2_hash.h"
+#include "tpm2_merkle.h"
+#include "tpm2_openssl.h"
 #include "tpm2_options.h"
 
 typedef struct tpm2_verifysig_ctx tpm2_verifysig_ctx;
@@ -33,6 +37,7 @@ struct tpm2_verifysig_ctx {
     char *msg_file_path;
     char *sig_file_path;
     char *out_file_path;
+    char *proof_path;
     const char *context_arg;
     tpm2_loaded_object key_context_object;
 };
@@ -101,6 +106,69 @@ static TPM2B *message_from_file(const char *msg_file_path) {
     return msg;
 }
 
+/*
+ * Computes the root of the Merkle tree the message was signed in with
+ * tpm2_sign --batch, from the message, or its digest, and its inclusion
+ * proof.
+ */
+static bool root_from_proof(void) {
+
+    tpm2_merkle_proof proof;
+    if (!tpm2_merkle_proof_load(ctx.proof_path, &proof)) {
+        return false;
+    }
+
+    if (ctx.flags.halg && ctx.halg != proof.halg) {
+        LOG_ERR("The proof hash algorithm 0x%x differs from --hash-algorithm"
+                " (-g) 0x%x", proof.halg, ctx.halg);
+        return false;
+    }
+
+    ctx.halg = proof.halg;
+
+    TPM2B_DATA leaf = TPM2B_EMPTY_INIT;
+    if (ctx.flags.digest) {
+        leaf.size = ctx.msg_hash->size;
+        memcpy(leaf.buffer, ctx.msg_hash->buffer, ctx.msg_hash->size);
+    } else {
+        FILE *input = fopen(ctx.msg_file_path, "rb");
+        if (!input) {
+            LOG_ERR("Could not open file \"%s\" error: \"%s\"",
+                    ctx.msg_file_path, strerror(errno));
+            return false;
+        }
+
+        TPM2B_DIGEST digest = TPM2B_EMPTY_INIT;
+        bool result = tpm2_openssl_hash_file(ctx.halg, input, &digest);
+        fclose(input);
+        if (!result) {
+            LOG_ERR("Could not hash message \"%s\"", ctx.msg_file_path);
+            return false;
+        }
+
+        leaf.size = digest.size;
+        memcpy(leaf.buffer, digest.buffer, digest.size);
+    }
+
+    TPM2B_DATA root;
+    if (!tpm2_merkle_proof_root(&proof, &leaf, &root)) {
+        return false;
+    }
+
+    if (!ctx.msg_hash) {
+        ctx.msg_hash = malloc(sizeof(TPM2B_DIGEST));
+        if (!ctx.msg_hash) {
+            LOG_ERR("oom");
+            return false;
+        }
+    }
+
+    ctx.msg_hash->size = root.size;
+    memcpy(ctx.msg_hash->buffer, root.buffer, root.size);
+
+    return true;
+}
+
 static tool_rc init(ESYS_CONTEXT *context) {
 
     tool_rc rc = tool_rc_general_error;
@@ -116,6 +184,11 @@ static tool_rc init(ESYS_CONTEXT *context) {
         return tool_rc_option_error;
     }
 
+    if (ctx.proof_path && !(ctx.flags.msg || ctx.flags.digest)) {
+        LOG_ERR("--proof requires --message (-m) or --digest (-d)");
+        return tool_rc_option_error;
+    }
+
     TPM2B *msg = NULL;
 
     tool_rc tmp_rc = tpm2_util_object_load(context, ctx.context_arg,
@@ -124,7 +197,12 @@ static tool_rc init(ESYS_CONTEXT *context) {
         return tmp_rc;
     }
 
-    if (ctx.flags.msg) {
+    if (ctx.proof_path) {
+        /* the signed digest is the root, the message a leaf of its tree */
+        if (!root_from_proof()) {
+            return tool_rc_general_error;
+        }
+    } else if (ctx.flags.msg) {
         msg = message_from_file(ctx.msg_file_path);
         if (!msg) {
             /* message_from_file() logs specific error no need to here */
@@ -144,7 +222,7 @@ static tool_rc init(ESYS_CONTEXT *context) {
     }
 
     /* If no digest is specified, compute it */
-    if (!ctx.flags.digest) {
+    if (!ctx.flags.digest && !ctx.proof_path) {
         if (!msg) {
             /*
              * This is a redundant check since main() checks this case, but
@@ -222,6 +300,9 @@ static bool on_option(char key, char *value) {
         ctx.out_file_path = value;
         ctx.flags.ticket = 1;
         break;
+    case 1:
+        ctx.proof_path = value;
+        break;
         /* no default */
     }
 
@@ -239,6 +320,7 @@ static bool tpm2_tool_onstart(tpm2_options **opts) {
             { "signature",      required_argument, NULL, 's' },
             { "ticket",         required_argument, NULL, 't' },
             { "key-context",    required_argument, NULL, 'c' },
+            { "proof",          required_argument, NULL,  1  },
     };
 
 